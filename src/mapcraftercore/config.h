@@ -0,0 +1,34 @@
+/*
+ * Copyright 2012-2014 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define HAVE_NULLPTR
+#define HAVE_ENUM_CLASS_COMPARISON
+#define HAVE_ENUM_CLASS_FORWARD_DECLARATION
+
+#define HAVE_ENDIAN_H
+/* #undef ENDIAN_H_FREEBSD */
+
+#define HAVE_SYS_IOCTL_H
+#define HAVE_UNISTD_H
+#define HAVE_SYSLOG_H
+
+/* #undef OPT_USE_BOOST_THREAD */
+
+/* #undef HAVE_LIBDEFLATE */
+#define HAVE_X86_SIMD
@@ -19,6 +19,7 @@
 
 #include "../configsections/map.h"
 #include "../iniconfig.h"
+#include "../../mc/worldcache.h"
 #include "../../util.h"
 
 namespace mapcrafter {
@@ -33,6 +34,58 @@ config::ImageFormat as<config::ImageFormat>(const std::string& from) {
 	throw std::invalid_argument("Must be 'png' or 'jpeg'!");
 }
 
+template <>
+renderer::PNGFilter as<renderer::PNGFilter>(const std::string& from) {
+	if (from == "adaptive")
+		return renderer::PNGFilter::ADAPTIVE;
+	else if (from == "none")
+		return renderer::PNGFilter::NONE;
+	else if (from == "sub")
+		return renderer::PNGFilter::SUB;
+	else if (from == "up")
+		return renderer::PNGFilter::UP;
+	else if (from == "average")
+		return renderer::PNGFilter::AVERAGE;
+	else if (from == "paeth")
+		return renderer::PNGFilter::PAETH;
+	throw std::invalid_argument("Must be one of 'adaptive', 'none', 'sub', 'up', "
+			"'average' or 'paeth'!");
+}
+
+template <>
+renderer::PNGStrategy as<renderer::PNGStrategy>(const std::string& from) {
+	if (from == "default")
+		return renderer::PNGStrategy::DEFAULT;
+	else if (from == "filtered")
+		return renderer::PNGStrategy::FILTERED;
+	else if (from == "huffman")
+		return renderer::PNGStrategy::HUFFMAN_ONLY;
+	else if (from == "rle")
+		return renderer::PNGStrategy::RLE;
+	else if (from == "fixed")
+		return renderer::PNGStrategy::FIXED;
+	throw std::invalid_argument("Must be one of 'default', 'filtered', 'huffman', "
+			"'rle' or 'fixed'!");
+}
+
+template <>
+config::PNGEncoderType as<config::PNGEncoderType>(const std::string& from) {
+	if (from == "libpng")
+		return config::PNGEncoderType::LIBPNG;
+	else if (from == "fast")
+		return config::PNGEncoderType::FAST;
+	throw std::invalid_argument("Must be 'libpng' or 'fast'!");
+}
+
+template <>
+config::TileStorageType as<config::TileStorageType>(const std::string& from) {
+	if (from == "files")
+		return config::TileStorageType::FILES;
+	else if (from == "pack")
+		return config::TileStorageType::PACK;
+	throw std::invalid_argument("Must be 'files' or 'pack'!");
+}
+
 template <>
 renderer::RenderModeType as<renderer::RenderModeType>(const std::string& from) {
 	if (from == "plain")
@@ -132,6 +185,22 @@ std::ostream& operator<<(std::ostream& out, ImageFormat image_format) {
 	return out;
 }
 
+std::ostream& operator<<(std::ostream& out, PNGEncoderType png_encoder) {
+	if (png_encoder == PNGEncoderType::LIBPNG)
+		out << "libpng";
+	else if (png_encoder == PNGEncoderType::FAST)
+		out << "fast";
+	return out;
+}
+
+std::ostream& operator<<(std::ostream& out, TileStorageType tile_storage) {
+	if (tile_storage == TileStorageType::FILES)
+		out << "files";
+	else if (tile_storage == TileStorageType::PACK)
+		out << "pack";
+	return out;
+}
+
 MapSection::MapSection()
 	: texture_size(12), render_biomes(false) {
 }
@@ -157,11 +226,20 @@ void MapSection::dump(std::ostream& out) const {
 	out << "  texture_size = " << texture_size << std::endl;
 	out << "  image_format = " << image_format << std::endl;
 	out << "  png_indexed = " << png_indexed << std::endl;
+	out << "  png_compression = " << png_compression << std::endl;
+	out << "  png_filter = " << png_filter << std::endl;
+	out << "  png_strategy = " << png_strategy << std::endl;
+	out << "  png_encoder = " << png_encoder << std::endl;
 	out << "  jpeg_quality = " << jpeg_quality << std::endl;
+	out << "  tile_storage = " << tile_storage << std::endl;
 	out << "  lighting_intensity = " << lighting_intensity << std::endl;
 	out << "  lighting_water_intensity = " << lighting_water_intensity << std::endl;
 	out << "  render_biomes = " << render_biomes << std::endl;
 	out << "  use_image_timestamps = " << use_image_mtimes << std::endl;
+	out << "  shared_chunk_cache = " << shared_chunk_cache << std::endl;
+	out << "  deduplicate_tiles = " << deduplicate_tiles << std::endl;
+	out << "  world_cache_regions = " << world_cache_regions << std::endl;
+	out << "  world_cache_chunks = " << world_cache_chunks << std::endl;
 }
 
 void MapSection::setConfigDir(const fs::path& config_dir) {
@@ -226,10 +304,26 @@ bool MapSection::isPNGIndexed() const {
 	return png_indexed.getValue();
 }
 
+renderer::PNGOptions MapSection::getPNGOptions() const {
+	renderer::PNGOptions options;
+	options.compression_level = png_compression.getValue();
+	options.filter = png_filter.getValue();
+	options.strategy = png_strategy.getValue();
+	return options;
+}
+
+PNGEncoderType MapSection::getPNGEncoder() const {
+	return png_encoder.getValue();
+}
+
 int MapSection::getJPEGQuality() const {
 	return jpeg_quality.getValue();
 }
 
+TileStorageType MapSection::getTileStorage() const {
+	return tile_storage.getValue();
+}
+
 double MapSection::getLightingIntensity() const {
 	return lighting_intensity.getValue();
 }
@@ -246,6 +340,22 @@ bool MapSection::useImageModificationTimes() const {
 	return use_image_mtimes.getValue();
 }
 
+int MapSection::getSharedChunkCacheSize() const {
+	return shared_chunk_cache.getValue();
+}
+
+bool MapSection::deduplicateTiles() const {
+	return deduplicate_tiles.getValue();
+}
+
+int MapSection::getWorldCacheRegions() const {
+	return world_cache_regions.getValue();
+}
+
+int MapSection::getWorldCacheChunks() const {
+	return world_cache_chunks.getValue();
+}
+
 TileSetGroupID MapSection::getTileSetGroup() const {
 	return TileSetGroupID(getWorld(), getRenderView(), getTileWidth());
 }
@@ -279,13 +389,22 @@ void MapSection::preParse(const INIConfigSection& section,
 
 	image_format.setDefault(ImageFormat::PNG);
 	png_indexed.setDefault(false);
+	png_compression.setDefault(6);
+	png_filter.setDefault(renderer::PNGFilter::ADAPTIVE);
+	png_strategy.setDefault(renderer::PNGStrategy::DEFAULT);
+	png_encoder.setDefault(PNGEncoderType::LIBPNG);
 	jpeg_quality.setDefault(85);
+	tile_storage.setDefault(TileStorageType::FILES);
 
 	lighting_intensity.setDefault(1.0);
 	lighting_water_intensity.setDefault(0.85);
 	water_opacity.setDefault(1.0);
 	render_biomes.setDefault(true);
 	use_image_mtimes.setDefault(true);
+	shared_chunk_cache.setDefault(0);
+	deduplicate_tiles.setDefault(false);
+	world_cache_regions.setDefault(mc::DEFAULT_REGION_CACHE_SIZE);
+	world_cache_chunks.setDefault(mc::DEFAULT_CHUNK_CACHE_SIZE);
 }
 
 bool MapSection::parseField(const std::string key, const std::string value,
@@ -330,10 +449,22 @@ bool MapSection::parseField(const std::string key, const std::string value,
 		image_format.load(key, value, validation);
 	} else if (key == "png_indexed") {
 		png_indexed.load(key, value, validation);
+	} else if (key == "png_compression") {
+		if (png_compression.load(key, value, validation)
+				&& (png_compression.getValue() < 0 || png_compression.getValue() > 9))
+			validation.error("'png_compression' must be a number between 0 and 9!");
+	} else if (key == "png_filter") {
+		png_filter.load(key, value, validation);
+	} else if (key == "png_strategy") {
+		png_strategy.load(key, value, validation);
+	} else if (key == "png_encoder") {
+		png_encoder.load(key, value, validation);
 	} else if (key == "jpeg_quality") {
 		if (jpeg_quality.load(key, value, validation)
 				&& (jpeg_quality.getValue() < 0 || jpeg_quality.getValue() > 100))
 			validation.error("'jpeg_quality' must be a number between 0 and 100!");
+	} else if (key == "tile_storage") {
+		tile_storage.load(key, value, validation);
 	} else if (key == "lighting_intensity") {
 		lighting_intensity.load(key, value, validation);
 	} else if (key == "lighting_water_intensity") {
@@ -346,6 +477,20 @@ bool MapSection::parseField(const std::string key, const std::string value,
 		render_biomes.load(key, value, validation);
 	} else if (key == "use_image_mtimes") {
 		use_image_mtimes.load(key, value, validation);
+	} else if (key == "shared_chunk_cache") {
+		if (shared_chunk_cache.load(key, value, validation)
+				&& shared_chunk_cache.getValue() < 0)
+			validation.error("'shared_chunk_cache' must be a positive number or 0!");
+	} else if (key == "deduplicate_tiles") {
+		deduplicate_tiles.load(key, value, validation);
+	} else if (key == "world_cache_regions") {
+		if (world_cache_regions.load(key, value, validation)
+				&& world_cache_regions.getValue() < 1)
+			validation.error("'world_cache_regions' must be a positive number!");
+	} else if (key == "world_cache_chunks") {
+		if (world_cache_chunks.load(key, value, validation)
+				&& world_cache_chunks.getValue() < 1)
+			validation.error("'world_cache_chunks' must be a positive number!");
 	} else
 		return false;
 	return true;
@@ -22,6 +22,7 @@
 
 #include "../configsection.h"
 #include "../validation.h"
+#include "../../renderer/image.h"
 #include "../../renderer/rendermode.h"
 #include "../../renderer/renderview.h"
 
@@ -81,6 +82,24 @@ enum class ImageFormat {
 
 std::ostream& operator<<(std::ostream& out, ImageFormat image_format);
 
+enum class PNGEncoderType {
+	// libpng, supports all PNG options
+	LIBPNG,
+	// the built-in encoder of RGBA images, which reuses its state across images
+	FAST
+};
+
+std::ostream& operator<<(std::ostream& out, PNGEncoderType png_encoder);
+
+enum class TileStorageType {
+	// every tile is an image file in the output directory
+	FILES,
+	// all tiles are stored in a single pack file per rotation
+	PACK
+};
+
+std::ostream& operator<<(std::ostream& out, TileStorageType tile_storage);
+
 class INIConfigSection;
 
 class MapSection : public ConfigSection {
@@ -110,12 +129,19 @@ public:
 	ImageFormat getImageFormat() const;
 	std::string getImageFormatSuffix() const;
 	bool isPNGIndexed() const;
+	renderer::PNGOptions getPNGOptions() const;
+	PNGEncoderType getPNGEncoder() const;
 	int getJPEGQuality() const;
+	TileStorageType getTileStorage() const;
 
 	double getLightingIntensity() const;
 	double getLightingWaterIntensity() const;
 	bool renderBiomes() const;
 	bool useImageModificationTimes() const;
+	int getSharedChunkCacheSize() const;
+	bool deduplicateTiles() const;
+	int getWorldCacheRegions() const;
+	int getWorldCacheChunks() const;
 
 	TileSetGroupID getTileSetGroup() const;
 	TileSetID getTileSet(renderer::RenderRotation::Direction rotation) const;
@@ -147,11 +173,19 @@ private:
 
 	Field<ImageFormat> image_format;
     Field<bool> png_indexed;
+	Field<int> png_compression;
+	Field<renderer::PNGFilter> png_filter;
+	Field<renderer::PNGStrategy> png_strategy;
+	Field<PNGEncoderType> png_encoder;
 	Field<int> jpeg_quality;
+	Field<TileStorageType> tile_storage;
 
 	Field<double> lighting_intensity, lighting_water_intensity;
 	Field<bool> cave_high_contrast;
 	Field<bool> render_biomes, use_image_mtimes;
+	Field<int> shared_chunk_cache;
+	Field<bool> deduplicate_tiles;
+	Field<int> world_cache_regions, world_cache_chunks;
 
 	std::set<TileSetID> tile_sets;
 };
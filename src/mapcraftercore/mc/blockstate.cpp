@@ -22,6 +22,7 @@
 #include "../util.h"
 
 #include <cassert>
+#include <cstring>
 
 namespace mapcrafter {
 namespace mc {
@@ -31,7 +32,7 @@ BlockState::BlockState(std::string name)
 	updateVariantDescription();
 }
 
-std::string BlockState::getName() const {
+const std::string& BlockState::getName() const {
 	return name;
 }
 
@@ -55,7 +56,7 @@ void BlockState::setProperty(std::string key, std::string value) {
 	updateVariantDescription();
 }
 
-const std::string BlockState::getVariantDescription() const {
+const std::string& BlockState::getVariantDescription() const {
 	return variant_description;
 }
 
@@ -77,45 +78,67 @@ void BlockState::updateVariantDescription() {
 	}
 }
 
+namespace {
+
+/**
+ * 64 bit FNV-1a hash of the raw NBT data of a palette entry.
+ */
+uint64_t hashData(const uint8_t* data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+}
+
+const size_t BlockStateRegistry::MAX_BLOCK_STATES;
+const size_t BlockStateRegistry::STATES_PER_BLOCK;
+
 BlockStateRegistry::BlockStateRegistry()
-	: unknown_block("mapcrafter:unknown") {
+	: block_states_count(0), unknown_block("mapcrafter:unknown") {
 }
 
-uint16_t BlockStateRegistry::getBlockID(const BlockState& block) {
-	std::lock_guard<std::mutex> guard(mutex);
-
-	// first check if that block name is known
-	auto it = block_lookup.find(block.getName());
-	if (it == block_lookup.end()) {
-		// block name unknown -> insert block
-		uint16_t id = block_states.size();
-		block_lookup[block.getName()][block.getVariantDescription()] = id;
-		block_states.push_back(block);
-		return id;
-	}
+BlockStateRegistry::~BlockStateRegistry() {
+}
 
-	// block name is known -> just search for the variant now
-	auto it2 = it->second.find(block.getVariantDescription());
-	if (it2 == it->second.end()) {
-		// variant not found -> insert block
-		uint16_t id = block_states.size();
-		it->second[block.getVariantDescription()] = id;
-		block_states.push_back(block);
+uint16_t BlockStateRegistry::getBlockID(const BlockState& block) {
+	std::string key = block.getName() + " " + block.getVariantDescription();
+	return block_lookup.get(key, [this, &block]() -> uint16_t {
+		// called only by one thread at a time
+		size_t id = block_states_count.load(std::memory_order_relaxed);
+		if (id >= MAX_BLOCK_STATES) {
+			LOG(ERROR) << "Too many different block states, ignoring "
+				<< block.getName() << " " << block.getVariantDescription();
+			return 0;
+		}
+		std::unique_ptr<BlockState[]>& states = block_states[id / STATES_PER_BLOCK];
+		if (!states)
+			states.reset(new BlockState[STATES_PER_BLOCK]);
+		states[id % STATES_PER_BLOCK] = block;
+		block_states_count.store(id + 1, std::memory_order_release);
 		return id;
-	}
-	return it2->second;
+	});
 }
 
 const BlockState& BlockStateRegistry::getBlockState(uint16_t id) const {
-	if (id >= block_states.size()) {
+	if (id >= block_states_count.load(std::memory_order_acquire)) {
 		assert(false);
 		return unknown_block;
 	}
-	return block_states.at(id);
+	return block_states[id / STATES_PER_BLOCK][id % STATES_PER_BLOCK];
+}
+
+size_t BlockStateRegistry::size() const {
+	return block_states_count.load(std::memory_order_acquire);
 }
 
 void BlockStateRegistry::addKnownProperty(std::string block, std::string property) {
 	known_properties[block].insert(property);
+	// palette entries might resolve to other block states now
+	palette_lookup.clear();
 }
 
 bool BlockStateRegistry::isKnownProperty(std::string block, std::string property) const {
@@ -125,7 +148,22 @@ bool BlockStateRegistry::isKnownProperty(std::string block, std::string property
 	}
 	return it->second.count(property);
 }
-
+bool BlockStateRegistry::findPaletteEntry(const uint8_t* data, size_t size,
+		uint16_t& id) const {
+	const PaletteEntry* entry = palette_lookup.findPublished(hashData(data, size));
+	if (entry == nullptr || entry->data.size() != size
+			|| std::memcmp(entry->data.data(), data, size) != 0)
+		return false;
+	id = entry->id;
+	return true;
 }
+
+void BlockStateRegistry::addPaletteEntry(const uint8_t* data, size_t size, uint16_t id) {
+	PaletteEntry entry;
+	entry.data.assign(reinterpret_cast<const char*>(data), size);
+	entry.id = id;
+	palette_lookup.insert(hashData(data, size), entry);
 }
 
+}
+}
@@ -20,10 +20,15 @@
 #ifndef BLOCKSTATE_H_
 #define BLOCKSTATE_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace mapcrafter {
@@ -33,14 +38,14 @@ class BlockState {
 public:
 	BlockState(std::string name = "");
 
-	std::string getName() const;
+	const std::string& getName() const;
 
 	const std::map<std::string, std::string>& getProperties() const;
 	bool hasProperty(std::string key) const;
 	std::string getProperty(std::string key, std::string default_value = "") const;
 	void setProperty(std::string key, std::string value);
 
-	const std::string getVariantDescription() const;
+	const std::string& getVariantDescription() const;
 
 	bool operator<(const BlockState& other) const;
 
@@ -56,21 +61,174 @@ private:
 	std::string variant_description;
 };
 
+/**
+ * A hash map for many concurrent readers and rare writers.
+ *
+ * Readers look up entries in an immutable snapshot without any locking. New entries are
+ * added to a map of pending entries under a mutex, and once there are enough of them
+ * the snapshot is replaced with a copy that contains them as well. So only lookups of
+ * pending entries need the mutex, and copying the snapshot is amortized over many
+ * insertions.
+ *
+ * Readers may still use old snapshots, so they are kept until the map is destroyed.
+ * Because a new snapshot is published only when the pending entries are a fraction of
+ * the current snapshot, all snapshots together need a few times the memory of the
+ * newest one.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class CopyOnWriteMap {
+public:
+	typedef std::unordered_map<Key, Value, Hash> Map;
+
+	CopyOnWriteMap() {
+		snapshots.emplace_back(new Map());
+		snapshot.store(snapshots.back().get());
+	}
+
+	/**
+	 * Looks up an entry in the current snapshot without locking. Returns a nullptr if
+	 * there is no such (published) entry. The returned value stays valid as long as the
+	 * map exists.
+	 */
+	const Value* findPublished(const Key& key) const {
+		const Map* map = snapshot.load(std::memory_order_acquire);
+		auto it = map->find(key);
+		return it == map->end() ? nullptr : &it->second;
+	}
+
+	/**
+	 * Returns the value of an entry. If there is no such entry, the value returned by
+	 * create() is inserted. create() is called with the mutex of the map held, so it is
+	 * called only once per key.
+	 */
+	template <typename Create>
+	Value get(const Key& key, Create create) {
+		const Value* value = findPublished(key);
+		if (value != nullptr)
+			return *value;
+
+		std::lock_guard<std::mutex> guard(mutex);
+		auto it = pending.find(key);
+		if (it != pending.end())
+			return it->second;
+		// the entry might have been published in the meantime
+		value = findPublished(key);
+		if (value != nullptr)
+			return *value;
+		Value created = create();
+		pending.insert(std::make_pair(key, created));
+		publishIfNecessary();
+		return created;
+	}
+
+	/**
+	 * Inserts an entry if there is no entry with this key yet.
+	 */
+	void insert(const Key& key, const Value& value) {
+		std::lock_guard<std::mutex> guard(mutex);
+		if (findPublished(key) != nullptr)
+			return;
+		pending.insert(std::make_pair(key, value));
+		publishIfNecessary();
+	}
+
+	/**
+	 * Removes all entries.
+	 */
+	void clear() {
+		std::lock_guard<std::mutex> guard(mutex);
+		pending.clear();
+		if (!snapshot.load()->empty()) {
+			snapshots.emplace_back(new Map());
+			snapshot.store(snapshots.back().get(), std::memory_order_release);
+		}
+	}
+
+	/**
+	 * Minimum number of pending entries before a new snapshot is published.
+	 */
+	static const size_t MIN_PENDING = 16;
+
+private:
+	void publishIfNecessary() {
+		const Map* current = snapshot.load();
+		if (pending.size() < std::max(MIN_PENDING, current->size() / 4))
+			return;
+		Map* map = new Map(*current);
+		map->insert(pending.begin(), pending.end());
+		snapshots.emplace_back(map);
+		snapshot.store(map, std::memory_order_release);
+		pending.clear();
+	}
+
+	std::atomic<const Map*> snapshot;
+	std::vector<std::unique_ptr<const Map>> snapshots;
+
+	std::mutex mutex;
+	Map pending;
+};
+
+template <typename Key, typename Value, typename Hash>
+const size_t CopyOnWriteMap<Key, Value, Hash>::MIN_PENDING;
+
+/**
+ * Assigns the block states numeric IDs.
+ *
+ * The registry is shared by all render threads. The IDs of known block states are
+ * looked up without locking, and block states can be read by their ID while other
+ * threads add new ones. Known properties must be added before chunks are read.
+ */
 class BlockStateRegistry {
 public:
 	BlockStateRegistry();
+	~BlockStateRegistry();
 
 	uint16_t getBlockID(const BlockState& block);
 	const BlockState& getBlockState(uint16_t id) const;
 
+	/**
+	 * Returns the number of registered block states.
+	 */
+	size_t size() const;
+
 	void addKnownProperty(std::string block, std::string property);
 	bool isKnownProperty(std::string block, std::string property) const;
 
-private:
-	std::mutex mutex;
+	/**
+	 * Looks up the block ID of a block state compound of a chunk palette by its raw NBT
+	 * data. Returns false if the data is unknown, entries added with addPaletteEntry()
+	 * are found only once a few of them were added.
+	 */
+	bool findPaletteEntry(const uint8_t* data, size_t size, uint16_t& id) const;
+
+	/**
+	 * Remembers the block ID of the raw NBT data of a palette block state compound, so
+	 * the same palette entry can be resolved without parsing it again.
+	 */
+	void addPaletteEntry(const uint8_t* data, size_t size, uint16_t id);
 
-	std::map<std::string, std::map<std::string, uint16_t>> block_lookup;
-	std::vector<BlockState> block_states;
+	/**
+	 * Maximum number of block states, the IDs are 16 bit.
+	 */
+	static const size_t MAX_BLOCK_STATES = 1 << 16;
+
+private:
+	struct PaletteEntry {
+		std::string data;
+		uint16_t id;
+	};
+
+	static const size_t STATES_PER_BLOCK = 256;
+
+	// block ID by block name and variant description
+	CopyOnWriteMap<std::string, uint16_t> block_lookup;
+	// the block states in blocks of STATES_PER_BLOCK block states, so they are never
+	// moved and can be read while new ones are added
+	std::unique_ptr<BlockState[]> block_states[MAX_BLOCK_STATES / STATES_PER_BLOCK];
+	std::atomic<size_t> block_states_count;
+
+	// block ID of palette entries by the hash of their NBT data
+	CopyOnWriteMap<uint64_t, PaletteEntry> palette_lookup;
 
 	std::map<std::string, std::set<std::string>> known_properties;
 
@@ -19,10 +19,14 @@
 
 #include "chunk.h"
 #include "blockstate.h"
+#include "compression.h"
+#include "nbtreader.h"
 #include "versions/data_adaptor.h"
 #include "../renderer/biomes.h"
 #include "../renderer/blockimages.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <iostream>
 #include <boost/range.hpp>
@@ -32,30 +36,582 @@ namespace mc {
 
 namespace {
 
-void readPackedShorts_v116(const std::vector<int64_t>& data, uint16_t* palette, uint16_t* palette_end) {
-	uint32_t palette_size = palette_end - palette;
-	uint32_t shorts_per_long = (palette_size + data.size() - 1) / data.size();
-	uint32_t bits_per_value = 64 / shorts_per_long;
-	std::fill(palette, &palette[palette_size], 0);
-	uint16_t mask = (1 << bits_per_value) - 1;
-
-	for (uint32_t i=0; i<shorts_per_long; i++) {
-		uint32_t j = 0;
-		for( uint32_t k=i; k<palette_size; k+=shorts_per_long) {
-			assert(j < data.size());
-			palette[k] = (uint16_t)(data[j] >> (bits_per_value * i)) & mask;
-			j++;
+/**
+ * Calls func(i, value) for count packed values with BITS bits from index start on
+ * (i counts from 0). Since the number of bits is a constant, the values of a long are
+ * extracted with constant shifts and the loop over them is unrolled.
+ */
+template <int BITS, typename Func>
+inline void forEachPacked(const uint64_t* longs, size_t start, size_t count, Func& func) {
+	const size_t PER_LONG = 64 / BITS;
+	const uint64_t MASK = (uint64_t(1) << BITS) - 1;
+
+	size_t i = 0, j = start / PER_LONG, k = start % PER_LONG;
+	// the remaining values of the long of the start index
+	if (k != 0) {
+		uint64_t value = longs[j++] >> (k * BITS);
+		for (; k < PER_LONG && i < count; k++, i++, value >>= BITS)
+			func(i, (uint16_t) (value & MASK));
+	}
+	// whole longs
+	for (; i + PER_LONG <= count; i += PER_LONG, j++) {
+		uint64_t value = longs[j];
+		for (size_t k = 0; k < PER_LONG; k++)
+			func(i + k, (uint16_t) ((value >> (k * BITS)) & MASK));
+	}
+	// the values at the beginning of the last long
+	if (i < count) {
+		uint64_t value = longs[j];
+		for (; i < count; i++, value >>= BITS)
+			func(i, (uint16_t) (value & MASK));
+	}
+}
+
+/**
+ * Calls kernel.run<BITS>() with the number of bits as constant.
+ */
+template <typename Kernel>
+void runWithBits(int bits, Kernel& kernel) {
+	switch (bits) {
+	case 1: kernel.template run<1>(); break;
+	case 2: kernel.template run<2>(); break;
+	case 3: kernel.template run<3>(); break;
+	case 4: kernel.template run<4>(); break;
+	case 5: kernel.template run<5>(); break;
+	case 6: kernel.template run<6>(); break;
+	case 7: kernel.template run<7>(); break;
+	case 8: kernel.template run<8>(); break;
+	case 9: kernel.template run<9>(); break;
+	case 10: kernel.template run<10>(); break;
+	case 11: kernel.template run<11>(); break;
+	case 12: kernel.template run<12>(); break;
+	case 13: kernel.template run<13>(); break;
+	case 14: kernel.template run<14>(); break;
+	case 15: kernel.template run<15>(); break;
+	case 16: kernel.template run<16>(); break;
+	default: assert(false);
+	}
+}
+
+struct UnpackValues {
+	void operator()(size_t i, uint16_t value) {
+		values[i] = value;
+	}
+
+	template <int BITS>
+	void run() {
+		forEachPacked<BITS>(longs, start, count, *this);
+	}
+
+	const uint64_t* longs;
+	size_t start, count;
+	uint16_t* values;
+};
+
+struct UnpackPalette {
+	void operator()(size_t i, uint16_t index) {
+		// branchless, so the loop stays simple
+		bool valid = index < palette_size;
+		invalid |= !valid;
+		values[i] = palette[valid ? index : 0];
+	}
+
+	template <int BITS>
+	void run() {
+		forEachPacked<BITS>(longs, start, count, *this);
+	}
+
+	const uint64_t* longs;
+	size_t start, count;
+	const uint16_t* palette;
+	size_t palette_size;
+	uint16_t* values;
+	bool invalid;
+};
+
+struct MaxPackedValue {
+	void operator()(size_t i, uint16_t value) {
+		max = std::max(max, value);
+	}
+
+	template <int BITS>
+	void run() {
+		forEachPacked<BITS>(longs, 0, count, *this);
+	}
+
+	const uint64_t* longs;
+	size_t count;
+	uint16_t max;
+};
+
+}
+
+int getPackedBits(size_t longs, size_t count, size_t palette_size) {
+	if (longs == 0 || count == 0)
+		return 0;
+
+	if (palette_size > 1) {
+		int bits = 1;
+		while ((size_t(1) << bits) < palette_size)
+			bits++;
+		for (; bits <= 16; bits++) {
+			size_t per_long = 64 / bits;
+			if ((count + per_long - 1) / per_long == longs)
+				return bits;
+		}
+	}
+
+	size_t per_long = (count + longs - 1) / longs;
+	int bits = 64 / per_long;
+	return bits <= 16 ? bits : 0;
+}
+
+void unpackValues(const uint64_t* longs, int bits, size_t start, size_t count,
+		uint16_t* values) {
+	UnpackValues kernel = {longs, start, count, values};
+	runWithBits(bits, kernel);
+}
+
+bool unpackPalette(const uint64_t* longs, int bits, size_t start, size_t count,
+		const uint16_t* palette, size_t palette_size, uint16_t* values) {
+	UnpackPalette kernel = {longs, start, count, palette, palette_size, values, false};
+	runWithBits(bits, kernel);
+	return !kernel.invalid;
+}
+
+uint16_t getMaxPackedValue(const uint64_t* longs, int bits, size_t count) {
+	MaxPackedValue kernel = {longs, count, 0};
+	runWithBits(bits, kernel);
+	return kernel.max;
+}
+
+SectionBlocks::SectionBlocks()
+	: bits(0), per_long(0), mask(0), single_id(0), long_divisor(0) {
+}
+
+void SectionBlocks::setSingle(uint16_t id) {
+	bits = per_long = 0;
+	mask = 0;
+	single_id = id;
+	long_divisor = 0;
+	std::vector<uint16_t>().swap(palette);
+	std::vector<uint64_t>().swap(data);
+}
+
+bool SectionBlocks::setPacked(const uint16_t* palette, size_t palette_size,
+		const nbt::LongArrayRef& data) {
+	int bits = getPackedBits(data.size(), 16 * 16 * 16, palette_size);
+	if (bits == 0)
+		return false;
+
+	// only the longs with indices of the section are needed
+	size_t per_long = 64 / bits;
+	size_t longs = (16 * 16 * 16 + per_long - 1) / per_long;
+	std::vector<uint64_t> unpacked(longs);
+	data.copyTo(unpacked.data(), longs);
+	if (getMaxPackedValue(unpacked.data(), bits, 16 * 16 * 16) >= palette_size)
+		return false;
+
+	this->bits = bits;
+	this->per_long = per_long;
+	mask = (1 << bits) - 1;
+	single_id = 0;
+	long_divisor = ((uint64_t(1) << 32) + per_long - 1) / per_long;
+	this->palette.assign(palette, palette + palette_size);
+	this->data.swap(unpacked);
+	return true;
+}
+
+void SectionBlocks::get(size_t index, size_t count, uint16_t* ids) const {
+	if (bits == 0) {
+		std::fill(ids, ids + count, single_id);
+		return;
+	}
+
+	// the indices were validated when they were set
+	unpackPalette(data.data(), bits, index, count, palette.data(), palette.size(), ids);
+}
+
+int SectionBlocks::getBits() const {
+	return bits;
+}
+
+size_t SectionBlocks::getMemoryUsage() const {
+	return palette.capacity() * sizeof(uint16_t) + data.capacity() * sizeof(uint64_t);
+}
+
+SectionLight::SectionLight()
+	: value(0) {
+}
+
+void SectionLight::setUniform(uint8_t value) {
+	this->value = value & 0x0f;
+	std::vector<uint8_t>().swap(nibbles);
+}
+
+void SectionLight::set(const uint8_t* nibbles) {
+	// the light is uniform if all bytes are the same and consist of the same two nibbles
+	uint8_t first = nibbles[0];
+	bool uniform = (first & 0x0f) == (first >> 4);
+	for (size_t i = 1; i < 16 * 16 * 8 && uniform; i++)
+		uniform = nibbles[i] == first;
+
+	if (uniform) {
+		setUniform(first);
+	} else {
+		this->nibbles.assign(nibbles, nibbles + 16 * 16 * 8);
+		this->nibbles.shrink_to_fit();
+	}
+}
+
+size_t SectionLight::getMemoryUsage() const {
+	return nibbles.capacity();
+}
+
+size_t ChunkSection::getMemoryUsage() const {
+	return sizeof(ChunkSection) + blocks.getMemoryUsage() + block_light.getMemoryUsage()
+		+ sky_light.getMemoryUsage() + raw.capacity();
+}
+
+namespace {
+
+/**
+ * Reads a block state compound ({Name: ..., Properties: {...}}) of a block state palette
+ * and returns the block ID of the block state.
+ */
+uint16_t parseBlockState(nbt::NBTReader& reader, mc::BlockStateRegistry& block_registry) {
+	nbt::StringRef block_name;
+	bool has_name = false;
+	// the properties can only be read once we know the block name, so remember where they are
+	size_t properties = 0;
+
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagString::TAG_TYPE && name == "Name") {
+			block_name = reader.readString();
+			has_name = true;
+		} else if (type == nbt::TagCompound::TAG_TYPE && name == "Properties") {
+			properties = reader.tell();
+			reader.skipPayload(type);
+		} else {
+			reader.skipPayload(type);
+		}
+	}
+	if (!has_name)
+		throw nbt::TagNotFound("Unable to find tag 'Name'");
+
+	mc::BlockState block(block_name.str());
+	if (properties != 0) {
+		size_t end = reader.tell();
+		reader.seek(properties);
+		while (reader.nextTag(type, name)) {
+			if (type != nbt::TagString::TAG_TYPE) {
+				reader.skipPayload(type);
+				continue;
+			}
+			std::string key = name.str();
+			nbt::StringRef value = reader.readString();
+			if (block_registry.isKnownProperty(block.getName(), key)) {
+				block.setProperty(key, value.str());
+			}
+		}
+		reader.seek(end);
+	}
+	return block_registry.getBlockID(block);
+}
+
+/**
+ * Returns the block ID of a block state compound of a block state palette. Palette
+ * entries are parsed only the first time their NBT data is seen, afterwards the block ID
+ * is looked up by the raw data.
+ */
+uint16_t readBlockState(nbt::NBTReader& reader, mc::BlockStateRegistry& block_registry) {
+	size_t start = reader.tell();
+	reader.skipPayload(nbt::TagCompound::TAG_TYPE);
+	size_t end = reader.tell();
+	const uint8_t* data = reader.getBuffer() + start;
+
+	uint16_t id;
+	if (block_registry.findPaletteEntry(data, end - start, id))
+		return id;
+	reader.seek(start);
+	id = parseBlockState(reader, block_registry);
+	block_registry.addPaletteEntry(data, end - start, id);
+	return id;
+}
+
+/**
+ * Checks the "block_states" compound of a section without resolving its block states.
+ * Returns false if the section should be ignored, only_air is set to whether all
+ * block states of the palette are air.
+ */
+bool scanBlockStates(nbt::NBTReader& reader, uint16_t nop_id, bool& only_air) {
+	int32_t palette_size = 0;
+	bool has_palette = false;
+	only_air = true;
+
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagList::TAG_TYPE && name == "palette") {
+			int8_t element_type;
+			palette_size = reader.readListHeader(element_type);
+			if (palette_size > 0 && element_type != nbt::TagCompound::TAG_TYPE)
+				throw nbt::InvalidTagCast("Invalid block state palette!");
+			for (int32_t i = 0; i < palette_size; i++) {
+				int8_t entry_type;
+				nbt::StringRef entry_name;
+				while (reader.nextTag(entry_type, entry_name)) {
+					if (entry_type == nbt::TagString::TAG_TYPE && entry_name == "Name")
+						only_air &= reader.readString() == "minecraft:air";
+					else
+						reader.skipPayload(entry_type);
+				}
+			}
+			has_palette = true;
+		} else {
+			reader.skipPayload(type);
+		}
+	}
+
+	if (!has_palette)
+		return false;
+	// Check if air is the only block in this section, if so, ignore it completly, it will speed up the rest
+	// of the rendering as we won't have to verify every single block in this section.
+	if (palette_size == 1 && only_air)
+		return false;
+	// No palette, the section is decoded with the default block
+	if (palette_size == 0)
+		only_air = nop_id == 0;
+	return true;
+}
+
+/**
+ * Reads the "block_states" compound of a section into the block IDs of the section.
+ * Returns false if the block states are invalid.
+ */
+bool readBlockStates(nbt::NBTReader& reader, mc::BlockStateRegistry& block_registry,
+		ChunkSection& section) {
+	uint16_t palette[16 * 16 * 16];
+	size_t palette_size = 0;
+	bool has_palette = false;
+	nbt::LongArrayRef data;
+	bool has_data = false;
+
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagList::TAG_TYPE && name == "palette") {
+			int8_t element_type;
+			int32_t length = reader.readListHeader(element_type);
+			if (length > 0 && element_type != nbt::TagCompound::TAG_TYPE)
+				throw nbt::InvalidTagCast("Invalid block state palette!");
+			if (length > 16 * 16 * 16)
+				throw nbt::NBTError("Block state palette is too long!");
+			for (int32_t i = 0; i < length; i++)
+				palette[i] = readBlockState(reader, block_registry);
+			palette_size = length;
+			has_palette = true;
+		} else if (type == nbt::TagLongArray::TAG_TYPE && name == "data") {
+			data = reader.readLongArray();
+			has_data = true;
+		} else {
+			reader.skipPayload(type);
+		}
+	}
+
+	if (!has_palette)
+		return false;
+
+	/**
+	 * Get the block states data
+	 */
+	if (palette_size > 1) {
+		if (!has_data || data.empty())
+			throw nbt::TagNotFound("Unable to find tag 'data'");
+		// the indices are kept packed
+		if (!section.blocks.setPacked(palette, palette_size, data)) {
+			LOG(ERROR) << "Invalid block state data with " << data.size()
+				<< " longs for a palette with " << palette_size << " entries";
+			return false;
+		}
+	} else if (palette_size == 1) {
+		// Only 1 in palette: There's only block in this chunk
+		section.blocks.setSingle(palette[0]);
+	} else {
+		// No palette, this shouldn't happen, anyway let's use the default one
+		section.blocks.setSingle(0);
+	}
+	return true;
+}
+
+/**
+ * Reads the "WORLD_SURFACE" heightmap of the "Heightmaps" compound of a chunk.
+ * Returns false if there is no such heightmap.
+ */
+bool readWorldSurface(nbt::NBTReader& reader, nbt::LongArrayRef& world_surface) {
+	bool found = false;
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagLongArray::TAG_TYPE && name == "WORLD_SURFACE") {
+			world_surface = reader.readLongArray();
+			found = true;
+		} else {
+			reader.skipPayload(type);
+		}
+	}
+	return found;
+}
+
+/**
+ * Reads the "biomes" compound of a section into the biomes of the section.
+ * Returns false if the biomes are invalid.
+ */
+bool readBiomes(nbt::NBTReader& reader, ChunkSection& section) {
+	uint16_t palette[4 * 4 * 4];
+	size_t palette_size = 0;
+	bool has_palette = false;
+	nbt::LongArrayRef data;
+	bool has_data = false;
+
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagList::TAG_TYPE && name == "palette") {
+			int8_t element_type;
+			int32_t length = reader.readListHeader(element_type);
+			if (length > 0 && element_type != nbt::TagString::TAG_TYPE)
+				throw nbt::InvalidTagCast("Invalid biome palette!");
+			if (length > 4 * 4 * 4)
+				throw nbt::NBTError("Biome palette is too long!");
+			for (int32_t i = 0; i < length; i++) {
+				nbt::StringRef biome = reader.readString();
+				palette[i] = mapcrafter::renderer::Biome::getBiomeId(biome.data, biome.size);
+			}
+			palette_size = length;
+			has_palette = true;
+		} else if (type == nbt::TagLongArray::TAG_TYPE && name == "data") {
+			data = reader.readLongArray();
+			has_data = true;
+		} else {
+			reader.skipPayload(type);
+		}
+	}
+
+	if (!has_palette)
+		return false;
+
+	if (palette_size > 1) {
+		// More than one biome: there must be data and palette size > 1
+		if (!has_data || data.empty())
+			return false;
+		size_t count = boost::size(section.biomes);
+		int bits = getPackedBits(data.size(), count, palette_size);
+		if (bits == 0)
+			return false;
+		uint64_t longs[4 * 4 * 4];
+		data.copyTo(longs, data.size());
+
+		// Convert chunk local index into the global biome index, if an index is not in
+		// the palette, the first biome is used
+		unpackPalette(longs, bits, 0, count, palette, palette_size, section.biomes);
+	} else if (palette_size == 1) {
+		// Only 1 in palette: It's only this biome in this chunk
+		std::fill(section.biomes, section.biomes+boost::size(section.biomes), palette[0]);
+	} else {
+		// No palette, this shouldn't happen, anyway let's use the default one
+		std::fill(section.biomes, section.biomes+boost::size(section.biomes), 0);
+	}
+	return true;
+}
+
+/**
+ * Reads a light array of a section. Returns false if the array does not have the
+ * expected size.
+ */
+bool readLight(nbt::NBTReader& reader, SectionLight& light) {
+	nbt::ByteArrayRef array = reader.readByteArray();
+	if (array.size() != 16 * 16 * 8)
+		return false;
+	light.set(array.data);
+	return true;
+}
+
+/**
+ * Reads a compound of the sections list into a chunk section. Only the fields (GET_*
+ * flags) are read, and the block states and biomes are not decoded, their NBT payloads
+ * (in data, the buffer of the reader) are stored in the section.
+ * Returns false if the section should be ignored.
+ */
+bool readSection(nbt::NBTReader& reader, const uint8_t* data, int fields,
+		uint16_t nop_id, int chunk_lowest, ChunkSection& section) {
+	bool has_y = false, has_block_states = false, has_biomes = false;
+	bool valid = true, has_block_light = false, has_sky_light = false;
+	size_t block_states_begin = 0, block_states_end = 0, biomes_begin = 0, biomes_end = 0;
+
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagByte::TAG_TYPE && name == "Y") {
+			section.y = reader.readByte();
+			has_y = true;
+		} else if (type == nbt::TagCompound::TAG_TYPE && name == "block_states") {
+			// read the remaining tags even if the section is invalid to get to its end
+			block_states_begin = reader.tell();
+			if (valid)
+				valid = scanBlockStates(reader, nop_id, section.only_air);
+			else
+				reader.skipPayload(type);
+			block_states_end = reader.tell();
+			has_block_states = true;
+		} else if (type == nbt::TagCompound::TAG_TYPE && name == "biomes") {
+			biomes_begin = reader.tell();
+			reader.skipPayload(type);
+			biomes_end = reader.tell();
+			has_biomes = true;
+		} else if (type == nbt::TagByteArray::TAG_TYPE && name == "BlockLight"
+				&& (fields & GET_BLOCK_LIGHT)) {
+			has_block_light = readLight(reader, section.block_light);
+		} else if (type == nbt::TagByteArray::TAG_TYPE && name == "SkyLight"
+				&& (fields & GET_SKY_LIGHT)) {
+			has_sky_light = readLight(reader, section.sky_light);
+		} else {
+			reader.skipPayload(type);
 		}
-		assert(j <= data.size());
 	}
+
+	// make sure section is valid
+	if (!valid || !has_y || !has_block_states || !has_biomes)
+		return false;
+	if (section.y < chunk_lowest || section.y >= chunk_lowest+Y_CHUNKS_PER_REGION_FILE)
+		return false;
+
+	size_t biomes_size = (fields & GET_BIOME) ? biomes_end - biomes_begin : 0;
+	section.raw.reserve(block_states_end - block_states_begin + biomes_size);
+	section.raw.assign(data + block_states_begin, data + block_states_end);
+	section.raw_biomes = section.raw.size();
+	section.raw.insert(section.raw.end(), data + biomes_begin, data + biomes_begin + biomes_size);
+	if (!(fields & GET_BIOME))
+		std::fill(section.biomes, section.biomes + boost::size(section.biomes),
+				renderer::DEFAULT_BIOME_ID);
+
+	if (!has_block_light)
+		section.block_light.setUniform(0);
+	if (!has_sky_light)
+		section.sky_light.setUniform(0);
+	return true;
 }
 
 } // namespace
 
 uint16_t Chunk::nop_id = 0;
+const uint8_t Chunk::DECODED_BLOCKS;
+const uint8_t Chunk::DECODED_BIOMES;
 
 Chunk::Chunk()
-	: chunkpos(42, 42) {
+	: chunkpos(42, 42), fields(GET_ID | GET_BIOME | GET_LIGHT), block_registry(nullptr) {
 	clear();
 }
 
@@ -66,6 +622,10 @@ void Chunk::setWorldCrop(const WorldCrop& world_crop) {
 	this->world_crop = world_crop;
 }
 
+void Chunk::setFields(int fields) {
+	this->fields = fields;
+}
+
 int Chunk::positionToKey(int x, int z, int y) const {
 	return y + 256 * (x + 16 * z);
 }
@@ -73,6 +633,7 @@ int Chunk::positionToKey(int x, int z, int y) const {
 bool Chunk::readNBT(mc::BlockStateRegistry& block_registry, const char* data, size_t len,
 		nbt::Compression compression) {
 	clear();
+	this->block_registry = &block_registry;
 
 	// In case it wasn't set before
 	if (nop_id == 0) {
@@ -80,16 +641,57 @@ bool Chunk::readNBT(mc::BlockStateRegistry& block_registry, const char* data, si
 		nop_id = block_registry.getBlockID(mc::BlockState("minecraft:air"));
 	}
 
-	nbt::NBTFile nbt;
-	nbt.readNBT(data, len, compression);
+	// the decompressed data is read with a NBT cursor instead of building a tag tree,
+	// the buffer is kept per thread so its memory is reused for all chunks
+	std::vector<uint8_t>& decompressed = nbt::getDecompressionBuffer();
+	nbt::decompress(data, len, compression, decompressed);
+	nbt::NBTReader reader(decompressed.data(), decompressed.size());
+	reader.readRoot();
+
+	bool has_version = false, has_x = false, has_y = false, has_z = false;
+	int data_version = 0, chunk_x = 0, chunk_z = 0, chunk_lowest = 0;
+	nbt::StringRef status;
+	bool has_status = false;
+	nbt::LongArrayRef world_surface;
+	bool has_world_surface = false;
+	// the sections depend on the other tags, so remember where they are
+	size_t sections_position = 0;
+
+	int8_t type;
+	nbt::StringRef name;
+	while (reader.nextTag(type, name)) {
+		if (type == nbt::TagInt::TAG_TYPE && name == "DataVersion") {
+			data_version = reader.readInt();
+			has_version = true;
+		} else if (type == nbt::TagInt::TAG_TYPE && name == "xPos") {
+			chunk_x = reader.readInt();
+			has_x = true;
+		} else if (type == nbt::TagInt::TAG_TYPE && name == "yPos") {
+			chunk_lowest = reader.readInt();
+			has_y = true;
+		} else if (type == nbt::TagInt::TAG_TYPE && name == "zPos") {
+			chunk_z = reader.readInt();
+			has_z = true;
+		} else if (type == nbt::TagString::TAG_TYPE && name == "Status") {
+			status = reader.readString();
+			has_status = true;
+		} else if (type == nbt::TagList::TAG_TYPE && name == "sections") {
+			sections_position = reader.tell();
+			reader.skipPayload(type);
+		} else if (type == nbt::TagCompound::TAG_TYPE && name == "Heightmaps") {
+			has_world_surface = readWorldSurface(reader, world_surface);
+		} else {
+			// entities, structures, ... are not needed
+			reader.skipPayload(type);
+		}
+	}
 
 	// Make sure we know which data format this chunk is built of
-	if (!nbt.hasTag<nbt::TagInt>("DataVersion")) {
+	if (!has_version) {
 		LOG(ERROR) << "Chunk error: No version tag found!";
 		return false;
 	}
 
-	int data_version = nbt.findTag<nbt::TagInt>("DataVersion").payload;
 	const DataAdaptor& dadap = DataAdaptor::GetVersionAdaptor(data_version);
 	if (!dadap.IsSupported()){
 		LOG(ERROR) << "Chunk error: Unsupported chunk version, please upgrade.";
@@ -97,192 +699,130 @@ bool Chunk::readNBT(mc::BlockStateRegistry& block_registry, const char* data, si
 	}
 
 	// then find x/z pos of the chunk
-	if (!nbt.hasTag<nbt::TagInt>("xPos") || !nbt.hasTag<nbt::TagInt>("yPos") || !nbt.hasTag<nbt::TagInt>("zPos")) {
+	if (!has_x || !has_y || !has_z) {
 		LOG(ERROR) << "Corrupt chunk: No x/z position found!";
 		return false;
 	}
 
-	chunkpos = ChunkPos(nbt.findTag<nbt::TagInt>("xPos").payload,
-	                             nbt.findTag<nbt::TagInt>("zPos").payload);
-	int chunk_lowest = nbt.findTag<nbt::TagInt>("yPos").payload;
+	chunkpos = ChunkPos(chunk_x, chunk_z);
 
 	// now we have the original chunk position:
 	// check whether this chunk is completely contained within the cropped world
 	chunk_completely_contained = world_crop.isChunkCompletelyContained(chunkpos);
 
-	if (nbt.hasTag<nbt::TagString>("Status")) {
-		const nbt::TagString& tag = nbt.findTag<nbt::TagString>("Status");
-		if(! dadap.chunkStatus.isFull(tag.payload) ){
-			return true;
-		}
-	}
+	if (has_status && !dadap.chunkStatus.isFull(status.str()))
+		return true;
 
 	// find sections list
 	// ignore it if section list does not exist, can happen sometimes with the empty
 	// chunks of the end
-	if (!nbt.hasList<nbt::TagCompound>("sections"))
+	if (sections_position == 0)
 		return true;
 
-	const nbt::TagList& sections_tag = nbt.findTag<nbt::TagList>("sections");
-	if (sections_tag.tag_type != nbt::TagCompound::TAG_TYPE)
+	reader.seek(sections_position);
+	int8_t section_type;
+	int32_t sections_count = reader.readListHeader(section_type);
+	if (section_type != nbt::TagCompound::TAG_TYPE)
 		return true;
 
 	// go through all sections
-	for (auto it = sections_tag.payload.begin(); it != sections_tag.payload.end(); ++it) {
-		const nbt::TagCompound& section_tag = (*it)->cast<nbt::TagCompound>();
-
-		// make sure section is valid
-		if (!section_tag.hasTag<nbt::TagByte>("Y")
-			|| !section_tag.hasTag<nbt::TagCompound>("block_states")
-			|| !section_tag.hasTag<nbt::TagCompound>("biomes"))
+	for (int32_t i = 0; i < sections_count; i++) {
+		// read the section directly into the section list, it is removed again if it
+		// turns out to be invalid
+		sections.resize(sections.size() + 1);
+		ChunkSection& section = sections.back();
+		if (!readSection(reader, decompressed.data(), fields, nop_id, chunk_lowest, section)) {
+			sections.pop_back();
 			continue;
+		}
 
-		// Check the Y
-		const nbt::TagByte& y = section_tag.findTag<nbt::TagByte>("Y");
-		if (y.payload < chunk_lowest || y.payload >= chunk_lowest+Y_CHUNKS_PER_REGION_FILE )
-			continue;
+		// add this section to the section list
+		section_offsets[section.y-CHUNK_LOWEST] = sections.size() - 1;
+	}
 
-		const nbt::TagCompound& blockstates = section_tag.findTag<nbt::TagCompound>("block_states");
-		if (!blockstates.hasTag<nbt::TagList>("palette"))
-			continue;
+	// biomes that are not read count as decoded
+	sections_decoded.reset(new std::atomic<uint8_t>[sections.size()]);
+	for (size_t i = 0; i < sections.size(); i++)
+		sections_decoded[i].store((fields & GET_BIOME) ? 0 : DECODED_BIOMES);
 
-		const nbt::TagCompound& biomes = section_tag.findTag<nbt::TagCompound>("biomes");
-		if (!biomes.hasTag<nbt::TagList>("palette"))
-			continue;
+	// the heightmap of Minecraft is used if there is one, it's calculated otherwise
+	if (!has_world_surface || !readHeightmap(world_surface, chunk_lowest * 16))
+		computeHeightmap();
 
-		// create a ChunkSection-object
-		ChunkSection section;
-		section.y = y.payload;
-
-		/**
-		 * Get the block states palette
-		 */
-
-		// Depalettize block_states palette
-		const nbt::TagList& palettebs = blockstates.findTag<nbt::TagList>("palette");
-		std::vector<mc::BlockState> palette_blockstates(palettebs.payload.size());
-		std::vector<uint16_t> palette_blockstates_idx(palettebs.payload.size());
-		int i = 0;
-		for (auto pbsit = palettebs.payload.begin(); pbsit != palettebs.payload.end(); ++pbsit, ++i) {
-			nbt::TagCompound& entry = (*pbsit)->cast<nbt::TagCompound>();
-			const nbt::TagString& name = entry.findTag<nbt::TagString>("Name");
-
-			mc::BlockState block(name.payload);
-			if (entry.hasTag<nbt::TagCompound>("Properties")) {
-				const nbt::TagCompound& properties = entry.findTag<nbt::TagCompound>("Properties");
-				for (auto it3 = properties.payload.begin(); it3 != properties.payload.end(); ++it3) {
-					std::string key = it3->first;
-					std::string value = it3->second->cast<nbt::TagString>().payload;
-					if (block_registry.isKnownProperty(block.getName(), key)) {
-						block.setProperty(key, value);
-					}
-				}
-			}
-			palette_blockstates[i] = block;
-			palette_blockstates_idx[i] = block_registry.getBlockID(block);
-		}
-
-		/**
-		 * Get the block states data
-		 */
-		if (palettebs.payload.size()>1) {
-			const nbt::TagLongArray& databs = blockstates.findTag<nbt::TagLongArray>("data");
-			readPackedShorts_v116(databs.payload, section.block_ids, &section.block_ids[boost::size(section.block_ids)]);
-
-			bool ok = true;
-			for (size_t i = 0; i < 16*16*16; i++) {
-				if (section.block_ids[i] >= palette_blockstates.size()) {
-					int bits_per_entry = databs.payload.size() * 64 / (16*16*16);
-					LOG(ERROR) << "Incorrectly parsed palette ID " << section.block_ids[i]
-						<< " at index " << i << " (max is " << palette_blockstates.size()-1
-						<< " with " << bits_per_entry << " bits per entry)";
-					ok = false;
-					break;
-				}
-				section.block_ids[i] = palette_blockstates_idx[section.block_ids[i]];
-			}
-			if (!ok) {
-				continue;
-			}
-		} else if (palettebs.payload.size()==1) {
-			// Check if air is the only block in this section, if so, ignore it completly, it will speed up the rest
-			// of the rendering as we won't have to verify every single block in this section.
-			if (palette_blockstates_idx[0] == nop_id) continue;
-			// Only 1 in palette: There's only block in this chunk
-			std::fill(section.block_ids, section.block_ids+boost::size(section.block_ids), palette_blockstates_idx[0]);
-		} else {
-			// No palette, this shouldn't happen, anyway let's use the default one
-			std::fill(section.block_ids, section.block_ids+boost::size(section.block_ids), 0);
-		}
+	return true;
+}
 
+bool Chunk::readHeightmap(const nbt::LongArrayRef& data, int min_y) {
+	// the heights are stored as (y + 1 - min_y), so 0 means that the column is empty
+	int max_height = Y_CHUNKS_PER_REGION_FILE * 16;
+	int bits = 0;
+	while ((1 << bits) <= max_height)
+		bits++;
+	size_t per_long = 64 / bits;
+	if (data.size() != (16 * 16 + per_long - 1) / per_long)
+		return false;
 
-		/**
-		 * Get the biome data
-		 */
-		const nbt::TagList& paletteb = biomes.findTag<nbt::TagList>("palette");
-		if (paletteb.payload.size()>1) {
-			// More than one biome: there must be data and palette size > 1
-			if (!biomes.hasTag<nbt::TagLongArray>("data"))
-				continue;
-			const nbt::TagLongArray& databiomes = biomes.findTag<nbt::TagLongArray>("data");
-			readPackedShorts_v116(databiomes.payload, section.biomes, &section.biomes[boost::size(section.biomes)]);
-
-			std::vector<uint16_t> palette_biomes(paletteb.payload.size());
-			size_t i = 0;
-			for (auto pbit = paletteb.payload.begin(); pbit != paletteb.payload.end(); ++pbit, ++i) {
-				nbt::TagString& biome = (*pbit)->cast<nbt::TagString>();
-				palette_biomes[i] = mapcrafter::renderer::Biome::getBiomeId(biome.payload);
-			}
-			// Convert chunk local index into the global biome index
-			for (i = 0; i < boost::size(section.biomes); ++i) {
-				uint16_t idx = section.biomes[i];
-				// Make sure we stay in the array, if it happens, use the default biome
-				if (idx>=palette_biomes.size()) idx = 0;
-				section.biomes[i] = palette_biomes[idx];
-			}
-		} else if (paletteb.payload.size()==1) {
-			// Only 1 in palette: It's only this biome in this chunk
-			nbt::TagString& biome = (*paletteb.payload.begin())->cast<nbt::TagString>();
-			std::fill(section.biomes, section.biomes+boost::size(section.biomes), mapcrafter::renderer::Biome::getBiomeId(biome.payload));
-		} else {
-			// No palette, this shouldn't happen, anyway let's use the default one
-			std::fill(section.biomes, section.biomes+boost::size(section.biomes), 0);
-		}
+	uint64_t longs[16 * 16];
+	data.copyTo(longs, data.size());
+	uint16_t heights[16 * 16];
+	unpackValues(longs, bits, 0, 16 * 16, heights);
+	highest_block_y = CHUNK_LOWEST * 16 - 1;
+	for (size_t i = 0; i < 16 * 16; i++) {
+		if (heights[i] > max_height)
+			return false;
+		heightmap[i] = heights[i] == 0 ? CHUNK_LOWEST * 16 - 1 : heights[i] + min_y - 1;
+		highest_block_y = std::max(highest_block_y, (int) heightmap[i]);
+	}
+	return true;
+}
 
-		if (section_tag.hasArray<nbt::TagByteArray>("BlockLight")) {
-			const nbt::TagByteArray& block_light = section_tag.findTag<nbt::TagByteArray>("BlockLight");
-			std::copy(block_light.payload.begin(), block_light.payload.end(), section.block_light);
-		} else {
-			std::fill(&section.block_light[0], &section.block_light[2048], 0);
-		}
+void Chunk::computeHeightmap() {
+	std::fill(heightmap, heightmap + 16 * 16, CHUNK_LOWEST * 16 - 1);
+	highest_block_y = CHUNK_LOWEST * 16 - 1;
 
-		if (section_tag.hasArray<nbt::TagByteArray>("SkyLight", 2048)) {
-			const nbt::TagByteArray& sky_light = section_tag.findTag<nbt::TagByteArray>("SkyLight");
-			std::copy(sky_light.payload.begin(), sky_light.payload.end(), section.sky_light);
-		} else {
-			std::fill(&section.sky_light[0], &section.sky_light[2048], 0);
+	// go through the sections from top to bottom until the highest block of every
+	// column is found
+	size_t remaining = 16 * 16;
+	bool found[16 * 16] = {false};
+	for (int i = CHUNK_HIGHEST - CHUNK_LOWEST - 1; i >= 0 && remaining > 0; i--) {
+		if (section_offsets[i] >= sections.size() || sections[section_offsets[i]].only_air)
+			continue;
+		const ChunkSection& section = *getDecodedSection((i + CHUNK_LOWEST) * 16,
+				DECODED_BLOCKS);
+		for (int y = 15; y >= 0 && remaining > 0; y--) {
+			uint16_t layer[16 * 16];
+			section.blocks.get(y * 256, 16 * 16, layer);
+			for (size_t j = 0; j < 16 * 16; j++) {
+				if (found[j] || layer[j] == nop_id)
+					continue;
+				found[j] = true;
+				heightmap[j] = (i + CHUNK_LOWEST) * 16 + y;
+				highest_block_y = std::max(highest_block_y, (int) heightmap[j]);
+				remaining--;
+			}
 		}
-
-		// add this section to the section list
-		section_offsets[section.y-CHUNK_LOWEST] = sections.size();
-		sections.push_back(section);
 	}
-
-	return true;
 }
 
 void Chunk::clear() {
 	sections.clear();
+	sections_decoded.reset();
 	for (size_t i = 0; i < boost::size(section_offsets); i++)
 		section_offsets[i] = -1;
+	std::fill(heightmap, heightmap + 16 * 16, CHUNK_LOWEST * 16 - 1);
+	highest_block_y = CHUNK_LOWEST * 16 - 1;
 }
 
 bool Chunk::hasSection(int y) const {
-	const ChunkSection* cs = this->getSection(y);
+	const ChunkSection* cs = findSection(y);
 	return cs != NULL;
 }
 
 const ChunkSection* Chunk::getSection(int y) const {
+	return getDecodedSection(y, DECODED_BLOCKS | DECODED_BIOMES);
+}
+
+const ChunkSection* Chunk::findSection(int y) const {
 	int chunk_idx = y >> 4;
 	if( chunk_idx < CHUNK_LOWEST || chunk_idx >= CHUNK_HIGHEST) {
 		return NULL;
@@ -295,8 +835,21 @@ const ChunkSection* Chunk::getSection(int y) const {
 	return &sections[section_idx];
 }
 
+bool Chunk::isSectionEmpty(int y) const {
+	const ChunkSection* cs = findSection(y);
+	return cs == NULL || cs->only_air;
+}
+
+int Chunk::getHighestBlockY(int x, int z) const {
+	return heightmap[z * 16 + x];
+}
+
+int Chunk::getHighestBlockY() const {
+	return highest_block_y;
+}
+
 uint16_t Chunk::getBlockID(const LocalBlockPos& pos, bool force) const {
-	const ChunkSection* cs = getSection(pos.y);
+	const ChunkSection* cs = getDecodedSection(pos.y, DECODED_BLOCKS);
 	if (!cs)
 		return nop_id;
 
@@ -307,7 +860,7 @@ uint16_t Chunk::getBlockID(const LocalBlockPos& pos, bool force) const {
 	// calculate the offset and get the block ID
 	// and don't forget the add data
 	int offset = ((pos.y & 15) * 256) + (pos.z * 16) + pos.x;
-	uint16_t id = cs->block_ids[offset];
+	uint16_t id = cs->blocks.get(offset);
 	if (!force && world_crop.hasBlockMask()) {
 		const BlockMask* mask = world_crop.getBlockMask();
 		BlockMask::BlockState block_state = mask->getBlockState(id);
@@ -335,7 +888,7 @@ int Chunk::checkBlockWorldCrop(int x, int z, int y) const {
 }
 
 uint8_t Chunk::getData(const LocalBlockPos& pos, int array, bool force) const {
-	const ChunkSection* cs = getSection(pos.y);
+	const ChunkSection* cs = findSection(pos.y);
 	if (!cs) {
 		 // not existing sections top sections should always have skylight
 		 return array == 1 ? (this->sections.size() ? 15 : mc::OUT_OF_WORLD_LIGHT) : 0;
@@ -349,15 +902,9 @@ uint8_t Chunk::getData(const LocalBlockPos& pos, int array, bool force) const {
 		case 2: return array == 1 ? mc::OUT_OF_WORLD_LIGHT : 0;
 	}
 
-	uint8_t data = 0;
 	// calculate the offset and get the block data
 	int offset = ((pos.y & 15) * 256) + (pos.z * 16) + pos.x;
-	// handle bottom/top nibble
-	if ((offset % 2) == 0)
-		 data = cs->getArray(array)[offset / 2] & 0xf;
-	else
-		 data = (cs->getArray(array)[offset / 2] >> 4) & 0x0f;
-	return data;
+	return cs->getLight(array).get(offset);
 }
 
 uint8_t Chunk::getBlockLight(const LocalBlockPos& pos) const {
@@ -368,8 +915,40 @@ uint8_t Chunk::getSkyLight(const LocalBlockPos& pos) const {
 	return getData(pos, 1);
 }
 
+void Chunk::getBlockRow(int x1, int x2, int z, int y, uint16_t* ids,
+		uint8_t* block_light, uint8_t* sky_light) const {
+	const ChunkSection* cs = getDecodedSection(y, DECODED_BLOCKS);
+	bool contained_y = world_crop.isBlockContainedY(BlockPos(0, 0, y));
+	int offset = ((y & 15) * 256) + (z * 16);
+	for (int x = x1; x <= x2; x++, ids++, block_light++, sky_light++) {
+		// same as getBlockID and getData
+		int crop = 0;
+		if (!cs)
+			crop = 3;
+		else if (!contained_y)
+			crop = 1;
+		else if (!chunk_completely_contained && !world_crop.isBlockContainedXZ(
+				LocalBlockPos(x, z, y).toGlobalPos(chunkpos)))
+			crop = 2;
+
+		if (crop != 0) {
+			*ids = nop_id;
+			*block_light = 0;
+			if (crop == 3)
+				*sky_light = sections.size() ? 15 : mc::OUT_OF_WORLD_LIGHT;
+			else
+				*sky_light = crop == 1 ? 15 : mc::OUT_OF_WORLD_LIGHT;
+			continue;
+		}
+
+		*ids = cs->blocks.get(offset + x);
+		*block_light = cs->block_light.get(offset + x);
+		*sky_light = cs->sky_light.get(offset + x);
+	}
+}
+
 uint16_t Chunk::getBiomeAt(const LocalBlockPos& pos) const {
-	const ChunkSection* cs = getSection(pos.y);
+	const ChunkSection* cs = getDecodedSection(pos.y, DECODED_BIOMES);
 	if (!cs)
 		return renderer::DEFAULT_BIOME_ID;
 
@@ -380,9 +959,59 @@ uint16_t Chunk::getBiomeAt(const LocalBlockPos& pos) const {
 	return cs->biomes[(y << 4) + (z << 2) + x];
 }
 
+void Chunk::decodeSection(size_t index, uint8_t parts) const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(decode_mutex);
+	uint8_t decoded = sections_decoded[index].load(std::memory_order_relaxed);
+	// other threads don't access the parts of the section before they are decoded
+	ChunkSection& section = const_cast<ChunkSection&>(sections[index]);
+
+	if ((parts & DECODED_BLOCKS) && !(decoded & DECODED_BLOCKS)) {
+		bool valid = false;
+		try {
+			nbt::NBTReader reader(section.raw.data(), section.raw_biomes);
+			valid = readBlockStates(reader, *block_registry, section);
+		} catch (const nbt::NBTError& err) {
+			LOG(ERROR) << "Unable to read the block states of section " << (int) section.y
+				<< " of chunk " << chunkpos << ": " << err.what();
+		}
+		// it's too late to ignore the section, so it's made air
+		if (!valid)
+			section.blocks.setSingle(nop_id);
+		decoded |= DECODED_BLOCKS;
+	}
+
+	if ((parts & DECODED_BIOMES) && !(decoded & DECODED_BIOMES)) {
+		bool valid = false;
+		try {
+			nbt::NBTReader reader(section.raw.data() + section.raw_biomes,
+					section.raw.size() - section.raw_biomes);
+			valid = readBiomes(reader, section);
+		} catch (const nbt::NBTError& err) {
+			LOG(ERROR) << "Unable to read the biomes of section " << (int) section.y
+				<< " of chunk " << chunkpos << ": " << err.what();
+		}
+		if (!valid)
+			std::fill(section.biomes, section.biomes + boost::size(section.biomes),
+					renderer::DEFAULT_BIOME_ID);
+		decoded |= DECODED_BIOMES;
+	}
+
+	if (decoded == (DECODED_BLOCKS | DECODED_BIOMES))
+		std::vector<uint8_t>().swap(section.raw);
+	sections_decoded[index].store(decoded, std::memory_order_release);
+}
+
 const ChunkPos& Chunk::getPos() const {
 	return chunkpos;
 }
 
+size_t Chunk::getMemoryUsage() const {
+	size_t bytes = sizeof(Chunk) + (sections.capacity() - sections.size()) * sizeof(ChunkSection)
+		+ extra_data_map.size() * (sizeof(int) + sizeof(uint16_t));
+	for (size_t i = 0; i < sections.size(); i++)
+		bytes += sections[i].getMemoryUsage();
+	return bytes;
+}
+
 }
 }
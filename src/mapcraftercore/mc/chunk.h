@@ -21,11 +21,17 @@
 #define CHUNK_H_
 
 #include "nbt.h"
+#include "nbtreader.h"
 #include "pos.h"
 #include "worldcrop.h"
 
+#include "../compat/thread.h"
+
+#include <atomic>
+#include <memory>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 namespace mapcrafter {
 namespace mc {
@@ -38,23 +44,185 @@ const int CHUNK_HIGHEST = 20;	// Excluded
 const int Y_CHUNKS_PER_REGION_FILE = 24;	// Number of chunksection in a chunk (to date)
 const int OUT_OF_WORLD_LIGHT = 9;	// Lighting value for shading side of the world
 
+// the fields of blocks which can be requested from chunks and the world cache
+const int GET_ID = 1;
+const int GET_BIOME = 4;
+const int GET_BLOCK_LIGHT = 8;
+const int GET_SKY_LIGHT = 16;
+const int GET_LIGHT = GET_BLOCK_LIGHT | GET_SKY_LIGHT;
+
+/**
+ * Returns the number of bits per value (1 - 16) of count values packed into a number of
+ * longs in the format of Minecraft 1.16+ (block state and biome indices of a section,
+ * heightmaps): All values have the same number of bits and values don't span two longs.
+ * Returns 0 if no supported width needs this number of longs.
+ *
+ * The number of bits isn't stored, and some widths need the same number of longs (for
+ * example 11 and 12 bits per block state). Palette indices are stored with the smallest
+ * width the palette fits into (at least 4 bits for block states), so if palette_size is
+ * specified, the smallest width from there on with the right number of longs is used.
+ * Otherwise it's the widest width with this number of longs.
+ */
+int getPackedBits(size_t longs, size_t count, size_t palette_size = 0);
+
+/**
+ * Unpacks count values from index start on of values with bits per value packed into
+ * longs (in the native byte order). There is a specialized implementation for every
+ * width, which extracts the values of every long with constant shifts.
+ */
+void unpackValues(const uint64_t* longs, int bits, size_t start, size_t count,
+		uint16_t* values);
+
+/**
+ * Like unpackValues, but the values are indices into a palette and the palette entries
+ * are written to values, all in one pass. Returns false if an index is not in the
+ * palette, the first palette entry is written for it.
+ */
+bool unpackPalette(const uint64_t* longs, int bits, size_t start, size_t count,
+		const uint16_t* palette, size_t palette_size, uint16_t* values);
+
+/**
+ * Returns the biggest one of the first count packed values.
+ */
+uint16_t getMaxPackedValue(const uint64_t* longs, int bits, size_t count);
+
+/**
+ * The block IDs of a chunk section, stored the way Minecraft stores them: A palette of
+ * the block IDs in the section and the palette indices of the 16x16x16 blocks, packed
+ * into 64 bit longs with the same number of bits per index. A section which consists
+ * of only one kind of block doesn't need any indices.
+ *
+ * This needs a fraction of the memory of an array with the ID of every block (usually
+ * 2 KiB for 4 bits per index instead of 8 KiB), and a block ID is still looked up with
+ * a few shifts and a palette access.
+ */
+class SectionBlocks {
+public:
+	SectionBlocks();
+
+	/**
+	 * Makes all blocks of the section the same block.
+	 */
+	void setSingle(uint16_t id);
+
+	/**
+	 * Sets the palette and the packed palette indices (see getPackedBits) of the blocks.
+	 * Returns false if the number of longs doesn't match a supported number of bits per
+	 * index or if an index is not in the palette.
+	 */
+	bool setPacked(const uint16_t* palette, size_t palette_size,
+			const nbt::LongArrayRef& data);
+
+	/**
+	 * Returns the block ID at an index (y * 256 + z * 16 + x).
+	 */
+	uint16_t get(size_t index) const {
+		if (bits == 0)
+			return single_id;
+		size_t j = (index * long_divisor) >> 32;
+		return palette[(data[j] >> ((index - j * per_long) * bits)) & mask];
+	}
+
+	/**
+	 * Returns the block IDs of count blocks from an index on.
+	 */
+	void get(size_t index, size_t count, uint16_t* ids) const;
+
+	/**
+	 * Returns the number of bits per palette index, 0 if all blocks are the same.
+	 */
+	int getBits() const;
+
+	/**
+	 * Returns the memory allocated for the palette and the indices in bytes.
+	 */
+	size_t getMemoryUsage() const;
+
+private:
+	uint8_t bits, per_long;
+	uint16_t mask;
+	// the ID of all blocks if there are no palette indices
+	uint16_t single_id;
+	// ceil(2^32 / per_long), to calculate index / per_long without a division
+	uint64_t long_divisor;
+
+	std::vector<uint16_t> palette;
+	std::vector<uint64_t> data;
+};
+
+/**
+ * The light values (4 bits per block) of a chunk section. All blocks of a section often
+ * have the same light value (sky light above the ground, no block light below it), then
+ * only that value is stored.
+ */
+class SectionLight {
+public:
+	SectionLight();
+
+	/**
+	 * Sets the light value of all blocks.
+	 */
+	void setUniform(uint8_t value);
+
+	/**
+	 * Sets the light values from a nibble array (2048 bytes, the light of the block at an
+	 * even index in the lower 4 bits).
+	 */
+	void set(const uint8_t* nibbles);
+
+	/**
+	 * Returns the light value at an index (y * 256 + z * 16 + x).
+	 */
+	uint8_t get(size_t index) const {
+		if (nibbles.empty())
+			return value;
+		return (nibbles[index / 2] >> ((index % 2) * 4)) & 0x0f;
+	}
+
+	/**
+	 * Returns the memory allocated for the light values in bytes.
+	 */
+	size_t getMemoryUsage() const;
+
+private:
+	std::vector<uint8_t> nibbles;
+	// the light value of all blocks if there are no nibbles
+	uint8_t value;
+};
+
 /**
  * A 16x16x16 section of a chunk.
+ *
+ * The block IDs and biomes are decoded from the NBT data of the section when they are
+ * accessed the first time (see Chunk), until then the section keeps the payloads of
+ * the "block_states" and "biomes" compounds.
  */
 struct ChunkSection {
 	int8_t y;
-	uint8_t block_light[16 * 16 * 8];
-	uint8_t sky_light[16 * 16 * 8];
-	uint16_t block_ids[16 * 16 * 16];
+	SectionBlocks blocks;
+	SectionLight block_light, sky_light;
 	uint16_t biomes[4 * 4 * 4];
+	// whether all blocks of the section are air, this is known before the block IDs
+	// are decoded (if all block states of the palette are air)
+	bool only_air;
+
+	// the NBT payloads of the block states and biomes not decoded yet, the biomes start
+	// at raw_biomes
+	std::vector<uint8_t> raw;
+	size_t raw_biomes;
 
-	inline const uint8_t* getArray(int index) const {
+	inline const SectionLight& getLight(int index) const {
 		if (index == 0) {
 			return block_light;
 		} else {
 			return sky_light;
 		}
 	}
+
+	/**
+	 * Returns the memory used by the section in bytes.
+	 */
+	size_t getMemoryUsage() const;
 };
 
 /**
@@ -62,6 +230,12 @@ struct ChunkSection {
  * data such as block IDs, block data values and block lighting data.
  *
  * To save memory, the class stores only the sections which exist in the NBT data.
+ *
+ * Only the fields set with setFields() are read from the NBT data, and the block IDs
+ * and biomes of a section are decoded when they are accessed the first time. Sections
+ * deep below the surface are often never accessed, and resolving the block states and
+ * biomes of their palettes is the most expensive part of reading a chunk. The decoding
+ * is thread-safe, so a chunk can be shared by multiple render threads.
  */
 class Chunk {
 public:
@@ -73,6 +247,13 @@ public:
 	 */
 	void setWorldCrop(const WorldCrop& world_crop);
 
+	/**
+	 * Sets which fields of the blocks (GET_* flags) are read from the NBT data, all
+	 * fields by default. The block light/sky light/biomes of chunks read without the
+	 * field are 0/0/the default biome.
+	 */
+	void setFields(int fields);
+
 	/**
 	 * Reads the NBT data of the chunk from a buffer. You need to specify a compression
 	 * type of the raw data.
@@ -92,9 +273,29 @@ public:
 
 	/**
 	 * Returns pointer to the section for the given y cordinate, NULL if no data available, or out of scope.
+	 * The block IDs and biomes of the section are decoded if they aren't yet.
 	 */
 	const ChunkSection* getSection(int y) const;
 
+	/**
+	 * Returns whether the section for the given y coordinate doesn't exist or contains
+	 * only air blocks.
+	 */
+	bool isSectionEmpty(int y) const;
+
+	/**
+	 * Returns the y coordinate of the highest block that is not air in a column of the
+	 * chunk (local x/z coordinates), or a y coordinate below the world if the column is
+	 * empty. Block masks and world cropping are not taken into account, so there is only
+	 * air above this block, but the block itself might be hidden.
+	 */
+	int getHighestBlockY(int x, int z) const;
+
+	/**
+	 * Returns the y coordinate of the highest block that is not air in the whole chunk.
+	 */
+	int getHighestBlockY() const;
+
 	/**
 	 * Returns the block ID at a specific position (local coordinates).
 	 */
@@ -110,6 +311,14 @@ public:
 	 */
 	uint8_t getSkyLight(const LocalBlockPos& pos) const;
 
+	/**
+	 * Returns the block IDs (like getBlockID with force), block light and sky light of
+	 * the blocks x1 to x2 (inclusive) of a row along the x axis (local coordinates).
+	 * This is much faster than getting the blocks one by one.
+	 */
+	void getBlockRow(int x1, int x2, int z, int y, uint16_t* ids,
+			uint8_t* block_light, uint8_t* sky_light) const;
+
 	/**
 	 * Returns the block light at a specific position (local coordinates).
 	 */
@@ -120,6 +329,11 @@ public:
 	 */
 	const ChunkPos& getPos() const;
 
+	/**
+	 * Returns the approximate memory used by the decoded chunk data in bytes.
+	 */
+	size_t getMemoryUsage() const;
+
 	// ID of the "no operation" block
 	static uint16_t nop_id;
 
@@ -138,6 +352,23 @@ private:
 	// the array with the sections, see indexes above
 	std::vector<ChunkSection> sections;
 
+	// the fields read from the NBT data (GET_* flags)
+	int fields;
+	// the registry the block states of the sections are resolved with
+	BlockStateRegistry* block_registry;
+	// which parts of the sections are decoded (DECODED_* flags, per index in the
+	// sections array), the sections are decoded while holding the mutex
+	mutable std::unique_ptr<std::atomic<uint8_t>[]> sections_decoded;
+	mutable thread_ns::mutex decode_mutex;
+
+	static const uint8_t DECODED_BLOCKS = 1;
+	static const uint8_t DECODED_BIOMES = 2;
+
+	// y coordinate of the highest block that is not air per column (index z*16 + x)
+	// and of the whole chunk
+	int16_t heightmap[16 * 16];
+	int highest_block_y;
+
 	// extra_data (e.g. from attributes read from NBT data, like beds) are stored in this map
 	std::unordered_map<int, uint16_t> extra_data_map;
 
@@ -151,6 +382,31 @@ private:
 	 */
 	int checkBlockWorldCrop(int x, int z, int y) const;
 
+	/**
+	 * Returns the section for the given y coordinate with the specified parts
+	 * (DECODED_* flags) decoded, NULL if there is no such section.
+	 */
+	const ChunkSection* getDecodedSection(int y, uint8_t parts) const {
+		const ChunkSection* section = findSection(y);
+		if (section != NULL) {
+			size_t index = section - sections.data();
+			if ((sections_decoded[index].load(std::memory_order_acquire) & parts) != parts)
+				decodeSection(index, parts);
+		}
+		return section;
+	}
+
+	/**
+	 * Returns the section for the given y coordinate (decoded or not), NULL if there is
+	 * no such section.
+	 */
+	const ChunkSection* findSection(int y) const;
+
+	/**
+	 * Decodes the specified parts of a section.
+	 */
+	void decodeSection(size_t index, uint8_t parts) const;
+
 	/**
 	 * Returns a specific block data (block data value, block light, sky light) at a
 	 * specific position. The parameter array specifies which one:
@@ -159,6 +415,17 @@ private:
 	 */
 	uint8_t getData(const LocalBlockPos& pos, int array, bool force = false) const;
 
+	/**
+	 * Reads the heightmap of the highest blocks from the packed WORLD_SURFACE heightmap
+	 * of the chunk. Returns false if the heightmap is invalid.
+	 */
+	bool readHeightmap(const nbt::LongArrayRef& data, int min_y);
+
+	/**
+	 * Calculates the heightmap of the highest blocks from the sections.
+	 */
+	void computeHeightmap();
+
 	int positionToKey(int x, int z, int y) const;
 	void insertExtraData(const LocalBlockPos& pos, uint16_t extra_data);
 	uint16_t getExtraData(const LocalBlockPos& pos, uint16_t default_value = 0) const;
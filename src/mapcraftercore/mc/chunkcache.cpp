@@ -0,0 +1,125 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkcache.h"
+
+namespace mapcrafter {
+namespace mc {
+
+ChunkCache::ChunkCache(size_t max_bytes)
+	: max_bytes(max_bytes), max_bytes_per_shard(max_bytes / SHARD_COUNT) {
+}
+
+ChunkCache::~ChunkCache() {
+}
+
+ChunkCache::Shard& ChunkCache::getShard(const ChunkPos& pos) {
+	// neighboring chunks should end up in different shards
+	unsigned int index = static_cast<unsigned int>(pos.x) + 5 * static_cast<unsigned int>(pos.z);
+	return shards[index % SHARD_COUNT];
+}
+
+ChunkHandle ChunkCache::get(const ChunkPos& pos) {
+	Shard& shard = getShard(pos);
+	thread_ns::unique_lock<thread_ns::mutex> lock(shard.mutex);
+
+	auto it = shard.lookup.find(pos);
+	if (it == shard.lookup.end()) {
+		shard.misses++;
+		return ChunkHandle();
+	}
+
+	// mark the chunk as most recently used
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+	shard.hits++;
+	return it->second->chunk;
+}
+
+ChunkHandle ChunkCache::put(const ChunkPos& pos, ChunkHandle chunk) {
+	Shard& shard = getShard(pos);
+	thread_ns::unique_lock<thread_ns::mutex> lock(shard.mutex);
+
+	// another thread was faster, use its chunk
+	auto it = shard.lookup.find(pos);
+	if (it != shard.lookup.end()) {
+		shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+		return it->second->chunk;
+	}
+
+	Entry entry;
+	entry.pos = pos;
+	entry.chunk = chunk;
+	entry.bytes = chunk->getMemoryUsage();
+	shard.lru.push_front(entry);
+	shard.lookup[pos] = shard.lru.begin();
+	shard.used_bytes += entry.bytes;
+
+	// evict the least recently used chunks, but always keep the one we just inserted
+	while (shard.used_bytes > max_bytes_per_shard && shard.lru.size() > 1) {
+		const Entry& last = shard.lru.back();
+		shard.used_bytes -= last.bytes;
+		shard.lookup.erase(last.pos);
+		shard.lru.pop_back();
+		shard.evictions++;
+	}
+	return chunk;
+}
+
+size_t ChunkCache::getMaxBytes() const {
+	return max_bytes;
+}
+
+size_t ChunkCache::getUsedBytes() {
+	size_t used_bytes = 0;
+	for (int i = 0; i < SHARD_COUNT; i++) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(shards[i].mutex);
+		used_bytes += shards[i].used_bytes;
+	}
+	return used_bytes;
+}
+
+size_t ChunkCache::getHits() {
+	size_t hits = 0;
+	for (int i = 0; i < SHARD_COUNT; i++) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(shards[i].mutex);
+		hits += shards[i].hits;
+	}
+	return hits;
+}
+
+size_t ChunkCache::getMisses() {
+	size_t misses = 0;
+	for (int i = 0; i < SHARD_COUNT; i++) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(shards[i].mutex);
+		misses += shards[i].misses;
+	}
+	return misses;
+}
+
+size_t ChunkCache::getEvictions() {
+	size_t evictions = 0;
+	for (int i = 0; i < SHARD_COUNT; i++) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(shards[i].mutex);
+		evictions += shards[i].evictions;
+	}
+	return evictions;
+}
+
+}
+}
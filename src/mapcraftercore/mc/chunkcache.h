@@ -0,0 +1,140 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKCACHE_H_
+#define CHUNKCACHE_H_
+
+#include "chunk.h"
+#include "pos.h"
+#include "../compat/thread.h"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace mapcrafter {
+namespace mc {
+
+/**
+ * A reference-counted handle to a decoded chunk. A chunk stays valid as long as someone
+ * (a cache or a render thread) holds a handle to it, even if it was already evicted from
+ * the shared chunk cache.
+ */
+typedef std::shared_ptr<Chunk> ChunkHandle;
+
+/**
+ * A thread-safe cache of decoded chunks which is shared by all render threads of a map.
+ *
+ * The per-thread WorldCache asks this cache before decoding a chunk from its region file,
+ * so chunks along tile borders that are needed by multiple threads are inflated and
+ * NBT-parsed only once.
+ *
+ * The cache is split into shards with a mutex and an LRU list each, so threads working on
+ * different chunks rarely contend for the same lock. The memory budget is distributed
+ * evenly across the shards and the least recently used chunks of a shard are evicted when
+ * its budget is exceeded.
+ *
+ * Since the decoded block IDs depend on the block state registry and the chunks depend
+ * on the world crop and the fields read from them, a cache must only be shared by world
+ * caches using the same registry, world and fields.
+ */
+class ChunkCache {
+public:
+	/**
+	 * Creates a cache with a memory budget in bytes for all decoded chunks.
+	 */
+	ChunkCache(size_t max_bytes);
+	~ChunkCache();
+
+	/**
+	 * Returns a handle to the chunk at the given position, or an empty handle if the
+	 * chunk is not cached.
+	 */
+	ChunkHandle get(const ChunkPos& pos);
+
+	/**
+	 * Inserts a decoded chunk and returns the handle that should be used from now on.
+	 *
+	 * If another thread inserted the same chunk in the meantime, the already cached
+	 * chunk is returned instead so all threads share one copy.
+	 */
+	ChunkHandle put(const ChunkPos& pos, ChunkHandle chunk);
+
+	/**
+	 * Returns the memory budget of the cache in bytes.
+	 */
+	size_t getMaxBytes() const;
+
+	/**
+	 * Returns the (approximate) memory currently used by cached chunks in bytes.
+	 */
+	size_t getUsedBytes();
+
+	/**
+	 * Returns how many lookups were answered by the cache / how many were not.
+	 */
+	size_t getHits();
+	size_t getMisses();
+
+	/**
+	 * Returns how many chunks were evicted because of the memory budget.
+	 */
+	size_t getEvictions();
+
+private:
+	struct ChunkPosHash {
+		size_t operator()(const ChunkPos& pos) const {
+			return static_cast<size_t>(pos.x) * 73856093u ^ static_cast<size_t>(pos.z) * 19349663u;
+		}
+	};
+
+	struct Entry {
+		ChunkPos pos;
+		ChunkHandle chunk;
+		// memory usage of the chunk when it was inserted
+		size_t bytes;
+	};
+
+	typedef std::list<Entry> LRUList;
+
+	struct Shard {
+		Shard() : used_bytes(0), hits(0), misses(0), evictions(0) {}
+
+		thread_ns::mutex mutex;
+		// most recently used chunks are at the front
+		LRUList lru;
+		std::unordered_map<ChunkPos, LRUList::iterator, ChunkPosHash> lookup;
+
+		size_t used_bytes;
+		size_t hits, misses, evictions;
+	};
+
+	Shard& getShard(const ChunkPos& pos);
+
+	static const int SHARD_COUNT = 16;
+
+	size_t max_bytes, max_bytes_per_shard;
+	Shard shards[SHARD_COUNT];
+};
+
+}
+}
+
+#endif /* CHUNKCACHE_H_ */
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkindex.h"
+
+#include "compression.h"
+#include "nbtreader.h"
+#include "region.h"
+#include "../util.h"
+
+namespace mapcrafter {
+namespace mc {
+
+namespace {
+
+// version of the index file, index files with other versions are ignored
+const int INDEX_VERSION = 1;
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+void hashBytes(uint64_t& hash, const uint8_t* data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+/**
+ * Returns whether a tag of a chunk is read by Chunk::readNBT.
+ */
+bool isRenderedTag(int8_t type, const nbt::StringRef& name) {
+	return (type == nbt::TagInt::TAG_TYPE && (name == "DataVersion" || name == "xPos"
+				|| name == "yPos" || name == "zPos"))
+			|| (type == nbt::TagString::TAG_TYPE && name == "Status")
+			|| (type == nbt::TagList::TAG_TYPE && name == "sections")
+			|| (type == nbt::TagCompound::TAG_TYPE && name == "Heightmaps");
+}
+
+}
+
+ChunkIndex::ChunkIndex(const World& world)
+	: world(world), now(std::time(nullptr)) {
+	index_file = world.getCacheDir() / "chunks.nbt.gz";
+}
+
+ChunkIndex::~ChunkIndex() {
+}
+
+bool ChunkIndex::read() {
+	regions.clear();
+	if (!fs::exists(index_file)) {
+		LOG(DEBUG) << "Chunk index " << index_file << " does not exist.";
+		return false;
+	}
+
+	try {
+		nbt::NBTFile nbt_file;
+		nbt_file.readNBT(index_file.string().c_str(), nbt::Compression::GZIP);
+		if (!nbt_file.hasTag<nbt::TagInt>("version")
+				|| nbt_file.findTag<nbt::TagInt>("version").payload != INDEX_VERSION) {
+			LOG(DEBUG) << "Ignoring chunk index " << index_file << " of another version.";
+			return false;
+		}
+
+		nbt::TagList& nbt_regions = nbt_file.findTag<nbt::TagList>("regions");
+		for (auto region_it = nbt_regions.payload.begin();
+				region_it != nbt_regions.payload.end(); ++region_it) {
+			nbt::TagCompound& nbt_region = (*region_it)->cast<nbt::TagCompound>();
+			RegionPos pos(nbt_region.findTag<nbt::TagInt>("x").payload,
+					nbt_region.findTag<nbt::TagInt>("z").payload);
+			const std::vector<int32_t>& indexes
+				= nbt_region.findTag<nbt::TagIntArray>("chunks").payload;
+			const std::vector<int32_t>& timestamps
+				= nbt_region.findTag<nbt::TagIntArray>("timestamps").payload;
+			const std::vector<int32_t>& changed
+				= nbt_region.findTag<nbt::TagIntArray>("changed").payload;
+			const std::vector<int64_t>& hashes
+				= nbt_region.findTag<nbt::TagLongArray>("hashes").payload;
+			if (timestamps.size() != indexes.size() || changed.size() != indexes.size()
+					|| hashes.size() != indexes.size())
+				continue;
+
+			RegionEntry& entry = regions[pos];
+			entry.mtime = nbt_region.findTag<nbt::TagLong>("mtime").payload;
+			entry.size = nbt_region.findTag<nbt::TagLong>("size").payload;
+			entry.chunks.resize(indexes.size());
+			for (size_t i = 0; i < indexes.size(); i++) {
+				entry.chunks[i].index = indexes[i] & 1023;
+				entry.chunks[i].timestamp = timestamps[i];
+				entry.chunks[i].changed = changed[i];
+				entry.chunks[i].hash = hashes[i];
+			}
+		}
+	} catch (const nbt::NBTError& e) {
+		LOG(WARNING) << "Ignoring invalid chunk index " << index_file << ": " << e.what();
+		regions.clear();
+		return false;
+	}
+
+	LOG(DEBUG) << "Read chunk index " << index_file << " with " << regions.size()
+			<< " regions.";
+	return true;
+}
+
+void ChunkIndex::write() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+
+	nbt::NBTFile nbt_file;
+	nbt_file.addTag("version", nbt::TagInt(INDEX_VERSION));
+	nbt::TagList nbt_regions(nbt::TagCompound::TAG_TYPE);
+	for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
+		if (!world.hasRegion(region_it->first))
+			continue;
+		const RegionEntry& entry = region_it->second;
+		std::vector<int32_t> indexes, timestamps, changed;
+		std::vector<int64_t> hashes;
+		for (auto chunk_it = entry.chunks.begin(); chunk_it != entry.chunks.end(); ++chunk_it) {
+			indexes.push_back(chunk_it->index);
+			timestamps.push_back(chunk_it->timestamp);
+			changed.push_back(chunk_it->changed);
+			hashes.push_back(chunk_it->hash);
+		}
+
+		nbt::TagCompound nbt_region;
+		nbt_region.addTag("x", nbt::TagInt(region_it->first.x));
+		nbt_region.addTag("z", nbt::TagInt(region_it->first.z));
+		nbt_region.addTag("mtime", nbt::TagLong(entry.mtime));
+		nbt_region.addTag("size", nbt::TagLong(entry.size));
+		nbt_region.addTag("chunks", nbt::TagIntArray(indexes));
+		nbt_region.addTag("timestamps", nbt::TagIntArray(timestamps));
+		nbt_region.addTag("changed", nbt::TagIntArray(changed));
+		nbt_region.addTag("hashes", nbt::TagLongArray(hashes));
+		nbt_regions.payload.push_back(nbt::TagPtr(nbt_region.clone()));
+	}
+	nbt_file.addTag("regions", nbt_regions);
+
+	LOG(DEBUG) << "Writing chunk index " << index_file << " with "
+			<< nbt_regions.payload.size() << " regions.";
+	nbt_file.writeNBT(index_file.string().c_str(), nbt::Compression::GZIP);
+}
+
+bool ChunkIndex::getRegionChunks(const RegionPos& pos,
+		std::vector<std::pair<ChunkPos, uint32_t>>& chunks) {
+	chunks.clear();
+	fs::path path = world.getRegionPath(pos);
+	if (path.empty())
+		return false;
+
+	boost::system::error_code error;
+	int64_t mtime = fs::last_write_time(path, error);
+	uint64_t size = fs::file_size(path, error);
+	if (error)
+		return false;
+
+	// look up the region in the index, the lock is not held while the region file is
+	// read so the other scan threads are not blocked
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = regions.find(pos);
+	RegionEntry entry;
+	if (it != regions.end() && it->second.mtime == mtime && it->second.size == size) {
+		stats.regions_unchanged++;
+		entry = it->second;
+	} else {
+		bool indexed = it != regions.end();
+		RegionEntry old_entry;
+		if (indexed)
+			old_entry = it->second;
+		lock.unlock();
+
+		ChunkIndexStats region_stats;
+		region_stats.regions_updated++;
+		bool ok = updateRegion(path, indexed ? &old_entry : nullptr, entry, region_stats);
+
+		lock.lock();
+		stats.regions_updated += region_stats.regions_updated;
+		stats.chunks_changed += region_stats.chunks_changed;
+		stats.chunks_touched += region_stats.chunks_touched;
+		if (!ok) {
+			regions.erase(pos);
+			return false;
+		}
+		// a region file modified in the same second as it was read might still change
+		// without getting a new modification time, so it is read again next time
+		entry.mtime = mtime < now ? mtime : 0;
+		entry.size = size;
+		regions[pos] = entry;
+	}
+	lock.unlock();
+
+	WorldCrop world_crop = world.getWorldCrop();
+	for (auto chunk_it = entry.chunks.begin(); chunk_it != entry.chunks.end(); ++chunk_it) {
+		ChunkPos chunk(pos.x * 32 + chunk_it->index % 32, pos.z * 32 + chunk_it->index / 32);
+		if (world_crop.isChunkContained(chunk))
+			chunks.push_back(std::make_pair(chunk, chunk_it->changed));
+	}
+	return true;
+}
+
+ChunkIndexStats ChunkIndex::getStats() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return stats;
+}
+
+uint64_t ChunkIndex::hashChunk(const uint8_t* data, size_t size,
+		nbt::Compression compression) {
+	try {
+		std::vector<uint8_t>& decompressed = nbt::getDecompressionBuffer();
+		nbt::decompress(reinterpret_cast<const char*>(data), size, compression, decompressed);
+		nbt::NBTReader reader(decompressed.data(), decompressed.size());
+		reader.readRoot();
+
+		// hash the names and raw payloads of the tags the renderer reads, tags like the
+		// inhabited time or the entities change all the time without changing the tiles
+		uint64_t hash = FNV_OFFSET_BASIS;
+		bool found = false;
+		int8_t type;
+		nbt::StringRef name;
+		while (reader.nextTag(type, name)) {
+			size_t start = reader.tell();
+			reader.skipPayload(type);
+			if (!isRenderedTag(type, name))
+				continue;
+			hashBytes(hash, reinterpret_cast<const uint8_t*>(name.data), name.size);
+			hashBytes(hash, decompressed.data() + start, reader.tell() - start);
+			found = true;
+		}
+		// chunks of other formats are hashed completely
+		if (!found)
+			hashBytes(hash, decompressed.data(), decompressed.size());
+		// 0 means that the hash is not known
+		return hash != 0 ? hash : 1;
+	} catch (const nbt::NBTError&) {
+		return 0;
+	}
+}
+
+bool ChunkIndex::updateRegion(const fs::path& path, const RegionEntry* old_entry,
+		RegionEntry& entry, ChunkIndexStats& stats) const {
+	// the index contains all chunks of a region, the world crop is applied later
+	RegionFile region(path.string());
+	if (old_entry == nullptr ? !region.readOnlyHeaders() : !region.map())
+		return false;
+
+	const RegionFile::ChunkMap& region_chunks = region.getContainingChunks();
+	entry.chunks.clear();
+	entry.chunks.reserve(region_chunks.size());
+	auto old_it = old_entry != nullptr ? old_entry->chunks.begin()
+			: std::vector<ChunkEntry>::const_iterator();
+	for (int i = 0; i < 1024; i++) {
+		ChunkPos pos(region.getPos().x * 32 + i % 32, region.getPos().z * 32 + i / 32);
+		if (!region.hasChunk(pos))
+			continue;
+
+		ChunkEntry chunk;
+		chunk.index = i;
+		chunk.timestamp = region.getChunkTimestamp(pos);
+		chunk.changed = chunk.timestamp;
+		chunk.hash = 0;
+
+		// find the chunk in the old entry of the region
+		const ChunkEntry* old_chunk = nullptr;
+		if (old_entry != nullptr) {
+			while (old_it != old_entry->chunks.end() && old_it->index < i)
+				++old_it;
+			if (old_it != old_entry->chunks.end() && old_it->index == i)
+				old_chunk = &*old_it;
+		}
+
+		if (old_chunk != nullptr && old_chunk->timestamp == chunk.timestamp
+				&& old_chunk->hash != 0) {
+			chunk = *old_chunk;
+		} else if (old_entry != nullptr) {
+			// only regions that were indexed before are mapped to hash their chunks
+			const uint8_t* data;
+			size_t size;
+			uint8_t compression_type;
+			nbt::Compression compression;
+			if (region.getChunkPayload(pos, data, size, compression_type)
+						== RegionFile::CHUNK_OK
+					&& RegionFile::getCompression(compression_type, compression))
+				chunk.hash = hashChunk(data, size, compression);
+
+			if (old_chunk != nullptr && old_chunk->timestamp == chunk.timestamp) {
+				// the hash of this chunk was just not known yet
+				chunk.changed = old_chunk->changed;
+			} else if (old_chunk != nullptr && chunk.hash != 0
+					&& chunk.hash == old_chunk->hash) {
+				chunk.changed = old_chunk->changed;
+				stats.chunks_touched++;
+			} else {
+				stats.chunks_changed++;
+			}
+		} else {
+			stats.chunks_changed++;
+		}
+		entry.chunks.push_back(chunk);
+	}
+	return true;
+}
+
+}
+}
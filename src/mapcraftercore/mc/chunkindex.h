@@ -0,0 +1,157 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKINDEX_H_
+#define CHUNKINDEX_H_
+
+#include "nbt.h"
+#include "pos.h"
+#include "world.h"
+#include "../compat/thread.h"
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <utility>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace mc {
+
+/**
+ * Some statistics of a chunk index, collected while the regions are looked up.
+ */
+struct ChunkIndexStats {
+	ChunkIndexStats()
+		: regions_unchanged(0), regions_updated(0), chunks_changed(0), chunks_touched(0) {
+	}
+
+	// regions whose files did not change, their headers were not read at all
+	size_t regions_unchanged;
+	// regions that are new or whose files changed, their headers were read again
+	size_t regions_updated;
+	// chunks with a new timestamp and changed (or unknown) contents
+	size_t chunks_changed;
+	// chunks with a new timestamp, but the same contents as before
+	size_t chunks_touched;
+};
+
+/**
+ * A persistent index of the chunks of a world, stored in the cache directory of the world.
+ *
+ * The index remembers the modification time and size of every region file and the
+ * timestamps of its chunks. The headers of region files that did not change since the
+ * last scan are not read again, the chunks are taken from the index instead.
+ *
+ * Minecraft updates the timestamp of a chunk every time it saves the chunk, even if
+ * only things like the inhabited time changed. So the index also stores a hash of the
+ * parts of every chunk the renderer actually reads. If a chunk has a new timestamp, but
+ * the same hash as before, the chunk keeps the time of its last real change and the
+ * tiles of the chunk don't need to be rendered again.
+ *
+ * The chunks of a region are only hashed once the region file changes, a new index
+ * doesn't read more than the region headers. Chunks without a known hash count as
+ * changed whenever their timestamp changes.
+ */
+class ChunkIndex {
+public:
+	ChunkIndex(const World& world);
+	~ChunkIndex();
+
+	/**
+	 * Reads the index file. Returns false if there is no index file or if it is invalid,
+	 * the index is empty then.
+	 */
+	bool read();
+
+	/**
+	 * Writes the index file, only with the regions that are still in the world.
+	 */
+	void write() const;
+
+	/**
+	 * Returns the chunks of a region (only the ones in the world crop) with the
+	 * timestamps of their last changes. Updates the index with the region first if its
+	 * file changed. Returns false if the region does not exist or is corrupted.
+	 *
+	 * This method can be called by multiple threads at the same time.
+	 */
+	bool getRegionChunks(const RegionPos& pos,
+			std::vector<std::pair<ChunkPos, uint32_t>>& chunks);
+
+	/**
+	 * Returns the statistics collected since the index was created.
+	 */
+	ChunkIndexStats getStats() const;
+
+	/**
+	 * Returns a hash of the parts of a (compressed) chunk that are relevant for the
+	 * renderer, or 0 if the chunk data is corrupted.
+	 */
+	static uint64_t hashChunk(const uint8_t* data, size_t size,
+			nbt::Compression compression);
+
+private:
+	struct ChunkEntry {
+		// local index of the chunk in the region (x + z * 32)
+		uint16_t index;
+		// timestamp of the chunk in the region header
+		uint32_t timestamp;
+		// timestamp of the last change of the chunk contents
+		uint32_t changed;
+		// hash of the chunk contents, 0 if not known
+		uint64_t hash;
+	};
+
+	struct RegionEntry {
+		RegionEntry() : mtime(0), size(0) {}
+
+		// modification time and size of the region file
+		// (a modification time of 0 makes sure the region is read again)
+		int64_t mtime;
+		uint64_t size;
+		// the chunks, sorted by their local index
+		std::vector<ChunkEntry> chunks;
+	};
+
+	/**
+	 * Reads the headers of a region file and updates the entry of the region.
+	 * The chunks with new timestamps are hashed if the region was indexed before.
+	 */
+	bool updateRegion(const fs::path& path, const RegionEntry* old_entry,
+			RegionEntry& entry, ChunkIndexStats& stats) const;
+
+	const World& world;
+	fs::path index_file;
+	// when the index was read, region files modified at this time or later are not
+	// marked as unchanged, they might be written again in the same second
+	std::time_t now;
+
+	std::map<RegionPos, RegionEntry> regions;
+	ChunkIndexStats stats;
+	mutable thread_ns::mutex mutex;
+};
+
+}
+}
+
+#endif /* CHUNKINDEX_H_ */
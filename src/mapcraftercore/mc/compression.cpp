@@ -0,0 +1,303 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compression.h"
+
+#include "../config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#ifdef HAVE_LIBDEFLATE
+#  include <libdeflate.h>
+#endif
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+namespace {
+
+const char* getCompressionName(Compression compression) {
+	return compression == Compression::GZIP ? "gzip" : "zlib";
+}
+
+/**
+ * Returns how large the decompressed data probably is, so we usually do not have to
+ * grow the buffer while decompressing.
+ */
+size_t estimateSize(const uint8_t* data, size_t len, Compression compression) {
+	// gzip stores the size of the uncompressed data (modulo 2^32) at the end
+	if (compression == Compression::GZIP && len >= 18) {
+		const uint8_t* isize = data + len - 4;
+		size_t size = isize[0] | (isize[1] << 8) | (isize[2] << 16) | ((size_t) isize[3] << 24);
+		// deflate can't compress better than about 1:1032, so don't trust corrupted sizes
+		if (size > 0 && size <= len * 1032)
+			return size;
+	}
+	// chunks are usually compressed to a fourth of their size or less
+	return std::max(len * 4, (size_t) 4096);
+}
+
+#ifdef HAVE_LIBDEFLATE
+
+/**
+ * A libdeflate decompressor for each thread, it is reused for all buffers.
+ */
+struct Decompressor {
+	Decompressor() : decompressor(libdeflate_alloc_decompressor()) {}
+	~Decompressor() {
+		if (decompressor != nullptr)
+			libdeflate_free_decompressor(decompressor);
+	}
+
+	libdeflate_decompressor* decompressor;
+};
+
+void inflateData(const uint8_t* data, size_t len, Compression compression,
+		std::vector<uint8_t>& decompressed) {
+	static thread_local Decompressor decompressor;
+	if (decompressor.decompressor == nullptr)
+		throw NBTError("Unable to allocate libdeflate decompressor!");
+
+	size_t size = estimateSize(data, len, compression);
+	if (decompressed.size() < size)
+		decompressed.resize(size);
+	while (true) {
+		size_t actual_size;
+		libdeflate_result result;
+		if (compression == Compression::GZIP)
+			result = libdeflate_gzip_decompress(decompressor.decompressor, data, len,
+					decompressed.data(), decompressed.size(), &actual_size);
+		else
+			result = libdeflate_zlib_decompress(decompressor.decompressor, data, len,
+					decompressed.data(), decompressed.size(), &actual_size);
+
+		if (result == LIBDEFLATE_INSUFFICIENT_SPACE) {
+			decompressed.resize(decompressed.size() * 2);
+			continue;
+		}
+		if (result != LIBDEFLATE_SUCCESS)
+			throw NBTError(std::string("Error while decompressing ")
+					+ getCompressionName(compression) + " data: Invalid data ("
+					+ util::str((int) result) + ")");
+		decompressed.resize(actual_size);
+		return;
+	}
+}
+
+#else
+
+/**
+ * A zlib inflate stream for each thread, it is reset and reused for all buffers.
+ */
+struct Inflater {
+	Inflater() {
+		std::memset(&stream, 0, sizeof(stream));
+		// 32 additional window bits to detect gzip and zlib headers automatically
+		initialized = inflateInit2(&stream, 15 + 32) == Z_OK;
+	}
+	~Inflater() {
+		if (initialized)
+			inflateEnd(&stream);
+	}
+
+	z_stream stream;
+	bool initialized;
+};
+
+void inflateData(const uint8_t* data, size_t len, Compression compression,
+		std::vector<uint8_t>& decompressed) {
+	static thread_local Inflater inflater;
+	if (!inflater.initialized)
+		throw NBTError("Unable to initialize zlib!");
+	z_stream& stream = inflater.stream;
+	inflateReset(&stream);
+
+	size_t size = estimateSize(data, len, compression);
+	if (decompressed.size() < size)
+		decompressed.resize(size);
+
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = len;
+	size_t used = 0;
+	while (true) {
+		if (used == decompressed.size())
+			decompressed.resize(decompressed.size() * 2);
+		stream.next_out = &decompressed[used];
+		stream.avail_out = decompressed.size() - used;
+		int status = inflate(&stream, Z_NO_FLUSH);
+		used = decompressed.size() - stream.avail_out;
+
+		if (status == Z_STREAM_END)
+			break;
+		// we just need a larger buffer
+		if ((status == Z_OK || status == Z_BUF_ERROR) && stream.avail_out == 0)
+			continue;
+		std::string message = stream.msg != nullptr ? stream.msg : "Unexpected end of data";
+		throw NBTError(std::string("Error while decompressing ")
+				+ getCompressionName(compression) + " data: " + message
+				+ " (" + util::str(status) + ")");
+	}
+	decompressed.resize(used);
+}
+
+#endif
+
+uint32_t readLittleEndian32(const uint8_t* data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/**
+ * Reads the length extension of a literal or match length of a LZ4 sequence.
+ */
+size_t readLZ4Length(const uint8_t*& ip, const uint8_t* iend) {
+	size_t length = 0;
+	uint8_t byte;
+	do {
+		if (ip == iend)
+			throw NBTError("Error while decompressing LZ4 data: Unexpected end of data");
+		byte = *ip++;
+		length += byte;
+	} while (byte == 255);
+	return length;
+}
+
+/**
+ * Decompresses a single LZ4 block. The size of the decompressed data must be known.
+ */
+void decompressLZ4Block(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) {
+	const uint8_t* ip = src;
+	const uint8_t* iend = src + src_len;
+	uint8_t* op = dst;
+	uint8_t* oend = dst + dst_len;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+			literals += readLZ4Length(ip, iend);
+		if (literals > (size_t) (iend - ip) || literals > (size_t) (oend - op))
+			throw NBTError("Error while decompressing LZ4 data: Invalid literal length");
+		std::memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+
+		// the last sequence consists of literals only
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			throw NBTError("Error while decompressing LZ4 data: Unexpected end of data");
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - dst))
+			throw NBTError("Error while decompressing LZ4 data: Invalid match offset");
+
+		size_t match = (token & 15) + 4;
+		if ((token & 15) == 15)
+			match += readLZ4Length(ip, iend);
+		if (match > (size_t) (oend - op))
+			throw NBTError("Error while decompressing LZ4 data: Invalid match length");
+		// matches may overlap with the output, so copy byte by byte
+		const uint8_t* mp = op - offset;
+		for (size_t i = 0; i < match; i++)
+			op[i] = mp[i];
+		op += match;
+	}
+
+	if (op != oend)
+		throw NBTError("Error while decompressing LZ4 data: Invalid size of block");
+}
+
+/**
+ * Decompresses data in the block stream format of lz4-java (LZ4BlockOutputStream).
+ * Each block has a 21 byte header: The magic "LZ4Block", a token with the compression
+ * method, the compressed size, the decompressed size and a checksum (which is not
+ * checked here). An empty block marks the end of the stream.
+ */
+void decompressLZ4(const uint8_t* data, size_t len, std::vector<uint8_t>& decompressed) {
+	const size_t HEADER_SIZE = 8 + 1 + 4 + 4 + 4;
+	const int METHOD_RAW = 0x10;
+	const int METHOD_LZ4 = 0x20;
+	// maximum size of a block written by lz4-java
+	const size_t MAX_LZ4_BLOCK_SIZE = 1 << 25;
+
+	size_t pos = 0, used = 0;
+	while (pos < len) {
+		if (len - pos < HEADER_SIZE || std::memcmp(data + pos, "LZ4Block", 8) != 0)
+			throw NBTError("Error while decompressing LZ4 data: Invalid block header");
+		int method = data[pos + 8] & 0xf0;
+		size_t compressed_size = readLittleEndian32(data + pos + 9);
+		size_t size = readLittleEndian32(data + pos + 13);
+		pos += HEADER_SIZE;
+
+		if (compressed_size == 0 && size == 0)
+			break;
+		if (compressed_size > len - pos)
+			throw NBTError("Error while decompressing LZ4 data: Unexpected end of data");
+		// the decompressed size comes from the (maybe corrupt) data, so make sure it is
+		// possible at all before allocating memory for it: lz4-java doesn't write bigger
+		// blocks, and a LZ4 sequence can't expand to more than 255 bytes per byte
+		if (size > MAX_LZ4_BLOCK_SIZE || size > compressed_size * 255 + 16)
+			throw NBTError("Error while decompressing LZ4 data: Invalid block size");
+
+		decompressed.resize(used + size);
+		if (method == METHOD_RAW && compressed_size == size)
+			std::memcpy(&decompressed[used], data + pos, size);
+		else if (method == METHOD_LZ4)
+			decompressLZ4Block(data + pos, compressed_size, &decompressed[used], size);
+		else
+			throw NBTError("Error while decompressing LZ4 data: Invalid block method");
+		used += size;
+		pos += compressed_size;
+	}
+	decompressed.resize(used);
+}
+
+}
+
+void decompress(const char* data, size_t len, Compression compression,
+		std::vector<uint8_t>& decompressed) {
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+	if (compression == Compression::NO_COMPRESSION)
+		decompressed.assign(bytes, bytes + len);
+	else if (compression == Compression::LZ4)
+		decompressLZ4(bytes, len, decompressed);
+	else
+		inflateData(bytes, len, compression, decompressed);
+}
+
+std::vector<uint8_t>& getDecompressionBuffer() {
+	static thread_local std::vector<uint8_t> buffer;
+	return buffer;
+}
+
+const char* getDecompressionBackend() {
+#ifdef HAVE_LIBDEFLATE
+	return "libdeflate";
+#else
+	return "zlib";
+#endif
+}
+
+}
+}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSION_H_
+#define COMPRESSION_H_
+
+#include "nbt.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+/**
+ * Decompresses a buffer in one shot into the specified vector. The vector is only
+ * resized, so its memory can be reused for multiple buffers.
+ *
+ * Gzip and zlib data is decompressed with libdeflate if Mapcrafter was built with it,
+ * otherwise with zlib. LZ4 data is expected in the block stream format of lz4-java,
+ * which Minecraft uses for region compression type 4.
+ *
+ * Throws a NBTError if the data is corrupted.
+ */
+void decompress(const char* data, size_t len, Compression compression,
+		std::vector<uint8_t>& decompressed);
+
+/**
+ * Returns a buffer for decompressed data which belongs to the calling thread.
+ * Decompressing into this buffer does not allocate memory once it has grown to the
+ * size of the largest data decompressed by the thread.
+ */
+std::vector<uint8_t>& getDecompressionBuffer();
+
+/**
+ * Returns the name of the library used to decompress gzip and zlib data.
+ */
+const char* getDecompressionBackend();
+
+}
+}
+}
+
+#endif /* COMPRESSION_H_ */
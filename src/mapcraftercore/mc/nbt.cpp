@@ -19,9 +19,13 @@
 
 #include "nbt.h"
 
+#include "compression.h"
+
 #include <fstream>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
 
@@ -387,29 +391,15 @@ void NBTFile::decompressStream(std::istream& stream, std::stringstream& decompre
 		decompressed << stream.rdbuf();
 		return;
 	}
-	boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
-	if (compression == Compression::GZIP) {
-		in.push(boost::iostreams::gzip_decompressor());
-	} else if (compression == Compression::ZLIB) {
-		in.push(boost::iostreams::zlib_decompressor());
-	}
-	try {
-		in.push(stream);
-		boost::iostreams::copy(in, decompressed);
-	} catch (boost::iostreams::gzip_error &e) {
-		throw NBTError(
-		        "Error while decompressing gzip data: " + std::string(e.what()) + " ("
-		                + util::str(e.error()) + ")");
-	} catch (boost::iostreams::zlib_error &e) {
-		throw NBTError(
-		        "Error while decompressing zlib data: " + std::string(e.what()) + " ("
-		                + util::str(e.error()) + ")");
-	}
+	std::stringstream compressed(std::ios::in | std::ios::out | std::ios::binary);
+	compressed << stream.rdbuf();
+	std::string data = compressed.str();
+	std::vector<uint8_t>& buffer = getDecompressionBuffer();
+	decompress(data.data(), data.size(), compression, buffer);
+	decompressed.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
 }
 
-void NBTFile::readCompressed(std::istream& stream, Compression compression) {
-	std::stringstream decompressed(std::ios::in | std::ios::out | std::ios::binary);
-	decompressStream(stream, decompressed, compression);
+void NBTFile::readDecompressed(std::istream& decompressed) {
 	int8_t type = ((TagByte&) TagByte().read(decompressed)).payload;
 	if (type != TagCompound::TAG_TYPE)
 		throw NBTError("First tag is not a tag compound!");
@@ -418,6 +408,12 @@ void NBTFile::readCompressed(std::istream& stream, Compression compression) {
 	setName(name);
 }
 
+void NBTFile::readCompressed(std::istream& stream, Compression compression) {
+	std::stringstream decompressed(std::ios::in | std::ios::out | std::ios::binary);
+	decompressStream(stream, decompressed, compression);
+	readDecompressed(decompressed);
+}
+
 void NBTFile::readNBT(std::istream& stream, Compression compression) {
 	readCompressed(stream, compression);
 }
@@ -431,9 +427,12 @@ void NBTFile::readNBT(const char* filename, Compression compression) {
 }
 
 void NBTFile::readNBT(const char* buffer, size_t len, Compression compression) {
-	std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
-	stream.write(buffer, len);
-	readCompressed(stream, compression);
+	// decompress the buffer in one shot and read the tags directly from the decompressed data
+	std::vector<uint8_t>& decompressed = getDecompressionBuffer();
+	decompress(buffer, len, compression, decompressed);
+	boost::iostreams::stream<boost::iostreams::array_source> stream(
+			reinterpret_cast<const char*>(decompressed.data()), decompressed.size());
+	readDecompressed(stream);
 }
 
 void NBTFile::writeNBT(std::ostream& stream, Compression compression) {
@@ -443,6 +442,8 @@ void NBTFile::writeNBT(std::ostream& stream, Compression compression) {
 		out.push(boost::iostreams::gzip_compressor());
 	} else if (compression == Compression::ZLIB) {
 		out.push(boost::iostreams::zlib_compressor());
+	} else if (compression == Compression::LZ4) {
+		throw NBTError("Writing LZ4 compressed NBT data is not supported!");
 	} else {
 		write(stream);
 		return;
@@ -73,7 +73,7 @@ enum class TagType : int8_t {
 };
 
 enum class Compression {
-	NO_COMPRESSION = 0, GZIP = 1, ZLIB = 2
+	NO_COMPRESSION = 0, GZIP = 1, ZLIB = 2, LZ4 = 3
 };
 
 static const char* TAG_NAMES[] = {
@@ -359,6 +359,7 @@ class NBTFile: public TagCompound {
 private:
 	void decompressStream(std::istream& stream, std::stringstream& decompressed,
 	        Compression compression);
+	void readDecompressed(std::istream& decompressed);
 public:
 	NBTFile();
 	NBTFile(const std::string name) : TagCompound(name) {}
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nbtreader.h"
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+NBTReader::NBTReader(const uint8_t* data, size_t size)
+	: data(data), size(size), position(0) {
+}
+
+NBTReader::~NBTReader() {
+}
+
+const uint8_t* NBTReader::require(size_t bytes) {
+	if (bytes > size - position)
+		throw NBTError("Unexpected end of NBT data!");
+	const uint8_t* ptr = data + position;
+	position += bytes;
+	return ptr;
+}
+
+void NBTReader::readRoot() {
+	if (readByte() != TagCompound::TAG_TYPE)
+		throw NBTError("First tag is not a tag compound!");
+	readString();
+}
+
+bool NBTReader::nextTag(int8_t& type, StringRef& name) {
+	type = readByte();
+	if (type == TagEnd::TAG_TYPE)
+		return false;
+	name = readString();
+	return true;
+}
+
+int32_t NBTReader::readListHeader(int8_t& element_type) {
+	element_type = readByte();
+	int32_t length = readInt();
+	if (length < 0)
+		throw NBTError("Invalid length of NBT list!");
+	return length;
+}
+
+int8_t NBTReader::readByte() {
+	return static_cast<int8_t>(*require(1));
+}
+
+int16_t NBTReader::readShort() {
+	int16_t value;
+	std::memcpy(&value, require(sizeof(value)), sizeof(value));
+	return util::bigEndian16(value);
+}
+
+int32_t NBTReader::readInt() {
+	int32_t value;
+	std::memcpy(&value, require(sizeof(value)), sizeof(value));
+	return util::bigEndian32(value);
+}
+
+int64_t NBTReader::readLong() {
+	int64_t value;
+	std::memcpy(&value, require(sizeof(value)), sizeof(value));
+	return util::bigEndian64(value);
+}
+
+float NBTReader::readFloat() {
+	int32_t tmp = readInt();
+	float value;
+	std::memcpy(&value, &tmp, sizeof(value));
+	return value;
+}
+
+double NBTReader::readDouble() {
+	int64_t tmp = readLong();
+	double value;
+	std::memcpy(&value, &tmp, sizeof(value));
+	return value;
+}
+
+StringRef NBTReader::readString() {
+	uint16_t length = static_cast<uint16_t>(readShort());
+	const char* str = reinterpret_cast<const char*>(require(length));
+	return StringRef(str, length);
+}
+
+ByteArrayRef NBTReader::readByteArray() {
+	int32_t length = readInt();
+	if (length < 0)
+		throw NBTError("Invalid length of NBT array!");
+	return ByteArrayRef(require(length), length);
+}
+
+IntArrayRef NBTReader::readIntArray() {
+	int32_t length = readInt();
+	if (length < 0 || static_cast<size_t>(length) > (size - position) / 4)
+		throw NBTError("Invalid length of NBT array!");
+	return IntArrayRef(require(length * 4), length);
+}
+
+LongArrayRef NBTReader::readLongArray() {
+	int32_t length = readInt();
+	if (length < 0 || static_cast<size_t>(length) > (size - position) / 8)
+		throw NBTError("Invalid length of NBT array!");
+	return LongArrayRef(require(length * 8), length);
+}
+
+void NBTReader::skipPayload(int8_t type) {
+	switch (type) {
+	case TagByte::TAG_TYPE:
+		require(1);
+		break;
+	case TagShort::TAG_TYPE:
+		require(2);
+		break;
+	case TagInt::TAG_TYPE:
+	case TagFloat::TAG_TYPE:
+		require(4);
+		break;
+	case TagLong::TAG_TYPE:
+	case TagDouble::TAG_TYPE:
+		require(8);
+		break;
+	case TagByteArray::TAG_TYPE:
+		readByteArray();
+		break;
+	case TagString::TAG_TYPE:
+		readString();
+		break;
+	case TagList::TAG_TYPE: {
+		int8_t element_type;
+		int32_t length = readListHeader(element_type);
+		for (int32_t i = 0; i < length; i++)
+			skipPayload(element_type);
+		break;
+	}
+	case TagCompound::TAG_TYPE: {
+		int8_t tag_type;
+		StringRef name;
+		while (nextTag(tag_type, name))
+			skipPayload(tag_type);
+		break;
+	}
+	case TagIntArray::TAG_TYPE:
+		readIntArray();
+		break;
+	case TagLongArray::TAG_TYPE:
+		readLongArray();
+		break;
+	default:
+		throw NBTError("Unknown tag type " + util::str((int) type) + "!");
+	}
+}
+
+size_t NBTReader::tell() const {
+	return position;
+}
+
+void NBTReader::seek(size_t position) {
+	if (position > size)
+		throw NBTError("Invalid NBT position!");
+	this->position = position;
+}
+
+const uint8_t* NBTReader::getBuffer() const {
+	return data;
+}
+
+}
+}
+}
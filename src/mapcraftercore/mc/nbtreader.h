@@ -0,0 +1,190 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NBTREADER_H_
+#define NBTREADER_H_
+
+#include "nbt.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace mapcrafter {
+namespace mc {
+namespace nbt {
+
+/**
+ * A reference to a string in a NBT buffer (not null-terminated).
+ */
+struct StringRef {
+	StringRef() : data(nullptr), size(0) {}
+	StringRef(const char* data, size_t size) : data(data), size(size) {}
+
+	bool operator==(const char* other) const {
+		return std::strlen(other) == size && std::memcmp(data, other, size) == 0;
+	}
+
+	bool operator!=(const char* other) const {
+		return !(*this == other);
+	}
+
+	std::string str() const {
+		return std::string(data, size);
+	}
+
+	const char* data;
+	size_t size;
+};
+
+/**
+ * A reference to the big-endian payload of a NBT array tag in a NBT buffer.
+ * The elements are converted to the native byte order when they are accessed.
+ */
+template <typename T>
+struct ArrayRef {
+	ArrayRef() : data(nullptr), length(0) {}
+	ArrayRef(const uint8_t* data, size_t length) : data(data), length(length) {}
+
+	size_t size() const {
+		return length;
+	}
+
+	bool empty() const {
+		return length == 0;
+	}
+
+	T operator[](size_t i) const;
+
+	/**
+	 * Copies the first n elements (in the native byte order) to an array, for example
+	 * the longs of a long array as unsigned values.
+	 */
+	template <typename U>
+	void copyTo(U* out, size_t n) const {
+		for (size_t i = 0; i < n; i++)
+			out[i] = (*this)[i];
+	}
+
+	const uint8_t* data;
+	size_t length;
+};
+
+template <>
+inline int8_t ArrayRef<int8_t>::operator[](size_t i) const {
+	return static_cast<int8_t>(data[i]);
+}
+
+template <>
+inline int32_t ArrayRef<int32_t>::operator[](size_t i) const {
+	int32_t value;
+	std::memcpy(&value, data + i * sizeof(value), sizeof(value));
+	return util::bigEndian32(value);
+}
+
+template <>
+inline int64_t ArrayRef<int64_t>::operator[](size_t i) const {
+	int64_t value;
+	std::memcpy(&value, data + i * sizeof(value), sizeof(value));
+	return util::bigEndian64(value);
+}
+
+typedef ArrayRef<int8_t> ByteArrayRef;
+typedef ArrayRef<int32_t> IntArrayRef;
+typedef ArrayRef<int64_t> LongArrayRef;
+
+/**
+ * A pull-style reader for uncompressed NBT data.
+ *
+ * Other than NBTFile, this reader does not build a tree of tags. It is a cursor over
+ * the buffer: You iterate over the tags of a compound with nextTag() and then either
+ * read the payload of a tag with one of the read*() methods or skip it with
+ * skipPayload(). Strings and arrays are returned as references into the buffer, so
+ * reading does not allocate any memory and subtrees that are not needed are skipped
+ * without being parsed.
+ *
+ * The buffer must stay valid while the reader (and the references returned by it)
+ * are used. All methods throw a NBTError if the data is truncated or corrupted.
+ */
+class NBTReader {
+public:
+	NBTReader(const uint8_t* data, size_t size);
+	~NBTReader();
+
+	/**
+	 * Reads the header of the root compound. Use nextTag() afterwards to iterate over
+	 * its tags.
+	 */
+	void readRoot();
+
+	/**
+	 * Reads the header of the next tag of the current compound. Returns false if the
+	 * end of the compound is reached.
+	 */
+	bool nextTag(int8_t& type, StringRef& name);
+
+	/**
+	 * Reads the header of a list payload and returns the number of elements.
+	 * The elements must be read (or skipped) in order with the methods for the
+	 * respective element type, compound elements with nextTag().
+	 */
+	int32_t readListHeader(int8_t& element_type);
+
+	int8_t readByte();
+	int16_t readShort();
+	int32_t readInt();
+	int64_t readLong();
+	float readFloat();
+	double readDouble();
+	StringRef readString();
+	ByteArrayRef readByteArray();
+	IntArrayRef readIntArray();
+	LongArrayRef readLongArray();
+
+	/**
+	 * Skips the payload of a tag of the specified type, including all of its subtags.
+	 */
+	void skipPayload(int8_t type);
+
+	/**
+	 * Returns the current position of the cursor, which can be restored later with
+	 * seek(). This is useful if a subtree depends on tags that come after it.
+	 */
+	size_t tell() const;
+	void seek(size_t position);
+
+	/**
+	 * Returns the buffer of the NBT data, for example to access the raw data between two
+	 * positions.
+	 */
+	const uint8_t* getBuffer() const;
+
+private:
+	const uint8_t* require(size_t bytes);
+
+	const uint8_t* data;
+	size_t size, position;
+};
+
+}
+}
+}
+
+#endif /* NBTREADER_H_ */
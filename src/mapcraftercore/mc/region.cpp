@@ -50,6 +50,19 @@ bool RegionFile::readHeaders(std::ifstream& file, uint32_t chunk_offsets[1024])
 	if (!file)
 		return false;
 
+	file.seekg(0, std::ios::end);
+	size_t filesize = file.tellg();
+	file.seekg(0, std::ios::beg);
+	uint32_t header[2 * 32 * 32];
+
+	// Make only one IO operation to parse the header
+	if (filesize >= sizeof(header))
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	return readHeaders(header, filesize, chunk_offsets);
+}
+
+bool RegionFile::readHeaders(const uint32_t* header, size_t filesize,
+		uint32_t chunk_offsets[1024]) {
 	containing_chunks.clear();
 	for (int i = 0; i < 1024; i++) {
 		chunk_offsets[i] = 0;
@@ -58,25 +71,16 @@ bool RegionFile::readHeaders(std::ifstream& file, uint32_t chunk_offsets[1024])
 		chunk_data_compression[i] = 0;
 	}
 
-	file.seekg(0, std::ios::end);
-	size_t filesize = file.tellg();
-	file.seekg(0, std::ios::beg);
-	uint32_t header[2 * 32 * 32];
-
 	// make sure the region file has a header
 	if (filesize == 0) {
 		// Simply ignore the file if empty. Some chunk management tools can empty all chunks but doesn't erase the file, so simply ignore it
 		return false;
 	}
-	if (filesize < sizeof(header)) {
+	if (filesize < 2 * 32 * 32 * sizeof(uint32_t)) {
 		LOG(ERROR) << "Corrupt region '" << filename << "': Header is too short.";
 		return false;
 	}
 
-	// Make only one IO operation to parse the header
-	file.seekg(0, std::ios::beg);
-	file.read(reinterpret_cast<char*>(&header), sizeof(header));
-
 	for (int z = 0; z < 32; z++) {
 		for (int x = 0; x < 32; x++) {
 			uint32_t tmp = header[(x + z * 32)];
@@ -119,8 +123,8 @@ void RegionFile::setWorldCrop(const WorldCrop& world_crop) {
 }
 
 bool RegionFile::read() {
+	mapping.close();
 	std::ifstream file(filename.c_str(), std::ios_base::binary);
-	uint32_t chunk_offsets[1024];
 	if (!readHeaders(file, chunk_offsets))
 		return false;
 	file.seekg(0, std::ios::end);
@@ -149,7 +153,8 @@ bool RegionFile::read() {
 		}
 		size = util::bigEndian32(size) - 1;
 		uint8_t compression = regiondata[offset + 4];
-		if (filesize < offset + 5 + size) {
+		// computed with 64 bits, a corrupt size must not wrap around
+		if (filesize < (uint64_t) offset + 5 + size) {
 			LOG(ERROR) << "Corrupt region '" << filename << "': Invalid size of chunk "
 				<< x << ":" << z << ".";
 			return false;
@@ -163,6 +168,33 @@ bool RegionFile::read() {
 	return true;
 }
 
+bool RegionFile::map() {
+	mapping.close();
+	for (int i = 0; i < 1024; i++)
+		chunk_data[i].clear();
+
+	boost::system::error_code error;
+	size_t filesize = fs::file_size(filename, error);
+	if (error || filesize == 0) {
+		// the file does not exist or is empty, same as with read()
+		return false;
+	}
+
+	try {
+		mapping.open(filename);
+	} catch (const std::exception& ex) {
+		LOG(ERROR) << "Unable to map region '" << filename << "': " << ex.what();
+		return false;
+	}
+
+	if (!readHeaders(reinterpret_cast<const uint32_t*>(mapping.data()), mapping.size(),
+			chunk_offsets)) {
+		mapping.close();
+		return false;
+	}
+	return true;
+}
+
 bool RegionFile::readOnlyHeaders() {
 	std::ifstream file(filename.c_str(), std::ios_base::binary);
 	uint32_t chunk_offsets[1024];
@@ -281,29 +313,90 @@ void RegionFile::setChunkData(const ChunkPos& chunk, const std::vector<uint8_t>&
 	}
 }
 
+bool RegionFile::getCompression(uint8_t type, nbt::Compression& compression) {
+	switch (type) {
+	case 1:
+		compression = nbt::Compression::GZIP;
+		return true;
+	case 2:
+		compression = nbt::Compression::ZLIB;
+		return true;
+	case 3:
+		compression = nbt::Compression::NO_COMPRESSION;
+		return true;
+	case 4:
+		compression = nbt::Compression::LZ4;
+		return true;
+	default:
+		// chunks stored in external .mcc files (type + 128) are not supported
+		return false;
+	}
+}
+
+int RegionFile::getChunkPayload(size_t index, const uint8_t*& data, size_t& size,
+		uint8_t& compression) const {
+	// chunk data read by read() or set by setChunkData()
+	if (chunk_data[index].size() != 0) {
+		data = &chunk_data[index][0];
+		size = chunk_data[index].size();
+		compression = chunk_data_compression[index];
+		return CHUNK_OK;
+	}
+
+	if (!mapping.is_open() || !chunk_exists[index] || chunk_offsets[index] == 0)
+		return CHUNK_DOES_NOT_EXIST;
+
+	// chunk data in the mapped region file, the headers already made sure that
+	// at least the size and compression type are in the file
+	const uint8_t* chunk = reinterpret_cast<const uint8_t*>(mapping.data()) + chunk_offsets[index];
+	uint32_t chunk_size = *(reinterpret_cast<const uint32_t*>(chunk));
+	chunk_size = util::bigEndian32(chunk_size);
+	// computed with 64 bits, a corrupt size must not wrap around
+	if (chunk_size == 0 || (uint64_t) chunk_offsets[index] + 4 + chunk_size > mapping.size()) {
+		int x = index % 32;
+		int z = index / 32;
+		LOG(ERROR) << "Corrupt region '" << filename << "': Invalid size of chunk "
+			<< x << ":" << z << ".";
+		return CHUNK_DATA_INVALID;
+	}
+
+	data = chunk + 5;
+	size = chunk_size - 1;
+	compression = chunk[4];
+	return CHUNK_OK;
+}
+
+int RegionFile::getChunkPayload(const ChunkPos& chunk, const uint8_t*& data, size_t& size,
+		uint8_t& compression) const {
+	return getChunkPayload(getChunkIndex(chunk), data, size, compression);
+}
+
 /**
  * This method tries to load a chunk from the region data and returns a status.
  */
 int RegionFile::loadChunk(const ChunkPos& pos, BlockStateRegistry& block_registry, Chunk& chunk) {
 	int index = getChunkIndex(pos);
 
-	// check if the chunk exists
-	if (chunk_data[index].size() == 0)
-		return CHUNK_DOES_NOT_EXIST;
-
-	// get compression type and size of the data
-	uint8_t compression = chunk_data_compression[index];
-	nbt::Compression comp = nbt::Compression::NO_COMPRESSION;
-	if (compression == 1)
-		comp = nbt::Compression::GZIP;
-	else if (compression == 2)
-		comp = nbt::Compression::ZLIB;
-	size_t size = chunk_data[index].size();
+	// check if the chunk exists and get its data
+	const uint8_t* data;
+	size_t size;
+	uint8_t compression;
+	int status = getChunkPayload(index, data, size, compression);
+	if (status != CHUNK_OK)
+		return status;
+
+	// get compression type of the data
+	nbt::Compression comp;
+	if (!getCompression(compression, comp)) {
+		LOG(ERROR) << "Unable to read chunk at " << pos << ": Unsupported compression type "
+			<< (int) compression << ".";
+		return CHUNK_DATA_INVALID;
+	}
 
 	chunk.setWorldCrop(world_crop);
 	// try to load the chunk
 	try {
-		if (!chunk.readNBT(block_registry, reinterpret_cast<char*>(&chunk_data[index][0]), size, comp))
+		if (!chunk.readNBT(block_registry, reinterpret_cast<const char*>(data), size, comp))
 			return CHUNK_DATA_INVALID;
 	} catch (const nbt::NBTError& err) {
 		LOG(ERROR) << "Unable to read chunk at " << pos << ": " << err.what();
@@ -323,23 +416,21 @@ int RegionFile::lowestY() {
 	for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it) {
 		ChunkPos pos = *chunk_it;
 		int index = getChunkIndex(pos);
-		if (chunk_data[index].size() == 0)
+		const uint8_t* data;
+		size_t size;
+		uint8_t compression;
+		if (getChunkPayload(index, data, size, compression) != CHUNK_OK)
 			continue;
 
-		// get compression type and size of the data
-		uint8_t compression = chunk_data_compression[index];
-		nbt::Compression comp = nbt::Compression::NO_COMPRESSION;
-		if (compression == 1)
-			comp = nbt::Compression::GZIP;
-		else if (compression == 2)
-			comp = nbt::Compression::ZLIB;
+		// get compression type of the data
+		nbt::Compression comp;
+		if (!getCompression(compression, comp))
+			continue;
 
-		Chunk chunk;
-		size_t size = chunk_data[index].size();
 		nbt::NBTFile nbt;
 
 		try {
-			nbt.readNBT(reinterpret_cast<char*>(&chunk_data[index][0]), size, comp);
+			nbt.readNBT(reinterpret_cast<const char*>(data), size, comp);
 			if (!nbt.hasTag<nbt::TagInt>("yPos")) {
 				continue;
 			}
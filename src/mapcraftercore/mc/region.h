@@ -27,6 +27,7 @@
 #include <set>
 #include <string>
 #include <vector>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 namespace mapcrafter {
 namespace mc {
@@ -61,6 +62,17 @@ public:
 	 */
 	bool read();
 
+	/**
+	 * Maps the region file into memory and reads only its headers. The compressed chunk
+	 * data is not copied, loadChunk decompresses it directly from the mapped file, so
+	 * only the pages of chunks that are actually loaded are read from disk.
+	 * Returns false if the region header is corrupted.
+	 *
+	 * Use this instead of read() if you only want to load chunks. The raw chunk data is
+	 * not available with getChunkData() then.
+	 */
+	bool map();
+
 	/**
 	 * Reads only the headers (timestamps and which chunks exist) of the region file.
 	 * Returns false if the region header is corrupted (size < 8192).
@@ -106,7 +118,7 @@ public:
 
 	/**
 	 * Returns the raw (compressed) data of a specific chunk. Returns an empty array if
-	 * the chunk does not exist.
+	 * the chunk does not exist or the region file was not read with read().
 	 */
 	const std::vector<uint8_t>& getChunkData(const ChunkPos& chunk) const;
 
@@ -116,6 +128,20 @@ public:
 	 */
 	uint8_t getChunkDataCompression(const ChunkPos& chunk) const;
 
+	/**
+	 * Returns the raw (compressed) data and compression type of a specific chunk, either
+	 * from the data read with read() or from the mapped region file (see map()).
+	 * Returns one of the RegionFile::CHUNK_* status codes.
+	 */
+	int getChunkPayload(const ChunkPos& chunk, const uint8_t*& data, size_t& size,
+			uint8_t& compression) const;
+
+	/**
+	 * Converts a compression type of the region format to the NBT compression.
+	 * Returns false if the compression type is not supported.
+	 */
+	static bool getCompression(uint8_t type, nbt::Compression& compression);
+
 	/**
 	 * Sets the raw (compressed) data of a specific chunk. You also need to specify
 	 * a compression type (one byte, see specification of region format).
@@ -158,10 +184,24 @@ private:
 	uint8_t chunk_data_compression[1024];
 	std::vector<uint8_t> chunk_data[1024];
 
+	// memory mapping of the region file and offsets of the chunk data in the file
+	// (only used if the region file was read with map())
+	boost::iostreams::mapped_file_source mapping;
+	uint32_t chunk_offsets[1024];
+
 	/**
 	 * Reads the headers of a region file.
 	 */
 	bool readHeaders(std::ifstream& file, uint32_t chunk_offsets[1024]);
+	bool readHeaders(const uint32_t* header, size_t filesize, uint32_t chunk_offsets[1024]);
+
+	/**
+	 * Returns the raw (compressed) data and compression type of a chunk, either from
+	 * the data read with read() or from the mapped region file.
+	 * Returns one of the RegionFile::CHUNK_* status codes.
+	 */
+	int getChunkPayload(size_t index, const uint8_t*& data, size_t& size,
+			uint8_t& compression) const;
 
 	/**
 	 * Calculates the index (chunk_* arrays) for a specific chunks.
@@ -29,41 +29,31 @@ Block::Block()
 	  block_light(0), sky_light(mc::OUT_OF_WORLD_LIGHT), fields_set(0) {
 }
 
-WorldCache::WorldCache(mc::BlockStateRegistry& block_registry, const World& world)
-	: block_registry(block_registry), world(world) {
-	for (int i = 0; i < RSIZE; i++)
-		regioncache[i].used = false;
-	for (int i = 0; i < CSIZE; i++)
-		chunkcache[i].used = false;
+WorldCache::WorldCache(mc::BlockStateRegistry& block_registry, const World& world,
+		std::shared_ptr<ChunkCache> shared_chunks, int region_cache_size,
+		int chunk_cache_size)
+	: block_registry(block_registry), world(world),
+	  regioncache(std::max(region_cache_size, 1), 4),
+	  chunkcache(std::max(chunk_cache_size, 1), 8), shared_chunks(shared_chunks),
+	  fields(GET_ID | GET_BIOME | GET_LIGHT) {
 }
 
-const World& WorldCache::getWorld() const {
-	return world;
-}
-
-/**
- * Calculates the position of a region position in the cache.
- */
-int WorldCache::getRegionCacheIndex(const RegionPos& pos) const {
-	return (((pos.x + 4096) & RMASK) * RWIDTH + (pos.z + 4096)) & RMASK;
+void WorldCache::setFields(int fields) {
+	this->fields = fields;
 }
 
-/**
- * Calculates the position of a chunk position in the cache.
- */
-int WorldCache::getChunkCacheIndex(const ChunkPos& pos) const {
-	//                4096*32
-	return (((pos.x + 131072) & CMASK) * CWIDTH + (pos.z + 131072)) & CMASK;
+const World& WorldCache::getWorld() const {
+	return world;
 }
 
 RegionFile* WorldCache::getRegion(const RegionPos& pos) {
-	CacheEntry<RegionPos, RegionFile>& entry = regioncache[getRegionCacheIndex(pos)];
-
 	// check if region is already in cache
-	if (entry.used && entry.key == pos) {
-		//regionstats.hits++;
-		return &entry.value;
+	SetAssociativeCache<RegionPos, RegionFile>::Entry* cached = regioncache.find(pos);
+	if (cached != nullptr) {
+		regionstats.hits++;
+		return &cached->value;
 	}
+	regionstats.misses++;
 
 	// if not try to load the region
 	// but make sure we did not already try to load the region file and it was broken
@@ -71,61 +61,98 @@ RegionFile* WorldCache::getRegion(const RegionPos& pos) {
 		return nullptr;
 
 	// region does not exist, region in cache was not modified
-	if (!world.getRegion(pos, entry.value))
+	SetAssociativeCache<RegionPos, RegionFile>::Entry& entry = regioncache.getVictim(pos);
+	bool evicted = entry.used;
+	if (!world.getRegion(pos, entry.value)) {
+		regionstats.not_found++;
 		return nullptr;
+	}
+	if (evicted)
+		regionstats.evictions++;
 
-	if (!entry.value.read()) {
-		// the region is not valid, region in cache was probably modified
+	if (!entry.value.map()) {
+		// the region is not valid, region in cache was modified
 		entry.used = false;
 		// remember this region as broken and do not try to load it again
 		regions_broken.insert(pos);
+		regionstats.invalid++;
 		return nullptr;
 	}
 
 	entry.used = true;
 	entry.key = pos;
-	//regionstats.misses++;
 	return &entry.value;
 }
 
 Chunk* WorldCache::getChunk(const ChunkPos& pos) {
-	CacheEntry<ChunkPos, Chunk>& entry = chunkcache[getChunkCacheIndex(pos)];
-	// check if chunk is already in cache
-	if (entry.used && entry.key == pos) {
-		//chunkstats.hits++;
-		return &entry.value;
+	// check if chunk is already in cache (or is known to not exist)
+	SetAssociativeCache<ChunkPos, ChunkHandle>::Entry* cached = chunkcache.find(pos);
+	if (cached != nullptr) {
+		chunkstats.hits++;
+		return cached->value.get();
+	}
+	chunkstats.misses++;
+
+	// make sure we did not already try to load the chunk and it was broken
+	if (chunks_broken.count(pos))
+		return nullptr;
+
+	// every path from here on replaces the entry
+	SetAssociativeCache<ChunkPos, ChunkHandle>::Entry& entry = chunkcache.getVictim(pos);
+	if (entry.used)
+		chunkstats.evictions++;
+
+	// maybe another thread already loaded this chunk
+	if (shared_chunks) {
+		ChunkHandle chunk = shared_chunks->get(pos);
+		if (chunk) {
+			entry.used = true;
+			entry.key = pos;
+			entry.value = chunk;
+			return entry.value.get();
+		}
 	}
 
 	// if not try to get the region of the chunk from the cache
 	RegionFile* region = getRegion(pos.getRegion());
 	if (region == nullptr) {
-		//chunkstats.unavailable++;
+		chunkstats.region_not_found++;
+		entry.used = true;
+		entry.key = pos;
+		entry.value.reset();
 		return nullptr;
 	}
 
-	// then try to load the chunk
-	// but make sure we did not already try to load the chunk and it was broken
-	if (chunks_broken.count(pos))
-		return nullptr;
-
-	int status = region->loadChunk(pos, block_registry, entry.value);
-	// the chunk does not exist, chunk in cache was not modified
-	if (status == RegionFile::CHUNK_DOES_NOT_EXIST)
+	// the chunk object of this cache entry can be reused if nobody else references it,
+	// otherwise we need a new one (chunks in the shared cache must not be modified)
+	entry.used = false;
+	if (!entry.value || entry.value.use_count() != 1)
+		entry.value = std::make_shared<Chunk>();
+
+	entry.value->setFields(fields);
+	int status = region->loadChunk(pos, block_registry, *entry.value);
+	// the chunk does not exist, remember that
+	if (status == RegionFile::CHUNK_DOES_NOT_EXIST) {
+		chunkstats.not_found++;
+		entry.used = true;
+		entry.key = pos;
+		entry.value.reset();
 		return nullptr;
+	}
 
 	if (status != RegionFile::CHUNK_OK) {
-		//chunkstats.unavailable++;
-		// the chunk is not valid, chunk in cache was probably modified
-		entry.used = false;
-		// remember this chunk as broken and do not try to load it again
+		chunkstats.invalid++;
+		// the chunk is not valid, remember this chunk as broken and do not try to load
+		// it again
 		chunks_broken.insert(pos);
 		return nullptr;
 	}
 
 	entry.used = true;
 	entry.key = pos;
-	//chunkstats.misses++;
-	return &entry.value;
+	if (shared_chunks)
+		entry.value = shared_chunks->put(pos, entry.value);
+	return entry.value.get();
 }
 
 Block WorldCache::getBlock(const mc::BlockPos& pos, const mc::Chunk* chunk, int get) {
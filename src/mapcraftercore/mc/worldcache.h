@@ -21,11 +21,17 @@
 #define WORLDCACHE_H_
 
 #include "chunk.h"
+#include "chunkcache.h"
 #include "pos.h"
 #include "region.h"
 #include "world.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <set>
+#include <vector>
 
 namespace mapcrafter {
 namespace mc {
@@ -47,87 +53,180 @@ struct Block {
 	int fields_set;
 };
 
-const int GET_ID = 1;
-const int GET_BIOME = 4;
-const int GET_BLOCK_LIGHT = 8;
-const int GET_SKY_LIGHT = 16;
-const int GET_LIGHT = GET_BLOCK_LIGHT | GET_SKY_LIGHT;
-
 /**
- * Some cache statistics for debugging. Not used at the moment.
+ * Some cache statistics, they are collected by the world cache of every render thread
+ * and reported at the end of the rendering of a map rotation.
  *
  * Maybe add a set of corrupt chunks/regions to dump them at the end of the rendering.
  */
 struct CacheStats {
 	CacheStats()
-			: hits(0), misses(0), region_not_found(0), not_found(0), invalid(0) {
+			: hits(0), misses(0), evictions(0), region_not_found(0), not_found(0),
+			  invalid(0) {
+	}
+
+	CacheStats& operator+=(const CacheStats& other) {
+		hits += other.hits;
+		misses += other.misses;
+		evictions += other.evictions;
+		region_not_found += other.region_not_found;
+		not_found += other.not_found;
+		invalid += other.invalid;
+		return *this;
+	}
+
+	/**
+	 * Returns the ratio of lookups answered by the cache (0 if there were no lookups).
+	 */
+	double getHitRate() const {
+		size_t lookups = hits + misses;
+		return lookups == 0 ? 0 : (double) hits / lookups;
 	}
 
 	void print(const std::string& name) const {
 		std::cout << name << ":" << std::endl;
 		std::cout << "  hits: " << hits << std::endl
 				  << "  misses: " << misses << std::endl
+				  << "  evictions: " << evictions << std::endl
 				  << "  region_not_found: " << region_not_found << std::endl
 				  << "  not_found: " << not_found << std::endl
 				  << "  invalid: " << invalid << std::endl;
 	}
 
-	int hits;
-	int misses;
+	size_t hits;
+	size_t misses;
+	// cached entries that were replaced by others
+	size_t evictions;
 
-	int region_not_found;
-	int not_found;
-	int invalid;
+	// lookups of chunks in missing regions / of missing regions and chunks
+	size_t region_not_found;
+	size_t not_found;
+	// regions/chunks that turned out to be corrupted
+	size_t invalid;
 };
 
 /**
- * An entry in the cache with a Key and a Value type. Used with regions and chunks.
+ * A set-associative cache with a fixed number of entries, used for regions and chunks.
+ *
+ * The position of a region/chunk is hashed to a set of a few entries (ways). A position
+ * can be stored in every entry of its set, if the set is full, the least recently used
+ * entry of the set is replaced. So other than with a direct-mapped cache, two positions
+ * that map to the same set don't evict each other as long as the set has room for both.
+ *
+ * The cache does not load anything by itself: Use find() to look up a position and
+ * getVictim() to get the entry a missing position should be loaded into.
  */
 template <typename Key, typename Value>
-struct CacheEntry {
-	Key key;
-	Value value;
-	bool used;
-};
+class SetAssociativeCache {
+public:
+	struct Entry {
+		Entry() : used(false), last_used(0) {}
 
-#define RBITS 2
-#define RWIDTH (1 << RBITS)
-#define RSIZE (RWIDTH*RWIDTH)
-#define RMASK (RSIZE-1)
+		Key key;
+		Value value;
+		// whether key and value are valid
+		bool used;
+		// time of the last access (see clock), to find the least recently used entry
+		uint64_t last_used;
+	};
+
+	SetAssociativeCache(size_t capacity, size_t ways)
+		: ways(std::max((size_t) 1, std::min(ways, capacity))),
+		  sets(std::max((size_t) 1, (capacity + this->ways - 1) / this->ways)),
+		  entries(sets * this->ways), clock(0) {
+	}
 
-#define CBITS 5
-#define CWIDTH (1 << CBITS)
-#define CSIZE (CWIDTH*CWIDTH)
-#define CMASK (CSIZE-1)
+	/**
+	 * Returns the entry of a position, or nullptr if the position is not cached.
+	 */
+	Entry* find(const Key& key) {
+		Entry* set = getSet(key);
+		for (size_t i = 0; i < ways; i++)
+			if (set[i].used && set[i].key == key) {
+				set[i].last_used = ++clock;
+				return &set[i];
+			}
+		return nullptr;
+	}
+
+	/**
+	 * Returns the entry of the set of a position that should be replaced to cache it,
+	 * i.e. an unused entry or the least recently used one. The entry is not modified
+	 * except that it counts as used just now.
+	 */
+	Entry& getVictim(const Key& key) {
+		Entry* set = getSet(key);
+		Entry* victim = &set[0];
+		for (size_t i = 0; i < ways; i++) {
+			if (!set[i].used) {
+				victim = &set[i];
+				break;
+			}
+			if (set[i].last_used < victim->last_used)
+				victim = &set[i];
+		}
+		victim->last_used = ++clock;
+		return *victim;
+	}
+
+	/**
+	 * Returns the number of entries.
+	 */
+	size_t getCapacity() const {
+		return entries.size();
+	}
+
+private:
+	Entry* getSet(const Key& key) {
+		uint32_t hash = (uint32_t) key.x * 0x9e3779b1u ^ (uint32_t) key.z * 0x85ebca77u;
+		hash ^= hash >> 15;
+		// maps the hash to [0, sets) without a division
+		size_t set = ((uint64_t) hash * sets) >> 32;
+		return &entries[set * ways];
+	}
+
+	size_t ways, sets;
+	std::vector<Entry> entries;
+	uint64_t clock;
+};
+
+// default number of cached regions/chunks per world cache
+const int DEFAULT_REGION_CACHE_SIZE = 16;
+const int DEFAULT_CHUNK_CACHE_SIZE = 1024;
 
 /**
  * This is a world cache with regions and chunks.
  *
- * Every region and chunk has a fixed position in the cache. The position in the cache is
- * calculated by using the first few bits of the region/chunk coordinates. Then the
- * regions/chunks are stored with the "smaller" coordinates in a 2D-like array.
- *
- * For the regions the first 2 bits are used, this are 4x4 regions (4 = 1 << 2) in the
- * cache. The regions store only the raw region file data and are used to read the chunks
- * when necessary.
+ * Regions and chunks are stored in set-associative caches with a configurable number of
+ * entries (see SetAssociativeCache). The regions store only the raw region file data
+ * (the region files are memory mapped) and are used to read the chunks when necessary.
  *
- * For the chunks the first 5 bits are used, this are 16x16 chunk (also the size of a
- * region) in the cache.
+ * When someone is trying to access the cache, the cache checks if the requested
+ * region/chunk is already stored in its set. If not, the cache tries to load the
+ * region/chunk and puts it into a free or the least recently used entry of the set.
+ * Chunks that do not exist are cached as well, so they are not looked up in their region
+ * again and again.
  *
- * When someone is trying to access the cache, the cache calculates the position of a
- * region/chunk coordinate in the cache. Then the cache checks if there is already
- * something stored on this position and if the real coordinate of this cache entry is
- * the coordinate of the requested region/chunk. If yes, the cache returns the objects.
- * If not, the cache tries to load the chunk/region and puts it in this cache entry
- * (overwrites an already loaded region/chunk at this cache position).
+ * Optionally the world cache can use a chunk cache that is shared with other world caches
+ * (i.e. other render threads). Chunks that are not in this cache are looked up in the
+ * shared cache first and only decoded from the region file if no other thread did that
+ * already. The chunk entries of this cache hold references to the shared chunks, so a
+ * chunk returned by getChunk stays valid as long as it is in this cache.
  */
 class WorldCache {
 private:
 	mc::BlockStateRegistry& block_registry;
 	World world;
 
-	CacheEntry<RegionPos, RegionFile> regioncache[RSIZE];
-	CacheEntry<ChunkPos, Chunk> chunkcache[CSIZE];
+	SetAssociativeCache<RegionPos, RegionFile> regioncache;
+	// entries with an empty handle are chunks that do not exist
+	SetAssociativeCache<ChunkPos, ChunkHandle> chunkcache;
+
+	// chunk cache shared with other world caches, may be nullptr
+	std::shared_ptr<ChunkCache> shared_chunks;
+
+	// the fields read from the chunks (GET_* flags)
+	int fields;
 
 	// provisional set to keep track of broken regions/chunks
 	// we do not want to try to load them again and again
@@ -137,11 +236,21 @@ private:
 	CacheStats regionstats;
 	CacheStats chunkstats;
 
-	int getRegionCacheIndex(const RegionPos& pos) const;
-	int getChunkCacheIndex(const ChunkPos& pos) const;
-
 public:
-	WorldCache(mc::BlockStateRegistry& block_registry, const World& world);
+	/**
+	 * Creates a world cache, region_cache_size and chunk_cache_size are the numbers of
+	 * regions/chunks that are kept in memory.
+	 */
+	WorldCache(mc::BlockStateRegistry& block_registry, const World& world,
+			std::shared_ptr<ChunkCache> shared_chunks = std::shared_ptr<ChunkCache>(),
+			int region_cache_size = DEFAULT_REGION_CACHE_SIZE,
+			int chunk_cache_size = DEFAULT_CHUNK_CACHE_SIZE);
+
+	/**
+	 * Sets which fields of the blocks (GET_* flags) are read from the chunks, all fields
+	 * by default. Fields that are not read are not available with getBlock.
+	 */
+	void setFields(int fields);
 
 	const World& getWorld() const;
 
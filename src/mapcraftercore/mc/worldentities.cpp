@@ -234,8 +234,11 @@ void WorldEntitiesCache::update(util::IProgressHandler* progress) {
 
 			mc::nbt::NBTFile nbt;
 			const std::vector<uint8_t>& data = region.getChunkData(*chunk_it);
-			nbt.readNBT(reinterpret_cast<const char*>(&data[0]), data.size(),
-					mc::nbt::Compression::ZLIB);
+			mc::nbt::Compression compression;
+			if (data.empty() || !RegionFile::getCompression(
+					region.getChunkDataCompression(*chunk_it), compression))
+				continue;
+			nbt.readNBT(reinterpret_cast<const char*>(&data[0]), data.size(), compression);
 
 			if (!nbt.hasTag<nbt::TagList>("block_entities")) {
 				continue;
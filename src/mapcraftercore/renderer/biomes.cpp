@@ -25,9 +25,12 @@
 #include "../util.h"
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
-#include <boost/unordered_map.hpp>
-#include <boost/array.hpp>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 
 namespace mapcrafter {
@@ -94,20 +97,89 @@ RGBAPixel Biome::getColor(const mc::BlockPos& pos, const ColorMapType& color_typ
 	return color;
 }
 
-// array with all possible biomes
-// empty/unknown biomes in this array have the ID 0, Name mapcrafter:unknown
-static bool biomes_initialized = false;
-static boost::unordered_map<std::string, uint16_t> biome_names;
-static std::set<std::string> unknown_biomes;
+namespace {
 
-void Biome::initializeBiomes() {
-	if (biomes_initialized) return;
-	biomes_initialized = true;
-	// put all biomes with their IDs into the array with all possible biomes
-	for (size_t i = 0; i < BIOMES_SIZE; i++) {
-		const Biome* biome = &BIOMES[i];
-		biome_names[biome->getName()] = i;
+/**
+ * A perfect hash table of the names of the biomes in BIOMES: Every biome name has its own
+ * slot, so a lookup needs only one hash and one comparison of the name. The table is
+ * built once, the seed of the hash function is chosen so that there are no collisions.
+ */
+class BiomeNameTable {
+public:
+	BiomeNameTable() {
+		size_t size = 1;
+		while (size < BIOMES_SIZE * 4)
+			size *= 2;
+		for (seed = 0; !build(size); seed++) {
+			// try a bigger table every now and then
+			if (seed % 1000 == 999)
+				size *= 2;
+		}
+	}
+
+	/**
+	 * Returns the index of a biome in BIOMES, or -1 if there is no such biome.
+	 */
+	int find(const char* name, size_t length) const {
+		int index = slots[hash(name, length, seed) & mask];
+		if (index < 0)
+			return -1;
+		const std::string& biome_name = names[index];
+		if (biome_name.size() != length || std::memcmp(biome_name.data(), name, length) != 0)
+			return -1;
+		return index;
 	}
+
+private:
+	bool build(size_t size) {
+		mask = size - 1;
+		slots.assign(size, -1);
+		names.resize(BIOMES_SIZE);
+		for (size_t i = 0; i < BIOMES_SIZE; i++) {
+			names[i] = BIOMES[i].getName();
+			int& slot = slots[hash(names[i].data(), names[i].size(), seed) & mask];
+			// if a name appears twice, the later biome wins
+			if (slot >= 0 && names[slot] != names[i])
+				return false;
+			slot = i;
+		}
+		return true;
+	}
+
+	/**
+	 * 64 bit FNV-1a hash of the name, with the seed mixed into the initial value.
+	 */
+	static uint64_t hash(const char* name, size_t length, uint64_t seed) {
+		uint64_t hash = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+		for (size_t i = 0; i < length; i++) {
+			hash ^= (uint8_t) name[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash ^ (hash >> 32);
+	}
+
+	uint64_t seed;
+	size_t mask;
+	std::vector<int> slots;
+	std::vector<std::string> names;
+};
+
+const BiomeNameTable& getBiomeNameTable() {
+	// initialized thread-safe the first time it is used
+	static const BiomeNameTable table;
+	return table;
+}
+
+// names of unknown biomes a warning was already shown for, every thread remembers the ones
+// it has seen so it needs to lock the shared set only once per name
+std::set<std::string> unknown_biomes;
+std::mutex unknown_biomes_mutex;
+thread_local std::set<std::string> thread_unknown_biomes;
+
+}
+
+void Biome::initializeBiomes() {
+	getBiomeNameTable();
 }
 
 const Biome& Biome::getBiome(uint16_t id) {
@@ -117,13 +189,20 @@ const Biome& Biome::getBiome(uint16_t id) {
 	return BIOMES[DEFAULT_BIOME_ID];
 }
 
-uint16_t Biome::getBiomeId(std::string name) {
-	auto bit = biome_names.find(name);
-	if ( bit != biome_names.end())
-		return biome_names[name];
-	if (unknown_biomes.find(name) == unknown_biomes.end()) {
-		LOG(WARNING) << "Unknown biome " << name;
-		unknown_biomes.insert(name);
+uint16_t Biome::getBiomeId(const std::string& name) {
+	return getBiomeId(name.data(), name.size());
+}
+
+uint16_t Biome::getBiomeId(const char* name, size_t length) {
+	int index = getBiomeNameTable().find(name, length);
+	if (index >= 0)
+		return index;
+
+	std::string unknown(name, length);
+	if (thread_unknown_biomes.insert(unknown).second) {
+		std::lock_guard<std::mutex> guard(unknown_biomes_mutex);
+		if (unknown_biomes.insert(unknown).second)
+			LOG(WARNING) << "Unknown biome " << unknown;
 	}
 	return DEFAULT_BIOME_ID;
 }
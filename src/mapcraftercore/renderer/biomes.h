@@ -60,6 +60,10 @@ private:
 	static const mc::JavaSimplexGenerator SWAMP_GRASS_NOISE;
 
 public:
+	/**
+	 * Builds the lookup table of the biome names. The table is also built the first time
+	 * a biome is looked up by its name, this just makes sure it is done at a known time.
+	 */
 	static void initializeBiomes();
 
 	Biome(std::string name = "mapcrafter:unknown", double temperature = 0.5, double rainfall = 0.5,
@@ -69,7 +73,12 @@ public:
 	std::string getName() const;
 	RGBAPixel getColor(const mc::BlockPos& pos, const ColorMapType& color_type, const ColorMap& color_map) const;
 
-	static uint16_t getBiomeId(std::string name);
+	/**
+	 * Returns the ID of a biome by its name, or the ID of the default biome if the biome
+	 * is unknown. This is thread-safe.
+	 */
+	static uint16_t getBiomeId(const std::string& name);
+	static uint16_t getBiomeId(const char* name, size_t length);
 	static const Biome& getBiome(uint16_t id);
 };
 
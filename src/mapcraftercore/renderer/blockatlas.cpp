@@ -22,9 +22,31 @@
 #include "blockatlas.h"
 #include "image.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+
 namespace mapcrafter {
 namespace renderer {
 
+SpriteSheet::SpriteSheet()
+	: width(0), height(0), count(0), stride(0), base(nullptr) {
+}
+
+void SpriteSheet::reset(int width, int height, size_t count) {
+	// 16 pixels are 64 bytes, the size of a cache line
+	const size_t line = 16;
+	this->width = width;
+	this->height = height;
+	this->count = count;
+	stride = ((size_t) width * height + line - 1) / line * line;
+
+	std::vector<RGBAPixel>(count * stride + line, 0).swap(pixels);
+	uintptr_t address = reinterpret_cast<uintptr_t>(pixels.data());
+	size_t misalignment = (address % (line * sizeof(RGBAPixel))) / sizeof(RGBAPixel);
+	base = pixels.data() + (misalignment == 0 ? 0 : line - misalignment);
+}
+
 // Singleton pointer
 BlockAtlas* BlockAtlas::instance_ptr = NULL;
 
@@ -35,7 +57,7 @@ BlockAtlas* BlockAtlas::instance_ptr = NULL;
  */
 bool BlockAtlas::OpenDictionnary(fs::path path, std::string name) {
 	this->block_count = 0;
-	this->block_ptrs.clear();
+	this->blocks.reset(0, 0, 0);
 	this->shaded_blocks.clear();
 
 	fs::path info_file  = path / (name + ".txt");
@@ -90,45 +112,48 @@ bool BlockAtlas::OpenDictionnary(fs::path path, std::string name) {
 		return false;
 	}
 	this->block_count = blocks_x * blocks_y;
-	this->block_ptrs.reserve(this->block_count);
 	this->shaded_blocks.reserve(this->block_count);
-	uint32_t x = 0, y = 0;
-	while (y <= blocks_y) {
-		std::shared_ptr<RGBAImage> ptr = std::make_shared<RGBAImage>();
-		*ptr = blocks_atlas.clip(x * block_width, y * block_height, block_width, block_height);
-		this->block_ptrs.emplace_back(ptr);
-		x++;
-		if (x >= blocks_x) {
-			x = 0;
-			y++;
-		}
+
+	// copy the blocks into one contiguous sheet
+	this->blocks.reset(block_width, block_height, this->block_count + 1);
+	for (uint32_t i = 0; i < this->block_count; i++) {
+		uint32_t x = (i % blocks_x) * block_width;
+		uint32_t y = (i / blocks_x) * block_height;
+		RGBAPixel* block = this->blocks.getPixels(i);
+		for (uint32_t row = 0; row < block_height; row++)
+			std::copy(&blocks_atlas.pixel(x, y + row), &blocks_atlas.pixel(x, y + row) + block_width,
+					block + row * block_width);
 	}
 	return true;
 }
 
-std::shared_ptr<const RGBAImage> const BlockAtlas::GetImage(uint32_t idx) {
-	if (idx < 0 || idx >= this->block_count) {
+RGBAImageView BlockAtlas::GetImage(uint32_t idx) const {
+	if (idx >= this->block_count) {
 		LOG(ERROR) << "Block atlas doesn't match image index file ";
-		return this->unknown_block;
+		return this->blocks.getView(this->block_count);
 	}
-	return this->block_ptrs[idx];
+	return this->blocks.getView(idx);
+}
+
+void BlockAtlas::Clear() {
+	this->block_count = 0;
+	this->blocks.reset(block_width, block_height, 1);
+	this->shaded_blocks.clear();
 }
 
 void BlockAtlas::ShadeBlock(int idx, int uv_idx, float factor_left, float factor_right, float factor_up) {
-	if (this->shaded_blocks.find(idx) != this->shaded_blocks.end()) {
+	if (idx < 0 || (uint32_t) idx >= this->block_count
+			|| this->shaded_blocks.find(idx) != this->shaded_blocks.end()) {
 		return;
 	}
 	shaded_blocks.insert(idx);
 
-	RGBAImage&       block   = *this->block_ptrs[idx];
-	const RGBAImage& uv_mask = *this->block_ptrs[uv_idx];
-
-	assert(block.getWidth() == uv_mask.getWidth());
-	assert(block.getHeight() == uv_mask.getHeight());
+	RGBAPixel*          block   = this->blocks.getPixels(idx);
+	const RGBAImageView uv_mask = GetImage(uv_idx);
 
-	for (int x = 0; x < block.getWidth(); x++) {
-		for (int y = 0; y < block.getHeight(); y++) {
-			uint32_t& pixel    = block.pixel(x, y);
+	for (int x = 0; x < uv_mask.getWidth(); x++) {
+		for (int y = 0; y < uv_mask.getHeight(); y++) {
+			uint32_t& pixel    = block[y * uv_mask.getWidth() + x];
 			uint32_t  uv_pixel = uv_mask.pixel(x, y);
 			if (rgba_alpha(uv_pixel) == 0) {
 				continue;
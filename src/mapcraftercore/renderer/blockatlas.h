@@ -20,10 +20,12 @@
 #ifndef BLOCKATLAS_H_
 #define BLOCKATLAS_H_
 
+#include "image.h"
+
 #include <boost/filesystem.hpp>
 #include <cstdint>
-#include <memory>
 #include <unordered_set>
+#include <vector>
 
 namespace fs = boost::filesystem;
 
@@ -36,13 +38,60 @@ class BlockStateRegistry;
 
 namespace renderer {
 
-class RGBAImage;
-
 // TODO rename these maybe
 static const uint8_t FACE_LEFT_INDEX  = ((float)255.0 / 6.0) * 1;
 static const uint8_t FACE_RIGHT_INDEX = ((float)255.0 / 6.0) * 4;
 static const uint8_t FACE_UP_INDEX    = ((float)255.0 / 6.0) * 2;
 
+/**
+ * Images of the same size (sprites) stored in one contiguous block of memory.
+ *
+ * Every sprite starts at a cache line boundary and the sprites have a fixed stride, so
+ * looking up a sprite is just pointer arithmetic and neighboring sprites are neighbors in
+ * memory as well.
+ */
+class SpriteSheet {
+public:
+	SpriteSheet();
+
+	/**
+	 * Allocates memory for the specified count of (transparent) sprites.
+	 */
+	void reset(int width, int height, size_t count);
+
+	size_t size() const {
+		return count;
+	}
+
+	int getWidth() const {
+		return width;
+	}
+
+	int getHeight() const {
+		return height;
+	}
+
+	RGBAPixel* getPixels(size_t index) {
+		return base + index * stride;
+	}
+
+	const RGBAPixel* getPixels(size_t index) const {
+		return base + index * stride;
+	}
+
+	RGBAImageView getView(size_t index) const {
+		return RGBAImageView(getPixels(index), width, height);
+	}
+
+private:
+	int width, height;
+	size_t count, stride;
+
+	std::vector<RGBAPixel> pixels;
+	// first pixel of the first sprite, aligned to a cache line
+	RGBAPixel* base;
+};
+
 class BlockAtlas {
   private:
 	static BlockAtlas* instance_ptr;
@@ -58,21 +107,25 @@ class BlockAtlas {
 
 	bool OpenDictionnary(fs::path path, std::string block_file);
 
-	uint32_t const                         GetCount() { return this->block_count; };
-	std::shared_ptr<const RGBAImage> const GetImage(uint32_t idx);
+	uint32_t const GetCount() { return this->block_count; };
+	// returns a transparent image if the index is invalid
+	RGBAImageView  GetImage(uint32_t idx) const;
 
 	void ShadeBlock(int idx, int uv_idx, float factor_left, float factor_right, float factor_up);
 
+	// frees the blocks once they were copied somewhere else
+	void Clear();
+
 	uint32_t GetBlockWidth() const { return block_width; };
-	uint32_t GetBlockHeight() const { return block_width; };
+	uint32_t GetBlockHeight() const { return block_height; };
 
   private:
-	std::vector<std::shared_ptr<RGBAImage> > block_ptrs;
-	std::shared_ptr<RGBAImage>               unknown_block;
-	std::unordered_set<uint16_t>             shaded_blocks;
-	uint32_t                                 block_count;
-	uint32_t                                 block_width;
-	uint32_t                                 block_height;
+	// all blocks and an additional transparent block for invalid indexes
+	SpriteSheet                  blocks;
+	std::unordered_set<uint16_t> shaded_blocks;
+	uint32_t                     block_count;
+	uint32_t                     block_width;
+	uint32_t                     block_height;
 };
 
 }  // namespace renderer
@@ -20,11 +20,11 @@
 #include "blockimages.h"
 
 #include "biomes.h"
+#include "image/kernels.h"
 #include "../util.h"
 #include "../mc/blockstate.h"
 #include "../mc/chunk.h"
 
-#include <chrono>
 #include <map>
 #include <vector>
 
@@ -107,7 +107,7 @@ uint32_t ColorMap::getColor(float x, float y) const {
 BlockImages::~BlockImages() {
 }
 
-void blockImageTest(RGBAImage& block, const RGBAImage& uv_mask) {
+void blockImageTest(RGBAImage& block, const RGBAImageView& uv_mask) {
 	assert(block.getWidth() == uv_mask.getWidth());
 	assert(block.getHeight() == uv_mask.getHeight());
 
@@ -133,7 +133,7 @@ void blockImageTest(RGBAImage& block, const RGBAImage& uv_mask) {
 	}
 }
 
-void blockImageMultiplyExcept(RGBAImage& block, const RGBAImage& uv_mask,
+void blockImageMultiplyExcept(RGBAImage& block, const RGBAImageView& uv_mask,
 		uint8_t except_face, float factor) {
 	assert(block.getWidth() == uv_mask.getWidth());
 	assert(block.getHeight() == uv_mask.getHeight());
@@ -154,149 +154,44 @@ void blockImageMultiplyExcept(RGBAImage& block, const RGBAImage& uv_mask,
 	}
 }
 
-namespace {
-
-inline uint32_t mix(uint32_t x, uint32_t y, uint32_t a) {
-	// >> 8 = / 256, serves as approximation for division by 255
-	return ((x * (255-a)) + (y * a)) >> 8;
-}
-
-}
-
-void blockImageMultiply(RGBAImage& block, const RGBAImage& uv_mask,
+void blockImageMultiply(RGBAImage& block, const RGBAImageView& uv_mask,
 		const CornerValues& factors_left, const CornerValues& factors_right, const CornerValues& factors_up) {
 	assert(block.getWidth() == uv_mask.getWidth());
 	assert(block.getHeight() == uv_mask.getHeight());
 
-	uint32_t fl[4], fr[4], fu[4];
+	uint32_t factors[3][4];
 	for (int i = 0; i < 4; i++) {
-		fl[i] = std::min(255u, (uint32_t)(factors_left[i] * 255u));
-		fr[i] = std::min(255u, (uint32_t)(factors_right[i] * 255u));
-		fu[i] = std::min(255u, (uint32_t)(factors_up[i] * 255u));
+		factors[0][i] = std::min(255u, (uint32_t)(factors_left[i] * 255u));
+		factors[1][i] = std::min(255u, (uint32_t)(factors_right[i] * 255u));
+		factors[2][i] = std::min(255u, (uint32_t)(factors_up[i] * 255u));
 	}
+	const uint8_t faces[3] = {FACE_LEFT_INDEX, FACE_RIGHT_INDEX, FACE_UP_INDEX};
 
-
-	int n = block.getWidth() * block.getHeight();
-	for (int i = 0; i < n; i++) {
-		uint32_t& pixel = block.data[i];
-		uint32_t uv_pixel = uv_mask.data[i];
-		if (rgba_alpha(uv_pixel) == 0) {
-			continue;
-		}
-
-		//const CornerValues* vptr = nullptr;
-		uint32_t* f = nullptr;
-		uint8_t side = rgba_blue(uv_pixel);
-		if (side == FACE_LEFT_INDEX) {
-			//vptr = &factors_left;
-			f = fl;
-		} else if (side == FACE_RIGHT_INDEX) {
-			//vptr = &factors_right;
-			f = fr;
-		} else if (side == FACE_UP_INDEX) {
-			//vptr = &factors_up;
-			f = fu;
-		} else {
-			continue;
-		}
-
-		/*
-		const CornerValues& values = *vptr;
-		float u = (float) rgba_red(uv_pixel) / 255.0;
-		float v = (float) rgba_green(uv_pixel) / 255.0;
-		float ab = (1-u) * values[0] + u * values[1];
-		float cd = (1-u) * values[2] + u * values[3];
-		float x = (1-v) * ab + v * cd;
-		*/
-
-		uint32_t u = rgba_red(uv_pixel);
-		uint32_t v = rgba_green(uv_pixel);
-
-		//uint32_t ab = divide255((255-u), f[0]) + divide255(u, f[1]);
-		//uint32_t cd = divide255((255-u), f[2]) + divide255(u, f[3]);
-		//uint32_t x = divide255((255-v), ab) + divide255(v,  cd);
-
-		// jetzt sogar 34.17
-		// und mit noch mehr rgba_multiply sogar 35.28
-		uint32_t ab = mix(f[0], f[1], u); // divide255((255-u) * f[0], u * f[1]);
-		uint32_t cd = mix(f[2], f[3], u); // divide255((255-u) * f[2], u * f[3]);
-		uint32_t x = mix(ab, cd, v); // divide255((255-v) * ab, v * cd);
-
-		// OHNE BASIS
-		// 45.68
-		//pixel = rgba_multiply(pixel, 0.5);
-
-		// 34.44
-		//float x = 0.5;
-		//pixel = rgba_multiply(pixel, x, x, x);
-
-		// FLOAT ALS BASIS
-		// 25.68
-		//pixel = rgba_multiply(pixel, x, x, x);
-
-		// geht. aber vielleicht auch nicht mega viel schneller
-		//uint8_t factor = x * 255;
-		//pixel = rgba_multiply(pixel, factor, factor, factor);
-
-		// geht, 29.13
-		//int factor = x * 255;
-		//assert(factor >= 0 && factor <= 255);
-		//pixel = rgba_multiply(pixel, factor);
-
-		// INTEGER ALS BASIS
-		//assert(x >= 0 && x <= 255);
-
-		// geht, 28.93
-		//double factor = (double) x / 255;
-		//pixel = rgba_multiply(pixel, factor, factor, factor);
-
-		// geht, 28.00
-		//uint8_t factor = x;
-		//pixel = rgba_multiply(pixel, factor, factor, factor);
-
-		// geht, 29.83
-		// ohne uv-alpha check sogar 32.15
-		// ohne uv-alpha check und uint8_t 32.39
-		// ... div255 32.60
-		// ... anderes div255 32.88
-		// rgba_ inline: 33.64
-		pixel = rgba_multiply_scalar(pixel, x);
-	}
+	// the factors of the corners are interpolated with the uv coordinates of the pixels
+	getImageKernels().multiplyFaces(block.data.data(), uv_mask.data,
+			block.data.size(), faces, factors);
 }
 
 void blockImageMultiply(RGBAImage& block, uint8_t factor) {
-	int n = block.getWidth() * block.getHeight();
-	for (int i = 0; i < n; i++) {
-		block.data[i] = rgba_multiply_scalar(block.data[i], factor);
-	}
+	getImageKernels().multiplyScalar(block.data.data(), block.data.size(), factor);
 }
 
-void blockImageTint(RGBAImage& block, const RGBAImage& mask, uint32_t color) {
+void blockImageTint(RGBAImage& block, const RGBAImageView& mask, uint32_t color) {
 	assert(block.getWidth() == mask.getWidth());
 	assert(block.getHeight() == mask.getHeight());
 
-	int n = block.getWidth() * block.getHeight();
-	for (int i = 0; i < n; i++) {
-		uint32_t mask_pixel = mask.data[i];
-		if (rgba_alpha(mask_pixel)) {
-			uint32_t& pixel = block.data[i];
-			// The mask is not supposed to be transfered directly
-			// but to be blend in with block pixel
-			// This will avoid white pixels on edges of the mask
-			RGBAPixel colored_mask_pixel = rgba_multiply(mask_pixel, color);
-			blend(pixel, colored_mask_pixel);
-		}
-	}
+	// The mask is not supposed to be transfered directly
+	// but to be blend in with block pixel
+	// This will avoid white pixels on edges of the mask
+	// (transparent mask pixels stay transparent, so blending skips them)
+	std::vector<RGBAPixel> colored_mask(mask.begin(), mask.end());
+	const ImageKernels& kernels = getImageKernels();
+	kernels.tint(colored_mask.data(), colored_mask.size(), color);
+	kernels.blend(block.data.data(), colored_mask.data(), colored_mask.size());
 }
 
 void blockImageTint(RGBAImage& block, uint32_t color) {
-	int n = block.getWidth() * block.getHeight();
-	for (int i = 0; i < n; i++) {
-		uint32_t pixel = block.data[i];
-		if(rgba_alpha(pixel)) {
-			block.data[i] = rgba_multiply(pixel, color);
-		}
-	}
+	getImageKernels().tint(block.data.data(), block.data.size(), color);
 }
 
 void blockImageTintHighContrast(RGBAImage& block, uint32_t color) {
@@ -326,7 +221,7 @@ void blockImageTintHighContrast(RGBAImage& block, uint32_t color) {
 	}
 }
 
-void blockImageTintHighContrast(RGBAImage& block, const RGBAImage& mask, int face, uint32_t color) {
+void blockImageTintHighContrast(RGBAImage& block, const RGBAImageView& mask, int face, uint32_t color) {
 	assert(block.getWidth() == mask.getWidth());
 	assert(block.getHeight() == mask.getHeight());
 
@@ -347,8 +242,8 @@ void blockImageTintHighContrast(RGBAImage& block, const RGBAImage& mask, int fac
 	}
 }
 
-void blockImageBlendZBuffered(RGBAImage& block, const RGBAImage& uv_mask,
-		const RGBAImage& top, const RGBAImage& top_uv_mask) {
+void blockImageBlendZBuffered(RGBAImage& block, const RGBAImageView& uv_mask,
+		const RGBAImageView& top, const RGBAImageView& top_uv_mask) {
 	assert(block.getWidth() == uv_mask.getWidth());
 	assert(block.getHeight() == uv_mask.getHeight());
 	assert(top.getWidth() == top_uv_mask.getWidth());
@@ -380,7 +275,7 @@ void blockImageBlendZBuffered(RGBAImage& block, const RGBAImage& uv_mask,
 	}
 }
 
-void blockImageShadowEdges(RGBAImage& block, const RGBAImage& uv_mask,
+void blockImageShadowEdges(RGBAImage& block, const RGBAImageView& uv_mask,
 		uint8_t north, uint8_t south, uint8_t east, uint8_t west, uint8_t bottomleft, uint8_t bottomright) {
 	assert(block.getWidth() == uv_mask.getWidth());
 	assert(block.getHeight() == uv_mask.getHeight());
@@ -435,7 +330,7 @@ void blockImageShadowEdges(RGBAImage& block, const RGBAImage& uv_mask,
 	}
 }
 
-bool blockImageIsTransparent(const RGBAImage& block, const RGBAImage& uv_mask) {
+bool blockImageIsTransparent(const RGBAImageView& block, const RGBAImageView& uv_mask) {
 	assert(block.getWidth() == uv_mask.getWidth());
 	assert(block.getHeight() == uv_mask.getHeight());
 
@@ -456,7 +351,7 @@ bool blockImageIsTransparent(const RGBAImage& block, const RGBAImage& uv_mask) {
 	return false;
 }
 
-std::array<bool, 3> blockImageGetSideMask(const RGBAImage& uv) {
+std::array<bool, 3> blockImageGetSideMask(const RGBAImageView& uv) {
 	std::array<bool, 3> side_mask = {false, false, false};
 	uint8_t mask_indices[3] = {FACE_LEFT_INDEX, FACE_RIGHT_INDEX, FACE_UP_INDEX};
 	for (int x = 0; x < uv.getWidth(); x++) {
@@ -626,7 +521,6 @@ bool RenderedBlockImages::loadBlockImages(fs::path path, std::string view, int r
 	in.close();
 
 	prepareBlockImages();
-	//runBenchmark();
 
 	return true;
 }
@@ -681,7 +575,7 @@ const BlockImage& RenderedBlockImages::getBlockImage(uint16_t id) const {
 void RenderedBlockImages::prepareBiomeBlockImage(RGBAImage& image, const BlockImage& block, uint32_t color) {
 
 	if (block.is_masked_biome) {
-		blockImageTint(image, *block.biome_mask, color);
+		blockImageTint(image, block.biome_mask, color);
 	} else {
 		blockImageTint(image, color);
 	}
@@ -746,6 +640,19 @@ void RenderedBlockImages::prepareBlockImages() {
 				BlockAtlas::instance().ShadeBlock(bid, uv_bid, darken_left, darken_right, 1.0);
 			}
 		}
+	}
+
+	// the block images are final now, so they can be moved to their sprite sheet
+	packBlockImages();
+
+	for (uint16_t id = 0; id < block_images.size(); ++id) {
+		if (block_images[id] == nullptr) {
+			continue;
+		}
+
+		BlockImage& block = *block_images[id];
+		const mc::BlockState& block_state = block_registry.getBlockState(id);
+		std::string name = block_state.getName();
 
 		block.side_mask = blockImageGetSideMask(block.uv_image(0));
 		block.is_transparent = blockImageIsTransparent(block.image(0), solid.uv_image(0));
@@ -754,7 +661,7 @@ void RenderedBlockImages::prepareBlockImages() {
 			std::string mask_name = name + "_biome_mask";
 			uint16_t mask_id = block_registry.getBlockID(mc::BlockState::parse(mask_name, block_state.getVariantDescription()));
 			assert(block_images.size() > mask_id && block_images[mask_id] != nullptr);
-			block.biome_mask = &block_images[mask_id]->image(0);
+			block.biome_mask = block_images[mask_id]->image(0);
 		}
 
 		if (!block.lighting_specified) {
@@ -777,52 +684,41 @@ void RenderedBlockImages::prepareBlockImages() {
 	unknown_block = solid;
 }
 
-void RenderedBlockImages::runBenchmark() {
-	LOG(INFO) << "Running benchmark";
-
-	typedef std::chrono::high_resolution_clock clock_;
-	typedef std::chrono::duration<double, std::ratio<1> > second_;
-
-	uint16_t id = block_registry.getBlockID(mc::BlockState::parse("minecraft:full_water", "up=false,south=false,west=false"));
-	assert(block_images.size() > id && block_images[id] != nullptr);
-	const BlockImage& solid = *block_images[id];
-
-	// uint32_t color = rgba(0x30, 0x59, 0xad, 0xff);
-
-	CornerValues left = {1.0, 0.8, 0.5, 1.0};
-	CornerValues right = {1.0, 0.6, 0.3, 0.8};
-	CornerValues up = {0.5, 1.0, 0.6, 0.8};
-
-	std::chrono::time_point<clock_> begin = clock_::now();
-	const RGBAImage& image = solid.image(0);
-	RGBAImage solid_image(image.getHeight(), image.getWidth());
-	solid_image.simpleBlit(image,0,0);
-
-	for (size_t i = 0; i < 1000000; i++) {
-
-		// 5.841s
-		//blockImageTint(image, image, 0x30, 0x59, 0xad, 0xff);
-
-		// 3.441s
-		// 3.072s mit nicem rgba_multiply
-		// 2.876s mit alpha check als bitmaske und vergleich > 0
-		//blockImageTint(image, image, color);
-
-		// 1.597s (wenn alpha check weg!)
-		// 1.590s (sonst auch!)
-		// 1.105s mit nicem rgba_multiply
-		//blockImageTint(image, color);
+void RenderedBlockImages::packBlockImages() {
+	// every distinct pair of image and uv image gets two adjacent sprites
+	std::map<std::pair<uint32_t, uint32_t>, size_t> pairs;
+	for (auto it = block_images.begin(); it != block_images.end(); ++it) {
+		if (*it == nullptr)
+			continue;
+		const BlockImage& block = **it;
+		for (size_t i = 0; i < block.images_idx.size(); i++) {
+			auto pair = std::make_pair(block.images_idx[i], block.uv_images_idx[i]);
+			if (!pairs.count(pair))
+				pairs.insert(std::make_pair(pair, pairs.size()));
+		}
+	}
 
-		// 9.534s mit rgb_multiply_scalar
-		// 6.345s mit rgb_multiply_scalar inline
-		// 6.377s mit rgba_multiply_scalar ohne f+1
-		// 6.126s doch wenn der alpha check drin ist
-		blockImageMultiply(solid_image, solid.uv_image(0), left, right, up);
+	BlockAtlas& atlas = BlockAtlas::instance();
+	sprites.reset(block_width, block_height, pairs.size() * 2);
+	size_t pixels = (size_t) block_width * block_height;
+	for (auto it = pairs.begin(); it != pairs.end(); ++it) {
+		RGBAImageView image = atlas.GetImage(it->first.first);
+		RGBAImageView uv_image = atlas.GetImage(it->first.second);
+		std::copy(image.begin(), image.begin() + pixels, sprites.getPixels(2 * it->second));
+		std::copy(uv_image.begin(), uv_image.begin() + pixels, sprites.getPixels(2 * it->second + 1));
 	}
 
-	double elapsed = std::chrono::duration_cast<second_>(clock_::now() - begin).count();
-	LOG(INFO) << "took " << elapsed << "s";
-	exit(0);
+	for (auto it = block_images.begin(); it != block_images.end(); ++it) {
+		if (*it == nullptr)
+			continue;
+		BlockImage& block = **it;
+		for (size_t i = 0; i < block.images_idx.size(); i++) {
+			size_t index = pairs[std::make_pair(block.images_idx[i], block.uv_images_idx[i])];
+			block.images[i] = sprites.getView(2 * index);
+			block.uv_images[i] = sprites.getView(2 * index + 1);
+		}
+	}
+	atlas.Clear();
 }
 
 }
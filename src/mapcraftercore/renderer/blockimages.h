@@ -75,24 +75,24 @@ public:
 
 typedef std::array<float, 4> CornerValues;
 
-void blockImageTest(RGBAImage& block, const RGBAImage& uv_mask);
-void blockImageMultiplyExcept(RGBAImage& block, const RGBAImage& uv_mask,
+void blockImageTest(RGBAImage& block, const RGBAImageView& uv_mask);
+void blockImageMultiplyExcept(RGBAImage& block, const RGBAImageView& uv_mask,
 		uint8_t except_face, float factor);
-void blockImageMultiply(RGBAImage& block, const RGBAImage& uv_mask,
+void blockImageMultiply(RGBAImage& block, const RGBAImageView& uv_mask,
 		const CornerValues& factors_left, const CornerValues& factors_right, const CornerValues& factors_up);
 void blockImageMultiply(RGBAImage& block, uint8_t factor);
-void blockImageTint(RGBAImage& block, const RGBAImage& mask,
+void blockImageTint(RGBAImage& block, const RGBAImageView& mask,
 		uint32_t color);
 // TODO maybe this should be named something with multiply too
 void blockImageTint(RGBAImage& block, uint32_t color);
 void blockImageTintHighContrast(RGBAImage& block, uint32_t color);
-void blockImageTintHighContrast(RGBAImage& block, const RGBAImage& mask, int face, uint32_t color);
-void blockImageBlendZBuffered(RGBAImage& block, const RGBAImage& uv_mask,
-		const RGBAImage& top, const RGBAImage& top_uv_mask);
-void blockImageShadowEdges(RGBAImage& block, const RGBAImage& uv_mask,
+void blockImageTintHighContrast(RGBAImage& block, const RGBAImageView& mask, int face, uint32_t color);
+void blockImageBlendZBuffered(RGBAImage& block, const RGBAImageView& uv_mask,
+		const RGBAImageView& top, const RGBAImageView& top_uv_mask);
+void blockImageShadowEdges(RGBAImage& block, const RGBAImageView& uv_mask,
 		uint8_t north, uint8_t south, uint8_t east, uint8_t west, uint8_t bottomleft, uint8_t bottomright);
-bool blockImageIsTransparent(const RGBAImage& block, const RGBAImage& uv_mask);
-std::array<bool, 3> blockImageGetSideMask(const RGBAImage& uv);
+bool blockImageIsTransparent(const RGBAImageView& block, const RGBAImageView& uv_mask);
+std::array<bool, 3> blockImageGetSideMask(const RGBAImageView& uv);
 
 enum class LightingType {
 	NONE,
@@ -116,7 +116,7 @@ struct BlockImage {
 	bool is_masked_biome;
 	ColorMapType biome_color;
 	ColorMap biome_colormap;
-	const RGBAImage* biome_mask;
+	RGBAImageView biome_mask;
 
 	bool is_waterlogged;
 
@@ -143,19 +143,25 @@ struct BlockImage {
 		return i;
 	}
 
-	const RGBAImage& image(int32_t idx) const {
-		assert(idx<(int32_t)images_idx.size());
-		return *(BlockAtlas::instance().GetImage(images_idx[idx]));
+	const RGBAImageView& image(int32_t idx) const {
+		assert(idx<(int32_t)images.size());
+		return images[idx];
 	}
 	void image(std::vector<uint32_t>& indexes) {
 		images_idx = indexes;
+		images.clear();
+		for (size_t i = 0; i < indexes.size(); i++)
+			images.push_back(BlockAtlas::instance().GetImage(indexes[i]));
 	}
-	const RGBAImage& uv_image(int32_t idx) const {
-		assert(idx<(int32_t)images_idx.size());
-		return *(BlockAtlas::instance().GetImage(uv_images_idx[idx]));
+	const RGBAImageView& uv_image(int32_t idx) const {
+		assert(idx<(int32_t)uv_images.size());
+		return uv_images[idx];
 	}
 	void uv_image(std::vector<uint32_t>& indexes) {
 		uv_images_idx = indexes;
+		uv_images.clear();
+		for (size_t i = 0; i < indexes.size(); i++)
+			uv_images.push_back(BlockAtlas::instance().GetImage(indexes[i]));
 	}
 	void weight_image(std::vector<uint32_t>& weights, double_t factor) {
 		images_weights = std::vector<double_t>(weights.size());
@@ -166,9 +172,15 @@ struct BlockImage {
 		weight_factor = factor;
 	}
 
+	// indexes of the images of the variants in the block atlas
 	std::vector<uint32_t> images_idx;
 	std::vector<uint32_t> uv_images_idx;
 	std::vector<double_t> images_weights;
+
+	// the images of the variants, first views into the block atlas, then into the
+	// sprite sheet of the block images (see RenderedBlockImages::packBlockImages)
+	std::vector<RGBAImageView> images;
+	std::vector<RGBAImageView> uv_images;
 };
 
 class RenderedBlockImages : public BlockImages {
@@ -180,8 +192,6 @@ public:
 	//virtual RGBAImage exportBlocks() const {}
 	virtual bool isBlockTransparent(uint16_t id, uint16_t data) const { return false; };
 	virtual bool hasBlock(uint16_t id, uint16_t) const { return true; };
-	virtual const RGBAImage& getBlock(uint16_t id, uint16_t data, uint16_t extra_data = 0) const { return unknown_block.image(0); };
-	virtual RGBAImage getBiomeBlock(uint16_t id, uint16_t data, const Biome& biome, uint16_t extra_data = 0) const { return unknown_block.image(0); };
 	virtual int getMaxWaterPreblit() const { return 0; };
 	//virtual int getBlockSize() const {};
 
@@ -203,7 +213,13 @@ public:
 
 private:
 	void prepareBlockImages();
-	void runBenchmark();
+
+	/**
+	 * Copies the (already shaded) images of all blocks from the block atlas into the
+	 * sprite sheet of the block images. The image and uv image of a variant are stored
+	 * next to each other, so rendering a block touches only a few adjacent pages.
+	 */
+	void packBlockImages();
 
 	mc::BlockStateRegistry& block_registry;
 
@@ -214,6 +230,8 @@ private:
 	// Mapcrafter-local block ID -> BlockImage (image, uv_image, is_transparent, ...)
 	std::vector<BlockImage*> block_images;
 	BlockImage unknown_block;
+	// images and uv images of all blocks, pairwise next to each other
+	SpriteSheet sprites;
 };
 
 }
@@ -24,6 +24,8 @@
 #include "image.h"
 
 #include "image/dithering.h"
+#include "image/kernels.h"
+#include "image/pngencoder.h"
 #include "image/quantization.h"
 #include "image/scaling.h"
 #include "../util.h"
@@ -32,6 +34,7 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 
 namespace mapcrafter {
 namespace renderer {
@@ -148,6 +151,46 @@ void pngWriteData(png_structp pngPtr, png_bytep data, png_size_t length) {
 	((std::ostream*) a)->write((char*) data, length);
 }
 
+void pngSetOptions(png_structp png, const PNGOptions& options) {
+	png_set_compression_level(png, options.compression_level);
+	if (options.strategy != PNGStrategy::DEFAULT)
+		png_set_compression_strategy(png, getZlibStrategy(options.strategy));
+
+	if (options.filter == PNGFilter::NONE)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+	else if (options.filter == PNGFilter::SUB)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+	else if (options.filter == PNGFilter::UP)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_UP);
+	else if (options.filter == PNGFilter::AVERAGE)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_AVG);
+	else if (options.filter == PNGFilter::PAETH)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_PAETH);
+}
+
+std::ostream& operator<<(std::ostream& out, PNGFilter filter) {
+	switch (filter) {
+	case PNGFilter::ADAPTIVE: return out << "adaptive";
+	case PNGFilter::NONE: return out << "none";
+	case PNGFilter::SUB: return out << "sub";
+	case PNGFilter::UP: return out << "up";
+	case PNGFilter::AVERAGE: return out << "average";
+	case PNGFilter::PAETH: return out << "paeth";
+	default: return out << "unknown";
+	}
+}
+
+std::ostream& operator<<(std::ostream& out, PNGStrategy strategy) {
+	switch (strategy) {
+	case PNGStrategy::DEFAULT: return out << "default";
+	case PNGStrategy::FILTERED: return out << "filtered";
+	case PNGStrategy::HUFFMAN_ONLY: return out << "huffman";
+	case PNGStrategy::RLE: return out << "rle";
+	case PNGStrategy::FIXED: return out << "fixed";
+	default: return out << "unknown";
+	}
+}
+
 RGBAImage::RGBAImage(int width, int height)
 	: Image<RGBAPixel>(width, height) {
 }
@@ -190,18 +233,21 @@ void RGBAImage::simpleAlphaBlit(const RGBAImage& image, int x, int y) {
 	*/
 
 	int sx = std::max(0, -x);
-	int sy;
-	for (; sx < image.width && sx+x < width; sx++) {
-		sy = std::max(0, -y);
-		for (; sy < image.height && sy+y < height; sy++) {
-			if (rgba_alpha(image.data[sy*image.width+sx]) != 0) {
-				data[(sy+y) * width + (sx+x)] = image.data[sy * image.width + sx];
-			}
-		}
+	int sx_end = std::min(image.width, width - x);
+	if (sx >= sx_end)
+		return;
+	const ImageKernels& kernels = getImageKernels();
+	for (int sy = std::max(0, -y); sy < image.height && sy+y < height; sy++) {
+		kernels.alphaCopy(&data[(sy+y) * width + (sx+x)], &image.data[sy * image.width + sx],
+				sx_end - sx);
 	}
 }
 
 void RGBAImage::alphaBlit(const RGBAImage& image, int x, int y) {
+	alphaBlit(RGBAImageView(image), x, y);
+}
+
+void RGBAImage::alphaBlit(const RGBAImageView& image, int x, int y) {
 	if (x >= width || y >= height)
 		return;
 
@@ -218,12 +264,13 @@ void RGBAImage::alphaBlit(const RGBAImage& image, int x, int y) {
 	*/
 
 	int sx = std::max(0, -x);
-	int sy;
-	for (; sx < image.width && sx+x < width; sx++) {
-		sy = std::max(0, -y);
-		for (; sy < image.height && sy+y < height; sy++) {
-			blend(data[(sy+y) * width + (sx+x)], image.data[sy * image.width + sx]);
-		}
+	int sx_end = std::min(image.width, width - x);
+	if (sx >= sx_end)
+		return;
+	const ImageKernels& kernels = getImageKernels();
+	for (int sy = std::max(0, -y); sy < image.height && sy+y < height; sy++) {
+		kernels.blend(&data[(sy+y) * width + (sx+x)], &image.data[sy * image.width + sx],
+				sx_end - sx);
 	}
 }
 
@@ -433,7 +480,10 @@ bool RGBAImage::readPNG(const std::string& filename) {
 	if (!file) {
 		return false;
 	}
+	return readPNG(file);
+}
 
+bool RGBAImage::readPNG(std::istream& file) {
 	uint8_t png_signature[8];
 	file.read((char*) &png_signature, 8);
 	if (png_sig_cmp(png_signature, 0, 8) != 0)
@@ -509,7 +559,10 @@ bool RGBAImage::writePNG(const std::string& filename) const {
 	if (!file) {
 		return false;
 	}
+	return writePNG(file);
+}
 
+bool RGBAImage::writePNG(std::ostream& file, const PNGOptions& options) const {
 	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png == NULL)
 		return false;
@@ -526,6 +579,7 @@ bool RGBAImage::writePNG(const std::string& filename) const {
 	}
 
 	png_set_write_fn(png, (png_voidp) &file, pngWriteData, NULL);
+	pngSetOptions(png, options);
 	png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
 	        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
@@ -541,10 +595,9 @@ bool RGBAImage::writePNG(const std::string& filename) const {
 	else
 		png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
 
-	file.close();
 	png_free(png, rows);
 	png_destroy_write_struct(&png, &info);
-	return true;
+	return !file.fail();
 }
 
 namespace {
@@ -577,7 +630,11 @@ bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, b
 	if (!file) {
 		return false;
 	}
+	return writeIndexedPNG(file, palette_bits, dithered);
+}
 
+bool RGBAImage::writeIndexedPNG(std::ostream& file, int palette_bits, bool dithered,
+		const PNGOptions& options) const {
 	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png == NULL)
 		return false;
@@ -595,6 +652,7 @@ bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, b
 
 	int palette_size = 1 << palette_bits;
 	png_set_write_fn(png, (png_voidp) &file, pngWriteData, NULL);
+	pngSetOptions(png, options);
 	png_set_IHDR(png, info, width, height, palette_bits, PNG_COLOR_TYPE_PALETTE,
 			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
@@ -658,7 +716,6 @@ bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, b
 	//else
 		png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
 
-	file.close();
 	for (int y = 0; y < height; y++)
 		png_free(png, rows[y]);
 	png_free(png, rows);
@@ -666,7 +723,7 @@ bool RGBAImage::writeIndexedPNG(const std::string& filename, int palette_bits, b
 	png_free(png, palette_alpha);
 	delete octree;
 	png_destroy_write_struct(&png, &info);
-	return true;
+	return !file.fail();
 }
 
 /*
@@ -719,6 +776,19 @@ my_error_exit (j_common_ptr cinfo)
 }
 
 bool RGBAImage::readJPEG(const std::string& filename) {
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	return readJPEG(file);
+}
+
+bool RGBAImage::readJPEG(std::istream& in) {
+	// the JPEG data is decompressed from memory
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (data.empty())
+		return false;
+
 	/* This struct contains the JPEG decompression parameters and pointers to
 	 * working space (which is allocated as needed by the JPEG library).
 	 */
@@ -729,22 +799,9 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	 */
 	struct my_error_mgr jerr;
 	/* More stuff */
-	FILE * infile;		/* source file */
 	JSAMPARRAY buffer;		/* Output row buffer */
 	int row_stride;		/* physical row width in output buffer */
 
-	/* In this example we want to open the input file before doing anything else,
-	 * so that the setjmp() error recovery below can assume the file is open.
-	 * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-	 * requires it in order to read binary files.
-	 */
-
-	if ((infile = fopen(filename.c_str(), "rb")) == NULL) {
-		//fprintf(stderr, "can't open %s\n", filename.c_str());
-		//return 0;
-		return false;
-	}
-
 	/* Step 1: allocate and initialize JPEG decompression object */
 
 	/* We set up the normal JPEG error routines, then override error_exit. */
@@ -756,15 +813,14 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 		 * We need to clean up the JPEG object, close the input file, and return.
 		 */
 		jpeg_destroy_decompress(&cinfo);
-		fclose(infile);
-		return 0;
+		return false;
 	}
 	/* Now we can initialize the JPEG decompression object. */
 	jpeg_create_decompress(&cinfo);
 
 	/* Step 2: specify data source (eg, a file) */
 
-	jpeg_stdio_src(&cinfo, infile);
+	jpeg_mem_src(&cinfo, (unsigned char*) data.data(), data.size());
 
 	/* Step 3: read file parameters with jpeg_read_header() */
 
@@ -837,13 +893,6 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 	/* This is an important step since it will release a good deal of memory. */
 	jpeg_destroy_decompress(&cinfo);
 
-	/* After finish_decompress, we can close the input file.
-	 * Here we postpone it until after no more JPEG errors are possible,
-	 * so as to simplify the setjmp error logic above.	(Actually, I don't
-	 * think that jpeg_destroy can do an error exit, but why assume anything...)
-	 */
-	fclose(infile);
-
 	/* At this point you may want to check to see whether any corrupt-data
 	 * warnings occurred (test whether jerr.pub.num_warnings is nonzero).
 	 */
@@ -855,6 +904,14 @@ bool RGBAImage::readJPEG(const std::string& filename) {
 
 bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 		RGBAPixel background) const {
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	return writeJPEG(file, quality, background);
+}
+
+bool RGBAImage::writeJPEG(std::ostream& out, int quality, RGBAPixel background) const {
 
 	/* This struct contains the JPEG compression parameters and pointers to
 	 * working space (which is allocated as needed by the JPEG library).
@@ -873,7 +930,8 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	 */
 	struct jpeg_error_mgr jerr;
 	/* More stuff */
-	FILE * outfile;		/* target file */
+	unsigned char* outbuffer = NULL;	/* target buffer, allocated by libjpeg */
+	unsigned long outsize = 0;
 
 	/* Step 1: allocate and initialize JPEG compression object */
 
@@ -889,17 +947,8 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	/* Step 2: specify data destination (eg, a file) */
 	/* Note: steps 2 and 3 can be done in either order. */
 
-	/* Here we use the library-supplied code to send compressed data to a
-	 * stdio stream.	You can also write your own code to do something else.
-	 * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-	 * requires it in order to write binary files.
-	 */
-	if ((outfile = fopen(filename.c_str(), "wb")) == NULL) {
-		//fprintf(stderr, "can't open %s\n", filename.c_str());
-		//exit(1);
-		return false;
-	}
-	jpeg_stdio_dest(&cinfo, outfile);
+	/* The compressed data is written to a memory buffer and then to the stream. */
+	jpeg_mem_dest(&cinfo, &outbuffer, &outsize);
 
 	/* Step 3: set parameters for compression */
 
@@ -963,16 +1012,17 @@ bool RGBAImage::writeJPEG(const std::string& filename, int quality,
 	/* Step 6: Finish compression */
 
 	jpeg_finish_compress(&cinfo);
-	/* After finish_compress, we can close the output file. */
-	fclose(outfile);
+	/* After finish_compress, the buffer contains the compressed data. */
+	out.write(reinterpret_cast<const char*>(outbuffer), outsize);
 
 	/* Step 7: release JPEG compression object */
 
 	/* This is an important step since it will release a good deal of memory. */
 	jpeg_destroy_compress(&cinfo);
+	free(outbuffer);
 
 	/* And we're done! */
-	return true;
+	return !out.fail();
 }
 
 }
@@ -26,6 +26,7 @@
 
 #include <png.h>
 #include <cstdint>
+#include <iostream>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -152,7 +153,50 @@ enum class InterpolationType {
 	AUTO
 };
 
+/**
+ * The filter applied to the rows of PNG images before they are compressed.
+ */
+enum class PNGFilter {
+	// chooses the filter of each row with a heuristic (libpng's default)
+	ADAPTIVE,
+	NONE,
+	SUB,
+	UP,
+	AVERAGE,
+	PAETH
+};
+
+/**
+ * The zlib strategy used to compress PNG images.
+ */
+enum class PNGStrategy {
+	// the filtered strategy for filtered images, the default strategy otherwise
+	DEFAULT,
+	FILTERED,
+	HUFFMAN_ONLY,
+	RLE,
+	FIXED
+};
+
+/**
+ * How PNG images are compressed.
+ */
+struct PNGOptions {
+	PNGOptions()
+		: compression_level(6), filter(PNGFilter::ADAPTIVE), strategy(PNGStrategy::DEFAULT) {}
+
+	// zlib compression level, from 0 (no compression) to 9 (best compression)
+	int compression_level;
+	PNGFilter filter;
+	PNGStrategy strategy;
+};
+
+std::ostream& operator<<(std::ostream& out, PNGFilter filter);
+std::ostream& operator<<(std::ostream& out, PNGStrategy strategy);
+
 // TODO better documentation...
+struct RGBAImageView;
+
 class RGBAImage : public Image<RGBAPixel> {
 public:
 	RGBAImage(int width = 0, int height = 0);
@@ -174,6 +218,7 @@ public:
 	 * image with the pixels of the destination image.
 	 */
 	void alphaBlit(const RGBAImage& image, int x, int y);
+	void alphaBlit(const RGBAImageView& image, int x, int y);
 	void blendPixel(RGBAPixel color, int x, int y);
 
 	void fill(RGBAPixel color, int x1, int y1, int w, int h);
@@ -221,6 +266,61 @@ public:
 	bool readJPEG(const std::string& filename);
 	bool writeJPEG(const std::string& filename, int quality,
 			RGBAPixel background = rgba(255, 255, 255, 255)) const;
+
+	/**
+	 * The same as above, but the images are read from / written to streams, for
+	 * example to encode them in memory.
+	 */
+	bool readPNG(std::istream& in);
+	bool writePNG(std::ostream& out, const PNGOptions& options = PNGOptions()) const;
+	bool writeIndexedPNG(std::ostream& out, int palette_bits = 8, bool dithered = true,
+			const PNGOptions& options = PNGOptions()) const;
+
+	bool readJPEG(std::istream& in);
+	bool writeJPEG(std::ostream& out, int quality,
+			RGBAPixel background = rgba(255, 255, 255, 255)) const;
+};
+
+/**
+ * A read-only view of the pixels of an image that is stored somewhere else, for example
+ * of a block image in the block atlas. The view doesn't own the pixels, so the pixels
+ * must stay valid as long as the view is used.
+ */
+struct RGBAImageView {
+	RGBAImageView()
+		: data(nullptr), width(0), height(0) {}
+	RGBAImageView(const RGBAPixel* data, int width, int height)
+		: data(data), width(width), height(height) {}
+	RGBAImageView(const RGBAImage& image)
+		: data(image.data.data()), width(image.width), height(image.height) {}
+
+	int getWidth() const {
+		return width;
+	}
+
+	int getHeight() const {
+		return height;
+	}
+
+	const RGBAPixel& pixel(int x, int y) const {
+		return data[y * width + x];
+	}
+
+	size_t size() const {
+		return (size_t) width * height;
+	}
+
+	const RGBAPixel* begin() const {
+		return data;
+	}
+
+	const RGBAPixel* end() const {
+		return data + size();
+	}
+
+	const RGBAPixel* data;
+	int width;
+	int height;
 };
 
 template <typename Pixel>
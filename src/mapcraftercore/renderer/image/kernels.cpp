@@ -0,0 +1,150 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.h"
+
+#include "kernels_x86.h"
+#include "../image.h"
+#include "../../config.h"
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+void blendScalar(RGBAPixel* dest, const RGBAPixel* source, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		renderer::blend(dest[i], source[i]);
+}
+
+void alphaCopyScalar(RGBAPixel* dest, const RGBAPixel* source, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		if (rgba_alpha(source[i]) != 0)
+			dest[i] = source[i];
+}
+
+void resizeHalfScalar(RGBAPixel* dest, const RGBAPixel* row1, const RGBAPixel* row2,
+		size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		RGBAPixel p1 = row1[2 * i];
+		RGBAPixel p2 = row1[2 * i + 1];
+		RGBAPixel p3 = row2[2 * i];
+		RGBAPixel p4 = row2[2 * i + 1];
+		RGBAPixel highBits = ((p1 >> 2) & 0x3f3f3f3f) + ((p2 >> 2) & 0x3f3f3f3f) + ((p3 >> 2) & 0x3f3f3f3f) + ((p4 >> 2) & 0x3f3f3f3f);
+		RGBAPixel lowBits = (((p1 & 0x03030303) + (p2 & 0x03030303) + (p3 & 0x03030303) + (p4 & 0x03030303)) >> 2) & 0x03030303;
+		dest[i] = highBits + lowBits;
+	}
+}
+
+void multiplyScalarScalar(RGBAPixel* pixels, size_t n, uint32_t factor) {
+	for (size_t i = 0; i < n; i++)
+		pixels[i] = rgba_multiply_scalar(pixels[i], factor);
+}
+
+void tintScalar(RGBAPixel* pixels, size_t n, RGBAPixel color) {
+	for (size_t i = 0; i < n; i++)
+		if (rgba_alpha(pixels[i]))
+			pixels[i] = rgba_multiply(pixels[i], color);
+}
+
+void multiplyWithAlphaScalar(RGBAPixel* dest, const RGBAPixel* source, size_t n,
+		RGBAPixel color) {
+	for (size_t i = 0; i < n; i++)
+		dest[i] = rgba_multiply_with_alpha(source[i], color);
+}
+
+inline uint32_t mix(uint32_t x, uint32_t y, uint32_t a) {
+	// >> 8 = / 256, serves as approximation for division by 255
+	return ((x * (255-a)) + (y * a)) >> 8;
+}
+
+void multiplyFacesScalar(RGBAPixel* pixels, const RGBAPixel* uv_mask, size_t n,
+		const uint8_t faces[3], const uint32_t factors[3][4]) {
+	for (size_t i = 0; i < n; i++) {
+		uint32_t uv_pixel = uv_mask[i];
+		if (rgba_alpha(uv_pixel) == 0)
+			continue;
+
+		const uint32_t* f = nullptr;
+		uint8_t side = rgba_blue(uv_pixel);
+		if (side == faces[0])
+			f = factors[0];
+		else if (side == faces[1])
+			f = factors[1];
+		else if (side == faces[2])
+			f = factors[2];
+		else
+			continue;
+
+		uint32_t u = rgba_red(uv_pixel);
+		uint32_t v = rgba_green(uv_pixel);
+		uint32_t ab = mix(f[0], f[1], u);
+		uint32_t cd = mix(f[2], f[3], u);
+		uint32_t x = mix(ab, cd, v);
+		pixels[i] = rgba_multiply_scalar(pixels[i], x);
+	}
+}
+
+const ImageKernels& selectImageKernels() {
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return getImageKernelsAVX2();
+	if (__builtin_cpu_supports("sse4.1"))
+		return getImageKernelsSSE41();
+#endif
+	return getImageKernelsScalar();
+}
+
+}
+
+const ImageKernels& getImageKernelsScalar() {
+	static ImageKernels kernels = {
+		"scalar",
+		&blendScalar,
+		&alphaCopyScalar,
+		&resizeHalfScalar,
+		&multiplyScalarScalar,
+		&tintScalar,
+		&multiplyWithAlphaScalar,
+		&multiplyFacesScalar
+	};
+	return kernels;
+}
+
+const ImageKernels& getImageKernels() {
+	static const ImageKernels& kernels = selectImageKernels();
+	return kernels;
+}
+
+std::vector<const ImageKernels*> getSupportedImageKernels() {
+	std::vector<const ImageKernels*> kernels;
+	kernels.push_back(&getImageKernelsScalar());
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1"))
+		kernels.push_back(&getImageKernelsSSE41());
+	if (__builtin_cpu_supports("avx2"))
+		kernels.push_back(&getImageKernelsAVX2());
+#endif
+	return kernels;
+}
+
+}
+}
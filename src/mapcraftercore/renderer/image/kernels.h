@@ -0,0 +1,106 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_KERNELS_H_
+#define IMAGE_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mapcrafter {
+namespace renderer {
+
+// same as in image.h, which isn't included here because the vector kernels must not
+// instantiate any inline functions of other headers with their instruction set enabled
+typedef uint32_t RGBAPixel;
+
+/**
+ * The per-pixel loops of the image operations which run most often while rendering
+ * (alpha blending, downscaling and tinting of block images). Every kernel works on a row
+ * of n pixels.
+ *
+ * There is a scalar implementation of each kernel, which is the reference, and
+ * implementations with SSE4.1 and AVX2 on x86 if Mapcrafter was compiled with support
+ * for them. The best implementation the CPU supports is selected at runtime. All
+ * implementations produce exactly the same results.
+ */
+struct ImageKernels {
+	const char* name;
+
+	/**
+	 * Alpha blends the source pixels over the destination pixels, like blend().
+	 */
+	void (*blend)(RGBAPixel* dest, const RGBAPixel* source, size_t n);
+
+	/**
+	 * Copies all source pixels which are not completely transparent.
+	 */
+	void (*alphaCopy)(RGBAPixel* dest, const RGBAPixel* source, size_t n);
+
+	/**
+	 * Downscales two rows of 2n pixels to one row of n pixels by averaging each 2x2 block.
+	 */
+	void (*resizeHalf)(RGBAPixel* dest, const RGBAPixel* row1, const RGBAPixel* row2,
+			size_t n);
+
+	/**
+	 * Multiplies the color channels of the pixels with a factor (0-255),
+	 * like rgba_multiply_scalar().
+	 */
+	void (*multiplyScalar)(RGBAPixel* pixels, size_t n, uint32_t factor);
+
+	/**
+	 * Multiplies the color channels of the pixels which are not completely transparent
+	 * with a color, like rgba_multiply().
+	 */
+	void (*tint)(RGBAPixel* pixels, size_t n, RGBAPixel color);
+
+	/**
+	 * Multiplies all channels (including alpha) of the source pixels with a color and
+	 * writes them to the destination, like rgba_multiply_with_alpha().
+	 */
+	void (*multiplyWithAlpha)(RGBAPixel* dest, const RGBAPixel* source, size_t n,
+			RGBAPixel color);
+
+	/**
+	 * Multiplies the color channels of the pixels of a block image with factors which
+	 * are bilinearly interpolated between the four corners of the block face the pixel
+	 * belongs to (see blockImageMultiply()). The face and the position on the face come
+	 * from the uv mask of the block image. Faces are the left, right and up face in this
+	 * order, with the face indices in faces and four corner factors (0-255) each.
+	 */
+	void (*multiplyFaces)(RGBAPixel* pixels, const RGBAPixel* uv_mask, size_t n,
+			const uint8_t faces[3], const uint32_t factors[3][4]);
+};
+
+/**
+ * Returns the kernels the image operations use, the best ones the CPU supports.
+ */
+const ImageKernels& getImageKernels();
+
+/**
+ * Returns all kernel implementations the CPU supports, the scalar reference first.
+ */
+std::vector<const ImageKernels*> getSupportedImageKernels();
+
+}
+}
+
+#endif /* IMAGE_KERNELS_H_ */
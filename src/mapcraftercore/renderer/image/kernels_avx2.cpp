@@ -0,0 +1,89 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// this file is compiled with AVX2 enabled, see getImageKernels() for the CPU check
+
+#include "kernels_x86.h"
+
+#include <immintrin.h>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+/**
+ * Most AVX2 operations work on the two 128-bit halves separately, that's fine for all
+ * kernels since unpacking and packing again restores the order of the pixels.
+ */
+struct AVX2 {
+	typedef __m256i T;
+	static const size_t WIDTH = 8;
+
+	static T load(const RGBAPixel* p) { return _mm256_loadu_si256((const __m256i*) p); }
+	static void store(RGBAPixel* p, T v) { _mm256_storeu_si256((__m256i*) p, v); }
+	static T zero() { return _mm256_setzero_si256(); }
+	static T set1(uint32_t v) { return _mm256_set1_epi32(v); }
+	static T set1_16(uint16_t v) { return _mm256_set1_epi16(v); }
+
+	static T and_(T a, T b) { return _mm256_and_si256(a, b); }
+	static T or_(T a, T b) { return _mm256_or_si256(a, b); }
+	static T select(T a, T b, T mask) { return _mm256_blendv_epi8(a, b, mask); }
+
+	static T add32(T a, T b) { return _mm256_add_epi32(a, b); }
+	static T sub32(T a, T b) { return _mm256_sub_epi32(a, b); }
+	static T mullo32(T a, T b) { return _mm256_mullo_epi32(a, b); }
+	static T srli32(T a, int n) { return _mm256_srli_epi32(a, n); }
+	static T cmpeq32(T a, T b) { return _mm256_cmpeq_epi32(a, b); }
+
+	static T add16(T a, T b) { return _mm256_add_epi16(a, b); }
+	static T sub16(T a, T b) { return _mm256_sub_epi16(a, b); }
+	static T mullo16(T a, T b) { return _mm256_mullo_epi16(a, b); }
+	static T srli16(T a, int n) { return _mm256_srli_epi16(a, n); }
+
+	static T unpacklo8(T a, T b) { return _mm256_unpacklo_epi8(a, b); }
+	static T unpackhi8(T a, T b) { return _mm256_unpackhi_epi8(a, b); }
+	static T packus16(T a, T b) { return _mm256_packus_epi16(a, b); }
+	static T broadcastAlpha16(T a) {
+		return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, 0xff), 0xff);
+	}
+	static T blendAlpha16(T a, T b) { return _mm256_blend_epi16(a, b, 0x88); }
+
+	// shuffling works per half, so the 64-bit quarters have to be put in order afterwards
+	static T even(T a, T b) {
+		T shuffled = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a),
+				_mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		return _mm256_permute4x64_epi64(shuffled, _MM_SHUFFLE(3, 1, 2, 0));
+	}
+	static T odd(T a, T b) {
+		T shuffled = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a),
+				_mm256_castsi256_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+		return _mm256_permute4x64_epi64(shuffled, _MM_SHUFFLE(3, 1, 2, 0));
+	}
+};
+
+}
+
+const ImageKernels& getImageKernelsAVX2() {
+	static ImageKernels kernels = VectorKernels<AVX2>::create("avx2");
+	return kernels;
+}
+
+}
+}
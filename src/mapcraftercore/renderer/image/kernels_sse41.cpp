@@ -0,0 +1,86 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// this file is compiled with SSE4.1 enabled, see getImageKernels() for the CPU check
+
+#include "kernels_x86.h"
+
+#include <smmintrin.h>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+struct SSE41 {
+	typedef __m128i T;
+	static const size_t WIDTH = 4;
+
+	static T load(const RGBAPixel* p) { return _mm_loadu_si128((const __m128i*) p); }
+	static void store(RGBAPixel* p, T v) { _mm_storeu_si128((__m128i*) p, v); }
+	static T zero() { return _mm_setzero_si128(); }
+	static T set1(uint32_t v) { return _mm_set1_epi32(v); }
+	static T set1_16(uint16_t v) { return _mm_set1_epi16(v); }
+
+	static T and_(T a, T b) { return _mm_and_si128(a, b); }
+	static T or_(T a, T b) { return _mm_or_si128(a, b); }
+	// bytes of b where the highest bit of the mask byte is set, otherwise of a
+	static T select(T a, T b, T mask) { return _mm_blendv_epi8(a, b, mask); }
+
+	static T add32(T a, T b) { return _mm_add_epi32(a, b); }
+	static T sub32(T a, T b) { return _mm_sub_epi32(a, b); }
+	static T mullo32(T a, T b) { return _mm_mullo_epi32(a, b); }
+	static T srli32(T a, int n) { return _mm_srli_epi32(a, n); }
+	static T cmpeq32(T a, T b) { return _mm_cmpeq_epi32(a, b); }
+
+	static T add16(T a, T b) { return _mm_add_epi16(a, b); }
+	static T sub16(T a, T b) { return _mm_sub_epi16(a, b); }
+	static T mullo16(T a, T b) { return _mm_mullo_epi16(a, b); }
+	static T srli16(T a, int n) { return _mm_srli_epi16(a, n); }
+
+	static T unpacklo8(T a, T b) { return _mm_unpacklo_epi8(a, b); }
+	static T unpackhi8(T a, T b) { return _mm_unpackhi_epi8(a, b); }
+	static T packus16(T a, T b) { return _mm_packus_epi16(a, b); }
+	// the alpha lane of each pixel copied to all four lanes of the pixel
+	static T broadcastAlpha16(T a) {
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xff), 0xff);
+	}
+	// the alpha lanes of b, the color lanes of a
+	static T blendAlpha16(T a, T b) { return _mm_blend_epi16(a, b, 0x88); }
+
+	// the pixels with even / odd indices of the pixels of a and b
+	static T even(T a, T b) {
+		return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+				_MM_SHUFFLE(2, 0, 2, 0)));
+	}
+	static T odd(T a, T b) {
+		return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+				_MM_SHUFFLE(3, 1, 3, 1)));
+	}
+};
+
+}
+
+const ImageKernels& getImageKernelsSSE41() {
+	static ImageKernels kernels = VectorKernels<SSE41>::create("sse4.1");
+	return kernels;
+}
+
+}
+}
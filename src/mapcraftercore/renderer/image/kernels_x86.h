@@ -0,0 +1,250 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_KERNELS_X86_H_
+#define IMAGE_KERNELS_X86_H_
+
+#include "kernels.h"
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * The scalar reference kernels, the vector kernels use them for the remaining pixels of
+ * a row which don't fill a whole vector.
+ */
+const ImageKernels& getImageKernelsScalar();
+
+/**
+ * The kernels implemented with SSE4.1 (kernels_sse41.cpp) and AVX2 (kernels_avx2.cpp).
+ * These translation units are compiled with the respective instruction set enabled, so
+ * these kernels must only be used if the CPU supports it.
+ */
+const ImageKernels& getImageKernelsSSE41();
+const ImageKernels& getImageKernelsAVX2();
+
+/**
+ * The implementation of the kernels, generic over the vector instruction set.
+ *
+ * V is a struct with the vector type T, the number of pixels per vector WIDTH and
+ * static methods for the vector operations. 8-bit channels are widened to 16-bit lanes
+ * (unpacklo8/unpackhi8) where the computation needs more than 8 bits. All computations
+ * are exactly the ones of the scalar reference kernels.
+ */
+template <typename V>
+struct VectorKernels {
+	typedef typename V::T T;
+
+	/**
+	 * Computes ((a + 1) * b) >> 8 for the 16-bit lanes of a and b. This is how
+	 * rgba_multiply() and rgba_multiply_with_alpha() multiply two channels.
+	 */
+	static T multiply16(T a, T b) {
+		return V::srli16(V::mullo16(V::add16(a, V::set1_16(1)), b), 8);
+	}
+
+	/**
+	 * Multiplies all channels of the pixels with the channels of a color.
+	 */
+	static T multiplyChannels(T pixels, T color) {
+		T zero = V::zero();
+		T lo = multiply16(V::unpacklo8(pixels, zero), V::unpacklo8(color, zero));
+		T hi = multiply16(V::unpackhi8(pixels, zero), V::unpackhi8(color, zero));
+		return V::packus16(lo, hi);
+	}
+
+	/**
+	 * rgba_multiply_scalar() with a factor for each pixel (in 32-bit lanes).
+	 */
+	static T multiplyScalar32(T pixels, T factor) {
+		T g = V::and_(V::srli32(V::mullo32(V::add32(V::and_(pixels, V::set1(0xff00)),
+				V::set1(0x0100)), factor), 8), V::set1(0xff00));
+		T br = V::and_(V::srli32(V::mullo32(V::add32(V::and_(pixels, V::set1(0xff00ff)),
+				V::set1(0x010001)), factor), 8), V::set1(0xff00ff));
+		return V::or_(V::and_(pixels, V::set1(0xff000000)), V::or_(g, br));
+	}
+
+	/**
+	 * Blends translucent source pixels over destination pixels which are not completely
+	 * transparent (in 16-bit lanes). This is the last case of blend(), which is also
+	 * exact for opaque destination pixels (the third case).
+	 */
+	static T blend16(T source, T dest) {
+		T one = V::set1_16(1);
+		T alpha = V::broadcastAlpha16(source);
+		T sa = V::add16(alpha, one);
+		T sainv = V::sub16(V::set1_16(256), alpha);
+		T rgb = V::srli16(V::add16(V::mullo16(source, sa), V::mullo16(dest, sainv)), 8);
+		T dainv = V::sub16(V::set1_16(256), V::broadcastAlpha16(dest));
+		T newa = V::sub16(V::set1_16(255),
+				V::srli16(V::sub16(V::mullo16(sainv, dainv), one), 8));
+		return V::blendAlpha16(rgb, newa);
+	}
+
+	static void blend(RGBAPixel* dest, const RGBAPixel* source, size_t n) {
+		T zero = V::zero();
+		T alpha_mask = V::set1(0xff000000);
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH) {
+			T s = V::load(source + i);
+			T d = V::load(dest + i);
+			T sa = V::and_(s, alpha_mask);
+			T source_transparent = V::cmpeq32(sa, zero);
+			T copy_source = V::or_(V::cmpeq32(sa, alpha_mask),
+					V::cmpeq32(V::and_(d, alpha_mask), zero));
+
+			T lo = blend16(V::unpacklo8(s, zero), V::unpacklo8(d, zero));
+			T hi = blend16(V::unpackhi8(s, zero), V::unpackhi8(d, zero));
+			T result = V::packus16(lo, hi);
+			result = V::select(result, s, copy_source);
+			result = V::select(result, d, source_transparent);
+			V::store(dest + i, result);
+		}
+		getImageKernelsScalar().blend(dest + i, source + i, n - i);
+	}
+
+	static void alphaCopy(RGBAPixel* dest, const RGBAPixel* source, size_t n) {
+		T zero = V::zero();
+		T alpha_mask = V::set1(0xff000000);
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH) {
+			T s = V::load(source + i);
+			T transparent = V::cmpeq32(V::and_(s, alpha_mask), zero);
+			V::store(dest + i, V::select(s, V::load(dest + i), transparent));
+		}
+		getImageKernelsScalar().alphaCopy(dest + i, source + i, n - i);
+	}
+
+	static void resizeHalf(RGBAPixel* dest, const RGBAPixel* row1, const RGBAPixel* row2,
+			size_t n) {
+		T high_mask = V::set1(0x3f3f3f3f);
+		T low_mask = V::set1(0x03030303);
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH) {
+			T a1 = V::load(row1 + 2 * i), b1 = V::load(row1 + 2 * i + V::WIDTH);
+			T a2 = V::load(row2 + 2 * i), b2 = V::load(row2 + 2 * i + V::WIDTH);
+			T p1 = V::even(a1, b1), p2 = V::odd(a1, b1);
+			T p3 = V::even(a2, b2), p4 = V::odd(a2, b2);
+
+			T high = V::add32(
+					V::add32(V::and_(V::srli32(p1, 2), high_mask), V::and_(V::srli32(p2, 2), high_mask)),
+					V::add32(V::and_(V::srli32(p3, 2), high_mask), V::and_(V::srli32(p4, 2), high_mask)));
+			T low = V::add32(V::add32(V::and_(p1, low_mask), V::and_(p2, low_mask)),
+					V::add32(V::and_(p3, low_mask), V::and_(p4, low_mask)));
+			low = V::and_(V::srli32(low, 2), low_mask);
+			V::store(dest + i, V::add32(high, low));
+		}
+		getImageKernelsScalar().resizeHalf(dest + i, row1 + 2 * i, row2 + 2 * i, n - i);
+	}
+
+	static void multiplyScalar(RGBAPixel* pixels, size_t n, uint32_t factor) {
+		T f = V::set1(factor);
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH)
+			V::store(pixels + i, multiplyScalar32(V::load(pixels + i), f));
+		getImageKernelsScalar().multiplyScalar(pixels + i, n - i, factor);
+	}
+
+	static void tint(RGBAPixel* pixels, size_t n, RGBAPixel color) {
+		T zero = V::zero();
+		T alpha_mask = V::set1(0xff000000);
+		T c = V::set1(color);
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH) {
+			T p = V::load(pixels + i);
+			// rgba_multiply() keeps the alpha channel, transparent pixels are skipped
+			T result = V::select(multiplyChannels(p, c), p, alpha_mask);
+			result = V::select(result, p, V::cmpeq32(V::and_(p, alpha_mask), zero));
+			V::store(pixels + i, result);
+		}
+		getImageKernelsScalar().tint(pixels + i, n - i, color);
+	}
+
+	static void multiplyWithAlpha(RGBAPixel* dest, const RGBAPixel* source, size_t n,
+			RGBAPixel color) {
+		T c = V::set1(color);
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH)
+			V::store(dest + i, multiplyChannels(V::load(source + i), c));
+		getImageKernelsScalar().multiplyWithAlpha(dest + i, source + i, n - i, color);
+	}
+
+	/**
+	 * mix() of blockImageMultiply(), in 32-bit lanes.
+	 */
+	static T mix32(T x, T y, T a) {
+		return V::srli32(V::add32(V::mullo32(x, V::sub32(V::set1(255), a)),
+				V::mullo32(y, a)), 8);
+	}
+
+	static void multiplyFaces(RGBAPixel* pixels, const RGBAPixel* uv_mask, size_t n,
+			const uint8_t faces[3], const uint32_t factors[3][4]) {
+		T zero = V::zero();
+		T byte_mask = V::set1(0xff);
+		T face_left = V::set1(faces[0]), face_right = V::set1(faces[1]),
+				face_up = V::set1(faces[2]);
+		T f_left[4], f_right[4], f_up[4];
+		for (int k = 0; k < 4; k++) {
+			f_left[k] = V::set1(factors[0][k]);
+			f_right[k] = V::set1(factors[1][k]);
+			f_up[k] = V::set1(factors[2][k]);
+		}
+
+		size_t i = 0;
+		for (; i + V::WIDTH <= n; i += V::WIDTH) {
+			T uv = V::load(uv_mask + i);
+			T p = V::load(pixels + i);
+			T u = V::and_(uv, byte_mask);
+			T v = V::and_(V::srli32(uv, 8), byte_mask);
+			T side = V::and_(V::srli32(uv, 16), byte_mask);
+
+			T is_left = V::cmpeq32(side, face_left);
+			T is_right = V::cmpeq32(side, face_right);
+			T is_up = V::cmpeq32(side, face_up);
+			// pixels which are not on one of the faces are left untouched
+			T skip = V::or_(V::cmpeq32(V::srli32(uv, 24), zero),
+					V::cmpeq32(V::or_(V::or_(is_left, is_right), is_up), zero));
+
+			T f[4];
+			for (int k = 0; k < 4; k++)
+				f[k] = V::select(V::select(f_up[k], f_right[k], is_right), f_left[k], is_left);
+			T x = mix32(mix32(f[0], f[1], u), mix32(f[2], f[3], u), v);
+			V::store(pixels + i, V::select(multiplyScalar32(p, x), p, skip));
+		}
+		getImageKernelsScalar().multiplyFaces(pixels + i, uv_mask + i, n - i, faces, factors);
+	}
+
+	static ImageKernels create(const char* name) {
+		ImageKernels kernels;
+		kernels.name = name;
+		kernels.blend = &blend;
+		kernels.alphaCopy = &alphaCopy;
+		kernels.resizeHalf = &resizeHalf;
+		kernels.multiplyScalar = &multiplyScalar;
+		kernels.tint = &tint;
+		kernels.multiplyWithAlpha = &multiplyWithAlpha;
+		kernels.multiplyFaces = &multiplyFaces;
+		return kernels;
+	}
+};
+
+}
+}
+
+#endif /* IMAGE_KERNELS_X86_H_ */
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pngencoder.h"
+
+#include "../../util.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+// PNG filter types, also the index of the filtered row candidates
+const int FILTER_NONE = 0;
+const int FILTER_SUB = 1;
+const int FILTER_UP = 2;
+const int FILTER_AVERAGE = 3;
+const int FILTER_PAETH = 4;
+
+// bytes per pixel
+const int BPP = 4;
+
+void writeInt32(std::string& out, uint32_t value) {
+	out.push_back((char) (value >> 24));
+	out.push_back((char) (value >> 16));
+	out.push_back((char) (value >> 8));
+	out.push_back((char) value);
+}
+
+void writeChunk(std::string& out, const char* type, const uint8_t* data, size_t size) {
+	writeInt32(out, size);
+	size_t start = out.size();
+	out.append(type, 4);
+	out.append((const char*) data, size);
+	uLong crc = crc32(0, (const Bytef*) &out[start], 4 + size);
+	writeInt32(out, crc);
+}
+
+inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+	int p = (int) a + b - c;
+	int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	if (pb <= pc)
+		return b;
+	return c;
+}
+
+/**
+ * Filters a row with a specific filter type to out (including the filter type byte).
+ * The previous row is all zeros for the first row.
+ */
+void filterRow(int type, const uint8_t* row, const uint8_t* previous, size_t size,
+		uint8_t* out) {
+	out[0] = type;
+	out++;
+	if (type == FILTER_NONE) {
+		std::memcpy(out, row, size);
+	} else if (type == FILTER_SUB) {
+		for (size_t i = 0; i < BPP; i++)
+			out[i] = row[i];
+		for (size_t i = BPP; i < size; i++)
+			out[i] = row[i] - row[i - BPP];
+	} else if (type == FILTER_UP) {
+		for (size_t i = 0; i < size; i++)
+			out[i] = row[i] - previous[i];
+	} else if (type == FILTER_AVERAGE) {
+		for (size_t i = 0; i < BPP; i++)
+			out[i] = row[i] - (previous[i] >> 1);
+		for (size_t i = BPP; i < size; i++)
+			out[i] = row[i] - (((int) row[i - BPP] + previous[i]) >> 1);
+	} else if (type == FILTER_PAETH) {
+		for (size_t i = 0; i < BPP; i++)
+			out[i] = row[i] - previous[i];
+		for (size_t i = BPP; i < size; i++)
+			out[i] = row[i] - paeth(row[i - BPP], previous[i], previous[i - BPP]);
+	}
+}
+
+/**
+ * The heuristic of libpng to choose a filter: The sum of the filtered bytes as signed
+ * values, the smaller the better the row will probably be compressed.
+ */
+uint64_t filterCost(const uint8_t* filtered, size_t size) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < size; i++)
+		sum += std::abs((int) (int8_t) filtered[i]);
+	return sum;
+}
+
+}
+
+int getZlibStrategy(PNGStrategy strategy, bool filtered) {
+	if (strategy == PNGStrategy::FILTERED)
+		return Z_FILTERED;
+	if (strategy == PNGStrategy::HUFFMAN_ONLY)
+		return Z_HUFFMAN_ONLY;
+	if (strategy == PNGStrategy::RLE)
+		return Z_RLE;
+	if (strategy == PNGStrategy::FIXED)
+		return Z_FIXED;
+	return filtered ? Z_FILTERED : Z_DEFAULT_STRATEGY;
+}
+
+PNGEncoder::PNGEncoder()
+	: stream_initialized(false), stream_level(0), stream_strategy(0) {
+	std::memset(&stream, 0, sizeof(stream));
+}
+
+PNGEncoder::~PNGEncoder() {
+	if (stream_initialized)
+		deflateEnd(&stream);
+}
+
+bool PNGEncoder::encode(const RGBAImage& image, const PNGOptions& options,
+		std::string& out) {
+	int width = image.getWidth(), height = image.getHeight();
+	if (width <= 0 || height <= 0)
+		return false;
+
+	filter(image, options.filter);
+	int strategy = getZlibStrategy(options.strategy, options.filter != PNGFilter::NONE);
+	if (!resetStream(options.compression_level, strategy))
+		return false;
+
+	compressed.resize(deflateBound(&stream, filtered.size()));
+	stream.next_in = (Bytef*) filtered.data();
+	stream.avail_in = filtered.size();
+	stream.next_out = (Bytef*) compressed.data();
+	stream.avail_out = compressed.size();
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+		return false;
+	size_t compressed_size = compressed.size() - stream.avail_out;
+
+	// width, height, bit depth 8, color type RGBA, default compression/filter method,
+	// no interlacing
+	uint8_t ihdr[13] = {
+		(uint8_t) (width >> 24), (uint8_t) (width >> 16), (uint8_t) (width >> 8),
+		(uint8_t) width,
+		(uint8_t) (height >> 24), (uint8_t) (height >> 16), (uint8_t) (height >> 8),
+		(uint8_t) height,
+		8, 6, 0, 0, 0
+	};
+
+	out.clear();
+	out.reserve(8 + 25 + 12 + compressed_size + 12);
+	out.append("\x89PNG\r\n\x1a\n", 8);
+	writeChunk(out, "IHDR", ihdr, sizeof(ihdr));
+	writeChunk(out, "IDAT", compressed.data(), compressed_size);
+	writeChunk(out, "IEND", nullptr, 0);
+	return true;
+}
+
+bool PNGEncoder::encodeWithThreadEncoder(const RGBAImage& image,
+		const PNGOptions& options, std::string& out) {
+	static thread_local PNGEncoder encoder;
+	return encoder.encode(image, options, out);
+}
+
+void PNGEncoder::filter(const RGBAImage& image, PNGFilter filter) {
+	int width = image.getWidth(), height = image.getHeight();
+	size_t row_size = (size_t) width * BPP;
+	row.resize(row_size);
+	previous_row.assign(row_size, 0);
+	filtered.resize((row_size + 1) * height);
+
+	bool big_endian = util::isBigEndian();
+	int fixed_type = FILTER_NONE;
+	if (filter == PNGFilter::SUB)
+		fixed_type = FILTER_SUB;
+	else if (filter == PNGFilter::UP)
+		fixed_type = FILTER_UP;
+	else if (filter == PNGFilter::AVERAGE)
+		fixed_type = FILTER_AVERAGE;
+	else if (filter == PNGFilter::PAETH)
+		fixed_type = FILTER_PAETH;
+	if (filter == PNGFilter::ADAPTIVE)
+		for (int i = 0; i < 5; i++)
+			candidates[i].resize(row_size + 1);
+
+	const RGBAPixel* pixels = image.data.data();
+	for (int y = 0; y < height; y++) {
+		// the pixels of the row as R, G, B, A bytes
+		const RGBAPixel* line = pixels + (size_t) y * width;
+		if (!big_endian) {
+			std::memcpy(row.data(), line, row_size);
+		} else {
+			for (int x = 0; x < width; x++) {
+				row[x * BPP] = rgba_red(line[x]);
+				row[x * BPP + 1] = rgba_green(line[x]);
+				row[x * BPP + 2] = rgba_blue(line[x]);
+				row[x * BPP + 3] = rgba_alpha(line[x]);
+			}
+		}
+
+		uint8_t* out = &filtered[(row_size + 1) * y];
+		if (filter != PNGFilter::ADAPTIVE) {
+			filterRow(fixed_type, row.data(), previous_row.data(), row_size, out);
+		} else {
+			int best = 0;
+			uint64_t best_cost = 0;
+			for (int type = 0; type < 5; type++) {
+				filterRow(type, row.data(), previous_row.data(), row_size,
+						candidates[type].data());
+				uint64_t cost = filterCost(candidates[type].data() + 1, row_size);
+				if (type == 0 || cost < best_cost) {
+					best = type;
+					best_cost = cost;
+				}
+			}
+			std::memcpy(out, candidates[best].data(), row_size + 1);
+		}
+		row.swap(previous_row);
+	}
+}
+
+bool PNGEncoder::resetStream(int level, int strategy) {
+	if (stream_initialized && level == stream_level && strategy == stream_strategy)
+		return deflateReset(&stream) == Z_OK;
+
+	if (stream_initialized)
+		deflateEnd(&stream);
+	std::memset(&stream, 0, sizeof(stream));
+	stream_initialized = deflateInit2(&stream, level, Z_DEFLATED, 15, 8, strategy) == Z_OK;
+	stream_level = level;
+	stream_strategy = strategy;
+	return stream_initialized;
+}
+
+}
+}
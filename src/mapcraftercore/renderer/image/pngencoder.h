@@ -0,0 +1,96 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_PNGENCODER_H_
+#define IMAGE_PNGENCODER_H_
+
+#include "../image.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * Returns the zlib strategy (Z_FILTERED, Z_RLE, ...) of a PNG strategy. The default
+ * strategy depends on whether the rows are filtered.
+ */
+int getZlibStrategy(PNGStrategy strategy, bool filtered = true);
+
+/**
+ * An encoder for RGBA images to PNG images in memory, which is reused for many images.
+ *
+ * libpng allocates its structures and a new zlib stream for every image, and it calls
+ * the output function many times per image. This encoder keeps its zlib stream and its
+ * buffers for the filtered rows and the compressed data across images, and it encodes
+ * straight to a string. It writes only what's necessary for a RGBA image (IHDR, one
+ * IDAT chunk, IEND).
+ *
+ * An encoder is not thread-safe, every thread needs its own one.
+ */
+class PNGEncoder {
+public:
+	PNGEncoder();
+	~PNGEncoder();
+
+	/**
+	 * Encodes an image, the PNG data is written to the string.
+	 */
+	bool encode(const RGBAImage& image, const PNGOptions& options, std::string& out);
+
+	/**
+	 * Encodes an image with an encoder of the calling thread.
+	 */
+	static bool encodeWithThreadEncoder(const RGBAImage& image, const PNGOptions& options,
+			std::string& out);
+
+private:
+	PNGEncoder(const PNGEncoder& other);
+	PNGEncoder& operator=(const PNGEncoder& other);
+
+	/**
+	 * Filters the rows of the image to the filtered buffer, each row prefixed with its
+	 * filter type.
+	 */
+	void filter(const RGBAImage& image, PNGFilter filter);
+
+	/**
+	 * Initializes the zlib stream for the compression level and strategy, or resets it
+	 * if they didn't change.
+	 */
+	bool resetStream(int level, int strategy);
+
+	z_stream stream;
+	bool stream_initialized;
+	int stream_level, stream_strategy;
+
+	// the current/previous row as bytes, the filtered rows and the compressed data
+	std::vector<uint8_t> row, previous_row;
+	std::vector<uint8_t> filtered;
+	std::vector<uint8_t> candidates[5];
+	std::vector<uint8_t> compressed;
+};
+
+}
+}
+
+#endif /* IMAGE_PNGENCODER_H_ */
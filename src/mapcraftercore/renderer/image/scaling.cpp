@@ -1,5 +1,6 @@
 #include "scaling.h"
 
+#include "kernels.h"
 #include "../image.h"
 
 namespace mapcrafter {
@@ -74,17 +75,13 @@ void imageResizeHalf(const RGBAImage& image, RGBAImage& dest) {
 	int width = image.getWidth();
 	int height = image.getHeight();
 	dest.setSize(width / 2, height / 2);
+	if (width < 2)
+		return;
 
-	for (int x = 0; x < width - 1; x += 2) {
-		for (int y = 0; y < height - 1; y += 2) {
-			RGBAPixel p1 = image.pixel(x, y);
-			RGBAPixel p2 = image.pixel(x + 1, y);
-			RGBAPixel p3 = image.pixel(x, y + 1);
-			RGBAPixel p4 = image.pixel(x + 1, y + 1);
-			RGBAPixel highBits = ((p1 >> 2) & 0x3f3f3f3f) + ((p2 >> 2) & 0x3f3f3f3f) + ((p3 >> 2) & 0x3f3f3f3f) + ((p4 >> 2) & 0x3f3f3f3f);
-			RGBAPixel lowBits = (((p1 & 0x03030303) + (p2 & 0x03030303) + (p3 & 0x03030303) + (p4 & 0x03030303)) >> 2) & 0x03030303;
-			dest.pixel(x >> 1, y >> 1) = highBits + lowBits;
-		}
+	const ImageKernels& kernels = getImageKernels();
+	for (int y = 0; y < height - 1; y += 2) {
+		kernels.resizeHalf(&dest.pixel(0, y >> 1), &image.pixel(0, y), &image.pixel(0, y + 1),
+				width / 2);
 	}
 }
 
@@ -20,7 +20,9 @@
 #include "manager.h"
 
 #include "blockimages.h"
+#include "tilededuplicator.h"
 #include "tilerenderworker.h"
+#include "tilestorage.h"
 #include "renderview.h"
 #include "../renderer/biomes.h"
 #include "../config/loggingconfig.h"
@@ -34,6 +36,7 @@
 #include <cstring>
 #include <array>
 #include <fstream>
+#include <iomanip>
 #include <memory>
 #include <thread>
 #include <tuple>
@@ -161,7 +164,7 @@ bool RenderManager::initialize() {
 	return web_config.readConfigJS();
 }
 
-bool RenderManager::scanWorlds() {
+bool RenderManager::scanWorlds(int threads) {
 	auto config_worlds = config.getWorlds();
 	auto config_maps = config.getMaps();
 
@@ -235,10 +238,10 @@ bool RenderManager::scanWorlds() {
 		//  - the ones with completely specified x- AND z-bounds
 		if (world_config.needsWorldCentering()) {
 			TilePos tile_offset;
-			tile_set->scan(*world, true, tile_offset);
+			tile_set->scan(*world, true, tile_offset, threads);
 			web_config.setTileSetTileOffset(*tile_set_it, tile_offset);
 		} else {
-			tile_set->scan(*world);
+			tile_set->scan(*world, threads);
 		}
 
 		// key of this tile_sets_max_zoom map is a TileSetGroupID, not TileSetID as we access it
@@ -298,6 +301,14 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 	}
 
 	fs::path output_dir = config.getOutputPath(map + "/" + config::ROTATION_NAMES_SHORT[rotation]);
+	config::Color bg = config.getBackgroundColor();
+	std::shared_ptr<TileStorage> tile_storage(createTileStorage(map_config, output_dir,
+			rgba(bg.red, bg.green, bg.blue, 255)));
+	if (!tile_storage) {
+		LOG(ERROR) << "Skipping remaining rotations.";
+		return;
+	}
+
 	// get the tile set
 	TileSet* tile_set = tile_sets[map_config.getTileSet((RenderRotation::Direction)rotation)].get();
 	if (render_behaviors.getRenderBehavior(map, rotation) == RenderBehavior::AUTO) {
@@ -305,7 +316,7 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 		LOG(INFO) << "Scanning required tiles...";
 		// use the incremental check method specified in the config
 		if (map_config.useImageModificationTimes())
-			tile_set->scanRequiredByFiletimes(output_dir, map_config.getImageFormatSuffix());
+			tile_set->scanRequiredByFiletimes(*tile_storage);
 		else
 			tile_set->scanRequiredByTimestamp(web_config.getMapLastRendered(map, rotation));
 	} else {
@@ -343,6 +354,16 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 	context.tile_set = tile_set;
 	context.block_registry = &block_registry;
 	context.world = worlds[map_config.getWorld()][rotation];
+	// let the render threads share their decoded chunks if requested
+	if (threads > 1 && map_config.getSharedChunkCacheSize() > 0)
+		context.chunk_cache = std::make_shared<mc::ChunkCache>(
+				(size_t) map_config.getSharedChunkCacheSize() * 1024 * 1024);
+	context.tile_storage = tile_storage;
+	std::shared_ptr<TileDeduplicator> tile_deduplicator;
+	if (map_config.deduplicateTiles()) {
+		tile_deduplicator = std::make_shared<TileDeduplicator>();
+		tile_storage->setDeduplicator(tile_deduplicator);
+	}
 	context.initializeTileRenderer();
 
 	// update map parameters in web config
@@ -360,6 +381,31 @@ void RenderManager::renderMap(const std::string& map, RenderRotation::Direction
 
 	// do the dance
 	dispatcher->dispatch(context, progress);
+	if (!tile_storage->flush())
+		LOG(ERROR) << "Unable to write the rendered tiles.";
+
+	const mc::CacheStats& region_stats = dispatcher->getRegionCacheStats();
+	const mc::CacheStats& chunk_stats = dispatcher->getChunkCacheStats();
+	LOG(INFO) << "World cache: " << std::fixed << std::setprecision(1)
+		<< chunk_stats.getHitRate() * 100 << "% chunk hits (" << chunk_stats.hits
+		<< " hits, " << chunk_stats.misses << " misses, " << chunk_stats.evictions
+		<< " evictions), " << region_stats.getHitRate() * 100 << "% region hits ("
+		<< region_stats.hits << " hits, " << region_stats.misses << " misses, "
+		<< region_stats.evictions << " evictions).";
+	if (chunk_stats.invalid > 0 || region_stats.invalid > 0)
+		LOG(WARNING) << "Skipped " << chunk_stats.invalid << " invalid chunks and "
+			<< region_stats.invalid << " invalid regions.";
+
+	if (context.chunk_cache) {
+		mc::ChunkCache& chunk_cache = *context.chunk_cache;
+		LOG(DEBUG) << "Shared chunk cache: " << chunk_cache.getHits() << " hits, "
+			<< chunk_cache.getMisses() << " misses, " << chunk_cache.getEvictions()
+			<< " evictions, " << chunk_cache.getUsedBytes() / 1024 / 1024 << " of "
+			<< chunk_cache.getMaxBytes() / 1024 / 1024 << " MiB used.";
+	}
+	if (tile_deduplicator)
+		LOG(INFO) << "Reused the images of other tiles for "
+			<< tile_deduplicator->getLinkedTiles() << " tiles.";
 
 	// update the map settings with last render time
 	web_config.setMapLastRendered(map, rotation, time_started_scanning);
@@ -371,7 +417,7 @@ bool RenderManager::run(int threads, bool batch) {
 		return false;
 
 	LOG(INFO) << "Scanning worlds...";
-	if (!scanWorlds())
+	if (!scanWorlds(threads))
 		return false;
 
 	int progress_maps = 0;
@@ -531,12 +577,18 @@ void RenderManager::initializeMap(const std::string& map) {
 		LOG(INFO) << "I will move some files around...";
 
 		// if zoom level has increased, increase zoom levels of tile sets
+		config::Color bg = config.getBackgroundColor();
 		auto rotations = map_config.getRotations();
 		for (auto rotation_it = rotations.begin(); rotation_it != rotations.end(); ++rotation_it) {
 			fs::path output_dir = config.getOutputPath(map + "/"
 					+ config::ROTATION_NAMES_SHORT[*rotation_it]);
+			std::unique_ptr<TileStorage> tile_storage(createTileStorage(map_config,
+					output_dir, rgba(bg.red, bg.green, bg.blue, 255)));
+			if (!tile_storage)
+				continue;
 			for (int i = old_max_zoom; i < max_zoom; i++)
-				increaseMaxZoom(output_dir, map_config.getImageFormatSuffix());
+				increaseMaxZoom(*tile_storage);
+			tile_storage->flush();
 		}
 	}
 
@@ -550,67 +602,24 @@ void RenderManager::initializeMap(const std::string& map) {
  * This method increases the max zoom of a rendered map and makes the necessary changes
  * on the tile tree.
  */
-void RenderManager::increaseMaxZoom(const fs::path& dir,
-		std::string image_format, int jpeg_quality) const {
-	// find out tile size by reading old base.png image
+void RenderManager::increaseMaxZoom(TileStorage& tile_storage) const {
+	// find out tile size by reading old base image
 	RGBAImage old_base;
-	if (image_format == "png") {
-		old_base.readPNG((dir / "base.png").string());
-	} else {
-		old_base.readJPEG((dir / "base.jpg").string());
-	}
+	tile_storage.readTile(TilePath(), old_base);
 	int w = old_base.getWidth();
 	int h = old_base.getHeight();
 
-	if (fs::exists(dir / "1")) {
-		// at first rename the directories 1 2 3 4 (zoom level 0) and make new directories
-		util::moveFile(dir / "1", dir / "1_");
-		fs::create_directories(dir / "1");
-		// then move the old tile trees one zoom level deeper
-		util::moveFile(dir / "1_", dir / "1/4");
-		// also move the images of the directories
-		util::moveFile(dir / (std::string("1.") + image_format),
-				dir / (std::string("1/4.") + image_format));
-	}
-
-	// do the same for the other directories
-	if (fs::exists(dir / "2")) {
-		util::moveFile(dir / "2", dir / "2_");
-		fs::create_directories(dir / "2");
-		util::moveFile(dir / "2_", dir / "2/3");
-		util::moveFile(dir / (std::string("2.") + image_format),
-				dir / (std::string("2/3.") + image_format));
-	}
-
-	if (fs::exists(dir / "3")) {
-		util::moveFile(dir / "3", dir / "3_");
-		fs::create_directories(dir / "3");
-		util::moveFile(dir / "3_", dir / "3/2");
-		util::moveFile(dir / (std::string("3.") + image_format),
-				dir / (std::string("3/2.") + image_format));
-	}
-
-	if (fs::exists(dir / "4")) {
-		util::moveFile(dir / "4", dir / "4_");
-		fs::create_directories(dir / "4");
-		util::moveFile(dir / "4_", dir / "4/1");
-		util::moveFile(dir / (std::string("4.") + image_format),
-				dir / (std::string("4/1.") + image_format));
-	}
+	// move the old tile trees (zoom level 1) one zoom level deeper:
+	// 1 -> 1/4, 2 -> 2/3, 3 -> 3/2, 4 -> 4/1
+	for (int i = 1; i <= 4; i++)
+		tile_storage.moveTiles(TilePath() + i, TilePath() + i + (5 - i));
 
 	// now read the images, which belong to the new directories
 	RGBAImage img1, img2, img3, img4;
-	if (image_format == "png") {
-		img1.readPNG((dir / "1/4.png").string());
-		img2.readPNG((dir / "2/3.png").string());
-		img3.readPNG((dir / "3/2.png").string());
-		img4.readPNG((dir / "4/1.png").string());
-	} else {
-		img1.readJPEG((dir / "1/4.jpg").string());
-		img2.readJPEG((dir / "2/3.jpg").string());
-		img3.readJPEG((dir / "3/2.jpg").string());
-		img4.readJPEG((dir / "4/1.jpg").string());
-	}
+	tile_storage.readTile(TilePath() + 1 + 4, img1);
+	tile_storage.readTile(TilePath() + 2 + 3, img2);
+	tile_storage.readTile(TilePath() + 3 + 2, img3);
+	tile_storage.readTile(TilePath() + 4 + 1, img4);
 
 	// create images for the new directories
 	RGBAImage new1(w, h), new2(w, h), new3(w, h), new4(w, h);
@@ -627,30 +636,20 @@ void RenderManager::increaseMaxZoom(const fs::path& dir,
 	new3.simpleAlphaBlit(old3, w/2, 0);
 	new4.simpleAlphaBlit(old4, 0, 0);
 
-	// now save the new images in the output directory
-	if (image_format == "png") {
-		new1.writePNG((dir / "1.png").string());
-		new2.writePNG((dir / "2.png").string());
-		new3.writePNG((dir / "3.png").string());
-		new4.writePNG((dir / "4.png").string());
-	} else {
-		new1.writeJPEG((dir / "1.jpg").string(), jpeg_quality);
-		new2.writeJPEG((dir / "2.jpg").string(), jpeg_quality);
-		new3.writeJPEG((dir / "3.jpg").string(), jpeg_quality);
-		new4.writeJPEG((dir / "4.jpg").string(), jpeg_quality);
-	}
+	// now save the new images
+	tile_storage.writeTile(TilePath() + 1, new1);
+	tile_storage.writeTile(TilePath() + 2, new2);
+	tile_storage.writeTile(TilePath() + 3, new3);
+	tile_storage.writeTile(TilePath() + 4, new4);
 
-	// don't forget the base.png
+	// don't forget the base image
 	RGBAImage base(2*h, 2*h);
 	base.simpleAlphaBlit(new1, 0, 0);
 	base.simpleAlphaBlit(new2, w, 0);
 	base.simpleAlphaBlit(new3, 0, h);
 	base.simpleAlphaBlit(new4, w, h);
 	base = base.resize(0, 0, InterpolationType::HALF);
-	if (image_format == "png")
-		base.writePNG((dir / "base.png").string());
-	else
-		base.writeJPEG((dir / "base.jpg").string(), jpeg_quality);
+	tile_storage.writeTile(TilePath(), base);
 }
 
 }
@@ -43,6 +43,8 @@ class IProgressHandler;
 
 namespace renderer {
 
+class TileStorage;
+
 /**
  * This are the render options from the command line.
  */
@@ -132,12 +134,13 @@ public:
 	bool initialize();
 
 	/**
-	 * Scans the worlds and create the tile sets.
+	 * Scans the worlds and create the tile sets. The region files of a world are
+	 * scanned with the specified count of threads.
 	 *
 	 * Returns false if a fatal error occured (for example unable to read a world)
 	 * and rendering the maps won't work.
 	 */
-	bool scanWorlds();
+	bool scanWorlds(int threads = 1);
 
 	/**
 	 * Renders a map/rotation with a specified count of threads and logs the progress to
@@ -192,10 +195,9 @@ private:
 	void initializeMap(const std::string& map);
 
 	/**
-	 * Increases the max zoom level of a map (given as directory, the one with base.png).
+	 * Increases the max zoom level of a map (given as the tile storage of a rotation).
 	 */
-	void increaseMaxZoom(const fs::path& dir, std::string image_format,
-			int jpeg_quality = 85) const;
+	void increaseMaxZoom(TileStorage& tile_storage) const;
 
 	config::MapcrafterConfig config;
 	config::WebConfig web_config;
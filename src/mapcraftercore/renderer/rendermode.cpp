@@ -94,6 +94,20 @@ void MultiplexingRenderMode::draw(RGBAImage& image, const BlockImage& block_imag
 		(*it)->draw(image, block_image, pos, id, rotation);
 }
 
+bool MultiplexingRenderMode::isDrawingBlocks() const {
+	for (auto it = render_modes.begin(); it != render_modes.end(); ++it)
+		if ((*it)->isDrawingBlocks())
+			return true;
+	return false;
+}
+
+int MultiplexingRenderMode::getRequiredFields() const {
+	int fields = 0;
+	for (auto it = render_modes.begin(); it != render_modes.end(); ++it)
+		fields |= (*it)->getRequiredFields();
+	return fields;
+}
+
 std::ostream& operator<<(std::ostream& out, RenderModeType render_mode) {
 	switch (render_mode) {
 	case RenderModeType::PLAIN: return out << "plain";
@@ -79,6 +79,18 @@ public:
 	 */
 	virtual void draw(RGBAImage& image, const BlockImage& block_image,
 			const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation) {}
+
+	/**
+	 * Returns whether draw() modifies block images at all. If not, the tile renderer
+	 * can draw the block images directly from the block atlas without copying them.
+	 */
+	virtual bool isDrawingBlocks() const { return false; }
+
+	/**
+	 * Returns which fields of blocks (mc::GET_* flags) the render mode needs besides the
+	 * block IDs and biomes, only these fields are read from the chunks.
+	 */
+	virtual int getRequiredFields() const { return 0; }
 };
 
 /**
@@ -142,6 +154,16 @@ public:
 	 */
 	virtual void draw(RGBAImage& image, const BlockImage& block_image, const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation);
 
+	/**
+	 * Returns true if one of the render modes draws blocks.
+	 */
+	virtual bool isDrawingBlocks() const;
+
+	/**
+	 * Returns the fields required by any of the render modes.
+	 */
+	virtual int getRequiredFields() const;
+
 protected:
 	std::vector<RenderMode*> render_modes;
 };
@@ -36,6 +36,7 @@ public:
 	virtual ~CaveRenderMode();
 
 	virtual bool isHidden(const mc::BlockPos& pos, const BlockImage& block_image);
+	virtual int getRequiredFields() const { return mc::GET_SKY_LIGHT; }
 
 protected:
 	// we want to hide some additional cave blocks to be able to look "inside" the caves,
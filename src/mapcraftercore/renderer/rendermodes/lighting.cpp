@@ -25,6 +25,7 @@
 #include "../../mc/pos.h"
 #include "../../util.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace mapcrafter {
@@ -126,48 +127,87 @@ LightingData LightingData::estimate(const mc::Block& block,
 	return LightingData(block_light, sky_light);
 }
 
+const int LightingVolume::SIZE;
+const uint8_t LightingVolume::MASK_LIGHT_LEVEL;
+const uint8_t LightingVolume::FLAG_TRANSPARENT;
+const uint8_t LightingVolume::FLAG_WATERLOGGED;
+const uint8_t LightingVolume::FLAG_FAULTY_LIGHTING;
+const uint8_t LightingVolume::FLAG_UNKNOWN;
+
+namespace {
+
+// number of cached lighting volumes (18^3 bytes each) per render mode and thread,
+// sections of the same chunk end up in the same set of the cache
+const size_t LIGHTING_VOLUMES = 256;
+const size_t LIGHTING_VOLUMES_WAYS = 8;
+
+CornerOffsets getCornerOffsets(const CornerNeighbors& corner) {
+	CornerOffsets offsets = {{
+		LightingVolume::getOffset(corner.pos1),
+		LightingVolume::getOffset(corner.pos2),
+		LightingVolume::getOffset(corner.pos3),
+		LightingVolume::getOffset(corner.pos4),
+	}};
+	return offsets;
+}
+
+FaceCornerOffsets getFaceCornerOffsets(const FaceCorners& corners) {
+	FaceCornerOffsets offsets = {{
+		getCornerOffsets(corners.corner1),
+		getCornerOffsets(corners.corner2),
+		getCornerOffsets(corners.corner3),
+		getCornerOffsets(corners.corner4),
+	}};
+	return offsets;
+}
+
+}
+
 LightingRenderMode::LightingRenderMode(bool day, double lighting_intensity,
 		double lighting_water_intensity, bool simulate_sun_light)
 	: day(day), lighting_intensity(lighting_intensity),
 	  lighting_water_intensity(lighting_water_intensity),
-	  simulate_sun_light(simulate_sun_light) {
+	  simulate_sun_light(simulate_sun_light),
+	  volumes(LIGHTING_VOLUMES, LIGHTING_VOLUMES_WAYS) {
+	for (uint8_t level = 0; level < 16; level++) {
+		LightingColor color = calculateLightingColor(LightingData(level, 0));
+		colors[level] = color + (1-color)*(1-lighting_intensity);
+		water_colors[level] = color + (1-color)*(1-lighting_water_intensity);
+	}
 }
 
-
 LightingRenderMode::~LightingRenderMode() {
 }
 
-void LightingRenderMode::draw(RGBAImage& image, const BlockImage& block_image,
-		const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation) {
+void LightingRenderMode::initialize(const RenderView* render_view, BlockImages* images,
+		mc::WorldCache* world, mc::Chunk** current_chunk) {
+	BaseRenderMode::initialize(render_view, images, world, current_chunk);
 
-	CORNERS_LEFT = FaceCorners(CornerNeighbors(
+	const RenderRotation& rotation = render_view->getRotation();
+	corners_left = getFaceCornerOffsets(FaceCorners(CornerNeighbors(
 		/*mc::DIR_WEST + mc::DIR_NORTH + mc::DIR_TOP*/ rotation.rotate(mc::BlockDir(-1, -1, 1)),
 		/*mc::DIR_SOUTH*/ rotation.rotate(mc::BlockDir(0, 1, 0)),
-		/*mc::DIR_BOTTOM*/ rotation.rotate(mc::BlockDir(0, 0, -1))));
-	CORNERS_RIGHT = FaceCorners(CornerNeighbors(
+		/*mc::DIR_BOTTOM*/ rotation.rotate(mc::BlockDir(0, 0, -1)))));
+	corners_right = getFaceCornerOffsets(FaceCorners(CornerNeighbors(
 		/*mc::DIR_SOUTH + mc::DIR_WEST + mc::DIR_TOP*/ rotation.rotate(mc::BlockDir(-1, 1, 1)),
 		/*mc::DIR_EAST*/ rotation.rotate(mc::BlockDir(1, 0, 0)),
-		/*mc::DIR_BOTTOM*/ rotation.rotate(mc::BlockDir(0, 0, -1))));
-	CORNERS_TOP = FaceCorners(CornerNeighbors(
+		/*mc::DIR_BOTTOM*/ rotation.rotate(mc::BlockDir(0, 0, -1)))));
+	corners_top = getFaceCornerOffsets(FaceCorners(CornerNeighbors(
 		/*mc::DIR_TOP + mc::DIR_NORTH + mc::DIR_WEST*/ rotation.rotate(mc::BlockDir(-1, -1, 1)),
 		/*mc::DIR_EAST*/ rotation.rotate(mc::BlockDir(1, 0, 0)),
-		/*mc::DIR_SOUTH*/ rotation.rotate(mc::BlockDir(0, 1, 0))));
-	CORNERS_BOTTOM = FaceCorners(CornerNeighbors(
+		/*mc::DIR_SOUTH*/ rotation.rotate(mc::BlockDir(0, 1, 0)))));
+	corners_bottom = getFaceCornerOffsets(FaceCorners(CornerNeighbors(
 		/*mc::DIR_NORTH + mc::DIR_WEST*/ rotation.rotate(mc::BlockDir(-1, -1, 0)),
 		/*mc::DIR_EAST*/ rotation.rotate(mc::BlockDir(1, 0, 0)),
-		/*mc::DIR_SOUTH*/ rotation.rotate(mc::BlockDir(0, 1, 0))));
-
-	//void blockImageMultiply(RGBAImage& block, const RGBAImage& uv_mask,
-	//		const CornerValues& factors_left, const CornerValues& factors_right, const CornerValues& factors_up);
+		/*mc::DIR_SOUTH*/ rotation.rotate(mc::BlockDir(0, 1, 0)))));
 
-	// top-left, top-right, bottom-right, bottom-left
-	/*
-	CornerValues left = {1.0, 1.0, 1.0, 0.0};
-	CornerValues right = {1.0, 1.0, 1.0, 1.0};
-	CornerValues up = {1.0, 1.0, 1.0, 1.0};
-	blockImageMultiply(image, block_image.uv_image, left, right, up);
-	*/
+	side_offsets[0] = LightingVolume::getOffset(rotation.getWest());
+	side_offsets[1] = LightingVolume::getOffset(rotation.getSouth());
+	side_offsets[2] = LightingVolume::getOffset(rotation.getTop());
+}
 
+void LightingRenderMode::draw(RGBAImage& image, const BlockImage& block_image,
+		const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation) {
 	// flat snow and grass paths: smooth (but bottom corners) (aka. lighting type smooth_bottom ?)
 	// waterlogged blocks: simple but water surface smooth (aka. lighting type smooth_top_simple_rest ?)
 	// slabs: smooth
@@ -179,24 +219,25 @@ void LightingRenderMode::draw(RGBAImage& image, const BlockImage& block_image,
 	// - block image: side mask (3x bool)
 	// - ice needs to be treated a bit like water after all
 
-	float intensity = block_image.is_waterlogged ? lighting_water_intensity : lighting_intensity;
+	const uint8_t* data = getVolumeData(pos);
+	const std::array<LightingColor, 16>& intensity_colors =
+			block_image.is_waterlogged ? water_colors : colors;
 
 	if (block_image.lighting_type == LightingType::SMOOTH) {
-		doSmoothLight(image, block_image, pos, id, false, rotation);
+		doSmoothLight(image, block_image, data, false);
 	} else if (block_image.lighting_type == LightingType::SIMPLE) {
-		// doSmoothLight(image, block_image, pos, id, false, rotation);
-		doSimpleLight(image, block_image, pos, id, rotation);
+		doSimpleLight(image, block_image, data);
 	} else if (block_image.lighting_type == LightingType::SMOOTH_TOP_REMAINING_SIMPLE) {
 		CornerValues id = {1.0, 1.0, 1.0, 1.0};
-		CornerValues up = getCornerColors(pos, CORNERS_TOP, intensity);
+		CornerValues up = getCornerColors(data, corners_top, intensity_colors);
 		blockImageMultiply(image, block_image.uv_image(0), id, id, up);
 
-		float factor = getLightingColor(pos, intensity);
+		float factor = intensity_colors[*data & LightingVolume::MASK_LIGHT_LEVEL];
 		blockImageMultiplyExcept(image, block_image.uv_image(0), FACE_UP_INDEX, factor);
 	} else if (block_image.lighting_type == LightingType::SMOOTH_BOTTOM) {
-		CornerValues left = getCornerColors(pos, CORNERS_LEFT, intensity);
-		CornerValues right = getCornerColors(pos, CORNERS_RIGHT, intensity);
-		CornerValues up = getCornerColors(pos, CORNERS_BOTTOM, intensity);
+		CornerValues left = getCornerColors(data, corners_left, intensity_colors);
+		CornerValues right = getCornerColors(data, corners_right, intensity_colors);
+		CornerValues up = getCornerColors(data, corners_bottom, intensity_colors);
 		blockImageMultiply(image, block_image.uv_image(0), left, right, up);
 	}
 }
@@ -205,60 +246,120 @@ LightingColor LightingRenderMode::calculateLightingColor(const LightingData& lig
 	return pow(0.8, 15 - light.getLightLevel(day));
 }
 
-LightingData LightingRenderMode::getBlockLight(const mc::BlockPos& pos) {
-	mc::Block block = getBlock(pos, mc::GET_ID | mc::GET_LIGHT);
-	LightingData light = LightingData::estimate(block, block_images, world, *current_chunk);
+uint8_t LightingRenderMode::getBlockFlags(uint16_t id) {
+	if (id >= block_flags.size())
+		block_flags.resize(id + 1, LightingVolume::FLAG_UNKNOWN);
+	if (block_flags[id] == LightingVolume::FLAG_UNKNOWN) {
+		const BlockImage& block_image = block_images->getBlockImage(id);
+		uint8_t flags = 0;
+		if (block_image.is_empty || block_image.is_transparent)
+			flags |= LightingVolume::FLAG_TRANSPARENT;
+		if (block_image.is_waterlogged)
+			flags |= LightingVolume::FLAG_WATERLOGGED;
+		if (block_image.has_faulty_lighting)
+			flags |= LightingVolume::FLAG_FAULTY_LIGHTING;
+		block_flags[id] = flags;
+	}
+	return block_flags[id];
+}
 
+uint8_t LightingRenderMode::getLightingData(uint8_t flags, LightingData light) const {
 	// TODO also move this to LightingData class?
 	// lighting fix for The End
 	// The End has no sun light set -> lighting looks ugly
 	// just emulate the sun light for transparent blocks
-	if (simulate_sun_light) {
-		uint8_t sky = 15;
-		/*
-		if (block.id != 0 && !images->isBlockTransparent(block.id, block.data))
-			sky = 0;
-		*/
-		const BlockImage& block_image = block_images->getBlockImage(block.id);
-		if (!block_image.is_empty && !block_image.is_transparent) {
-			sky = 0;
+	if (simulate_sun_light)
+		light = LightingData(light.getBlockLight(),
+				(flags & LightingVolume::FLAG_TRANSPARENT) ? 15 : 0);
+	return light.getLightLevel(day) | flags;
+}
+
+void LightingRenderMode::fillVolume(const LightingVolumePos& pos, LightingVolume& volume) {
+	// the blocks of a row of the volume (x from -1 to 16) in the three chunks
+	static const int SEGMENTS[3][2] = {{-1, -1}, {0, 15}, {16, 16}};
+
+	uint16_t ids[LightingVolume::SIZE];
+	uint8_t block_light[LightingVolume::SIZE], sky_light[LightingVolume::SIZE];
+	faulty_blocks.clear();
+	uint8_t* data = volume.data;
+	for (int y = -1; y <= 16; y++)
+		for (int z = -1; z <= 16; z++) {
+			for (int i = 0; i < 3; i++) {
+				mc::BlockPos first(pos.x * 16 + SEGMENTS[i][0], pos.z * 16 + z, pos.y * 16 + y);
+				int begin = SEGMENTS[i][0] + 1, end = SEGMENTS[i][1] + 2;
+				// same as WorldCache::getBlock, the chunk is used right away because
+				// looking up other chunks may evict it from the cache
+				const mc::Chunk* chunk = nullptr;
+				if (first.y >= mc::CHUNK_LOWEST*16)
+					chunk = world->getChunk(mc::ChunkPos(first));
+				if (chunk == nullptr) {
+					mc::Block block;
+					std::fill(ids + begin, ids + end, block.id);
+					std::fill(block_light + begin, block_light + end, block.block_light);
+					std::fill(sky_light + begin, sky_light + end, block.sky_light);
+					continue;
+				}
+				mc::LocalBlockPos local(first);
+				chunk->getBlockRow(local.x, local.x + end - begin - 1, local.z, local.y,
+						ids + begin, block_light + begin, sky_light + begin);
+			}
+
+			for (int x = 0; x < LightingVolume::SIZE; x++, data++) {
+				// estimating the light of these blocks looks up other blocks, do it later
+				uint8_t flags = getBlockFlags(ids[x]);
+				if (flags & LightingVolume::FLAG_FAULTY_LIGHTING) {
+					mc::Block block;
+					block.pos = mc::BlockPos(pos.x * 16 + x - 1, pos.z * 16 + z, pos.y * 16 + y);
+					block.id = ids[x];
+					block.block_light = block_light[x];
+					block.sky_light = sky_light[x];
+					faulty_blocks.push_back(std::make_pair(data - volume.data, block));
+				} else {
+					*data = getLightingData(flags, LightingData(block_light[x], sky_light[x]));
+				}
+			}
 		}
-		return LightingData(light.getBlockLight(), sky);
-	}
-	return light;
+
+	for (auto it = faulty_blocks.begin(); it != faulty_blocks.end(); ++it)
+		volume.data[it->first] = getLightingData(getBlockFlags(it->second.id),
+				LightingData::estimate(it->second, block_images, world, nullptr));
 }
 
-LightingColor LightingRenderMode::getLightingColor(const mc::BlockPos& pos, double intensity) {
-	LightingData lighting = getBlockLight(pos);
-	LightingColor color = calculateLightingColor(lighting);
-	return color + (1-color)*(1-intensity);
+const uint8_t* LightingRenderMode::getVolumeData(const mc::BlockPos& pos) {
+	LightingVolumePos volume_pos(pos.x >> 4, pos.z >> 4, pos.y >> 4);
+	auto* entry = volumes.find(volume_pos);
+	if (entry == nullptr) {
+		entry = &volumes.getVictim(volume_pos);
+		entry->key = volume_pos;
+		entry->used = true;
+		fillVolume(volume_pos, entry->value);
+	}
+	return entry->value.data + LightingVolume::getIndex(pos.x & 15, pos.z & 15, pos.y & 15);
 }
 
-LightingColor LightingRenderMode::getCornerColor(const mc::BlockPos& pos,
-		const CornerNeighbors& corner, double intensity) {
+LightingColor LightingRenderMode::getCornerColor(const uint8_t* data,
+		const CornerOffsets& corner, const std::array<LightingColor, 16>& colors) const {
 	LightingColor color = 0;
-	color += getLightingColor(pos + corner.pos1, intensity) * 0.25;
-	color += getLightingColor(pos + corner.pos2, intensity) * 0.25;
-	color += getLightingColor(pos + corner.pos3, intensity) * 0.25;
-	color += getLightingColor(pos + corner.pos4, intensity) * 0.25;
+	color += colors[data[corner[0]] & LightingVolume::MASK_LIGHT_LEVEL] * 0.25;
+	color += colors[data[corner[1]] & LightingVolume::MASK_LIGHT_LEVEL] * 0.25;
+	color += colors[data[corner[2]] & LightingVolume::MASK_LIGHT_LEVEL] * 0.25;
+	color += colors[data[corner[3]] & LightingVolume::MASK_LIGHT_LEVEL] * 0.25;
 	return color;
 }
 
-CornerColors LightingRenderMode::getCornerColors(const mc::BlockPos& pos,
-		const FaceCorners& corners, double intensity) {
-	if (intensity < 0)
-		intensity = lighting_intensity;
-	CornerColors colors = {{
-		getCornerColor(pos, corners.corner1, intensity),
-		getCornerColor(pos, corners.corner2, intensity),
-		getCornerColor(pos, corners.corner3, intensity),
-		getCornerColor(pos, corners.corner4, intensity),
+CornerColors LightingRenderMode::getCornerColors(const uint8_t* data,
+		const FaceCornerOffsets& corners, const std::array<LightingColor, 16>& colors) const {
+	CornerColors corner_colors = {{
+		getCornerColor(data, corners[0], colors),
+		getCornerColor(data, corners[1], colors),
+		getCornerColor(data, corners[2], colors),
+		getCornerColor(data, corners[3], colors),
 	}};
-	return colors;
+	return corner_colors;
 }
 
 void LightingRenderMode::doSmoothLight(RGBAImage& image, const BlockImage& block_image,
-		const mc::BlockPos& pos, uint16_t id, bool use_bottom_corners, const RenderRotation& rotation) {
+		const uint8_t* data, bool use_bottom_corners) {
 
 	// TODO adapt
 	// - light only visible faces
@@ -267,12 +368,11 @@ void LightingRenderMode::doSmoothLight(RGBAImage& image, const BlockImage& block
 	std::array<bool, 3> side_mask = block_image.side_mask;
 	bool under_water[3] = {false, false, false};
 
-	mc::BlockDir dirs[3] = {rotation.getWest(), rotation.getSouth(), rotation.getTop()};
 	for (int i = 0; i < 3; i++) {
 		if (side_mask[i]) {
-			const BlockImage& block = block_images->getBlockImage(getBlock(pos + dirs[i]).id);
-			under_water[i] = block.is_waterlogged;
-			side_mask[i] = block.is_empty || block.is_transparent;
+			uint8_t side = data[side_offsets[i]];
+			under_water[i] = side & LightingVolume::FLAG_WATERLOGGED;
+			side_mask[i] = side & LightingVolume::FLAG_TRANSPARENT;
 		}
 	}
 
@@ -281,55 +381,33 @@ void LightingRenderMode::doSmoothLight(RGBAImage& image, const BlockImage& block
 	CornerValues up = {1.0, 1.0, 1.0, 1.0};
 
 	if (side_mask[0]) {
-		left = getCornerColors(pos, CORNERS_LEFT,
-				under_water[0] ? lighting_water_intensity : lighting_intensity);
+		left = getCornerColors(data, corners_left, under_water[0] ? water_colors : colors);
 	}
 	if (side_mask[1]) {
-		right = getCornerColors(pos, CORNERS_RIGHT,
-				under_water[1] ? lighting_water_intensity : lighting_intensity);
+		right = getCornerColors(data, corners_right, under_water[1] ? water_colors : colors);
 	}
 	if (side_mask[2]) {
-		up = getCornerColors(pos, use_bottom_corners ? CORNERS_BOTTOM : CORNERS_TOP,
-				under_water[2] ? lighting_water_intensity : lighting_intensity);
+		up = getCornerColors(data, use_bottom_corners ? corners_bottom : corners_top,
+				under_water[2] ? water_colors : colors);
 	}
 	blockImageMultiply(image, block_image.uv_image(0), left, right, up);
 }
 
 void LightingRenderMode::doSimpleLight(RGBAImage& image, const BlockImage& block_image,
-		const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation) {
+		const uint8_t* data) {
 	// TODO adapt how to consider underwater with waterlogged blocks?
 	// (some waterlogged blocks are rendered as if they weren't)
 
-	float intensity = lighting_intensity;
-	if (block_image.is_waterlogged) {
-		// TODO adapt
-		// all waterloggable blocks are assumed to be under water for now
-		intensity = lighting_water_intensity;
-	}
-	uint8_t factor = getLightingColor(pos, intensity) * 255;
+	// TODO adapt
+	// all waterloggable blocks are assumed to be under water for now
+	const std::array<LightingColor, 16>& intensity_colors =
+			block_image.is_waterlogged ? water_colors : colors;
+	uint8_t factor = intensity_colors[*data & LightingVolume::MASK_LIGHT_LEVEL] * 255;
 	if (factor == 255) {
 		//blockImageTint(image, rgba(0xff, 0x00, 0x00));
 		return;
 	}
 
-	/*
-	int size = image.getWidth();
-	for (int x = 0; x < size; x++) {
-		for (int y = 0; y < size; y++) {
-			uint32_t& pixel = image.pixel(x, y);
-			if (pixel != 0)
-				pixel = rgba_multiply(pixel, factor, factor, factor, 255);
-		}
-	}
-	*/
-
-	/*
-	size_t n = image.getWidth() * image.getHeight();
-	for (size_t i = 0; i < n; i++) {
-		image.data[i] = rgba_multiply_scalar(image.data[i], factor);
-	}
-	*/
-
 	blockImageMultiply(image, factor);
 }
 
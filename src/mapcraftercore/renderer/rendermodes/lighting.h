@@ -23,6 +23,8 @@
 #include "../rendermode.h"
 
 #include <array>
+#include <utility>
+#include <vector>
 
 namespace mapcrafter {
 namespace renderer {
@@ -88,19 +90,95 @@ typedef float LightingColor;
 // - defined as array with corners top left / top right / bottom left / bottom right
 typedef std::array<LightingColor, 4> CornerColors;
 
+// offsets of the four neighbor blocks of a face corner in a lighting volume
+typedef std::array<int, 4> CornerOffsets;
+// neighbor offsets of the four corners of a face, in the order of the corner colors
+typedef std::array<CornerOffsets, 4> FaceCornerOffsets;
+
+/**
+ * Position of a lighting volume, i.e. the chunk position and the index of the section.
+ */
+struct LightingVolumePos {
+	LightingVolumePos() : x(0), z(0), y(0) {}
+	LightingVolumePos(int x, int z, int y) : x(x), z(z), y(y) {}
+
+	bool operator==(const LightingVolumePos& other) const {
+		return x == other.x && z == other.z && y == other.y;
+	}
+
+	int x, z, y;
+};
+
+/**
+ * The unpacked lighting data of a 16x16x16 chunk section and the blocks around it.
+ *
+ * Every block has one byte with its light level (0 to 15, already estimated for blocks
+ * with faulty lighting) and some flags of its block image. Blocks are stored in y/z/x
+ * order with a border of one block from the neighbor sections, so the lighting data of
+ * all neighbors of a block in the section can be looked up with constant offsets.
+ */
+struct LightingVolume {
+	static const int SIZE = 18;
+
+	static const uint8_t MASK_LIGHT_LEVEL = 0x0f;
+	static const uint8_t FLAG_TRANSPARENT = 0x10;
+	static const uint8_t FLAG_WATERLOGGED = 0x20;
+	// only used for the flags of block ids (see LightingRenderMode::getBlockFlags)
+	static const uint8_t FLAG_FAULTY_LIGHTING = 0x40;
+	static const uint8_t FLAG_UNKNOWN = 0x80;
+
+	/**
+	 * Returns the index of a block in the volume, the coordinates are relative to the
+	 * first block of the section and range from -1 to 16.
+	 */
+	static int getIndex(int x, int z, int y) {
+		return ((y + 1) * SIZE + z + 1) * SIZE + x + 1;
+	}
+
+	/**
+	 * Returns the difference of the indices of two blocks that are dir apart.
+	 */
+	static int getOffset(const mc::BlockDir& dir) {
+		return (dir.y * SIZE + dir.z) * SIZE + dir.x;
+	}
+
+	uint8_t data[SIZE * SIZE * SIZE];
+};
+
 class LightingRenderMode : public BaseRenderMode {
 public:
 	LightingRenderMode(bool day, double lighting_intensity,
 			double lighting_water_intensity, bool simulate_sun_light);
 	virtual ~LightingRenderMode();
 
+	/**
+	 * Calculates the rotation dependent neighbor offsets of the face corners.
+	 */
+	virtual void initialize(const RenderView* render_view, BlockImages* images,
+			mc::WorldCache* world, mc::Chunk** current_chunk);
+
 	virtual void draw(RGBAImage& image, const BlockImage& block_image, const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation);
+	virtual bool isDrawingBlocks() const { return true; }
+	virtual int getRequiredFields() const { return mc::GET_LIGHT; }
 
 private:
 	bool day;
 	double lighting_intensity, lighting_water_intensity;
 	bool simulate_sun_light;
-	FaceCorners CORNERS_LEFT, CORNERS_RIGHT, CORNERS_TOP, CORNERS_BOTTOM;
+
+	// lighting colors of the light levels with the normal and the water intensity
+	std::array<LightingColor, 16> colors, water_colors;
+
+	FaceCornerOffsets corners_left, corners_right, corners_top, corners_bottom;
+	// offsets of the neighbors in front of the left, right and top face
+	std::array<int, 3> side_offsets;
+
+	// lighting volumes of the recently rendered sections
+	mc::SetAssociativeCache<LightingVolumePos, LightingVolume> volumes;
+	// lighting volume flags of the block images per block id
+	std::vector<uint8_t> block_flags;
+	// blocks with faulty lighting found while filling a volume
+	std::vector<std::pair<int, mc::Block>> faulty_blocks;
 
 	/**
 	 * Calculates the color of the light of a block.
@@ -111,41 +189,52 @@ private:
 	LightingColor calculateLightingColor(const LightingData& light) const;
 
 	/**
-	 * Returns the light of a block (sky/block light). This also means that the light is
-	 * estimated if the block is a special transparent block.
+	 * Returns the lighting volume flags of the block image of a block.
+	 */
+	uint8_t getBlockFlags(uint16_t id);
+
+	/**
+	 * Returns the lighting data of a block in a lighting volume (light level and flags),
+	 * the light of blocks with faulty lighting must be estimated already.
+	 */
+	uint8_t getLightingData(uint8_t flags, LightingData light) const;
+
+	/**
+	 * Unpacks the lighting data of a section and its neighbor blocks into a volume.
 	 */
-	LightingData getBlockLight(const mc::BlockPos& pos);
+	void fillVolume(const LightingVolumePos& pos, LightingVolume& volume);
 
 	/**
-	 * Returns the lighting color of a block.
+	 * Returns the lighting data of a block in the lighting volume of its section, the
+	 * lighting data of the neighbors can be accessed with the offsets of the volume.
 	 */
-	LightingColor getLightingColor(const mc::BlockPos& pos, double intensity);
+	const uint8_t* getVolumeData(const mc::BlockPos& pos);
 
 	/**
 	 * Returns the lighting color of a corner by calculating the average lighting color of
 	 * the four neighbor blocks.
 	 */
-	LightingColor getCornerColor(const mc::BlockPos& pos, const CornerNeighbors& corner,
-			double intensity);
+	LightingColor getCornerColor(const uint8_t* data, const CornerOffsets& corner,
+			const std::array<LightingColor, 16>& colors) const;
 
 	/**
 	 * Returns the corner lighting colors of a block face.
 	 */
-	CornerColors getCornerColors(const mc::BlockPos& pos, const FaceCorners& corners,
-			double intensity = -1);
+	CornerColors getCornerColors(const uint8_t* data, const FaceCornerOffsets& corners,
+			const std::array<LightingColor, 16>& colors) const;
 
 	/**
 	 * Applies the smooth lighting to a block by adding lighting to the top, left and
 	 * right face (if not covered by another, not transparent, block).
 	 */
-	void doSmoothLight(RGBAImage& image, const BlockImage& block_image, const mc::BlockPos& pos,
-			uint16_t id, bool use_bottom_corners, const RenderRotation& rotation);
+	void doSmoothLight(RGBAImage& image, const BlockImage& block_image, const uint8_t* data,
+			bool use_bottom_corners);
 
 	/**
 	 * Applies a simple lighting to a block by coloring the whole block with the lighting
 	 * color of the block.
 	 */
-	void doSimpleLight(RGBAImage& image, const BlockImage& block_image, const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation);
+	void doSimpleLight(RGBAImage& image, const BlockImage& block_image, const uint8_t* data);
 };
 
 } /* namespace render */
@@ -48,6 +48,7 @@ public:
 	virtual ~OverlayRenderMode();
 
 	virtual void draw(RGBAImage& image, const BlockImage& block_image, const mc::BlockPos& pos, uint16_t id, const RenderRotation& rotation);
+	virtual bool isDrawingBlocks() const { return true; }
 
 protected:
 	virtual RGBAPixel getBlockColor(const mc::BlockPos& pos, const BlockImage& block_image) { return 0; }
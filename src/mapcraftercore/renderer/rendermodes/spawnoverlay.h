@@ -31,6 +31,8 @@ public:
 	SpawnOverlay(bool day);
 	virtual ~SpawnOverlay();
 
+	virtual int getRequiredFields() const { return mc::GET_LIGHT; }
+
 protected:
 	virtual RGBAPixel getBlockColor(const mc::BlockPos& pos, uint16_t id, uint16_t data);
 
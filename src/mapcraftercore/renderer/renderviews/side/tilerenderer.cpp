@@ -63,7 +63,7 @@ int SideTileRenderer::getTileHeight() const {
 	return block_images->getBlockHeight() * 8 * tile_width;
 }
 
-void SideTileRenderer::renderTopBlocks(const TilePos& tile_pos, boost::container::vector<TileImage>& tile_images) {
+void SideTileRenderer::renderTopBlocks(const TilePos& tile_pos) {
 	int block_width = block_images->getBlockWidth();
 	int block_height = block_images->getBlockHeight();
 	for (int cx = 0; cx < tile_width; cx++) {
@@ -77,7 +77,7 @@ void SideTileRenderer::renderTopBlocks(const TilePos& tile_pos, boost::container
 				for (int x = 0; x < 16; x++) {
 					int px = dx + x * block_width;
 					int py = dz + z * block_height / 2 - block_height / 2;
-					renderBlocks(px, py, blockpos + mc::BlockDir(x, z, 0), mc::BlockDir(0, -1, -1), tile_images);
+					renderBlocks(px, py, blockpos + mc::BlockDir(x, z, 0), mc::BlockDir(0, -1, -1));
 				}
 			}
 		}
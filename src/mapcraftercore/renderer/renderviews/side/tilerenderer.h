@@ -40,7 +40,7 @@ public:
 	virtual int getTileHeight() const;
 
 protected:
-	virtual void renderTopBlocks(const TilePos& tile_pos, boost::container::vector<TileImage>& tile_images);
+	virtual void renderTopBlocks(const TilePos& tile_pos);
 };
 
 }
@@ -53,7 +53,7 @@ int TopdownTileRenderer::getTileSize() const {
 	return images->getBlockSize() * 16 * tile_width;
 }
 
-void TopdownTileRenderer::renderTopBlocks(const TilePos& tile_pos, boost::container::vector<TileImage>& tile_images) {
+void TopdownTileRenderer::renderTopBlocks(const TilePos& tile_pos) {
 	int block_size = images->getBlockSize();
 	for (int cx = 0; cx < tile_width; cx++) {
 		for (int cz = 0; cz < tile_width; cz++) {
@@ -66,7 +66,7 @@ void TopdownTileRenderer::renderTopBlocks(const TilePos& tile_pos, boost::contai
 				for (int z = 0; z < 16; z++) {
 					int px = dx + x * block_size;
 					int py = dz + z * block_size;
-					renderBlocks(px, py, blockpos + mc::BlockDir(x, z, 0), mc::BlockDir(0, 0, -1), tile_images);
+					renderBlocks(px, py, blockpos + mc::BlockDir(x, z, 0), mc::BlockDir(0, 0, -1));
 				}
 			}
 		}
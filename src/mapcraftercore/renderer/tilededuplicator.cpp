@@ -0,0 +1,114 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilededuplicator.h"
+
+#include <cstring>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+inline uint64_t rotl(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+}
+
+TileDeduplicator::TileDeduplicator(size_t max_entries)
+	: max_entries(max_entries), linked_tiles(0) {
+}
+
+TileDeduplicator::~TileDeduplicator() {
+}
+
+bool TileDeduplicator::find(const TileHash& hash, std::string& tile) const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = entries.find(hash);
+	if (it == entries.end())
+		return false;
+	tile = it->second.tile;
+	return true;
+}
+
+void TileDeduplicator::addLink(const TileHash& hash) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = entries.find(hash);
+	if (it != entries.end())
+		it->second.hits++;
+	linked_tiles++;
+}
+
+void TileDeduplicator::add(const TileHash& hash, const std::string& tile) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	if (entries.count(hash))
+		return;
+	if (entries.size() >= max_entries) {
+		// forget the images that were not found again, or everything if all were
+		for (auto it = entries.begin(); it != entries.end(); ) {
+			if (it->second.hits == 0)
+				it = entries.erase(it);
+			else
+				++it;
+		}
+		if (entries.size() >= max_entries)
+			entries.clear();
+	}
+	entries[hash].tile = tile;
+}
+
+size_t TileDeduplicator::getLinkedTiles() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return linked_tiles;
+}
+
+TileHash TileDeduplicator::hash(const RGBAImage& image) {
+	// two independent multiply-rotate hashes over pairs of pixels
+	const uint64_t prime1 = 0x9e3779b185ebca87ULL, prime2 = 0xc2b2ae3d27d4eb4fULL;
+	TileHash hash;
+	hash.a = ((uint64_t) image.getWidth() << 32) | (uint32_t) image.getHeight();
+	hash.b = hash.a ^ 0x27d4eb2f165667c5ULL;
+
+	const RGBAPixel* data = image.data.data();
+	size_t size = image.data.size();
+	size_t i = 0;
+	for ( ; i + 2 <= size; i += 2) {
+		uint64_t value;
+		std::memcpy(&value, data + i, sizeof(value));
+		hash.a = rotl(hash.a ^ (value * prime1), 31) * prime2;
+		hash.b = rotl(hash.b ^ (value * prime2), 27) * prime1;
+	}
+	if (i < size) {
+		hash.a = rotl(hash.a ^ (data[i] * prime1), 31) * prime2;
+		hash.b = rotl(hash.b ^ (data[i] * prime2), 27) * prime1;
+	}
+
+	// final mixing, so that all bits of the pixels affect all bits of the hash
+	hash.a ^= hash.a >> 33;
+	hash.a *= prime2;
+	hash.a ^= hash.a >> 29;
+	hash.b ^= hash.b >> 32;
+	hash.b *= prime1;
+	hash.b ^= hash.b >> 31;
+	return hash;
+}
+
+}
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILEDEDUPLICATOR_H_
+#define TILEDEDUPLICATOR_H_
+
+#include "image.h"
+#include "../compat/thread.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * A 128 bit hash of the size and pixels of a tile image.
+ */
+struct TileHash {
+	TileHash() : a(0), b(0) {}
+
+	bool operator<(const TileHash& other) const {
+		return a < other.a || (a == other.a && b < other.b);
+	}
+
+	bool operator==(const TileHash& other) const {
+		return a == other.a && b == other.b;
+	}
+
+	uint64_t a, b;
+};
+
+/**
+ * A thread-safe cache of already written tile images by the hashes of their pixels.
+ *
+ * Large parts of a map (oceans, the void of the end) consist of tiles with exactly the
+ * same images. Before a worker encodes a tile image, it looks up the hash of the image.
+ * If a tile with the same image was already written, the tile storage links the new
+ * tile to the data of that tile (a hardlink for tile files, a shared blob in a tile
+ * pack), so the image is not encoded again.
+ *
+ * The number of remembered tiles is bounded. If the cache is full, the tiles whose
+ * images were not found again are forgotten.
+ */
+class TileDeduplicator {
+public:
+	/**
+	 * Creates a cache which remembers up to max_entries written tile images.
+	 */
+	TileDeduplicator(size_t max_entries = 16384);
+	~TileDeduplicator();
+
+	/**
+	 * Looks up the name of an already written tile with the same hash.
+	 * Returns false if there is no such tile and the image needs to be encoded.
+	 */
+	bool find(const TileHash& hash, std::string& tile) const;
+
+	/**
+	 * Counts a tile that was written with the image of the tile with a specific hash.
+	 */
+	void addLink(const TileHash& hash);
+
+	/**
+	 * Remembers the name of the tile a tile image with a specific hash was written to.
+	 */
+	void add(const TileHash& hash, const std::string& tile);
+
+	/**
+	 * Returns the number of tiles that were written with the image of another tile.
+	 */
+	size_t getLinkedTiles() const;
+
+	/**
+	 * Returns the hash of a tile image.
+	 */
+	static TileHash hash(const RGBAImage& image);
+
+private:
+	struct Entry {
+		Entry() : hits(0) {}
+
+		std::string tile;
+		// how often the image was found again
+		size_t hits;
+	};
+
+	size_t max_entries;
+	std::map<TileHash, Entry> entries;
+	size_t linked_tiles;
+
+	mutable thread_ns::mutex mutex;
+};
+
+}
+}
+
+#endif /* TILEDEDUPLICATOR_H_ */
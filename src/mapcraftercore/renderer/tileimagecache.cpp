@@ -0,0 +1,89 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tileimagecache.h"
+
+#include <utility>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+/**
+ * Swaps two images without copying their pixels.
+ */
+void swapImages(RGBAImage& image1, RGBAImage& image2) {
+	std::swap(image1.width, image2.width);
+	std::swap(image1.height, image2.height);
+	image1.data.swap(image2.data);
+}
+
+}
+
+TileImageCache::TileImageCache(size_t max_bytes)
+	: max_bytes(max_bytes), used_bytes(0) {
+}
+
+TileImageCache::~TileImageCache() {
+}
+
+bool TileImageCache::put(const TilePath& tile, RGBAImage& image) {
+	size_t bytes = getMemoryUsage(image);
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	if (used_bytes + bytes > max_bytes || images.count(tile))
+		return false;
+	swapImages(images[tile], image);
+	used_bytes += bytes;
+	return true;
+}
+
+bool TileImageCache::take(const TilePath& tile, RGBAImage& image) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = images.find(tile);
+	if (it == images.end())
+		return false;
+	swapImages(it->second, image);
+	used_bytes -= getMemoryUsage(image);
+	images.erase(it);
+	return true;
+}
+
+void TileImageCache::clear() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	images.clear();
+	used_bytes = 0;
+}
+
+size_t TileImageCache::size() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return images.size();
+}
+
+size_t TileImageCache::getMemoryUsage() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return used_bytes;
+}
+
+size_t TileImageCache::getMemoryUsage(const RGBAImage& image) {
+	return (size_t) image.getWidth() * image.getHeight() * sizeof(RGBAPixel);
+}
+
+}
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILEIMAGECACHE_H_
+#define TILEIMAGECACHE_H_
+
+#include "image.h"
+#include "tileset.h"
+#include "../compat/thread.h"
+
+#include <cstddef>
+#include <map>
+
+namespace mapcrafter {
+namespace renderer {
+
+/**
+ * A thread-safe hand-off of downscaled tile images from the workers which render tiles
+ * to the workers which compose their parent tiles.
+ *
+ * When a worker finished a tile, it puts the tile image downscaled to a quarter
+ * (InterpolationType::HALF) into this cache. The worker composing the parent tile takes
+ * the quadrant images out of the cache again, so it doesn't have to read and decode the
+ * tile images which were just written to disk.
+ *
+ * The memory used by the cached images is bounded. If the cache is full, images are
+ * just not cached and the parent tile reads the child tile from disk as before.
+ */
+class TileImageCache {
+public:
+	/**
+	 * Creates a cache with a memory budget in bytes for all cached images.
+	 */
+	TileImageCache(size_t max_bytes);
+	~TileImageCache();
+
+	/**
+	 * Puts the downscaled image of a tile into the cache. The image is moved into the
+	 * cache if there is enough memory left, otherwise it is left untouched.
+	 * Returns whether the image was cached.
+	 */
+	bool put(const TilePath& tile, RGBAImage& image);
+
+	/**
+	 * Takes the downscaled image of a tile out of the cache. Returns false if the tile
+	 * is not cached.
+	 */
+	bool take(const TilePath& tile, RGBAImage& image);
+
+	/**
+	 * Removes all cached images.
+	 */
+	void clear();
+
+	/**
+	 * Returns the number of cached images / the memory used by them.
+	 */
+	size_t size() const;
+	size_t getMemoryUsage() const;
+
+private:
+	static size_t getMemoryUsage(const RGBAImage& image);
+
+	size_t max_bytes, used_bytes;
+	std::map<TilePath, RGBAImage> images;
+
+	mutable thread_ns::mutex mutex;
+};
+
+}
+}
+
+#endif /* TILEIMAGECACHE_H_ */
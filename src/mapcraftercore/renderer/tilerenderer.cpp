@@ -19,9 +19,8 @@
 
 #include "tilerenderer.h"
 
-#include <boost/range/algorithm/sort.hpp>
-
 #include "blockimages.h"
+#include "image/kernels.h"
 #include "rendermode.h"
 #include "renderview.h"
 #include "tileset.h"
@@ -30,9 +29,79 @@
 #include "../mc/pos.h"
 #include "../util.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace mapcrafter {
 namespace renderer {
 
+namespace {
+
+/**
+ * Returns after how many steps in a direction a block leaves its chunk.
+ */
+int getStepsInChunk(const mc::LocalBlockPos& local, const mc::BlockDir& dir) {
+	int steps = std::numeric_limits<int>::max();
+	if (dir.x > 0)
+		steps = std::min(steps, (15 - local.x) / dir.x + 1);
+	else if (dir.x < 0)
+		steps = std::min(steps, local.x / -dir.x + 1);
+	if (dir.z > 0)
+		steps = std::min(steps, (15 - local.z) / dir.z + 1);
+	else if (dir.z < 0)
+		steps = std::min(steps, local.z / -dir.z + 1);
+	return steps;
+}
+
+}
+
+TileDrawList::TileDrawList() {
+}
+
+TileDrawList::~TileDrawList() {
+}
+
+void TileDrawList::clear() {
+	keys.clear();
+	commands.clear();
+	arena.clear();
+}
+
+bool TileDrawList::empty() const {
+	return commands.empty();
+}
+
+size_t TileDrawList::size() const {
+	return commands.size();
+}
+
+void TileDrawList::add(uint64_t key, int x, int y, const RGBAImageView& image) {
+	keys.push_back(SortKey {key, (uint32_t) commands.size(), 0});
+	commands.push_back(DrawCommand {x, y, image.width, image.height, image.data, 0});
+}
+
+void TileDrawList::addCopy(uint64_t key, int x, int y, const RGBAImage& image) {
+	size_t offset = arena.size();
+	arena.insert(arena.end(), image.data.begin(), image.data.end());
+	keys.push_back(SortKey {key, (uint32_t) commands.size(), 0});
+	commands.push_back(DrawCommand {x, y, image.width, image.height, nullptr, offset});
+}
+
+void TileDrawList::sort() {
+	std::sort(keys.begin(), keys.end());
+}
+
+void TileDrawList::draw(RGBAImage& tile) const {
+	for (auto it = keys.begin(); it != keys.end(); ++it) {
+		const DrawCommand& command = commands[it->command];
+		const RGBAPixel* pixels = command.pixels;
+		if (pixels == nullptr)
+			pixels = arena.data() + command.arena_offset;
+		tile.alphaBlit(RGBAImageView(pixels, command.width, command.height),
+				command.x, command.y);
+	}
+}
+
 TileRenderer::TileRenderer(const RenderView* render_view, mc::BlockStateRegistry& block_registry,
 		BlockImages* images, int tile_width, mc::WorldCache* world, RenderMode* render_mode) :
 		block_registry(block_registry), images(images), block_images(dynamic_cast<RenderedBlockImages*>(images)),
@@ -47,11 +116,12 @@ TileRenderer::TileRenderer(const RenderView* render_view, mc::BlockStateRegistry
 			block_images->getBlockImage(
 				block_registry.getBlockID(
 					mc::BlockState::parse("minecraft:water_mask", "level=2" )))),
-		tile_image(waterlog_full_image.image(0).width, waterlog_full_image.image(0).height),
-		waterLogTinted(tile_image.image.width, tile_image.image.height) {
+		render_mode_draws(render_mode->isDrawingBlocks()), occlusion_culling(true),
+		coverage_width(0), coverage_height(0),
+		block_buffer(waterlog_full_image.image(0).width, waterlog_full_image.image(0).height),
+		waterLogTinted(block_buffer.width, block_buffer.height) {
 	assert(block_images);
 	render_mode->initialize(render_view, images, world, &current_chunk);
-	// Pre-allocate rendering buffers
 }
 
 TileRenderer::~TileRenderer() {
@@ -65,64 +135,60 @@ void TileRenderer::setShadowEdges(std::array<uint8_t, 5> shadow_edges) {
 	this->shadow_edges = shadow_edges;
 }
 
-TileRenderer::cmpBlockPos* TileRenderer::getTileComparator() const {
-	switch ((RenderRotation::Direction)render_view->getRotation()){
+void TileRenderer::setOcclusionCulling(bool occlusion_culling) {
+	this->occlusion_culling = occlusion_culling;
+}
+
+uint64_t TileRenderer::getDrawKey(const mc::BlockPos& pos) const {
+	int64_t dx = pos.x - draw_origin.x;
+	int64_t dz = pos.z - draw_origin.z;
+	int64_t dy = pos.y - draw_origin.y;
+
+	// the horizontal axes from back to front
+	int64_t first, second;
+	switch ((RenderRotation::Direction) render_view->getRotation()) {
 	default:
 	case RenderRotation::TOP_LEFT:
-		return [](const TileImage& a, const TileImage& b) -> bool {
-			return
-				(a.pos.y != b.pos.y) ? (a.pos.y < b.pos.y) : (
-				(a.pos.z != b.pos.z) ? (a.pos.z < b.pos.z) : (
-				(a.pos.x != b.pos.x) ? (a.pos.x > b.pos.x) : (
-					false
-				)));
-		};
+		first = dz;
+		second = -dx;
 		break;
 	case RenderRotation::TOP_RIGHT:
-		return [](const TileImage& a, const TileImage& b) -> bool {
-			return
-				(a.pos.y != b.pos.y) ? (a.pos.y < b.pos.y) : (
-				(a.pos.x != b.pos.x) ? (a.pos.x < b.pos.x) : (
-				(a.pos.z != b.pos.z) ? (a.pos.z < b.pos.z) : (
-					false
-				)));
-		};
+		first = dx;
+		second = dz;
 		break;
 	case RenderRotation::BOTTOM_RIGHT:
-		return [](const TileImage& a, const TileImage& b) -> bool {
-			return
-				(a.pos.y != b.pos.y) ? (a.pos.y < b.pos.y) : (
-				(a.pos.z != b.pos.z) ? (a.pos.z > b.pos.z) : (
-				(a.pos.x != b.pos.x) ? (a.pos.x < b.pos.x) : (
-					false
-				)));
-		};
+		first = -dz;
+		second = dx;
 		break;
 	case RenderRotation::BOTTOM_LEFT:
-		return [](const TileImage& a, const TileImage& b) -> bool {
-			return
-				(a.pos.y != b.pos.y) ? (a.pos.y < b.pos.y) : (
-				(a.pos.x != b.pos.x) ? (a.pos.x > b.pos.x) : (
-				(a.pos.z != b.pos.z) ? (a.pos.z > b.pos.z) : (
-					false
-				)));
-		};
+		first = -dx;
+		second = -dz;
 		break;
 	}
+
+	// 22 bits for the height and 21 bits for each horizontal axis, with a bias so the
+	// (relative) coordinates are unsigned
+	return ((uint64_t) (dy + (1 << 21)) << 42)
+		| ((uint64_t) (first + (1 << 20)) << 21)
+		| (uint64_t) (second + (1 << 20));
 }
 
 void TileRenderer::renderTile(const TilePos& tile_pos, RGBAImage& tile) {
 	tile.setSize(getTileWidth(), getTileHeight());
 
-	boost::container::vector<TileImage> tile_images;
-	renderTopBlocks(tile_pos, tile_images);
+	queued_blocks.clear();
+	draw_list.clear();
+	renderTopBlocks(tile_pos);
 
-	// Sort them in order depending of the rotation
-	boost::range::sort(tile_images, getTileComparator());
+	if (occlusion_culling)
+		cullOccludedBlocks(tile.getWidth(), tile.getHeight());
+	for (auto it = queued_blocks.begin(); it != queued_blocks.end(); ++it)
+		if (!it->occluded)
+			drawBlock(*it);
 
-	for (auto it = tile_images.begin(); it != tile_images.end(); ++it) {
-		tile.alphaBlit(it->image, it->x, it->y);
-	}
+	// draw the blocks in order depending of the rotation
+	draw_list.sort();
+	draw_list.draw(tile);
 }
 
 int TileRenderer::getTileWidth() const {
@@ -133,7 +199,16 @@ int TileRenderer::getTileHeight() const {
 	return getTileSize();
 }
 
-void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockDir& dir, boost::container::vector<TileImage>& tile_images) {
+void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockDir& dir) {
+	// the columns go downwards, so we can skip everything above the highest blocks
+	assert(dir.y < 0);
+
+	// skips some steps of the column, the loop itself does the last step
+	auto skip = [&top, &dir](int steps) {
+		// but don't go further than to the bottom of the world
+		steps = std::min(steps, (top.y - mc::CHUNK_LOWEST*16) / -dir.y + 1);
+		top += mc::BlockDir(dir.x * (steps - 1), dir.z * (steps - 1), dir.y * (steps - 1));
+	};
 
 	for (; top.y >= mc::CHUNK_LOWEST*16 ; top += dir) {
 		// get current chunk position
@@ -146,12 +221,25 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockD
 			//	continue;
 			current_chunk = world->getChunk(current_chunk_pos);
 		}
+		// get local block position
+		mc::LocalBlockPos local(top);
+
 		if (current_chunk == nullptr) {
+			skip(getStepsInChunk(local, dir));
 			continue;
 		}
 
-		// get local block position
-		mc::LocalBlockPos local(top);
+		// skip the air above the highest block of the chunk (or of an empty section)
+		// while the column is in this chunk, and the air above the column
+		int max_y = current_chunk->getHighestBlockY();
+		if (current_chunk->isSectionEmpty(top.y))
+			max_y = std::min(max_y, (top.y & ~15) - 1);
+		if (top.y > max_y) {
+			skip(std::min(getStepsInChunk(local, dir), (top.y - max_y - 1) / -dir.y + 1));
+			continue;
+		}
+		if (top.y > current_chunk->getHighestBlockY(local.x, local.z))
+			continue;
 
 		uint16_t id = current_chunk->getBlockID(local, false);
 		if (id == mc::Chunk::nop_id) continue;
@@ -207,31 +295,175 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockD
 			alt = abs((int32_t)rnd.nextLong());
 			alt = block_image->variant_2_index(alt);
 		}
-		const RGBAImage& image = block_image->image(alt);
-		const RGBAImage& uv_image = block_image->uv_image(alt);
 
-		// Prep the tile
-		tile_image.x = x;
-		tile_image.y = y;
-		tile_image.pos = top;
-		tile_image.image.setSize(image.width,image.height);
+		if (queued_blocks.empty())
+			draw_origin = top;
+
+		QueuedBlock queued;
+		queued.key = getDrawKey(top);
+		queued.pos = top;
+		queued.x = x;
+		queued.y = y;
+		queued.block_image = block_image;
+		queued.alt = alt;
+		queued.id = id;
+		queued.id_top = id_top;
+		queued.id_south = id_south;
+		queued.id_west = id_west;
+		queued.water_top = water_top;
+		queued.water_south = water_south;
+		queued.water_west = water_west;
+		queued.solid_top = solid_top;
+		queued.occluded = false;
+		queued_blocks.push_back(queued);
+
+		// if this block is not transparent, then stop looking for more blocks
+		if (!block_image->is_transparent) {
+			break;
+		}
+	}
+}
+
+void TileRenderer::cullOccludedBlocks(int width, int height) {
+	coverage_width = width;
+	coverage_height = height;
+	coverage.assign((size_t) width * height, 0);
+
+	// go through the blocks from front to back
+	queued_order.clear();
+	for (size_t i = 0; i < queued_blocks.size(); i++)
+		queued_order.push_back(std::make_pair(queued_blocks[i].key, (uint32_t) i));
+	std::sort(queued_order.begin(), queued_order.end());
+	for (auto it = queued_order.rbegin(); it != queued_order.rend(); ++it) {
+		QueuedBlock& block = queued_blocks[it->second];
+		block.occluded = isOccluded(block);
+		if (!block.occluded)
+			addCoverage(block);
+	}
+}
+
+bool TileRenderer::isOccluded(const QueuedBlock& block) const {
+	const BlockImage* block_image = block.block_image;
+
+	// all pixels the block might draw: the pixels of its image, and of the biome mask
+	// and the water because they are blended over the block image
+	const RGBAImageView* footprint[3];
+	int count = 0;
+	footprint[count++] = &block_image->image(block.alt);
+	if (block_image->is_biome && block_image->is_masked_biome)
+		footprint[count++] = &block_image->biome_mask;
+	if (block_image->is_waterlogged)
+		footprint[count++] = (block.water_top || block.solid_top)
+			? &waterlog_full_image.image(0) : &waterlog_shore_image.image(0);
+
+	// pixels outside of the tile are not visible anyway
+	const RGBAImageView& image = *footprint[0];
+	int sx_begin = std::max(0, -block.x), sx_end = std::min(image.width, coverage_width - block.x);
+	int sy_begin = std::max(0, -block.y), sy_end = std::min(image.height, coverage_height - block.y);
+	for (int sy = sy_begin; sy < sy_end; sy++) {
+		// the row of the coverage, block.x may be negative
+		const uint8_t* covered = &coverage[(size_t) (sy + block.y) * coverage_width];
+		uint8_t visible = 0;
+		for (int i = 0; i < count; i++) {
+			const RGBAPixel* row = &footprint[i]->data[sy * image.width];
+			for (int sx = sx_begin; sx < sx_end; sx++)
+				visible |= (row[sx] >= 0x01000000) & !covered[block.x + sx];
+		}
+		if (visible)
+			return false;
+	}
+	return true;
+}
+
+void TileRenderer::addCoverage(const QueuedBlock& block) {
+	const BlockImage* block_image = block.block_image;
+
+	// biome colors, shadow edges, lighting and water don't make opaque pixels of a
+	// block image transparent, but drawing only some faces of a block does, so skip it
+	// to be on the safe side
+	if (block_image->is_empty || (block_image->can_partial && (block.id == block.id_top
+			|| block.id == block.id_south || block.id == block.id_west)))
+		return;
+
+	const RGBAImageView& image = block_image->image(block.alt);
+	int sx_begin = std::max(0, -block.x), sx_end = std::min(image.width, coverage_width - block.x);
+	int sy_begin = std::max(0, -block.y), sy_end = std::min(image.height, coverage_height - block.y);
+	for (int sy = sy_begin; sy < sy_end; sy++) {
+		uint8_t* covered = &coverage[(size_t) (sy + block.y) * coverage_width];
+		const RGBAPixel* row = &image.data[sy * image.width];
+		for (int sx = sx_begin; sx < sx_end; sx++)
+			covered[block.x + sx] |= row[sx] >= 0xff000000;
+	}
+}
+
+void TileRenderer::drawBlock(const QueuedBlock& block) {
+	const mc::BlockPos& top = block.pos;
+	const BlockImage* block_image = block.block_image;
+	uint16_t id = block.id;
+	uint16_t id_top = block.id_top;
+	uint16_t id_south = block.id_south;
+	uint16_t id_west = block.id_west;
+
+	// the render mode and biome colors expect the chunk of the block as current chunk
+	mc::ChunkPos chunk_pos(top);
+	if (current_chunk == nullptr || current_chunk->getPos() != chunk_pos)
+		current_chunk = world->getChunk(chunk_pos);
+	if (current_chunk == nullptr)
+		return;
+
+	const RGBAImageView& image = block_image->image(block.alt);
+	const RGBAImageView& uv_image = block_image->uv_image(block.alt);
+
+	bool strip_up = false;
+	bool strip_left = false;
+	bool strip_right = false;
+	uint8_t north = 0, south = 0, east = 0, west = 0, bottomleft = 0, bottomright = 0;
+	if (!block_image->is_empty) {
+		if (block_image->can_partial) {
+			strip_up    = id == id_top;
+			strip_right = id == id_south;
+			strip_left  = id == id_west;
+		}
+
+		if (block_image->shadow_edges > 0) {
+			auto shadow_edge = [this, top](const mc::BlockDir& dir) {
+				const BlockImage& b = block_images->getBlockImage(getBlock(top + dir).id);
+				return b.shadow_edges == 0;
+			};
+			uint8_t diff_top = (id != id_top);
+			north = shadow_edge(render_view->getRotation().getNorth()) && diff_top;
+			south = shadow_edge(render_view->getRotation().getSouth()) && diff_top;
+			east = shadow_edge(render_view->getRotation().getEast()) && diff_top;
+			west = shadow_edge(render_view->getRotation().getWest()) && diff_top;
+			uint8_t bottom = shadow_edge(render_view->getRotation().getBottom());
+			bottomleft = bottom && (id != id_west);
+			bottomright = bottom && (id != id_south);
+
+			int f = block_image->shadow_edges;
+			north *= shadow_edges[0] * f;
+			south *= shadow_edges[1] * f;
+			east *= shadow_edges[2] * f;
+			west *= shadow_edges[3] * f;
+			bottomleft *= shadow_edges[4] * f;
+			bottomright *= shadow_edges[4] * f;
+		}
+	}
+	bool strip = strip_up || strip_left || strip_right;
+	bool shadow = north + south + east + west + bottomleft + bottomright != 0;
+
+	// Blocks that are drawn as they are don't need a copy of their image
+	if (!block_image->is_empty && !block_image->is_waterlogged && !block_image->is_biome
+			&& !strip && !shadow && !render_mode_draws) {
+		draw_list.add(block.key, block.x, block.y, image);
+	} else {
+		block_buffer.setSize(image.width, image.height);
 
 		// Only display if there's something to print
 		// This applies for water blocks, where we print
 		// the water on the next step
 		if (!block_image->is_empty) {
-
-			bool strip_up = false;
-			bool strip_left = false;
-			bool strip_right = false;
-			if (block_image->can_partial) {
-				strip_up    = id == id_top;
-				strip_right = id == id_south;
-				strip_left  = id == id_west;
-			}
-
-			if (strip_up || strip_left || strip_right) {
-				for (int i=0; i<tile_image.image.width*tile_image.image.height; i++) {
+			if (strip) {
+				for (int i=0; i<block_buffer.width*block_buffer.height; i++) {
 					RGBAPixel puv = uv_image.data[i];
 					RGBAPixel p = image.data[i];
 					switch(rgba_blue(puv)) {
@@ -251,134 +483,103 @@ void TileRenderer::renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockD
 							}
 							break;
 					}
-					tile_image.image.data[i] = p;
+					block_buffer.data[i] = p;
 				}
 			} else {
-				std::copy(image.data.begin(), image.data.end(), tile_image.image.data.begin());
+				std::copy(image.begin(), image.end(), block_buffer.data.begin());
 			}
 
 			if (block_image->is_biome) {
-				block_images->prepareBiomeBlockImage(tile_image.image, *block_image, getBiomeColor(top, *block_image, current_chunk));
+				block_images->prepareBiomeBlockImage(block_buffer, *block_image, getBiomeColor(top, *block_image, current_chunk));
 			}
 
-			if (block_image->shadow_edges > 0) {
-				auto shadow_edge = [this, top](const mc::BlockDir& dir) {
-					const BlockImage& b = block_images->getBlockImage(getBlock(top + dir).id);
-					return b.shadow_edges == 0;
-				};
-				uint8_t diff_top = (id != id_top);
-				uint8_t north = shadow_edge(render_view->getRotation().getNorth()) && diff_top;
-				uint8_t south = shadow_edge(render_view->getRotation().getSouth()) && diff_top;
-				uint8_t east = shadow_edge(render_view->getRotation().getEast()) && diff_top;
-				uint8_t west = shadow_edge(render_view->getRotation().getWest()) && diff_top;
-				uint8_t bottom = shadow_edge(render_view->getRotation().getBottom());
-				uint8_t bottomleft = bottom && (id != id_west);
-				uint8_t bottomright = bottom && (id != id_south);
-
-				if (north + south + east + west + bottomleft + bottomright != 0) {
-					int f = block_image->shadow_edges;
-					north *= shadow_edges[0] * f;
-					south *= shadow_edges[1] * f;
-					east *= shadow_edges[2] * f;
-					west *= shadow_edges[3] * f;
-					bottomleft *= shadow_edges[4] * f;
-					bottomright *= shadow_edges[4] * f;
-					blockImageShadowEdges(tile_image.image, uv_image,
-						north, south, east, west, bottomleft, bottomright);
-				}
+			if (shadow) {
+				blockImageShadowEdges(block_buffer, uv_image,
+					north, south, east, west, bottomleft, bottomright);
 			}
 
 			// let the render mode do their magic with the block image
-			render_mode->draw(tile_image.image, *block_image, tile_image.pos, id, render_view->getRotation());
+			render_mode->draw(block_buffer, *block_image, top, id, render_view->getRotation());
 
 		} else {
 			// Clear out the tile from previous rendering
-			std::fill(tile_image.image.data.begin(), tile_image.image.data.end(), 0);
+			std::fill(block_buffer.data.begin(), block_buffer.data.end(), 0);
 		}
 
-
 		if (block_image->is_waterlogged) {
-			// assert( !(water_top && water_south && water_west) );
-
-			const RGBAImage* waterlog;
-			const RGBAImage* waterlog_uv;
-			if (water_top || solid_top) {
-				// This will be displayed as full water
-				waterlog = &waterlog_full_image.image(0);
-				waterlog_uv = &waterlog_full_image.uv_image(0);
-			} else {
-				// That one will be displayed a bit lower to look like a shore line
-				waterlog = &waterlog_shore_image.image(0);
-				waterlog_uv = &waterlog_shore_image.uv_image(0);
-			}
+			renderWaterlog(top, uv_image, block.water_top, block.water_south,
+					block.water_west, block.solid_top);
+		}
 
-			uint32_t biome_color = getBiomeColor(top, waterlog_full_image, current_chunk);
-			biome_color = rgba(rgba_red(biome_color), rgba_green(biome_color), rgba_blue(biome_color), (render_view->getWaterOpacity() * 255));
-
-			std::vector<RGBAPixel>::const_iterator pit      = waterlog->data.begin();
-			std::vector<RGBAPixel>::const_iterator pitend   = waterlog->data.end();
-			std::vector<RGBAPixel>::const_iterator puvit    = waterlog_uv->data.begin();
-			std::vector<RGBAPixel>::iterator pdestit        = waterLogTinted.data.begin();
-
-			if ((water_top || water_south || water_west) == false) {
-				// fast lane
-				// Nothing to clip, just render the whole water block with biome color
-				while (pit != pitend)
-				{
-					RGBAPixel p = *pit;
-					if (p) {
-						p = rgba_multiply_with_alpha(p, biome_color);
-					}
-					*pdestit = p;
-					pit ++;
-					puvit ++;
-					pdestit ++;
-				}
-			} else {
-				// Clip the some faces, and multiply by biome color
-				while (pit != pitend)
-				{
-					RGBAPixel p = *pit;
-					if (p) {
-						RGBAPixel puv = *puvit;
-						switch(rgba_blue(puv)){
-							case FACE_UP_INDEX:
-								if(water_top) {
-									p = 0;
-								}
-								break;
-							case FACE_LEFT_INDEX:
-								if(water_west) {
-									p = 0;
-								}
-								break;
-							case FACE_RIGHT_INDEX:
-								if(water_south) {
-									p = 0;
-								}
-								break;
+		draw_list.addCopy(block.key, block.x, block.y, block_buffer);
+	}
+}
+
+void TileRenderer::renderWaterlog(const mc::BlockPos& pos, const RGBAImageView& uv_image,
+		bool water_top, bool water_south, bool water_west, bool solid_top) {
+	// assert( !(water_top && water_south && water_west) );
+
+	const RGBAImageView* waterlog;
+	const RGBAImageView* waterlog_uv;
+	if (water_top || solid_top) {
+		// This will be displayed as full water
+		waterlog = &waterlog_full_image.image(0);
+		waterlog_uv = &waterlog_full_image.uv_image(0);
+	} else {
+		// That one will be displayed a bit lower to look like a shore line
+		waterlog = &waterlog_shore_image.image(0);
+		waterlog_uv = &waterlog_shore_image.uv_image(0);
+	}
+
+	uint32_t biome_color = getBiomeColor(pos, waterlog_full_image, current_chunk);
+	biome_color = rgba(rgba_red(biome_color), rgba_green(biome_color), rgba_blue(biome_color), (render_view->getWaterOpacity() * 255));
+
+	const RGBAPixel* pit                            = waterlog->begin();
+	const RGBAPixel* pitend                         = waterlog->end();
+	const RGBAPixel* puvit                          = waterlog_uv->begin();
+	std::vector<RGBAPixel>::iterator pdestit        = waterLogTinted.data.begin();
+
+	if ((water_top || water_south || water_west) == false) {
+		// fast lane
+		// Nothing to clip, just render the whole water block with biome color
+		getImageKernels().multiplyWithAlpha(waterLogTinted.data.data(),
+				waterlog->data, waterlog->size(), biome_color);
+	} else {
+		// Clip the some faces, and multiply by biome color
+		while (pit != pitend)
+		{
+			RGBAPixel p = *pit;
+			if (p) {
+				RGBAPixel puv = *puvit;
+				switch(rgba_blue(puv)){
+					case FACE_UP_INDEX:
+						if(water_top) {
+							p = 0;
 						}
-						if (p) {
-							p = rgba_multiply_with_alpha(p, biome_color);
+						break;
+					case FACE_LEFT_INDEX:
+						if(water_west) {
+							p = 0;
 						}
-					}
-					*pdestit = p;
-					pit ++;
-					puvit ++;
-					pdestit ++;
+						break;
+					case FACE_RIGHT_INDEX:
+						if(water_south) {
+							p = 0;
+						}
+						break;
+				}
+				if (p) {
+					p = rgba_multiply_with_alpha(p, biome_color);
 				}
 			}
-
-			blockImageBlendZBuffered(tile_image.image, uv_image, waterLogTinted, *waterlog_uv);
-		}
-
-		tile_images.push_back(tile_image);
-
-		// if this block is not transparent, then stop looking for more blocks
-		if (!block_image->is_transparent) {
-			break;
+			*pdestit = p;
+			pit ++;
+			puvit ++;
+			pdestit ++;
 		}
 	}
+
+	blockImageBlendZBuffered(block_buffer, uv_image, waterLogTinted, *waterlog_uv);
 }
 
 mc::Block TileRenderer::getBlock(const mc::BlockPos& pos, int get) {
@@ -386,35 +587,57 @@ mc::Block TileRenderer::getBlock(const mc::BlockPos& pos, int get) {
 }
 
 uint32_t TileRenderer::getBiomeColor(const mc::BlockPos& pos, const BlockImage& block, const mc::Chunk* chunk) {
+	// the color is the average biome color of the 5x5 blocks around the block, biomes
+	// are stored per 4x4x4 blocks, so these blocks are in 2x2 biome cells
 	const int radius = 2;
-	float f = ((2*radius+1)*(2*radius+1));
-	float r = 0.0, g = 0.0, b = 0.0;
-
-	for (int dx = -radius; dx <= radius; dx++) {
-		for (int dz = -radius; dz <= radius; dz++) {
-			mc::BlockPos other = pos + mc::BlockDir(dx, dz, 0);
+	int x1 = pos.x - radius, x2 = pos.x + radius;
+	int z1 = pos.z - radius, z2 = pos.z + radius;
+
+	// count the blocks per biome first, every biome color is calculated only once
+	uint16_t biome_ids[4];
+	int biome_counts[4];
+	int biomes = 0;
+	for (int cell_x = x1 >> 2; cell_x <= x2 >> 2; cell_x++) {
+		for (int cell_z = z1 >> 2; cell_z <= z2 >> 2; cell_z++) {
+			mc::BlockPos other(std::max(x1, cell_x * 4), std::max(z1, cell_z * 4), pos.y);
+			int count = (std::min(x2, cell_x * 4 + 3) - other.x + 1)
+					* (std::min(z2, cell_z * 4 + 3) - other.z + 1);
 			mc::ChunkPos chunk_pos(other);
 
 			uint16_t biome_id;
 			mc::LocalBlockPos local(other);
 			if (chunk_pos != chunk->getPos()) {
 				mc::Chunk* other_chunk = world->getChunk(chunk_pos);
-				if (other_chunk == nullptr) {
-					f -= 1.0f;
+				if (other_chunk == nullptr)
 					continue;
-				}
 				biome_id = other_chunk->getBiomeAt(local);
 			} else {
 				biome_id = chunk->getBiomeAt(local);
 			}
-			const Biome& biome = Biome::getBiome(biome_id);
-			uint32_t c = biome.getColor(other, block.biome_color, block.biome_colormap);
-			r += (float) rgba_red(c);
-			g += (float) rgba_green(c);
-			b += (float) rgba_blue(c);
+
+			int i = 0;
+			while (i < biomes && biome_ids[i] != biome_id)
+				i++;
+			if (i == biomes) {
+				biome_ids[biomes] = biome_id;
+				biome_counts[biomes++] = 0;
+			}
+			biome_counts[i] += count;
 		}
 	}
 
+	// the sums are integers, so they are the same as when adding up the single blocks
+	float f = 0.0;
+	float r = 0.0, g = 0.0, b = 0.0;
+	for (int i = 0; i < biomes; i++) {
+		const Biome& biome = Biome::getBiome(biome_ids[i]);
+		uint32_t c = biome.getColor(pos, block.biome_color, block.biome_colormap);
+		r += (float) (rgba_red(c) * biome_counts[i]);
+		g += (float) (rgba_green(c) * biome_counts[i]);
+		b += (float) (rgba_blue(c) * biome_counts[i]);
+		f += biome_counts[i];
+	}
+
 	f = 1.0 / f;
 	return rgba(r * f, g * f, b * f, 255);
 }
@@ -25,9 +25,9 @@
 #include "../mc/worldcache.h" // mc::DIR_*
 
 #include <array>
+#include <utility>
 #include <vector>
 #include <boost/filesystem.hpp>
-#include <boost/container/vector.hpp>
 
 namespace fs = boost::filesystem;
 
@@ -49,14 +49,74 @@ class RenderedBlockImages;
 class RenderMode;
 class RenderView;
 
-struct TileImage {
-	int x, y;
-	RGBAImage image;
-	mc::BlockPos pos;
-	int z_index;
-
-	TileImage() {}
-	TileImage(int width, int height): image(width, height) {}
+/**
+ * The block images of a tile that are about to be drawn, in the order they were added.
+ *
+ * Block images that are drawn as they are in the block images are only referenced,
+ * block images that were modified for this one block (biome colors, lighting, ...) are
+ * copied into a scratch arena. Every block image has a sort key that determines the order
+ * in which the images are drawn, and only the compact keys are sorted, not the images.
+ *
+ * The draw list is reused for all tiles of a tile renderer, so it does not allocate any
+ * memory anymore once it is large enough for one tile.
+ */
+class TileDrawList {
+public:
+	TileDrawList();
+	~TileDrawList();
+
+	/**
+	 * Removes all block images, but keeps the allocated memory.
+	 */
+	void clear();
+
+	bool empty() const;
+	size_t size() const;
+
+	/**
+	 * Adds a block image that is referenced only, the pixels must stay valid until the
+	 * draw list is drawn.
+	 */
+	void add(uint64_t key, int x, int y, const RGBAImageView& image);
+
+	/**
+	 * Adds a block image whose pixels are copied into the scratch arena.
+	 */
+	void addCopy(uint64_t key, int x, int y, const RGBAImage& image);
+
+	/**
+	 * Sorts the block images by their keys, block images with the same key are drawn
+	 * in the order they were added.
+	 */
+	void sort();
+
+	/**
+	 * Alpha-blits all block images onto a tile image.
+	 */
+	void draw(RGBAImage& tile) const;
+
+private:
+	struct SortKey {
+		uint64_t key;
+		uint32_t command;
+		uint32_t padding;
+
+		bool operator<(const SortKey& other) const {
+			return key != other.key ? key < other.key : command < other.command;
+		}
+	};
+
+	struct DrawCommand {
+		int x, y;
+		int width, height;
+		// pixels of a referenced block image, nullptr if it is in the arena
+		const RGBAPixel* pixels;
+		size_t arena_offset;
+	};
+
+	std::vector<SortKey> keys;
+	std::vector<DrawCommand> commands;
+	std::vector<RGBAPixel> arena;
 };
 
 class TileRenderer {
@@ -68,6 +128,13 @@ public:
 	void setRenderBiomes(bool render_biomes);
 	void setShadowEdges(std::array<uint8_t, 5> shadow_edges);
 
+	/**
+	 * Sets whether blocks that are completely hidden behind opaque blocks in front of
+	 * them are skipped before their block images are prepared (enabled by default).
+	 * The rendered tiles are the same either way.
+	 */
+	void setOcclusionCulling(bool occlusion_culling);
+
 	virtual void renderTile(const TilePos& tile_pos, RGBAImage& tile);
 
 	virtual int getTileSize() const = 0;
@@ -75,11 +142,58 @@ public:
 	virtual int getTileHeight() const;
 
 protected:
-	// void sortTiles(boost::container::vector<TileImage>& tile_images) const;
-	typedef bool cmpBlockPos(const TileImage &, const TileImage &);
-	cmpBlockPos* getTileComparator() const;
-	void renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockDir& dir, boost::container::vector<TileImage>& tile_images);
-	virtual void renderTopBlocks(const TilePos& tile_pos, boost::container::vector<TileImage>& tile_images) {}
+	/**
+	 * A visible block found while walking the columns of a tile. Its block image is
+	 * prepared and added to the draw list later by drawBlock().
+	 */
+	struct QueuedBlock {
+		uint64_t key;
+		mc::BlockPos pos;
+		int x, y;
+		const BlockImage* block_image;
+		int32_t alt;
+		uint16_t id, id_top, id_south, id_west;
+		bool water_top, water_south, water_west, solid_top;
+		// whether the block is hidden behind other blocks and doesn't need to be drawn
+		bool occluded;
+	};
+
+	/**
+	 * Returns the sort key of a block for the draw list. Blocks are drawn from bottom
+	 * to top and then from back to front, depending on the rotation of the render view.
+	 * The key is relative to the first block of the tile, so it fits into 64 bits.
+	 */
+	uint64_t getDrawKey(const mc::BlockPos& pos) const;
+	void renderBlocks(int x, int y, mc::BlockPos top, const mc::BlockDir& dir);
+
+	/**
+	 * Goes through the queued blocks from front to back and marks the blocks that are
+	 * completely hidden behind opaque pixels of blocks in front of them as occluded.
+	 */
+	void cullOccludedBlocks(int width, int height);
+
+	/**
+	 * Returns whether all pixels a block might draw are already covered by opaque
+	 * pixels of blocks in front of it (or are outside of the tile).
+	 */
+	bool isOccluded(const QueuedBlock& block) const;
+
+	/**
+	 * Marks the pixels of a block that are opaque for sure as covered.
+	 */
+	void addCoverage(const QueuedBlock& block);
+
+	/**
+	 * Prepares the block image of a queued block and adds it to the draw list.
+	 */
+	void drawBlock(const QueuedBlock& block);
+
+	/**
+	 * Blends the water of a waterlogged block over the block image in the block buffer.
+	 */
+	void renderWaterlog(const mc::BlockPos& pos, const RGBAImageView& uv_image,
+			bool water_top, bool water_south, bool water_west, bool solid_top);
+	virtual void renderTopBlocks(const TilePos& tile_pos) {}
 
 	mc::Block getBlock(const mc::BlockPos& pos, int get = mc::GET_ID);
 	uint32_t getBiomeColor(const mc::BlockPos& pos, const BlockImage& block, const mc::Chunk* chunk);
@@ -100,7 +214,21 @@ protected:
 
 	const BlockImage& waterlog_full_image;
 	const BlockImage& waterlog_shore_image;
-	TileImage tile_image;
+	// whether the render mode modifies block images
+	bool render_mode_draws;
+
+	bool occlusion_culling;
+	std::vector<QueuedBlock> queued_blocks;
+	// keys and indexes of the queued blocks, to sort them from front to back
+	std::vector<std::pair<uint64_t, uint32_t>> queued_order;
+	// which pixels of the tile are already covered by opaque pixels (when culling)
+	std::vector<uint8_t> coverage;
+	int coverage_width, coverage_height;
+
+	TileDrawList draw_list;
+	mc::BlockPos draw_origin;
+	// buffer for block images that are modified before they are drawn
+	RGBAImage block_buffer;
 	RGBAImage waterLogTinted;
 };
 
@@ -23,8 +23,10 @@
 #include "image.h"
 #include "rendermode.h"
 #include "renderview.h"
+#include "tileimagecache.h"
 #include "tilerenderer.h"
 #include "tileset.h"
+#include "tilestorage.h"
 #include "../mc/worldcache.h"
 #include "../mc/blockstate.h"
 #include "../util.h"
@@ -33,8 +35,11 @@ namespace mapcrafter {
 namespace renderer {
 
 void RenderContext::initializeTileRenderer() {
-	world_cache.reset(new mc::WorldCache(*block_registry, *world));
 	render_mode.reset(createRenderMode(world_config, map_config, render_view->getRotation()));
+	world_cache.reset(new mc::WorldCache(*block_registry, *world, chunk_cache,
+			map_config.getWorldCacheRegions(), map_config.getWorldCacheChunks()));
+	// the tile renderer needs the block IDs and biomes
+	world_cache->setFields(mc::GET_ID | mc::GET_BIOME | render_mode->getRequiredFields());
 	tile_renderer.reset(render_view->createTileRenderer(*block_registry, block_images,
 			map_config.getTileWidth(), world_cache.get(), render_mode.get()));
 	render_view->configureTileRenderer(tile_renderer.get(), world_config, map_config);
@@ -66,37 +71,26 @@ void TileRenderWorker::setProgressHandler(util::IProgressHandler* progress) {
 }
 
 void TileRenderWorker::saveTile(const TilePath& tile, const RGBAImage& image) {
-	bool png = render_context.map_config.getImageFormat() == config::ImageFormat::PNG;
-	bool png_indexed = render_context.map_config.isPNGIndexed();
-	std::string suffix = std::string(".") + render_context.map_config.getImageFormatSuffix();
-	std::string filename = tile.toString() + suffix;
-	if (tile.getDepth() == 0)
-		filename = std::string("base") + suffix;
-	fs::path file = render_context.output_dir / filename;
-	if (!fs::exists(file.parent_path()))
-		fs::create_directories(file.parent_path());
-
-	if ((png && !png_indexed) && !image.writePNG(file.string()))
-		LOG(WARNING) << "Unable to write '" << file.string() << "'.";
-
-	if ((png && png_indexed) && !image.writeIndexedPNG(file.string()))
-		LOG(WARNING) << "Unable to write '" << file.string() << "'.";
-
-	config::Color bg = render_context.background_color;
-	if (!png && !image.writeJPEG(file.string(),
-			render_context.map_config.getJPEGQuality(), rgba(bg.red, bg.green, bg.blue, 255)))
-		LOG(WARNING) << "Unable to write '" << file.string() << "'.";
+	TileStorage& tile_storage = *render_context.tile_storage;
+	if (!tile_storage.writeTile(tile, image))
+		LOG(WARNING) << "Unable to write tile '" << tile_storage.getTileFile(tile) << "'.";
+}
+
+bool TileRenderWorker::takeCachedTile(const TilePath& tile, RGBAImage& image) {
+	if (!render_context.tile_image_cache || !render_work.tiles_skip.count(tile)
+			|| !render_context.tile_image_cache->take(tile, image))
+		return false;
+	if (progress != nullptr)
+		progress->setValue(progress->getValue()
+				+ render_context.tile_set->getContainingRenderTiles(tile));
+	return true;
 }
 
 void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 	// if this is tile is not required or we should skip it, try to load it from file
 	if (!render_context.tile_set->isTileRequired(tile)
 			|| render_work.tiles_skip.count(tile)) {
-		bool png = render_context.map_config.getImageFormat() == config::ImageFormat::PNG;
-		fs::path file = render_context.output_dir
-				/ (tile.toString() + "." + render_context.map_config.getImageFormatSuffix());
-		if ((png && image.readPNG(file.string()))
-				|| (!png && image.readJPEG(file.string()))) {
+		if (render_context.tile_storage->readTile(tile, image)) {
 			if (render_work.tiles_skip.count(tile) && progress != nullptr)
 				progress->setValue(progress->getValue()
 						+ render_context.tile_set->getContainingRenderTiles(tile));
@@ -150,28 +144,17 @@ void TileRenderWorker::renderRecursive(const TilePath& tile, RGBAImage& image) {
 
 		RGBAImage other;
 		RGBAImage resized;
-		if (render_context.tile_set->hasTile(tile + 1)) {
-			renderRecursive(tile + 1, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, 0, 0);
-			other.clear();
-		}
-		if (render_context.tile_set->hasTile(tile + 2)) {
-			renderRecursive(tile + 2, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, w / 2, 0);
-			other.clear();
-		}
-		if (render_context.tile_set->hasTile(tile + 3)) {
-			renderRecursive(tile + 3, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, 0, h / 2);
-			other.clear();
-		}
-		if (render_context.tile_set->hasTile(tile + 4)) {
-			renderRecursive(tile + 4, other);
-			other.resize(resized, 0, 0, InterpolationType::HALF);
-			image.simpleAlphaBlit(resized, w / 2, h / 2);
+		for (int i = 1; i <= 4; i++) {
+			TilePath child = tile + i;
+			if (!render_context.tile_set->hasTile(child))
+				continue;
+			// use the downscaled image of the child tile if another worker just rendered it
+			if (!takeCachedTile(child, resized)) {
+				renderRecursive(child, other);
+				other.resize(resized, 0, 0, InterpolationType::HALF);
+				other.clear();
+			}
+			image.simpleAlphaBlit(resized, i % 2 == 1 ? 0 : w / 2, i <= 2 ? 0 : h / 2);
 		}
 
 		/*
@@ -205,6 +188,13 @@ void TileRenderWorker::operator()() {
 		// render this composite tile
 		renderRecursive(*it, image);
 
+		// hand the tile over to the worker composing the parent tile
+		if (render_context.tile_image_cache && it->getDepth() > 0) {
+			RGBAImage resized;
+			image.resize(resized, 0, 0, InterpolationType::HALF);
+			render_context.tile_image_cache->put(*it, resized);
+		}
+
 		// clear image
 		image.clear();
 	}
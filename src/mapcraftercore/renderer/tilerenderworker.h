@@ -35,6 +35,7 @@ namespace mapcrafter {
 
 namespace mc {
 class BlockStateRegistry;
+class ChunkCache;
 class WorldCache;
 }
 
@@ -44,9 +45,11 @@ class BlockImages;
 class RenderMode;
 class RenderView;
 class RGBAImage;
+class TileImageCache;
 class TilePath;
 class TileRenderer;
 class TileSet;
+class TileStorage;
 
 struct RenderContext {
 	fs::path output_dir;
@@ -59,6 +62,12 @@ struct RenderContext {
 	TileSet* tile_set;
 	mc::BlockStateRegistry* block_registry;
 	std::shared_ptr<mc::World> world;
+	// chunk cache shared by the world caches of all threads, may be empty
+	std::shared_ptr<mc::ChunkCache> chunk_cache;
+	// hand-off of downscaled tile images to the parent composite tiles, may be empty
+	std::shared_ptr<TileImageCache> tile_image_cache;
+	// where the tile images are read from and written to
+	std::shared_ptr<TileStorage> tile_storage;
 
 	std::shared_ptr<mc::WorldCache> world_cache;
 	std::shared_ptr<RenderMode> render_mode;
@@ -104,6 +113,12 @@ public:
 	void operator()();
 
 private:
+	/**
+	 * Takes the downscaled image of a skipped child tile from the tile image cache.
+	 * Returns false if it is not cached and the tile has to be read from disk.
+	 */
+	bool takeCachedTile(const TilePath& tile, RGBAImage& image);
+
 	RenderContext render_context;
 	RenderWork render_work;
 	RenderWorkResult render_work_result;
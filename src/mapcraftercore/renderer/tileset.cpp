@@ -19,18 +19,26 @@
 
 #include "tileset.h"
 
+#include "tilestorage.h"
 #include "../mc/chunk.h"
+#include "../mc/chunkindex.h"
 #include "../mc/pos.h"
+#include "../mc/region.h"
 #include "../mc/world.h"
+#include "../compat/thread.h"
+#include "../util.h"
 
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <ctime>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <set>
 #include <sstream>
+#include <thread>
 
 namespace mapcrafter {
 namespace renderer {
@@ -226,53 +234,144 @@ TileSet::TileSet(int tile_width, const RenderRotation& rotation)
 TileSet::~TileSet() {
 }
 
+/**
+ * The tiles (with timestamps) and tile bounds found by a scan thread.
+ */
+struct TileSet::ScannedTiles {
+	ScannedTiles()
+		: x_min(std::numeric_limits<int>::max()), x_max(std::numeric_limits<int>::min()),
+		  y_min(std::numeric_limits<int>::max()), y_max(std::numeric_limits<int>::min()) {}
+
+	std::vector<std::pair<TilePos, int>> tiles;
+	int x_min, x_max, y_min, y_max;
+};
+
+namespace {
+
+bool compareTiles(const std::pair<TilePos, int>& a, const std::pair<TilePos, int>& b) {
+	return a.first < b.first;
+}
+
+/**
+ * Sorts a list of tiles with timestamps and removes duplicate tiles, the remaining tile
+ * gets the highest timestamp of its duplicates.
+ */
+void mergeTiles(std::vector<std::pair<TilePos, int>>& tiles) {
+	std::sort(tiles.begin(), tiles.end(), compareTiles);
+	size_t unique = 0;
+	for (size_t i = 0; i < tiles.size(); i++) {
+		if (unique > 0 && tiles[unique - 1].first == tiles[i].first)
+			tiles[unique - 1].second = std::max(tiles[unique - 1].second, tiles[i].second);
+		else
+			tiles[unique++] = tiles[i];
+	}
+	tiles.resize(unique);
+}
+
+}
+
+void TileSet::scanRegions(mc::ChunkIndex& chunk_index,
+		const std::vector<mc::RegionPos>& regions, std::atomic<size_t>& next_region,
+		ScannedTiles& scanned) {
+	std::set<TilePos> tiles;
+	std::vector<std::pair<mc::ChunkPos, uint32_t>> region_chunks;
+	// number of tiles after the last merge
+	size_t merged_size = 0;
+	size_t i;
+	while ((i = next_region++) < regions.size()) {
+		// the chunks come with the time of their last change, which is older than the
+		// timestamp in the region header if Minecraft saved a chunk without changing it
+		if (!chunk_index.getRegionChunks(regions[i], region_chunks))
+			continue;
+		for (auto chunk_it = region_chunks.begin(); chunk_it != region_chunks.end();
+		        ++chunk_it) {
+			int timestamp = chunk_it->second;
+
+			// now get all tiles of the chunk
+			tiles.clear();
+			mapChunkToTiles(chunk_it->first, tiles);
+			for (auto tile_it = tiles.begin(); tile_it != tiles.end(); ++tile_it) {
+				// update the bounds
+				scanned.x_min = std::min(scanned.x_min, tile_it->getX());
+				scanned.x_max = std::max(scanned.x_max, tile_it->getX());
+				scanned.y_min = std::min(scanned.y_min, tile_it->getY());
+				scanned.y_max = std::max(scanned.y_max, tile_it->getY());
+				scanned.tiles.push_back(std::make_pair(*tile_it, timestamp));
+			}
+		}
+
+		// neighboring chunks share most of their tiles, so get rid of duplicates
+		// from time to time to keep the memory usage low, the tiles are merged again
+		// only when they doubled so that merging doesn't get quadratic for big worlds
+		if (scanned.tiles.size() > std::max<size_t>(1 << 20, 2 * merged_size)) {
+			mergeTiles(scanned.tiles);
+			merged_size = scanned.tiles.size();
+		}
+	}
+	mergeTiles(scanned.tiles);
+}
+
 void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
-		TilePos& tile_offset) {
+		TilePos& tile_offset, int threads) {
 	// clear maybe already calculated tiles
 	render_tiles.clear();
 	required_render_tiles.clear();
+	tile_timestamps.clear();
+
+	// go through all chunks in the world, the region files are distributed dynamically
+	// across the scan threads, each collecting the tiles of its regions on its own
+	const mc::World::RegionSet& region_set = world.getAvailableRegions();
+	std::vector<mc::RegionPos> regions(region_set.begin(), region_set.end());
+	threads = std::max(1, std::min(threads, (int) regions.size()));
+	// the regions are looked up in the chunk index of the world, so the headers of
+	// regions that did not change since the last scan don't need to be read
+	mc::ChunkIndex chunk_index(world);
+	chunk_index.read();
+	std::atomic<size_t> next_region(0);
+	std::vector<ScannedTiles> scanned(threads);
+	if (threads == 1) {
+		scanRegions(chunk_index, regions, next_region, scanned[0]);
+	} else {
+		std::vector<thread_ns::thread> scan_threads;
+		for (int i = 0; i < threads; i++)
+			scan_threads.push_back(thread_ns::thread(&TileSet::scanRegions, this,
+					std::ref(chunk_index), std::cref(regions), std::ref(next_region),
+					std::ref(scanned[i])));
+		for (int i = 0; i < threads; i++)
+			scan_threads[i].join();
+	}
+	chunk_index.write();
 
+	mc::ChunkIndexStats stats = chunk_index.getStats();
+	LOG(DEBUG) << "Chunk index: " << stats.regions_unchanged << " regions unchanged, "
+			<< stats.regions_updated << " regions updated, " << stats.chunks_changed
+			<< " chunks changed, " << stats.chunks_touched << " chunks saved without changes.";
+
+	// merge the tiles of all threads
 	// the min/max x/y coordinates of the tiles in the world
 	int tiles_x_min = std::numeric_limits<int>::max(),
 	    tiles_x_max = std::numeric_limits<int>::min(),
 	    tiles_y_min = std::numeric_limits<int>::max(),
 	    tiles_y_max = std::numeric_limits<int>::min();
-
-	// go through all chunks in the world
-	auto regions = world.getAvailableRegions();
-	for (auto region_it = regions.begin(); region_it != regions.end(); ++region_it) {
-		mc::RegionFile region;
-		if (!world.getRegion(*region_it, region) || !region.readOnlyHeaders())
-			continue;
-		const std::set<mc::ChunkPos>& region_chunks = region.getContainingChunks();
-		for (auto chunk_it = region_chunks.begin(); chunk_it != region_chunks.end();
-		        ++chunk_it) {
-			int timestamp = region.getChunkTimestamp(*chunk_it);
-
-			// now get all tiles of the chunk
-			std::set<TilePos> tiles;
-			mapChunkToTiles(*chunk_it, tiles);
-			for (std::set<TilePos>::const_iterator tile_it = tiles.begin();
-			        tile_it != tiles.end(); ++tile_it) {
-
-				// and update the bounds
-				tiles_x_min = std::min(tiles_x_min, tile_it->getX());
-				tiles_x_max = std::max(tiles_x_max, tile_it->getX());
-				tiles_y_min = std::min(tiles_y_min, tile_it->getY());
-				tiles_y_max = std::max(tiles_y_max, tile_it->getY());
-
-				// update tile timestamp
-				if (!render_tiles.count(*tile_it))
-					tile_timestamps[*tile_it] = timestamp;
-				else
-					tile_timestamps[*tile_it] = std::max(tile_timestamps[*tile_it], timestamp);
-
-				// insert the tile to the set of available render tiles
-				// and also make it required by default
-				render_tiles.insert(*tile_it);
-				required_render_tiles.insert(*tile_it);
-			}
-		}
+	std::vector<std::pair<TilePos, int>> tiles;
+	for (int i = 0; i < threads; i++) {
+		tiles_x_min = std::min(tiles_x_min, scanned[i].x_min);
+		tiles_x_max = std::max(tiles_x_max, scanned[i].x_max);
+		tiles_y_min = std::min(tiles_y_min, scanned[i].y_min);
+		tiles_y_max = std::max(tiles_y_max, scanned[i].y_max);
+		tiles.insert(tiles.end(), scanned[i].tiles.begin(), scanned[i].tiles.end());
+		std::vector<std::pair<TilePos, int>>().swap(scanned[i].tiles);
+	}
+	if (threads > 1)
+		mergeTiles(tiles);
+
+	// every tile is also required by default
+	render_tiles.reserve(tiles.size());
+	tile_timestamps.reserve(tiles.size());
+	for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+		render_tiles.push_back(it->first);
+		tile_timestamps.push_back(it->second);
+		required_render_tiles.insert(required_render_tiles.end(), it->first);
 	}
 
 	// center tiles
@@ -281,19 +380,14 @@ void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
 		if (auto_center)
 			tile_offset = TilePos((tiles_x_min + tiles_x_max) / 2, (tiles_y_min + tiles_y_max) / 2);
 
-		// update all tile positions
-		std::set<TilePos> render_tiles_tmp, required_render_tiles_tmp;
-		std::map<TilePos, int> tile_timestamps_tmp;
+		// update all tile positions, moving all tiles by the same offset doesn't
+		// change their order
+		std::set<TilePos> required_render_tiles_tmp;
 		for (auto it = render_tiles.begin(); it != render_tiles.end(); ++it)
-			render_tiles_tmp.insert(*it - tile_offset);
+			*it -= tile_offset;
 		for (auto it = required_render_tiles.begin(); it != required_render_tiles.end(); ++it)
-			required_render_tiles_tmp.insert(*it - tile_offset);
-		for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it)
-			tile_timestamps_tmp[it->first - tile_offset] = it->second;
-
-		render_tiles = render_tiles_tmp;
-		required_render_tiles = required_render_tiles_tmp;
-		tile_timestamps = tile_timestamps_tmp;
+			required_render_tiles_tmp.insert(required_render_tiles_tmp.end(), *it - tile_offset);
+		required_render_tiles.swap(required_render_tiles_tmp);
 		this->tile_offset = tile_offset;
 	}
 
@@ -310,12 +404,13 @@ void TileSet::findRenderTiles(const mc::World& world, bool auto_center,
 	}
 }
 
-void TileSet::findRequiredCompositeTiles(const std::set<TilePos>& render_tiles,
+template <typename Container>
+void TileSet::findRequiredCompositeTiles(const Container& render_tiles,
 		std::set<TilePath>& tiles) {
 
 	// iterate through the render tiles on the max zoom level
 	// add their parent composite tiles
-	for (std::set<TilePos>::iterator it = render_tiles.begin(); it != render_tiles.end(); ++it) {
+	for (auto it = render_tiles.begin(); it != render_tiles.end(); ++it) {
 		TilePath path = TilePath::byTilePos(*it, depth);
 		tiles.insert(path.parent());
 	}
@@ -350,21 +445,22 @@ void TileSet::updateContainingRenderTiles() {
 	}
 }
 
-void TileSet::scan(const mc::World& world) {
+void TileSet::scan(const mc::World& world, int threads) {
 	TilePos tile_offset(0, 0);
-	scan(world, false, tile_offset);
+	scan(world, false, tile_offset, threads);
 }
 
-void TileSet::scan(const mc::World& world, bool auto_center, TilePos& tile_offset) {
-	findRenderTiles(world, auto_center, tile_offset);
+void TileSet::scan(const mc::World& world, bool auto_center, TilePos& tile_offset,
+		int threads) {
+	findRenderTiles(world, auto_center, tile_offset, threads);
 	setDepth(min_depth);
 }
 
 void TileSet::resetRequired() {
 	required_render_tiles.clear();
 
-	for (auto it = tile_timestamps.begin(); it != tile_timestamps.end(); ++it)
-		required_render_tiles.insert(it->first);
+	for (auto it = render_tiles.begin(); it != render_tiles.end(); ++it)
+		required_render_tiles.insert(required_render_tiles.end(), *it);
 
 	required_composite_tiles.clear();
 	findRequiredCompositeTiles(required_render_tiles, required_composite_tiles);
@@ -375,10 +471,9 @@ void TileSet::resetRequired() {
 void TileSet::scanRequiredByTimestamp(int last_change) {
 	required_render_tiles.clear();
 
-	for (std::map<TilePos, int>::iterator it = tile_timestamps.begin();
-			it != tile_timestamps.end(); ++it) {
-		if (it->second >= last_change)
-			required_render_tiles.insert(it->first);
+	for (size_t i = 0; i < render_tiles.size(); i++) {
+		if (tile_timestamps[i] >= last_change)
+			required_render_tiles.insert(required_render_tiles.end(), render_tiles[i]);
 	}
 
 	required_composite_tiles.clear();
@@ -387,16 +482,14 @@ void TileSet::scanRequiredByTimestamp(int last_change) {
 	updateContainingRenderTiles();
 }
 
-void TileSet::scanRequiredByFiletimes(const fs::path& output_dir,
-		std::string image_format) {
+void TileSet::scanRequiredByFiletimes(const TileStorage& tile_storage) {
 	required_render_tiles.clear();
 
-	for (std::map<TilePos, int>::iterator it = tile_timestamps.begin();
-			it != tile_timestamps.end(); ++it) {
-		TilePath path = TilePath::byTilePos(it->first, depth);
-		fs::path file = output_dir / (path.toString() + "." + image_format);
-		if (!fs::exists(file) || fs::last_write_time(file) <= it->second)
-			required_render_tiles.insert(it->first);
+	for (size_t i = 0; i < render_tiles.size(); i++) {
+		TilePath path = TilePath::byTilePos(render_tiles[i], depth);
+		std::time_t mtime;
+		if (!tile_storage.getTileTime(path, mtime) || mtime <= tile_timestamps[i])
+			required_render_tiles.insert(required_render_tiles.end(), render_tiles[i]);
 	}
 
 	required_composite_tiles.clear();
@@ -440,7 +533,8 @@ const TilePos& TileSet::getTileOffset() const {
 
 bool TileSet::hasTile(const TilePath& path) const {
 	if (path.getDepth() == depth)
-		return render_tiles.count(path.getTilePos()) != 0;
+		return std::binary_search(render_tiles.begin(), render_tiles.end(),
+				path.getTilePos());
 	return composite_tiles.count(path) != 0;
 }
 
@@ -467,6 +561,8 @@ const std::set<TilePath>& TileSet::getRequiredCompositeTiles() const {
 }
 
 int TileSet::getContainingRenderTiles(const TilePath& tile) const {
+	if (tile.getDepth() == depth)
+		return isTileRequired(tile) ? 1 : 0;
 	return containing_render_tiles.at(tile);
 }
 
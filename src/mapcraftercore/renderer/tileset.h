@@ -20,6 +20,7 @@
 #ifndef TILE_H_
 #define TILE_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -63,12 +64,16 @@ namespace fs = boost::filesystem;
 namespace mapcrafter {
 
 namespace mc {
+class ChunkIndex;
 class ChunkPos;
+class RegionPos;
 class World;
 }
 
 namespace renderer {
 
+class TileStorage;
+
 /**
  * This class represents the position of a tile in the quadtree.
  */
@@ -180,9 +185,12 @@ public:
 	 * found tiles. If set to false (default), it will use tile_offset as center. The
 	 * default value for tile_offset is (0, 0) when using scan without the
 	 * auto_center and tile_offset parameters.
+	 *
+	 * The region files are scanned with the specified count of threads.
 	 */
-	void scan(const mc::World& world);
-	void scan(const mc::World& world, bool auto_center, TilePos& tile_offset);
+	void scan(const mc::World& world, int threads = 1);
+	void scan(const mc::World& world, bool auto_center, TilePos& tile_offset,
+			int threads = 1);
 
 	/**
 	 * Resets which tiles are required / not required. All tiles will be required.
@@ -197,10 +205,9 @@ public:
 
 	/**
 	 * Scans which tiles are required by using the modification times of the already
-	 * rendered image files.
+	 * rendered tile images.
 	 */
-	void scanRequiredByFiletimes(const fs::path& output_dir,
-			std::string image_format = "png");
+	void scanRequiredByFiletimes(const TileStorage& tile_storage);
 
 	/**
 	 * Returns the width of the tiles in chunks.
@@ -260,6 +267,7 @@ public:
 
 	/**
 	 * Returns the count of required render tiles a specific composite tiles contains.
+	 * For a render tile this is 1 if it is required, otherwise 0.
 	 */
 	int getContainingRenderTiles(const TilePath& tile) const;
 
@@ -268,6 +276,8 @@ protected:
 	const RenderRotation& rotation;
 
 private:
+	struct ScannedTiles;
+
 	// width of the tiles in chunks
 	int tile_width;
 
@@ -281,14 +291,14 @@ private:
 	// but are actually rendered as pos+tile_offset
 	TilePos tile_offset;
 
-	// all available render tiles
+	// all available render tiles, sorted
 	// (= tiles with the highest zoom level, tree leaves in the quadtree)
-	std::set<TilePos> render_tiles;
+	std::vector<TilePos> render_tiles;
 	// the render tiles which actually need to get rendered
 	std::set<TilePos> required_render_tiles;
-	// timestamps of render tiles required to re-render a tile
-	// (= highest timestamp of all chunks in a tile)
-	std::map<TilePos, int> tile_timestamps;
+	// timestamps of the render tiles (same order as render_tiles) required to
+	// re-render a tile (= highest timestamp of all chunks in a tile)
+	std::vector<int> tile_timestamps;
 
 	// same here for composite tiles
 	std::set<TilePath> composite_tiles;
@@ -304,7 +314,16 @@ private:
 	 * The auto_center parameter describes whether it should automatically center the
 	 * found tiles. If set to false (default), it will use tile_offset as center.
 	 */
-	void findRenderTiles(const mc::World& world, bool auto_center, TilePos& tile_offset);
+	void findRenderTiles(const mc::World& world, bool auto_center, TilePos& tile_offset,
+			int threads);
+
+	/**
+	 * Collects the tiles of the chunks of the supplied regions, used by the scan threads
+	 * of findRenderTiles. The regions are taken one after another with the shared
+	 * next_region index.
+	 */
+	void scanRegions(mc::ChunkIndex& chunk_index, const std::vector<mc::RegionPos>& regions,
+			std::atomic<size_t>& next_region, ScannedTiles& scanned);
 
 	/**
 	 * This method finds out which composite tiles are needed, depending on a
@@ -312,7 +331,8 @@ private:
 	 * So we can find out which composite tiles are available and which composite tiles
 	 * need to get rendered.
 	 */
-	void findRequiredCompositeTiles(const std::set<TilePos>& render_tiles,
+	template <typename Container>
+	void findRequiredCompositeTiles(const Container& render_tiles,
 			std::set<TilePath>& tiles);
 
 	/**
@@ -0,0 +1,622 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilestorage.h"
+
+#include "tilededuplicator.h"
+#include "tileset.h"
+#include "image/pngencoder.h"
+#include "../util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <sstream>
+
+namespace mapcrafter {
+namespace renderer {
+
+namespace {
+
+const char PACK_MAGIC[] = "MCTPACK1";
+const char INDEX_MAGIC[] = "MCTI";
+// magic, offset of the newest index block, end of the pack
+const size_t HEADER_SIZE = 8 + 8 + 8;
+// magic, offset of the previous index block, size of the entries, number of entries
+const size_t INDEX_HEADER_SIZE = 4 + 8 + 4 + 4;
+
+void writeInt(std::string& out, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+uint64_t readInt(const char* data, int bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (uint64_t) (uint8_t) data[i] << (8 * i);
+	return value;
+}
+
+std::string createHeader(uint64_t index_offset, uint64_t end) {
+	std::string header(PACK_MAGIC, 8);
+	writeInt(header, index_offset, 8);
+	writeInt(header, end, 8);
+	return header;
+}
+
+}
+
+TileFormat::TileFormat()
+	: image_format(config::ImageFormat::PNG), png_indexed(false), png_fast(false),
+	  jpeg_quality(85),
+	  background(rgba(255, 255, 255, 255)) {
+}
+
+std::string TileFormat::getSuffix() const {
+	if (image_format == config::ImageFormat::PNG)
+		return "png";
+	return "jpg";
+}
+
+TileStorage::TileStorage(const TileFormat& format)
+	: format(format) {
+}
+
+TileStorage::~TileStorage() {
+}
+
+const TileFormat& TileStorage::getFormat() const {
+	return format;
+}
+
+void TileStorage::setDeduplicator(std::shared_ptr<TileDeduplicator> deduplicator) {
+	this->deduplicator = deduplicator;
+}
+
+bool TileStorage::readTile(const TilePath& tile, RGBAImage& image) const {
+	return readTileImage(getTileFile(tile), image);
+}
+
+bool TileStorage::writeTile(const TilePath& tile, const RGBAImage& image) {
+	std::string file = getTileFile(tile);
+
+	// reuse the data of an already written tile with the same image if possible
+	TileHash hash;
+	if (deduplicator) {
+		hash = TileDeduplicator::hash(image);
+		std::string source;
+		if (deduplicator->find(hash, source) && source != file
+				&& linkTile(file, source)) {
+			deduplicator->addLink(hash);
+			return true;
+		}
+	}
+
+	if (!writeTileImage(file, image))
+		return false;
+	if (deduplicator)
+		deduplicator->add(hash, file);
+	return true;
+}
+
+bool TileStorage::flush() {
+	return true;
+}
+
+std::string TileStorage::getTileName(const TilePath& tile) {
+	if (tile.getDepth() == 0)
+		return "base";
+	return tile.toString();
+}
+
+std::string TileStorage::getTileFile(const TilePath& tile) const {
+	return getTileName(tile) + "." + format.getSuffix();
+}
+
+bool TileStorage::encodeImage(const RGBAImage& image, std::string& data) const {
+	bool png = format.image_format == config::ImageFormat::PNG;
+	if (png && !format.png_indexed && format.png_fast)
+		return PNGEncoder::encodeWithThreadEncoder(image, format.png_options, data);
+
+	std::ostringstream out;
+	bool encoded;
+	if (png && format.png_indexed)
+		encoded = image.writeIndexedPNG(out, 8, true, format.png_options);
+	else if (png)
+		encoded = image.writePNG(out, format.png_options);
+	else
+		encoded = image.writeJPEG(out, format.jpeg_quality, format.background);
+	data = out.str();
+	return encoded;
+}
+
+bool TileStorage::decodeImage(std::istream& in, RGBAImage& image) const {
+	if (format.image_format == config::ImageFormat::PNG)
+		return image.readPNG(in);
+	return image.readJPEG(in);
+}
+
+FileTileStorage::FileTileStorage(const fs::path& output_dir, const TileFormat& format)
+	: TileStorage(format), output_dir(output_dir) {
+}
+
+FileTileStorage::~FileTileStorage() {
+}
+
+bool FileTileStorage::getTileTime(const TilePath& tile, std::time_t& time) const {
+	boost::system::error_code error;
+	std::time_t mtime = fs::last_write_time(output_dir / getTileFile(tile), error);
+	if (error)
+		return false;
+	time = mtime;
+	return true;
+}
+
+void FileTileStorage::moveTiles(const TilePath& from, const TilePath& to) {
+	fs::path from_dir = output_dir / getTileName(from);
+	fs::path to_dir = output_dir / getTileName(to);
+	if (!fs::exists(from_dir))
+		return;
+
+	// rename the directory first, the new path might be inside of it
+	fs::path tmp_dir = from_dir.string() + "_";
+	util::moveFile(from_dir, tmp_dir);
+	fs::create_directories(to_dir.parent_path());
+	util::moveFile(tmp_dir, to_dir);
+	// also move the image of the directory
+	util::moveFile(output_dir / getTileFile(from), output_dir / getTileFile(to));
+}
+
+bool FileTileStorage::readTileImage(const std::string& file, RGBAImage& image) const {
+	std::ifstream in((output_dir / file).string().c_str(), std::ios::binary);
+	if (!in)
+		return false;
+	return decodeImage(in, image);
+}
+
+bool FileTileStorage::writeTileImage(const std::string& file, const RGBAImage& image) {
+	fs::path path = output_dir / file;
+	if (!fs::exists(path.parent_path()))
+		fs::create_directories(path.parent_path());
+
+	std::string data;
+	if (!encodeImage(image, data))
+		return false;
+
+	// the tile file might be a link to the files of other tiles (from deduplication),
+	// so it must not be overwritten in place
+	boost::system::error_code error;
+	uintmax_t links = fs::hard_link_count(path, error);
+	if (!error && links > 1)
+		fs::remove(path, error);
+
+	std::ofstream out(path.string().c_str(), std::ios::binary);
+	if (!out)
+		return false;
+	out.write(data.data(), data.size());
+	out.close();
+	return !out.fail();
+}
+
+bool FileTileStorage::linkTile(const std::string& file, const std::string& source) {
+	fs::path path = output_dir / file;
+	fs::path source_path = output_dir / source;
+	if (!fs::exists(path.parent_path()))
+		fs::create_directories(path.parent_path());
+
+	// the old tile file is replaced, it might be a link to another tile itself
+	boost::system::error_code error;
+	fs::remove(path, error);
+	fs::create_hard_link(source_path, path, error);
+	if (error) {
+		error.clear();
+		fs::copy_file(source_path, path, error);
+		if (error)
+			return false;
+	}
+	return true;
+}
+
+const size_t PackTileStorage::COMMIT_TILES = 1024;
+const int PackTileStorage::MAX_INDEX_BLOCKS = 64;
+
+PackTileStorage::PackTileStorage(const fs::path& file, const TileFormat& format)
+	: TileStorage(format), path(file), read_only(true), index_offset(0),
+	  end(HEADER_SIZE), append(HEADER_SIZE), index_blocks(0) {
+}
+
+PackTileStorage::~PackTileStorage() {
+	if (stream.is_open())
+		flush();
+}
+
+bool PackTileStorage::open(bool read_only) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return openLocked(read_only);
+}
+
+bool PackTileStorage::openLocked(bool read_only) {
+	this->read_only = read_only;
+	if (stream.is_open())
+		stream.close();
+	entries.clear();
+	pending.clear();
+
+	boost::system::error_code error;
+	if (!fs::exists(path, error)) {
+		if (read_only)
+			return false;
+		std::ofstream out(path.string().c_str(), std::ios::binary);
+		out << createHeader(0, HEADER_SIZE);
+		if (!out)
+			return false;
+	}
+
+	if (!readHeader(path, index_offset, end))
+		return false;
+	uint64_t size = fs::file_size(path, error);
+	if (error || end < HEADER_SIZE || end > size)
+		return false;
+
+	// discard the data of tiles which were written after the last index block
+	if (!read_only && size > end)
+		fs::resize_file(path, end, error);
+	if (error)
+		return false;
+
+	std::ios::openmode mode = std::ios::in | std::ios::binary;
+	if (!read_only)
+		mode |= std::ios::out;
+	stream.open(path.string().c_str(), mode);
+	if (!stream)
+		return false;
+	append = end;
+	return readIndex();
+}
+
+bool PackTileStorage::readHeader(const fs::path& file, uint64_t& index_offset,
+		uint64_t& end) {
+	char header[HEADER_SIZE];
+	std::ifstream in(file.string().c_str(), std::ios::binary);
+	if (!in.read(header, HEADER_SIZE) || std::memcmp(header, PACK_MAGIC, 8) != 0)
+		return false;
+	index_offset = readInt(header + 8, 8);
+	end = readInt(header + 16, 8);
+	return true;
+}
+
+bool PackTileStorage::getTileTime(const TilePath& tile, std::time_t& time) const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = entries.find(getTileFile(tile));
+	if (it == entries.end())
+		return false;
+	time = it->second.mtime;
+	return true;
+}
+
+void PackTileStorage::moveTiles(const TilePath& from, const TilePath& to) {
+	std::string from_name = getTileName(from);
+	std::string to_name = getTileName(to);
+
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	// the tile itself ("1.png") and its children ("1/...")
+	std::vector<std::pair<std::string, TilePackEntry>> moved;
+	for (auto it = entries.lower_bound(from_name); it != entries.end()
+			&& it->first.compare(0, from_name.size(), from_name) == 0; ++it) {
+		char separator = it->first.size() > from_name.size() ? it->first[from_name.size()] : 0;
+		if (separator == '/' || separator == '.')
+			moved.push_back(*it);
+	}
+
+	// remove all moved tiles first, the new paths might be old paths of moved tiles
+	for (auto it = moved.begin(); it != moved.end(); ++it)
+		addEntry(it->first, TilePackEntry());
+	for (auto it = moved.begin(); it != moved.end(); ++it)
+		addEntry(to_name + it->first.substr(from_name.size()), it->second);
+}
+
+bool PackTileStorage::flush() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	if (read_only || !stream.is_open())
+		return true;
+	return commit(index_blocks >= MAX_INDEX_BLOCKS);
+}
+
+std::map<std::string, TilePackEntry> PackTileStorage::getEntries() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	return entries;
+}
+
+bool PackTileStorage::readTileData(const std::string& file, std::string& data) const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = entries.find(file);
+	if (it == entries.end())
+		return false;
+	data.resize(it->second.size);
+	stream.clear();
+	stream.seekg(it->second.offset);
+	return (bool) stream.read(&data[0], data.size());
+}
+
+bool PackTileStorage::writeTileData(const std::string& file, const std::string& data,
+		std::time_t mtime) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	if (read_only || data.empty())
+		return false;
+	stream.clear();
+	stream.seekp(append);
+	if (!stream.write(data.data(), data.size()))
+		return false;
+
+	TilePackEntry entry;
+	entry.offset = append;
+	entry.size = data.size();
+	entry.mtime = mtime;
+	append += data.size();
+	addEntry(file, entry);
+	if (pending.size() >= COMMIT_TILES)
+		return commit(false);
+	return true;
+}
+
+uint64_t PackTileStorage::getUnusedSize() const {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	std::set<uint64_t> used_offsets;
+	uint64_t used = 0;
+	for (auto it = entries.begin(); it != entries.end(); ++it)
+		if (used_offsets.insert(it->second.offset).second)
+			used += it->second.size;
+
+	// the blocks of the current index are used as well, replaced index blocks are not
+	uint64_t index_size = 0;
+	for (uint64_t offset = index_offset; offset != 0; ) {
+		char header[INDEX_HEADER_SIZE];
+		stream.clear();
+		stream.seekg(offset);
+		if (!stream.read(header, INDEX_HEADER_SIZE))
+			break;
+		index_size += INDEX_HEADER_SIZE + readInt(header + 12, 4);
+		offset = readInt(header + 4, 8);
+	}
+	return append - HEADER_SIZE - used - index_size;
+}
+
+bool PackTileStorage::compact() {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	if (read_only)
+		return false;
+
+	fs::path tmp_path = path.string() + ".tmp";
+	boost::system::error_code error;
+	fs::remove(tmp_path, error);
+	bool ok = false;
+	{
+		PackTileStorage compacted(tmp_path, format);
+		ok = compacted.open();
+
+		// copy the images in the order they are in the pack, each only once
+		std::vector<std::pair<std::string, TilePackEntry>> sorted(entries.begin(), entries.end());
+		std::sort(sorted.begin(), sorted.end(),
+				[](const std::pair<std::string, TilePackEntry>& a,
+						const std::pair<std::string, TilePackEntry>& b) {
+			return a.second.offset < b.second.offset;
+		});
+		std::map<uint64_t, uint64_t> offsets;
+		std::string data;
+		for (auto it = sorted.begin(); ok && it != sorted.end(); ++it) {
+			TilePackEntry entry = it->second;
+			auto offset = offsets.find(entry.offset);
+			if (offset != offsets.end()) {
+				entry.offset = offset->second;
+			} else {
+				data.resize(entry.size);
+				stream.clear();
+				stream.seekg(entry.offset);
+				compacted.stream.seekp(compacted.append);
+				if (!stream.read(&data[0], data.size())
+						|| !compacted.stream.write(data.data(), data.size())) {
+					ok = false;
+					break;
+				}
+				offsets[entry.offset] = compacted.append;
+				entry.offset = compacted.append;
+				compacted.append += data.size();
+			}
+			compacted.addEntry(it->first, entry);
+		}
+		ok = ok && compacted.commit(true);
+		compacted.pending.clear();
+		compacted.stream.close();
+	}
+
+	if (!ok) {
+		fs::remove(tmp_path, error);
+		return false;
+	}
+
+	// reopen the pack (the compacted one or the old one if renaming failed) before
+	// other threads can access it again
+	stream.close();
+	fs::rename(tmp_path, path, error);
+	if (error) {
+		fs::remove(tmp_path, error);
+		openLocked(false);
+		return false;
+	}
+	return openLocked(false);
+}
+
+bool PackTileStorage::readTileImage(const std::string& file, RGBAImage& image) const {
+	std::string data;
+	if (!readTileData(file, data))
+		return false;
+	std::istringstream in(data);
+	return decodeImage(in, image);
+}
+
+bool PackTileStorage::writeTileImage(const std::string& file, const RGBAImage& image) {
+	std::string data;
+	if (!encodeImage(image, data))
+		return false;
+	return writeTileData(file, data, std::time(nullptr));
+}
+
+bool PackTileStorage::linkTile(const std::string& file, const std::string& source) {
+	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+	auto it = entries.find(source);
+	if (read_only || it == entries.end())
+		return false;
+	TilePackEntry entry = it->second;
+	entry.mtime = std::time(nullptr);
+	addEntry(file, entry);
+	if (pending.size() >= COMMIT_TILES)
+		return commit(false);
+	return true;
+}
+
+bool PackTileStorage::readIndex() {
+	// newer index blocks replace the entries of older ones
+	std::set<std::string> seen;
+	index_blocks = 0;
+	for (uint64_t offset = index_offset; offset != 0; ) {
+		char header[INDEX_HEADER_SIZE];
+		if (offset + INDEX_HEADER_SIZE > end)
+			return false;
+		stream.seekg(offset);
+		if (!stream.read(header, INDEX_HEADER_SIZE)
+				|| std::memcmp(header, INDEX_MAGIC, 4) != 0)
+			return false;
+		uint64_t previous = readInt(header + 4, 8);
+		uint64_t size = readInt(header + 12, 4);
+		uint64_t count = readInt(header + 16, 4);
+		if (previous >= offset || offset + INDEX_HEADER_SIZE + size > end)
+			return false;
+
+		std::string data(size, '\0');
+		if (size > 0 && !stream.read(&data[0], size))
+			return false;
+		std::vector<std::pair<std::string, TilePackEntry>> block;
+		size_t pos = 0;
+		for (uint64_t i = 0; i < count; i++) {
+			if (pos + 2 > size)
+				return false;
+			size_t length = readInt(&data[pos], 2);
+			if (pos + 2 + length + 20 > size)
+				return false;
+			std::pair<std::string, TilePackEntry> record;
+			record.first = data.substr(pos + 2, length);
+			pos += 2 + length;
+			record.second.offset = readInt(&data[pos], 8);
+			record.second.size = readInt(&data[pos + 8], 4);
+			record.second.mtime = (int64_t) readInt(&data[pos + 12], 8);
+			pos += 20;
+			if (record.second.offset + record.second.size > end)
+				return false;
+			block.push_back(record);
+		}
+
+		// also within a block, later entries replace earlier ones
+		for (auto it = block.rbegin(); it != block.rend(); ++it)
+			if (seen.insert(it->first).second && it->second.size > 0)
+				entries[it->first] = it->second;
+		index_blocks++;
+		offset = previous;
+	}
+	return true;
+}
+
+bool PackTileStorage::commit(bool full_index) {
+	if (pending.empty() && !full_index)
+		return true;
+
+	std::vector<std::pair<std::string, TilePackEntry>> records;
+	if (full_index)
+		records.assign(entries.begin(), entries.end());
+	else
+		records.swap(pending);
+
+	std::string data;
+	for (auto it = records.begin(); it != records.end(); ++it) {
+		writeInt(data, it->first.size(), 2);
+		data += it->first;
+		writeInt(data, it->second.offset, 8);
+		writeInt(data, it->second.size, 4);
+		writeInt(data, it->second.mtime, 8);
+	}
+	std::string block(INDEX_MAGIC, 4);
+	writeInt(block, full_index ? 0 : index_offset, 8);
+	writeInt(block, data.size(), 4);
+	writeInt(block, records.size(), 4);
+	block += data;
+
+	// the header is written last, it makes the new index block valid
+	stream.clear();
+	stream.seekp(append);
+	stream.write(block.data(), block.size());
+	stream.flush();
+	std::string header = createHeader(append, append + block.size());
+	stream.seekp(0);
+	stream.write(header.data(), header.size());
+	stream.flush();
+	if (!stream)
+		return false;
+
+	index_offset = append;
+	append += block.size();
+	end = append;
+	index_blocks = full_index ? 1 : index_blocks + 1;
+	pending.clear();
+	return true;
+}
+
+void PackTileStorage::addEntry(const std::string& file, const TilePackEntry& entry) {
+	if (entry.size == 0)
+		entries.erase(file);
+	else
+		entries[file] = entry;
+	pending.push_back(std::make_pair(file, entry));
+}
+
+TileStorage* createTileStorage(const config::MapSection& map_config,
+		const fs::path& output_dir, RGBAPixel background) {
+	TileFormat format;
+	format.image_format = map_config.getImageFormat();
+	format.png_indexed = map_config.isPNGIndexed();
+	format.png_options = map_config.getPNGOptions();
+	format.png_fast = map_config.getPNGEncoder() == config::PNGEncoderType::FAST;
+	format.jpeg_quality = map_config.getJPEGQuality();
+	format.background = background;
+
+	if (map_config.getTileStorage() == config::TileStorageType::PACK) {
+		fs::path file = output_dir / "tiles.pack";
+		if (!fs::exists(output_dir))
+			fs::create_directories(output_dir);
+		PackTileStorage* storage = new PackTileStorage(file, format);
+		if (!storage->open()) {
+			LOG(ERROR) << "Unable to open the tile pack '" << file.string() << "'.";
+			delete storage;
+			return nullptr;
+		}
+		return storage;
+	}
+	return new FileTileStorage(output_dir, format);
+}
+
+}
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILESTORAGE_H_
+#define TILESTORAGE_H_
+
+#include "image.h"
+#include "../config/configsections/map.h"
+#include "../compat/thread.h"
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace mapcrafter {
+namespace renderer {
+
+class TileDeduplicator;
+class TilePath;
+
+/**
+ * How the images of tiles are encoded.
+ */
+struct TileFormat {
+	TileFormat();
+
+	/**
+	 * Returns the file extension of the tile images ("png" or "jpg").
+	 */
+	std::string getSuffix() const;
+
+	config::ImageFormat image_format;
+	bool png_indexed;
+	PNGOptions png_options;
+	// whether RGBA PNGs are written with the built-in encoder instead of libpng
+	bool png_fast;
+	int jpeg_quality;
+	// background color of JPEG images, they don't have an alpha channel
+	RGBAPixel background;
+};
+
+/**
+ * Stores the images of the tiles of a rendered map (rotation).
+ *
+ * Tiles are addressed by their file names relative to the map rotation directory
+ * (for example "1/2/3.png" or "base.png"), no matter how the backend stores them. The
+ * render workers use the same tile storage concurrently, so implementations must be
+ * thread-safe.
+ */
+class TileStorage {
+public:
+	TileStorage(const TileFormat& format);
+	virtual ~TileStorage();
+
+	const TileFormat& getFormat() const;
+
+	/**
+	 * Sets the cache of already written tile images. If set, tiles with the same image
+	 * as an already written tile are linked to the data of that tile instead of being
+	 * encoded again.
+	 */
+	void setDeduplicator(std::shared_ptr<TileDeduplicator> deduplicator);
+
+	/**
+	 * Reads the image of a tile. Returns false if the tile does not exist or can't be
+	 * decoded.
+	 */
+	bool readTile(const TilePath& tile, RGBAImage& image) const;
+
+	/**
+	 * Encodes and writes the image of a tile.
+	 */
+	bool writeTile(const TilePath& tile, const RGBAImage& image);
+
+	/**
+	 * Returns the time a tile was written. Returns false if the tile does not exist.
+	 */
+	virtual bool getTileTime(const TilePath& tile, std::time_t& time) const = 0;
+
+	/**
+	 * Moves a tile and all of its child tiles to another path. The new path may be a
+	 * child of the old path (this is what happens when the max zoom level of a map is
+	 * increased).
+	 */
+	virtual void moveTiles(const TilePath& from, const TilePath& to) = 0;
+
+	/**
+	 * Makes sure that all written tiles are stored persistently.
+	 */
+	virtual bool flush();
+
+	/**
+	 * Returns the file name of a tile (without the extension), "base" for the tile at
+	 * the top of the tile tree.
+	 */
+	static std::string getTileName(const TilePath& tile);
+
+	/**
+	 * Returns the file name of a tile with the extension of the tile images.
+	 */
+	std::string getTileFile(const TilePath& tile) const;
+
+protected:
+	virtual bool readTileImage(const std::string& file, RGBAImage& image) const = 0;
+	virtual bool writeTileImage(const std::string& file, const RGBAImage& image) = 0;
+
+	/**
+	 * Writes a tile with the data of an already written tile.
+	 */
+	virtual bool linkTile(const std::string& file, const std::string& source) = 0;
+
+	/**
+	 * Encodes an image in memory.
+	 */
+	bool encodeImage(const RGBAImage& image, std::string& data) const;
+	bool decodeImage(std::istream& in, RGBAImage& image) const;
+
+	TileFormat format;
+	std::shared_ptr<TileDeduplicator> deduplicator;
+};
+
+/**
+ * Stores every tile as image file in a directory, this is the layout the web viewer
+ * reads the tiles from.
+ */
+class FileTileStorage : public TileStorage {
+public:
+	FileTileStorage(const fs::path& output_dir, const TileFormat& format);
+	virtual ~FileTileStorage();
+
+	virtual bool getTileTime(const TilePath& tile, std::time_t& time) const;
+	virtual void moveTiles(const TilePath& from, const TilePath& to);
+
+protected:
+	virtual bool readTileImage(const std::string& file, RGBAImage& image) const;
+	virtual bool writeTileImage(const std::string& file, const RGBAImage& image);
+
+	/**
+	 * Makes the tile file a hardlink to the file of the other tile, or a copy of it if
+	 * the file system doesn't support hardlinks.
+	 */
+	virtual bool linkTile(const std::string& file, const std::string& source);
+
+	fs::path output_dir;
+};
+
+/**
+ * An entry of a tile pack: Where the encoded image of a tile is in the pack file.
+ */
+struct TilePackEntry {
+	TilePackEntry() : offset(0), size(0), mtime(0) {}
+
+	uint64_t offset;
+	uint32_t size;
+	int64_t mtime;
+};
+
+/**
+ * Stores all tiles of a map rotation in a single append-only file (a tile pack).
+ *
+ * Millions of small tile files are slow to scan, copy and synchronize, and some file
+ * systems run out of inodes. A tile pack consists of a header, the encoded tile images
+ * and index blocks which map the tile file names to the images. Tiles are appended to
+ * the pack, and every now and then (and when the pack is flushed) an index block with
+ * the tiles written since the last one is appended. The header points to the newest
+ * index block, each index block points to the previous one.
+ *
+ * The header is updated after the data of the tiles and the index block is written.
+ * If rendering is aborted, the tiles written after the last index block are
+ * discarded the next time the pack is opened, but the pack stays consistent.
+ *
+ * Images of replaced tiles stay in the pack until it is compacted.
+ */
+class PackTileStorage : public TileStorage {
+public:
+	PackTileStorage(const fs::path& file, const TileFormat& format = TileFormat());
+	virtual ~PackTileStorage();
+
+	/**
+	 * Opens the pack file, a new one is created if it does not exist yet and the
+	 * pack is not opened read-only.
+	 */
+	bool open(bool read_only = false);
+
+	/**
+	 * Reads the offset of the newest index block and the end of the committed pack
+	 * from the header of a pack file. Both change with every commit of the pack.
+	 */
+	static bool readHeader(const fs::path& file, uint64_t& index_offset, uint64_t& end);
+
+	virtual bool getTileTime(const TilePath& tile, std::time_t& time) const;
+	virtual void moveTiles(const TilePath& from, const TilePath& to);
+
+	/**
+	 * Writes the index of the tiles written since the last flush.
+	 */
+	virtual bool flush();
+
+	/**
+	 * Returns the entries of all tiles in the pack.
+	 */
+	std::map<std::string, TilePackEntry> getEntries() const;
+
+	/**
+	 * Reads/writes the encoded image of a tile file.
+	 */
+	bool readTileData(const std::string& file, std::string& data) const;
+	bool writeTileData(const std::string& file, const std::string& data,
+			std::time_t mtime);
+
+	/**
+	 * Returns the size of the images in the pack which are not used by any tile.
+	 */
+	uint64_t getUnusedSize() const;
+
+	/**
+	 * Rewrites the pack without the images that are not used anymore.
+	 */
+	bool compact();
+
+	/**
+	 * Number of tiles after which an index block is written.
+	 */
+	static const size_t COMMIT_TILES;
+
+	/**
+	 * Number of index blocks after which the whole index is written again when the
+	 * pack is flushed, so opening the pack doesn't need to read too many blocks.
+	 */
+	static const int MAX_INDEX_BLOCKS;
+
+protected:
+	virtual bool readTileImage(const std::string& file, RGBAImage& image) const;
+	virtual bool writeTileImage(const std::string& file, const RGBAImage& image);
+
+	/**
+	 * Adds an entry of the tile which points to the image of the other tile.
+	 */
+	virtual bool linkTile(const std::string& file, const std::string& source);
+
+	bool readIndex();
+	bool commit(bool full_index);
+	void addEntry(const std::string& file, const TilePackEntry& entry);
+
+	fs::path path;
+	bool read_only;
+
+	mutable std::fstream stream;
+	// offset of the newest index block and the end of the committed pack
+	uint64_t index_offset, end;
+	// the position where new data is appended
+	uint64_t append;
+	int index_blocks;
+
+	std::map<std::string, TilePackEntry> entries;
+	// tiles changed since the last index block, removed tiles have size 0
+	std::vector<std::pair<std::string, TilePackEntry>> pending;
+
+	mutable thread_ns::mutex mutex;
+
+private:
+	/**
+	 * Opens the pack file like open(), the mutex must already be locked.
+	 */
+	bool openLocked(bool read_only);
+};
+
+/**
+ * Creates the tile storage configured for a map, output_dir is the directory of a map
+ * rotation. Returns a nullptr if the tile storage can't be opened.
+ */
+TileStorage* createTileStorage(const config::MapSection& map_config,
+		const fs::path& output_dir, RGBAPixel background);
+
+}
+}
+
+#endif /* TILESTORAGE_H_ */
@@ -20,6 +20,7 @@
 #ifndef DISPATCHER_H_
 #define DISPATCHER_H_
 
+#include "../mc/worldcache.h"
 #include "../util.h"
 
 namespace mapcrafter {
@@ -40,6 +41,21 @@ public:
 
 	virtual void dispatch(const renderer::RenderContext& context,
 			util::IProgressHandler* progress) = 0;
+
+	/**
+	 * Returns the region/chunk cache statistics of the world caches of all render
+	 * threads of the last dispatch.
+	 */
+	const mc::CacheStats& getRegionCacheStats() const {
+		return region_cache_stats;
+	}
+
+	const mc::CacheStats& getChunkCacheStats() const {
+		return chunk_cache_stats;
+	}
+
+protected:
+	mc::CacheStats region_cache_stats, chunk_cache_stats;
 };
 
 } /* namespace thread */
@@ -20,76 +20,187 @@
 #include "multithreading.h"
 
 #include "../../mc/worldcache.h"
+#include "../../renderer/tileimagecache.h"
+#include "../../renderer/tilerenderer.h"
 #include "../../renderer/tileset.h"
 #include "../../util.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <map>
 
 namespace mapcrafter {
 namespace thread {
 
-ThreadManager::ThreadManager()
-	: finished(false) {
+WorkStealingManager::WorkStealingManager(int workers)
+	: worker_count(workers), queued_tasks(0), remaining_tasks(0), rendered_tiles(0),
+	  idle_workers(0) {
+	for (int i = 0; i < worker_count; i++)
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
 }
 
-ThreadManager::~ThreadManager() {
+WorkStealingManager::~WorkStealingManager() {
 }
 
-void ThreadManager::addWork(const renderer::RenderWork& work) {
-	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	work_queue.push(work);
+bool WorkStealingManager::initialize(const renderer::TileSet& tile_set) {
+	int depth = tile_set.getDepth();
+	const std::set<renderer::TilePath>& composite_tiles = tile_set.getRequiredCompositeTiles();
+	const std::set<renderer::TilePos>& render_tiles_pos = tile_set.getRequiredRenderTiles();
+	if (render_tiles_pos.empty())
+		return false;
+
+	// create the composite tile tasks first, so we can link the children to them
+	std::map<renderer::TilePath, RenderTask*> composite_tasks;
+	for (auto tile_it = composite_tiles.begin(); tile_it != composite_tiles.end(); ++tile_it) {
+		RenderTask* task = new RenderTask();
+		tasks.push_back(std::unique_ptr<RenderTask>(task));
+		task->work.tiles.insert(*tile_it);
+		for (int i = 1; i <= 4; i++)
+			if (tile_set.hasTile(*tile_it + i))
+				task->work.tiles_skip.insert(*tile_it + i);
+		composite_tasks[*tile_it] = task;
+	}
+	for (auto task_it = composite_tasks.begin(); task_it != composite_tasks.end(); ++task_it) {
+		if (task_it->first.getDepth() == 0)
+			continue;
+		auto parent = composite_tasks.find(task_it->first.parent());
+		if (parent != composite_tasks.end()) {
+			task_it->second->parent = parent->second;
+			parent->second->pending_children++;
+		}
+	}
+
+	// sort the render tiles in quadtree order, so neighboring tiles (which need the
+	// same chunks) end up at the same worker
+	std::vector<renderer::TilePath> render_tiles;
+	for (auto pos_it = render_tiles_pos.begin(); pos_it != render_tiles_pos.end(); ++pos_it)
+		render_tiles.push_back(renderer::TilePath::byTilePos(*pos_it, depth));
+	std::sort(render_tiles.begin(), render_tiles.end());
+
+	std::vector<RenderTask*> render_tasks;
+	for (auto tile_it = render_tiles.begin(); tile_it != render_tiles.end(); ++tile_it) {
+		RenderTask* task = new RenderTask();
+		tasks.push_back(std::unique_ptr<RenderTask>(task));
+		task->work.tiles.insert(*tile_it);
+		if (tile_it->getDepth() > 0) {
+			auto parent = composite_tasks.find(tile_it->parent());
+			if (parent != composite_tasks.end()) {
+				task->parent = parent->second;
+				parent->second->pending_children++;
+			}
+		}
+		render_tasks.push_back(task);
+	}
+
+	remaining_tasks = tasks.size();
+
+	// give every worker a contiguous range of render tiles, workers take their tasks from
+	// the back of their queue, so add the tiles in reverse order
+	size_t count = render_tasks.size();
+	for (int worker = 0; worker < worker_count; worker++) {
+		size_t begin = count * worker / worker_count;
+		size_t end = count * (worker + 1) / worker_count;
+		for (size_t i = end; i > begin; i--)
+			queues[worker]->tasks.push_back(render_tasks[i - 1]);
+		queued_tasks += end - begin;
+	}
+
+	// composite tiles without any required children, shouldn't happen
+	for (auto task_it = composite_tasks.begin(); task_it != composite_tasks.end(); ++task_it)
+		if (task_it->second->pending_children == 0)
+			pushTask(0, task_it->second);
+	return true;
 }
 
-void ThreadManager::addExtraWork(const renderer::RenderWork& work) {
-	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	work_extra_queue.push(work);
-	condition_wait_jobs.notify_one();
+void WorkStealingManager::pushTask(int worker, RenderTask* task) {
+	{
+		thread_ns::unique_lock<thread_ns::mutex> lock(queues[worker]->mutex);
+		queues[worker]->tasks.push_back(task);
+	}
+	queued_tasks++;
+
+	// wake up an idle worker, if there is one
+	if (idle_workers > 0) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		condition_wait_tasks.notify_one();
+	}
 }
 
-void ThreadManager::setFinished() {
-	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	this->finished = true;
-	condition_wait_jobs.notify_all();
-	condition_wait_results.notify_all();
+RenderTask* WorkStealingManager::popTask(int worker) {
+	WorkerQueue& queue = *queues[worker];
+	thread_ns::unique_lock<thread_ns::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+		return nullptr;
+	RenderTask* task = queue.tasks.back();
+	queue.tasks.pop_back();
+	return task;
 }
 
-bool ThreadManager::getWork(renderer::RenderWork& work) {
-	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	while (!finished && (work_queue.empty() && work_extra_queue.empty()))
-		condition_wait_jobs.wait(lock);
-	if (finished)
-		return false;
-	if (!work_extra_queue.empty())
-		work = work_extra_queue.pop();
-	else if (!work_queue.empty())
-		work = work_queue.pop();
-	return true;
+RenderTask* WorkStealingManager::stealTask(int worker) {
+	for (int i = 1; i < worker_count; i++) {
+		WorkerQueue& queue = *queues[(worker + i) % worker_count];
+		thread_ns::unique_lock<thread_ns::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+		RenderTask* task = queue.tasks.front();
+		queue.tasks.pop_front();
+		return task;
+	}
+	return nullptr;
+}
+
+RenderTask* WorkStealingManager::getTask(int worker) {
+	while (true) {
+		RenderTask* task = popTask(worker);
+		if (task == nullptr)
+			task = stealTask(worker);
+		if (task != nullptr) {
+			queued_tasks--;
+			return task;
+		}
+
+		// no task available right now, wait until some composite tile becomes ready
+		// or everything is finished
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		idle_workers++;
+		while (queued_tasks == 0 && remaining_tasks > 0)
+			condition_wait_tasks.wait(lock);
+		idle_workers--;
+		if (remaining_tasks == 0)
+			return nullptr;
+	}
 }
 
-void ThreadManager::workFinished(const renderer::RenderWork& work,
+void WorkStealingManager::taskFinished(int worker, RenderTask* task,
 		const renderer::RenderWorkResult& result) {
-	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	if (!result_queue.empty())
-		result_queue.push(result);
-	else {
-		result_queue.push(result);
-		condition_wait_results.notify_one();
+	rendered_tiles += result.tiles_rendered;
+
+	// the last finished child schedules its parent, on this worker because the
+	// children are probably still in its caches
+	if (task->parent != nullptr && --task->parent->pending_children == 0)
+		pushTask(worker, task->parent);
+
+	if (--remaining_tasks == 0) {
+		thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
+		condition_wait_tasks.notify_all();
+		condition_wait_finished.notify_all();
 	}
 }
 
-bool ThreadManager::getResult(renderer::RenderWorkResult& result) {
+bool WorkStealingManager::waitFinished(int milliseconds) {
 	thread_ns::unique_lock<thread_ns::mutex> lock(mutex);
-	while (!finished && result_queue.empty())
-		condition_wait_results.wait(lock);
-	if (finished)
-		return false;
-	result = result_queue.pop();
-	return true;
+	if (remaining_tasks > 0)
+		condition_wait_finished.wait_for(lock, thread_ns::chrono::milliseconds(milliseconds));
+	return remaining_tasks == 0;
 }
 
-ThreadWorker::ThreadWorker(WorkerManager<renderer::RenderWork, renderer::RenderWorkResult>& manager,
+int WorkStealingManager::getRenderedTiles() const {
+	return rendered_tiles;
+}
+
+ThreadWorker::ThreadWorker(WorkStealingManager& manager, int worker,
 		const renderer::RenderContext& context)
-	: manager(manager), render_context(context) {
+	: manager(manager), worker(worker), render_context(context) {
 	render_worker.setRenderContext(context);
 }
 
@@ -97,18 +208,17 @@ ThreadWorker::~ThreadWorker() {
 }
 
 void ThreadWorker::operator()() {
-	renderer::RenderWork work;
-
-	while (manager.getWork(work)) {
-		render_worker.setRenderWork(work);
+	RenderTask* task;
+	while ((task = manager.getTask(worker)) != nullptr) {
+		render_worker.setRenderWork(task->work);
 		render_worker();
 
-		manager.workFinished(work, render_worker.getRenderWorkResult());
+		manager.taskFinished(worker, task, render_worker.getRenderWorkResult());
 	}
 }
 
 MultiThreadingDispatcher::MultiThreadingDispatcher(int threads)
-	: thread_count(threads) {
+	: thread_count(threads), manager(threads) {
 }
 
 MultiThreadingDispatcher::~MultiThreadingDispatcher() {
@@ -116,61 +226,39 @@ MultiThreadingDispatcher::~MultiThreadingDispatcher() {
 
 void MultiThreadingDispatcher::dispatch(const renderer::RenderContext& context,
 		util::IProgressHandler* progress) {
-	auto tiles = context.tile_set->getRequiredCompositeTiles();
-	if (tiles.size() == 0)
+	if (!manager.initialize(*context.tile_set))
 		return;
 
-	// int jobs = 0;
-	for (auto tile_it = tiles.begin(); tile_it != tiles.end(); ++tile_it)
-		if (tile_it->getDepth() == context.tile_set->getDepth() - 2) {
-			renderer::RenderWork work;
-			work.tiles.insert(*tile_it);
-			manager.addWork(work);
-			// jobs++;
-		}
-
-	//int render_tiles = context.tile_set->getRequiredRenderTilesCount();
-	//LOG(INFO) << thread_count << " threads will render " << render_tiles << " render tiles.";
+	// every worker has at most three finished siblings per tile level waiting for their
+	// parent tile, so this is usually enough for all downscaled tile images in flight
+	// (a downscaled image has a quarter of the pixels of a tile with four bytes each)
+	size_t image_size = (size_t) context.tile_renderer->getTileWidth()
+			* context.tile_renderer->getTileHeight();
+	size_t cache_images = thread_count * (3 * context.tile_set->getDepth() + 4);
+	std::shared_ptr<renderer::TileImageCache> tile_image_cache(
+			new renderer::TileImageCache(cache_images * image_size));
 
+	std::vector<std::shared_ptr<mc::WorldCache>> world_caches;
 	for (int i = 0; i < thread_count; i++) {
 		renderer::RenderContext thread_context = context;
+		thread_context.tile_image_cache = tile_image_cache;
 		thread_context.initializeTileRenderer();
-		threads.push_back(thread_ns::thread(ThreadWorker(manager, thread_context)));
+		world_caches.push_back(thread_context.world_cache);
+		threads.push_back(thread_ns::thread(ThreadWorker(manager, i, thread_context)));
 	}
 
+	// the workers only count the rendered tiles, the progress is updated from here
 	progress->setMax(context.tile_set->getRequiredRenderTilesCount());
-	renderer::RenderWorkResult result;
-	while (manager.getResult(result)) {
-		progress->setValue(progress->getValue() + result.tiles_rendered);
-		for (auto tile_it = result.render_work.tiles.begin();
-				tile_it != result.render_work.tiles.end(); ++tile_it) {
-			rendered_tiles.insert(*tile_it);
-			if (*tile_it == renderer::TilePath()) {
-				manager.setFinished();
-				continue;
-			}
+	while (!manager.waitFinished(500))
+		progress->setValue(manager.getRenderedTiles());
+	progress->setValue(manager.getRenderedTiles());
 
-			renderer::TilePath parent = tile_it->parent();
-			bool childs_rendered = true;
-			for (int i = 1; i <= 4; i++)
-				if (context.tile_set->isTileRequired(parent + i)
-						&& !rendered_tiles.count(parent + i)) {
-					childs_rendered = false;
-				}
-
-			if (childs_rendered) {
-				renderer::RenderWork work;
-				work.tiles.insert(parent);
-				for (int i = 1; i <= 4; i++)
-					if (context.tile_set->hasTile(parent + i))
-						work.tiles_skip.insert(parent + i);
-				manager.addExtraWork(work);
-			}
-		}
-	}
-
-	for (int i = 0; i < thread_count; i++)
+	for (int i = 0; i < thread_count; i++) {
 		threads[i].join();
+		region_cache_stats += world_caches[i]->getRegionCacheStats();
+		chunk_cache_stats += world_caches[i]->getChunkCacheStats();
+	}
+	tile_image_cache->clear();
 }
 
 } /* namespace thread */
@@ -20,50 +20,120 @@
 #ifndef MULTITHREADING_H_
 #define MULTITHREADING_H_
 
-#include "concurrentqueue.h"
 #include "../dispatcher.h"
-#include "../workermanager.h"
 #include "../../compat/thread.h"
 #include "../../renderer/tilerenderworker.h"
 
-#include <set>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <thread>
 #include <vector>
 
 namespace mapcrafter {
+
+namespace renderer {
+class TileSet;
+}
+
 namespace thread {
 
-class ThreadManager : public WorkerManager<renderer::RenderWork, renderer::RenderWorkResult> {
-public:
-	ThreadManager();
-	virtual ~ThreadManager();
+/**
+ * A task of the render threads: Rendering one render tile or composing one composite tile
+ * from its (already rendered) children.
+ */
+struct RenderTask {
+	RenderTask() : parent(nullptr), pending_children(0) {}
 
-	void addWork(const renderer::RenderWork& work);
-	void addExtraWork(const renderer::RenderWork& work);
-	void setFinished();
+	renderer::RenderWork work;
 
-	virtual bool getWork(renderer::RenderWork& work);
-	virtual void workFinished(const renderer::RenderWork& work, const renderer::RenderWorkResult& result);
+	// task of the parent composite tile, nullptr for the top level tile
+	RenderTask* parent;
+	// number of required children which are not finished yet,
+	// the task is scheduled as soon as this drops to zero
+	std::atomic<int> pending_children;
+};
+
+/**
+ * Distributes the render tasks of a tile set across the render threads with work stealing.
+ *
+ * Every worker has its own task deque. A worker takes tasks from the back of its own deque
+ * and, if that one is empty, steals tasks from the front of the deques of the other
+ * workers. The render tiles are distributed in quadtree order at the beginning, so each
+ * worker starts with a spatially coherent part of the map, and idle workers take over the
+ * remaining parts of busy workers at the end of the render.
+ *
+ * Composite tiles are scheduled by the worker which finishes their last required child,
+ * using an atomic counter of pending children per composite tile.
+ */
+class WorkStealingManager {
+public:
+	WorkStealingManager(int workers);
+	~WorkStealingManager();
+
+	/**
+	 * Creates the tasks for all required render and composite tiles of a tile set.
+	 * Returns false if there is nothing to render.
+	 */
+	bool initialize(const renderer::TileSet& tile_set);
+
+	/**
+	 * Returns the next task of a worker, waits if there is currently no task available.
+	 * Returns nullptr if all tasks are finished.
+	 */
+	RenderTask* getTask(int worker);
+
+	/**
+	 * Marks a task of a worker as finished and schedules its parent composite tile if
+	 * all of its children are finished now.
+	 */
+	void taskFinished(int worker, RenderTask* task, const renderer::RenderWorkResult& result);
+
+	/**
+	 * Waits until all tasks are finished or the specified time (in milliseconds) has
+	 * passed. Returns true if all tasks are finished.
+	 */
+	bool waitFinished(int milliseconds);
+
+	/**
+	 * Returns the number of render tiles rendered so far.
+	 */
+	int getRenderedTiles() const;
 
-	bool getResult(renderer::RenderWorkResult& result);
 private:
-	ConcurrentQueue<renderer::RenderWork> work_queue, work_extra_queue;
-	ConcurrentQueue<renderer::RenderWorkResult> result_queue;
+	struct WorkerQueue {
+		thread_ns::mutex mutex;
+		std::deque<RenderTask*> tasks;
+	};
+
+	void pushTask(int worker, RenderTask* task);
+	RenderTask* popTask(int worker);
+	RenderTask* stealTask(int worker);
 
-	bool finished;
+	int worker_count;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::unique_ptr<RenderTask>> tasks;
+
+	// tasks in the queues, tasks not finished yet, rendered render tiles
+	std::atomic<int> queued_tasks, remaining_tasks, rendered_tiles;
+	// workers waiting for new tasks
+	std::atomic<int> idle_workers;
+
+	// only used to wait for tasks / for the render to finish
 	thread_ns::mutex mutex;
-	thread_ns::condition_variable condition_wait_jobs, condition_wait_results;
+	thread_ns::condition_variable condition_wait_tasks, condition_wait_finished;
 };
 
 class ThreadWorker {
 public:
-	ThreadWorker(WorkerManager<renderer::RenderWork, renderer::RenderWorkResult>& manager,
+	ThreadWorker(WorkStealingManager& manager, int worker,
 			const renderer::RenderContext& context);
 	~ThreadWorker();
 
 	void operator()();
 private:
-	WorkerManager<renderer::RenderWork, renderer::RenderWorkResult>& manager;
+	WorkStealingManager& manager;
+	int worker;
 
 	renderer::RenderContext render_context;
 	renderer::TileRenderWorker render_worker;
@@ -79,10 +149,8 @@ public:
 private:
 	int thread_count;
 
-	ThreadManager manager;
+	WorkStealingManager manager;
 	std::vector<thread_ns::thread> threads;
-
-	std::set<renderer::TilePath> rendered_tiles;
 };
 
 } /* namespace thread */
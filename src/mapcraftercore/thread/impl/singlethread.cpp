@@ -51,6 +51,9 @@ void SingleThreadDispatcher::dispatch(const renderer::RenderContext& context,
 	worker.setRenderWork(work);
 	worker.setProgressHandler(progress);
 	worker();
+
+	region_cache_stats = context.world_cache->getRegionCacheStats();
+	chunk_cache_stats = context.world_cache->getChunkCacheStats();
 }
 
 } /* namespace thread */
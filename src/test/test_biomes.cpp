@@ -0,0 +1,65 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/renderer/biomes.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+namespace renderer = mapcrafter::renderer;
+
+BOOST_AUTO_TEST_CASE(biomes_testBiomeId) {
+	// every biome is found by its name
+	for (size_t i = 0; i < renderer::BIOMES_SIZE; i++) {
+		std::string name = renderer::BIOMES[i].getName();
+		BOOST_CHECK_EQUAL(renderer::Biome::getBiomeId(name), i);
+	}
+
+	// names are compared completely, not only by their hash
+	std::string plains = "minecraft:plains";
+	BOOST_CHECK_EQUAL(renderer::Biome::getBiome(renderer::Biome::getBiomeId(plains)).getName(),
+			plains);
+	BOOST_CHECK_EQUAL(renderer::Biome::getBiomeId(plains.data(), plains.size() - 1),
+			renderer::DEFAULT_BIOME_ID);
+	BOOST_CHECK_EQUAL(renderer::Biome::getBiomeId(""), renderer::DEFAULT_BIOME_ID);
+	BOOST_CHECK_EQUAL(renderer::Biome::getBiomeId("mymod:unknown_biome"),
+			renderer::DEFAULT_BIOME_ID);
+
+	// known and unknown biomes are looked up concurrently
+	std::vector<int> wrong(4, 0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(std::thread([&wrong, t]() {
+			for (int i = 0; i < 1000; i++) {
+				size_t id = (i + t) % renderer::BIOMES_SIZE;
+				if (renderer::Biome::getBiomeId(renderer::BIOMES[id].getName()) != id)
+					wrong[t]++;
+				std::string unknown = "mymod:biome_" + std::to_string(i % 10);
+				if (renderer::Biome::getBiomeId(unknown) != renderer::DEFAULT_BIOME_ID)
+					wrong[t]++;
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (int t = 0; t < 4; t++)
+		BOOST_CHECK_EQUAL(wrong[t], 0);
+}
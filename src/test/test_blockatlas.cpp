@@ -0,0 +1,134 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/renderer/blockatlas.h"
+#include "../mapcraftercore/renderer/blockimages.h"
+#include "../mapcraftercore/renderer/image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace renderer = mapcrafter::renderer;
+
+namespace {
+
+renderer::RGBAImage createImage(int width, int height, int seed) {
+	renderer::RGBAImage image(width, height);
+	for (int x = 0; x < width; x++)
+		for (int y = 0; y < height; y++)
+			image.setPixel(x, y, renderer::rgba(x * 7 + seed, y * 5 + seed, seed * 31, 255));
+	return image;
+}
+
+bool equalPixels(const renderer::RGBAImageView& view, const renderer::RGBAImage& image) {
+	if (view.getWidth() != image.getWidth() || view.getHeight() != image.getHeight())
+		return false;
+	for (int x = 0; x < image.getWidth(); x++)
+		for (int y = 0; y < image.getHeight(); y++)
+			if (view.pixel(x, y) != image.getPixel(x, y))
+				return false;
+	return std::equal(view.begin(), view.end(), image.data.begin());
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(blockatlas_testSpriteSheet) {
+	int sizes[][2] = {{1, 1}, {5, 3}, {16, 16}, {17, 9}, {24, 40}};
+	for (size_t s = 0; s < 5; s++) {
+		int width = sizes[s][0], height = sizes[s][1];
+		std::vector<renderer::RGBAImage> images;
+		for (int i = 0; i < 4; i++)
+			images.push_back(createImage(width, height, i + 1));
+
+		renderer::SpriteSheet sheet;
+		sheet.reset(width, height, images.size());
+		BOOST_CHECK_EQUAL(sheet.size(), images.size());
+		BOOST_CHECK_EQUAL(sheet.getWidth(), width);
+		BOOST_CHECK_EQUAL(sheet.getHeight(), height);
+		for (size_t i = 0; i < images.size(); i++)
+			std::copy(images[i].data.begin(), images[i].data.end(), sheet.getPixels(i));
+
+		// writing a sprite doesn't touch the others, and every sprite is aligned to a
+		// cache line
+		for (size_t i = 0; i < images.size(); i++) {
+			renderer::RGBAImageView view = sheet.getView(i);
+			BOOST_CHECK_EQUAL(view.getWidth(), width);
+			BOOST_CHECK_EQUAL(view.getHeight(), height);
+			BOOST_CHECK_EQUAL(view.size(), (size_t) width * height);
+			BOOST_CHECK(equalPixels(view, images[i]));
+			BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(sheet.getPixels(i)) % 64, 0);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(blockatlas_testPackBlockImages) {
+	// blocks which are higher than wide, so width and height can't be mixed up
+	const int width = 24, height = 40;
+	renderer::RGBAImage uv(width, height);
+	for (int x = 0; x < width; x++)
+		for (int y = 0; y < height; y++)
+			uv.setPixel(x, y, renderer::rgba(0, 0, y < height / 2
+				? renderer::FACE_UP_INDEX : renderer::FACE_LEFT_INDEX, 255));
+	std::vector<renderer::RGBAImage> images;
+	images.push_back(uv);
+	for (int i = 0; i < 3; i++)
+		images.push_back(createImage(width, height, i + 1));
+
+	// the atlas with two rows
+	renderer::RGBAImage atlas(width * 2, height * 2);
+	for (size_t i = 0; i < images.size(); i++)
+		atlas.simpleBlit(images[i], (i % 2) * width, (i / 2) * height);
+	fs::path dir = fs::temp_directory_path() / fs::unique_path("mapcrafter-test-%%%%%%%%");
+	fs::create_directories(dir);
+	BOOST_REQUIRE(atlas.writePNG((dir / "isometric_0_16.png").string()));
+	std::ofstream info((dir / "isometric_0_16.txt").string().c_str());
+	info << width << " " << height << " 2" << std::endl;
+	info << "minecraft:air - color=0,uv=0" << std::endl;
+	info << "minecraft:unknown_block - color=1,uv=0" << std::endl;
+	info << "minecraft:stone - color=2,uv=0" << std::endl;
+	info << "minecraft:dirt - color=3,uv=0" << std::endl;
+	info.close();
+
+	mc::BlockStateRegistry block_registry;
+	renderer::RenderedBlockImages block_images(block_registry);
+	BOOST_REQUIRE(block_images.loadBlockImages(dir, "isometric", 0, 16));
+	BOOST_CHECK_EQUAL(renderer::BlockAtlas::instance().GetBlockWidth(), width);
+	BOOST_CHECK_EQUAL(renderer::BlockAtlas::instance().GetBlockHeight(), height);
+	BOOST_CHECK_EQUAL(block_images.getBlockWidth(), width);
+	BOOST_CHECK_EQUAL(block_images.getBlockHeight(), height);
+
+	// the packed views have the pixels of the atlas (block sides aren't darkened)
+	const char* names[] = {"minecraft:unknown_block", "minecraft:stone", "minecraft:dirt"};
+	for (int i = 0; i < 3; i++) {
+		const renderer::BlockImage& block = block_images.getBlockImage(
+				block_registry.getBlockID(mc::BlockState(names[i])));
+		BOOST_CHECK(equalPixels(block.image(0), images[i + 1]));
+		BOOST_CHECK(equalPixels(block.uv_image(0), uv));
+		BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(block.image(0).data) % 64, 0);
+	}
+
+	fs::remove_all(dir);
+}
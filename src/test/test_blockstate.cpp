@@ -22,6 +22,9 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include <boost/test/unit_test.hpp>
 
 namespace mc = mapcrafter::mc;
@@ -77,3 +80,60 @@ BOOST_AUTO_TEST_CASE(blockstate_testRegistry) {
 	BOOST_CHECK_EQUAL(block_compare.getVariantDescription(), block.getVariantDescription());
 }
 
+BOOST_AUTO_TEST_CASE(blockstate_testRegistryConcurrent) {
+	mc::BlockStateRegistry registry;
+
+	// all threads register the same block states in a different order
+	const int THREADS = 4, STATES = 2000;
+	const int STEPS[THREADS] = {1, 3, 7, 9};
+	std::vector<std::vector<uint16_t>> ids(THREADS, std::vector<uint16_t>(STATES));
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; t++) {
+		threads.push_back(std::thread([&registry, &ids, &STEPS, t]() {
+			for (int i = 0; i < STATES; i++) {
+				int state = (i * STEPS[t] + t * 7) % STATES;
+				mc::BlockState block("mapcrafter:test");
+				block.setProperty("state", std::to_string(state));
+				ids[t][state] = registry.getBlockID(block);
+				// block states can be read while other threads add new ones
+				if (registry.getBlockState(ids[t][state]).getProperty("state")
+						!= std::to_string(state))
+					ids[t][state] = STATES;
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	BOOST_CHECK_EQUAL(registry.size(), STATES);
+	for (int t = 1; t < THREADS; t++)
+		BOOST_CHECK(ids[t] == ids[0]);
+	for (int i = 0; i < STATES; i++)
+		BOOST_REQUIRE(ids[0][i] < STATES);
+}
+
+BOOST_AUTO_TEST_CASE(blockstate_testPaletteEntries) {
+	mc::BlockStateRegistry registry;
+
+	// entries are found once a few of them were added
+	std::vector<std::string> entries;
+	for (int i = 0; i < 100; i++) {
+		entries.push_back("palette entry " + std::to_string(i));
+		registry.addPaletteEntry((const uint8_t*) entries[i].data(), entries[i].size(), i);
+	}
+	uint16_t id;
+	BOOST_CHECK(registry.findPaletteEntry((const uint8_t*) entries[0].data(),
+			entries[0].size(), id));
+	BOOST_CHECK_EQUAL(id, 0);
+	BOOST_CHECK(registry.findPaletteEntry((const uint8_t*) entries[42].data(),
+			entries[42].size(), id));
+	BOOST_CHECK_EQUAL(id, 42);
+	std::string unknown = "palette entry 1000";
+	BOOST_CHECK(!registry.findPaletteEntry((const uint8_t*) unknown.data(),
+			unknown.size(), id));
+
+	// known properties change how palette entries are resolved
+	registry.addKnownProperty("mapcrafter:test", "foo");
+	BOOST_CHECK(!registry.findPaletteEntry((const uint8_t*) entries[0].data(),
+			entries[0].size(), id));
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/util.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/range.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
+
+namespace {
+
+// block of the test section at a specific index (0 = air, 1 = stone, 2 = dirt)
+int testBlock(int index) {
+	return (index * 7) % 3;
+}
+
+nbt::TagCompound createPaletteEntry(const std::string& name) {
+	nbt::TagCompound entry;
+	entry.addTag("Name", nbt::TagString(name));
+	return entry;
+}
+
+// y coordinate of the highest block of a column of the test section
+int testHighestBlock(int x, int z) {
+	for (int y = 15; y >= 0; y--)
+		if (testBlock(y * 256 + z * 16 + x) != 0)
+			return 16 + y;
+	return -65;
+}
+
+/**
+ * Creates the NBT data of a chunk in the format of Minecraft 1.18+ with one section.
+ * The chunk has a WORLD_SURFACE heightmap with the specified heights if there are any.
+ */
+std::string createChunk(nbt::Compression compression,
+		const std::vector<int>& heightmap = std::vector<int>()) {
+	nbt::NBTFile chunk("");
+	chunk.addTag("DataVersion", nbt::TagInt(3337));
+	chunk.addTag("Status", nbt::TagString("full"));
+	chunk.addTag("xPos", nbt::TagInt(3));
+	chunk.addTag("yPos", nbt::TagInt(-4));
+	chunk.addTag("zPos", nbt::TagInt(-7));
+
+	// some data the chunk reader does not need
+	nbt::TagList block_entities(nbt::TagCompound::TAG_TYPE);
+	block_entities.payload.push_back(nbt::TagPtr(createPaletteEntry("minecraft:chest").clone()));
+	chunk.addTag("block_entities", block_entities);
+
+	if (!heightmap.empty()) {
+		// heights are stored as y + 1 - min_y, 9 bits per height, 7 heights per long
+		std::vector<int64_t> world_surface(37, 0);
+		for (int i = 0; i < 256; i++)
+			world_surface[i / 7] |= (int64_t) (heightmap[i] + 1 + 64) << (9 * (i % 7));
+		nbt::TagCompound heightmaps;
+		heightmaps.addTag("WORLD_SURFACE", nbt::TagLongArray(world_surface));
+		chunk.addTag("Heightmaps", heightmaps);
+	}
+
+	nbt::TagCompound section;
+	section.addTag("Y", nbt::TagByte(1));
+
+	nbt::TagCompound block_states;
+	nbt::TagList block_palette(nbt::TagCompound::TAG_TYPE);
+	block_palette.payload.push_back(nbt::TagPtr(createPaletteEntry("minecraft:air").clone()));
+	block_palette.payload.push_back(nbt::TagPtr(createPaletteEntry("minecraft:stone").clone()));
+	block_palette.payload.push_back(nbt::TagPtr(createPaletteEntry("minecraft:dirt").clone()));
+	block_states.addTag("palette", block_palette);
+	// 4 bits per block, 16 blocks per long
+	std::vector<int64_t> data(256, 0);
+	for (int i = 0; i < 4096; i++)
+		data[i / 16] |= (int64_t) testBlock(i) << (4 * (i % 16));
+	block_states.addTag("data", nbt::TagLongArray(data));
+	section.addTag("block_states", block_states);
+
+	nbt::TagCompound biomes;
+	nbt::TagList biome_palette(nbt::TagString::TAG_TYPE);
+	biome_palette.payload.push_back(nbt::TagPtr(new nbt::TagString("minecraft:plains")));
+	biomes.addTag("palette", biome_palette);
+	section.addTag("biomes", biomes);
+
+	section.addTag("SkyLight", nbt::TagByteArray(std::vector<int8_t>(2048, 0x3f)));
+
+	nbt::TagList sections(nbt::TagCompound::TAG_TYPE);
+	sections.payload.push_back(nbt::TagPtr(section.clone()));
+	chunk.addTag("sections", sections);
+
+	std::stringstream stream;
+	chunk.writeNBT(stream, compression);
+	return stream.str();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testSectionBlocks) {
+	uint16_t palette[1 << 12];
+	for (size_t i = 0; i < boost::size(palette); i++)
+		palette[i] = 1000 + i * 3;
+
+	// values don't span two longs, so some widths leave bits of every long unused
+	for (int bits = 1; bits <= 12; bits++) {
+		int per_long = 64 / bits;
+		std::vector<int64_t> longs((4096 + per_long - 1) / per_long, 0);
+		std::vector<uint16_t> expected(4096);
+		for (int i = 0; i < 4096; i++) {
+			uint64_t index = (i * 7 + i / 13) % (1 << bits);
+			longs[i / per_long] |= index << (bits * (i % per_long));
+			expected[i] = palette[index];
+		}
+		// the NBT reader references the big-endian longs of the NBT data
+		std::vector<int64_t> big_endian(longs.size());
+		for (size_t i = 0; i < longs.size(); i++)
+			big_endian[i] = mapcrafter::util::bigEndian64(longs[i]);
+		nbt::LongArrayRef data((const uint8_t*) big_endian.data(), big_endian.size());
+
+		mc::SectionBlocks blocks;
+		BOOST_REQUIRE(blocks.setPacked(palette, 1 << bits, data));
+		BOOST_CHECK_EQUAL(blocks.getBits(), bits);
+		for (int i = 0; i < 4096; i++)
+			BOOST_REQUIRE_EQUAL(blocks.get(i), expected[i]);
+		std::vector<uint16_t> ids(4096);
+		blocks.get(0, 4096, ids.data());
+		BOOST_CHECK(ids == expected);
+		blocks.get(per_long - 1, 37, ids.data());
+		BOOST_CHECK(std::equal(ids.begin(), ids.begin() + 37, expected.begin() + per_long - 1));
+		// with big palettes the palette itself needs more memory than unpacked ids
+		if (bits <= 10)
+			BOOST_CHECK(blocks.getMemoryUsage() < 4096 * sizeof(uint16_t));
+
+		// indices which are not in the palette are rejected
+		if (bits > 1)
+			BOOST_CHECK(!blocks.setPacked(palette, (1 << (bits - 1)) + 1, data));
+	}
+
+	mc::SectionBlocks blocks;
+	blocks.setSingle(42);
+	BOOST_CHECK_EQUAL(blocks.getBits(), 0);
+	BOOST_CHECK_EQUAL(blocks.get(1234), 42);
+	BOOST_CHECK_EQUAL(blocks.getMemoryUsage(), 0);
+
+	// uniform light is stored as a single value
+	mc::SectionLight light;
+	std::vector<uint8_t> nibbles(2048, 0xff);
+	light.set(nibbles.data());
+	BOOST_CHECK_EQUAL(light.get(17), 15);
+	BOOST_CHECK_EQUAL(light.getMemoryUsage(), 0);
+	nibbles[8] = 0x3f;
+	light.set(nibbles.data());
+	BOOST_CHECK_EQUAL(light.get(16), 15);
+	BOOST_CHECK_EQUAL(light.get(17), 3);
+	BOOST_CHECK_EQUAL(light.getMemoryUsage(), 2048);
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testUnpackPacked) {
+	uint16_t palette[1 << 16];
+	for (size_t i = 0; i < boost::size(palette); i++)
+		palette[i] = (i * 31 + 7) & 0xffff;
+
+	for (int bits = 1; bits <= 16; bits++) {
+		uint64_t mask = (uint64_t(1) << bits) - 1;
+		size_t per_long = 64 / bits;
+		size_t count = 4096;
+		std::vector<uint64_t> longs((count + per_long - 1) / per_long, 0);
+		std::vector<uint16_t> expected(count);
+		for (size_t i = 0; i < count; i++) {
+			expected[i] = (i * 7919 + i / 5) & mask;
+			longs[i / per_long] |= uint64_t(expected[i]) << (bits * (i % per_long));
+		}
+		uint16_t max = *std::max_element(expected.begin(), expected.end());
+
+		// unpacking with different start indices, with partial first and last longs
+		size_t starts[] = {0, 1, per_long - 1, per_long, 3 * per_long + 1};
+		for (size_t j = 0; j < boost::size(starts); j++) {
+			size_t start = starts[j];
+			size_t n = std::min<size_t>(count - start, 2 * per_long + 3);
+			std::vector<uint16_t> values(n);
+			mc::unpackValues(longs.data(), bits, start, n, values.data());
+			BOOST_CHECK(std::equal(values.begin(), values.end(), expected.begin() + start));
+		}
+		std::vector<uint16_t> values(count);
+		mc::unpackValues(longs.data(), bits, 0, count, values.data());
+		BOOST_CHECK(values == expected);
+
+		// remapping with a palette
+		BOOST_CHECK(mc::unpackPalette(longs.data(), bits, 0, count,
+				palette, max + 1, values.data()));
+		for (size_t i = 0; i < count; i++)
+			BOOST_REQUIRE_EQUAL(values[i], palette[expected[i]]);
+
+		// indices which are not in the palette are detected and replaced
+		if (max > 0) {
+			BOOST_CHECK(!mc::unpackPalette(longs.data(), bits, 0, count,
+					palette, max, values.data()));
+			for (size_t i = 0; i < count; i++)
+				BOOST_REQUIRE_EQUAL(values[i], palette[expected[i] < max ? expected[i] : 0]);
+		}
+
+		BOOST_CHECK_EQUAL(mc::getMaxPackedValue(longs.data(), bits, count), max);
+		BOOST_CHECK_EQUAL(mc::getPackedBits(longs.size(), count, max + 1), bits);
+	}
+
+	// 11 and 12 bits need the same number of longs, only the palette tells them apart
+	BOOST_CHECK_EQUAL(mc::getPackedBits(820, 4096, 2000), 11);
+	BOOST_CHECK_EQUAL(mc::getPackedBits(820, 4096, 3000), 12);
+	BOOST_CHECK_EQUAL(mc::getPackedBits(820, 4096), 12);
+	// 3 bit biome indices of a section
+	BOOST_CHECK_EQUAL(mc::getPackedBits(4, 64, 5), 3);
+	BOOST_CHECK_EQUAL(mc::getPackedBits(0, 4096), 0);
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testReadNBT) {
+	mc::BlockStateRegistry block_registry;
+	uint16_t ids[] = {
+		block_registry.getBlockID(mc::BlockState("minecraft:air")),
+		block_registry.getBlockID(mc::BlockState("minecraft:stone")),
+		block_registry.getBlockID(mc::BlockState("minecraft:dirt")),
+	};
+
+	nbt::Compression compressions[] = {
+		nbt::Compression::NO_COMPRESSION,
+		nbt::Compression::GZIP,
+		nbt::Compression::ZLIB
+	};
+	for (size_t i = 0; i < 3; i++) {
+		std::string data = createChunk(compressions[i]);
+		mc::Chunk chunk;
+		BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(), compressions[i]));
+		BOOST_CHECK_EQUAL(chunk.getPos(), mc::ChunkPos(3, -7));
+
+		BOOST_CHECK(!chunk.hasSection(0));
+		BOOST_REQUIRE(chunk.hasSection(16));
+		for (int index = 0; index < 4096; index++) {
+			mc::LocalBlockPos pos(index % 16, (index / 16) % 16, 16 + index / 256);
+			BOOST_REQUIRE_EQUAL(chunk.getBlockID(pos), ids[testBlock(index)]);
+		}
+		mc::LocalBlockPos pos(4, 2, 21);
+		BOOST_CHECK_EQUAL(chunk.getSkyLight(pos), 0xf);
+		BOOST_CHECK_EQUAL(chunk.getBlockLight(pos), 0);
+
+		// truncated chunks must be rejected
+		BOOST_CHECK_THROW(chunk.readNBT(block_registry, data.data(), data.size() / 2,
+				compressions[i]), nbt::NBTError);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testLazyDecoding) {
+	mc::BlockStateRegistry block_registry;
+	uint16_t ids[] = {
+		block_registry.getBlockID(mc::BlockState("minecraft:air")),
+		block_registry.getBlockID(mc::BlockState("minecraft:stone")),
+		block_registry.getBlockID(mc::BlockState("minecraft:dirt")),
+	};
+	std::string data = createChunk(nbt::Compression::NO_COMPRESSION);
+
+	// fields that are not read have default values
+	mc::Chunk chunk;
+	chunk.setFields(mc::GET_ID);
+	BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+			nbt::Compression::NO_COMPRESSION));
+	mc::LocalBlockPos pos(4, 2, 21);
+	BOOST_CHECK_EQUAL(chunk.getSkyLight(pos), 0);
+	BOOST_CHECK_EQUAL(chunk.getBiomeAt(pos), 0);
+	BOOST_CHECK_EQUAL(chunk.getBlockID(pos), ids[testBlock(5 * 256 + 2 * 16 + 4)]);
+
+	// the sections are decoded by the thread accessing them first
+	chunk.setFields(mc::GET_ID | mc::GET_BIOME | mc::GET_LIGHT);
+	BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+			nbt::Compression::NO_COMPRESSION));
+	BOOST_CHECK_EQUAL(chunk.getSkyLight(pos), 0xf);
+	std::vector<int> errors(4, 0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+		threads.push_back(std::thread([&chunk, &ids, &errors, t]() {
+			for (int index = 0; index < 4096; index++) {
+				mc::LocalBlockPos pos(index % 16, (index / 16) % 16, 16 + index / 256);
+				errors[t] += chunk.getBlockID(pos) != ids[testBlock(index)];
+			}
+		}));
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	for (int t = 0; t < 4; t++)
+		BOOST_CHECK_EQUAL(errors[t], 0);
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testHeightmap) {
+	mc::BlockStateRegistry block_registry;
+
+	// without heightmap in the NBT data the heightmap is calculated from the sections
+	std::string data = createChunk(nbt::Compression::NO_COMPRESSION);
+	mc::Chunk chunk;
+	BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+			nbt::Compression::NO_COMPRESSION));
+	int highest = -65;
+	for (int x = 0; x < 16; x++)
+		for (int z = 0; z < 16; z++) {
+			BOOST_CHECK_EQUAL(chunk.getHighestBlockY(x, z), testHighestBlock(x, z));
+			highest = std::max(highest, testHighestBlock(x, z));
+		}
+	BOOST_CHECK_EQUAL(chunk.getHighestBlockY(), highest);
+	BOOST_CHECK(chunk.isSectionEmpty(0));
+	BOOST_CHECK(!chunk.isSectionEmpty(16));
+	BOOST_CHECK(chunk.isSectionEmpty(-64));
+
+	// otherwise the heightmap of Minecraft is used
+	std::vector<int> heightmap(256);
+	for (int i = 0; i < 256; i++)
+		heightmap[i] = i % 3 == 0 ? -65 : i - 40;
+	data = createChunk(nbt::Compression::NO_COMPRESSION, heightmap);
+	BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+			nbt::Compression::NO_COMPRESSION));
+	for (int i = 0; i < 256; i++)
+		BOOST_CHECK_EQUAL(chunk.getHighestBlockY(i % 16, i / 16), heightmap[i]);
+	BOOST_CHECK_EQUAL(chunk.getHighestBlockY(), 254 - 40);
+}
+
+BOOST_AUTO_TEST_CASE(chunk_testGetBlockRow) {
+	mc::BlockStateRegistry block_registry;
+	std::string data = createChunk(nbt::Compression::NO_COMPRESSION);
+	mc::Chunk chunk;
+	BOOST_REQUIRE(chunk.readNBT(block_registry, data.data(), data.size(),
+			nbt::Compression::NO_COMPRESSION));
+
+	// rows in the section, in the missing sections below/above it and partial rows
+	int ys[] = {0, 15, 16, 21, 31, 32, 319};
+	int ranges[][2] = {{0, 15}, {3, 9}, {15, 15}};
+	for (int i = 0; i < 7; i++)
+		for (int z = 0; z < 16; z++)
+			for (int j = 0; j < 3; j++) {
+				uint16_t ids[16];
+				uint8_t block_light[16], sky_light[16];
+				chunk.getBlockRow(ranges[j][0], ranges[j][1], z, ys[i],
+						ids, block_light, sky_light);
+				for (int x = ranges[j][0]; x <= ranges[j][1]; x++) {
+					mc::LocalBlockPos pos(x, z, ys[i]);
+					int k = x - ranges[j][0];
+					BOOST_CHECK_EQUAL(ids[k], chunk.getBlockID(pos, true));
+					BOOST_CHECK_EQUAL(block_light[k], chunk.getBlockLight(pos));
+					BOOST_CHECK_EQUAL(sky_light[k], chunk.getSkyLight(pos));
+				}
+			}
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/chunkcache.h"
+#include "../mapcraftercore/mc/pos.h"
+#include "../mapcraftercore/mc/worldcache.h"
+
+#include <memory>
+#include <boost/test/unit_test.hpp>
+
+namespace mc = mapcrafter::mc;
+
+BOOST_AUTO_TEST_CASE(chunkcache_testPutGet) {
+	mc::ChunkCache cache(1024 * 1024);
+
+	mc::ChunkPos pos(3, -7);
+	BOOST_CHECK(!cache.get(pos));
+
+	mc::ChunkHandle chunk = std::make_shared<mc::Chunk>();
+	BOOST_CHECK_EQUAL(cache.put(pos, chunk), chunk);
+	BOOST_CHECK_EQUAL(cache.get(pos), chunk);
+
+	// a second thread inserting the same chunk gets the already cached one
+	mc::ChunkHandle other = std::make_shared<mc::Chunk>();
+	BOOST_CHECK_EQUAL(cache.put(pos, other), chunk);
+
+	BOOST_CHECK_EQUAL(cache.getHits(), 1);
+	BOOST_CHECK_EQUAL(cache.getMisses(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(chunkcache_testEviction) {
+	// budget is just enough for one (empty) chunk per shard
+	size_t chunk_size = mc::Chunk().getMemoryUsage();
+	mc::ChunkCache cache(16 * chunk_size);
+
+	mc::ChunkHandle first = std::make_shared<mc::Chunk>();
+	cache.put(mc::ChunkPos(0, 0), first);
+	for (int x = 1; x <= 64; x++)
+		cache.put(mc::ChunkPos(x * 16, 0), std::make_shared<mc::Chunk>());
+
+	// the evicted chunk is still usable by whoever holds a handle to it
+	BOOST_CHECK(!cache.get(mc::ChunkPos(0, 0)));
+	BOOST_CHECK(first.use_count() == 1);
+	BOOST_CHECK(cache.getEvictions() > 0);
+	BOOST_CHECK(cache.getUsedBytes() <= cache.getMaxBytes());
+}
+
+BOOST_AUTO_TEST_CASE(worldcache_testSetAssociativeCache) {
+	// a single set with four entries
+	typedef mc::SetAssociativeCache<mc::ChunkPos, int> Cache;
+	Cache cache(4, 4);
+	BOOST_CHECK_EQUAL(cache.getCapacity(), 4);
+
+	for (int i = 0; i < 4; i++) {
+		mc::ChunkPos pos(i * 32, 0);
+		BOOST_CHECK(cache.find(pos) == nullptr);
+		Cache::Entry& entry = cache.getVictim(pos);
+		// there is still a free entry, so nothing is replaced
+		BOOST_CHECK(!entry.used);
+		entry.used = true;
+		entry.key = pos;
+		entry.value = i;
+	}
+
+	// the first chunk is used again, so the second one is the least recently used one
+	BOOST_CHECK_EQUAL(cache.find(mc::ChunkPos(0, 0))->value, 0);
+	Cache::Entry& victim = cache.getVictim(mc::ChunkPos(128, 0));
+	BOOST_CHECK(victim.used);
+	BOOST_CHECK_EQUAL(victim.value, 1);
+	victim.key = mc::ChunkPos(128, 0);
+	victim.value = 4;
+
+	BOOST_CHECK(cache.find(mc::ChunkPos(32, 0)) == nullptr);
+	for (int i : {0, 2, 3, 4})
+		BOOST_CHECK_EQUAL(cache.find(mc::ChunkPos(i * 32, 0))->value, i);
+}
+
+BOOST_AUTO_TEST_CASE(worldcache_testCacheStats) {
+	mc::CacheStats stats, other;
+	BOOST_CHECK_EQUAL(stats.getHitRate(), 0);
+	stats.hits = 3;
+	stats.misses = 1;
+	other.hits = 1;
+	other.misses = 3;
+	other.evictions = 2;
+	stats += other;
+	BOOST_CHECK_EQUAL(stats.hits, 4);
+	BOOST_CHECK_EQUAL(stats.misses, 4);
+	BOOST_CHECK_EQUAL(stats.evictions, 2);
+	BOOST_CHECK_CLOSE(stats.getHitRate(), 0.5, 0.0001);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/mc/chunkindex.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+
+#include <ctime>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
+
+namespace {
+
+typedef std::map<mc::ChunkPos, uint32_t> ChunkTimes;
+
+/**
+ * Creates the zlib compressed NBT data of an (empty) chunk in the format of
+ * Minecraft 1.18+. The inhabited time is a tag which is not read by the renderer.
+ */
+std::vector<uint8_t> createChunk(const mc::ChunkPos& pos, const std::string& status,
+		int64_t inhabited_time) {
+	nbt::NBTFile chunk("");
+	chunk.addTag("DataVersion", nbt::TagInt(3337));
+	chunk.addTag("Status", nbt::TagString(status));
+	chunk.addTag("xPos", nbt::TagInt(pos.x));
+	chunk.addTag("yPos", nbt::TagInt(-4));
+	chunk.addTag("zPos", nbt::TagInt(pos.z));
+	chunk.addTag("InhabitedTime", nbt::TagLong(inhabited_time));
+	chunk.addTag("sections", nbt::TagList(nbt::TagCompound::TAG_TYPE));
+
+	std::stringstream stream;
+	chunk.writeNBT(stream, nbt::Compression::ZLIB);
+	std::string data = stream.str();
+	return std::vector<uint8_t>(data.begin(), data.end());
+}
+
+/**
+ * Scans a region with a new chunk index read from the cache directory of the world,
+ * returns the times of the last changes of the chunks.
+ */
+ChunkTimes scanRegion(const mc::World& world, const mc::RegionPos& pos,
+		mc::ChunkIndexStats& stats) {
+	mc::ChunkIndex index(world);
+	index.read();
+	std::vector<std::pair<mc::ChunkPos, uint32_t>> chunks;
+	BOOST_REQUIRE(index.getRegionChunks(pos, chunks));
+	index.write();
+	stats = index.getStats();
+	return ChunkTimes(chunks.begin(), chunks.end());
+}
+
+/**
+ * Sets the timestamp and data of a chunk in a region file. The region file gets a
+ * modification time in the past, so the index doesn't treat it as still being written.
+ */
+void writeChunk(const fs::path& path, const mc::ChunkPos& pos, uint32_t timestamp,
+		const std::vector<uint8_t>& data) {
+	static std::time_t mtime = std::time(nullptr) - 1000;
+	mc::RegionFile region(path.string());
+	if (fs::exists(path))
+		BOOST_REQUIRE(region.read());
+	region.setChunkData(pos, data, 2);
+	region.setChunkTimestamp(pos, timestamp);
+	BOOST_REQUIRE(region.write());
+	fs::last_write_time(path, mtime++);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(chunkindex_testHashChunk) {
+	mc::ChunkPos pos(3, -7);
+	std::vector<uint8_t> data = createChunk(pos, "full", 0);
+	uint64_t hash = mc::ChunkIndex::hashChunk(data.data(), data.size(),
+			nbt::Compression::ZLIB);
+	BOOST_CHECK(hash != 0);
+
+	// tags that are not rendered don't change the hash, others do
+	data = createChunk(pos, "full", 42);
+	BOOST_CHECK_EQUAL(mc::ChunkIndex::hashChunk(data.data(), data.size(),
+			nbt::Compression::ZLIB), hash);
+	data = createChunk(pos, "features", 0);
+	BOOST_CHECK(mc::ChunkIndex::hashChunk(data.data(), data.size(),
+			nbt::Compression::ZLIB) != hash);
+	data = createChunk(mc::ChunkPos(3, -6), "full", 0);
+	BOOST_CHECK(mc::ChunkIndex::hashChunk(data.data(), data.size(),
+			nbt::Compression::ZLIB) != hash);
+
+	// corrupted chunks don't have a hash
+	BOOST_CHECK_EQUAL(mc::ChunkIndex::hashChunk(data.data(), data.size() / 2,
+			nbt::Compression::ZLIB), 0);
+}
+
+BOOST_AUTO_TEST_CASE(chunkindex_testScan) {
+	fs::path world_dir = fs::temp_directory_path() / fs::unique_path("mapcrafter-test-%%%%%%%%");
+	fs::create_directories(world_dir / "region");
+	fs::path path = world_dir / "region" / "r.-1.0.mca";
+	mc::RegionPos region_pos(-1, 0);
+
+	// a region with a few chunks in a row
+	ChunkTimes expected;
+	for (int i = 0; i < 4; i++) {
+		mc::ChunkPos pos(-32 + i, 0);
+		writeChunk(path, pos, 1000 + i, createChunk(pos, "full", 0));
+		expected[pos] = 1000 + i;
+	}
+	mc::ChunkPos touched(-32, 0), changed(-31, 0);
+
+	mc::World world(world_dir.string(), mc::Dimension::OVERWORLD, (world_dir / "cache").string());
+	BOOST_REQUIRE(world.load());
+
+	// the chunks of a new index are the chunks in the region header
+	mc::ChunkIndexStats stats;
+	BOOST_CHECK(scanRegion(world, region_pos, stats) == expected);
+	BOOST_CHECK_EQUAL(stats.regions_updated, 1);
+	BOOST_CHECK_EQUAL(stats.regions_unchanged, 0);
+
+	// the region file did not change
+	BOOST_CHECK(scanRegion(world, region_pos, stats) == expected);
+	BOOST_CHECK_EQUAL(stats.regions_updated, 0);
+	BOOST_CHECK_EQUAL(stats.regions_unchanged, 1);
+
+	// the hash of the chunk is not known yet, so a new timestamp is a change
+	writeChunk(path, touched, 2000, createChunk(touched, "full", 1));
+	expected[touched] = 2000;
+	BOOST_CHECK(scanRegion(world, region_pos, stats) == expected);
+	BOOST_CHECK_EQUAL(stats.regions_updated, 1);
+	BOOST_CHECK_EQUAL(stats.chunks_changed, 1);
+
+	// now the chunks are hashed, the chunk keeps the time of its last change
+	writeChunk(path, touched, 3000, createChunk(touched, "full", 2));
+	BOOST_CHECK(scanRegion(world, region_pos, stats) == expected);
+	BOOST_CHECK_EQUAL(stats.chunks_changed, 0);
+	BOOST_CHECK_EQUAL(stats.chunks_touched, 1);
+
+	// but chunks with other contents changed
+	writeChunk(path, changed, 3000, createChunk(changed, "features", 0));
+	expected[changed] = 3000;
+	BOOST_CHECK(scanRegion(world, region_pos, stats) == expected);
+	BOOST_CHECK_EQUAL(stats.chunks_changed, 1);
+	BOOST_CHECK_EQUAL(stats.chunks_touched, 0);
+
+	// the world crop is applied to the chunks of the index
+	mc::WorldCrop world_crop;
+	world_crop.setMaxX(changed.x * 16 + 15);
+	world.setWorldCrop(world_crop);
+	ChunkTimes cropped;
+	cropped[touched] = expected[touched];
+	cropped[changed] = expected[changed];
+	BOOST_CHECK(scanRegion(world, region_pos, stats) == cropped);
+
+	fs::remove_all(world_dir);
+}
@@ -18,12 +18,38 @@
  */
 
 #include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/renderer/image/kernels.h"
+#include "../mapcraftercore/renderer/image/pngencoder.h"
 
 #include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <boost/test/unit_test.hpp>
 
 namespace renderer = mapcrafter::renderer;
 
+namespace {
+
+/**
+ * Creates random pixels, with a lot of completely transparent and opaque pixels, since
+ * the kernels handle them separately.
+ */
+std::vector<renderer::RGBAPixel> createPixels(size_t n) {
+	std::vector<renderer::RGBAPixel> pixels(n);
+	for (size_t i = 0; i < n; i++) {
+		int alpha = rand() % 256;
+		if (rand() % 4 == 0)
+			alpha = 0;
+		else if (rand() % 3 == 0)
+			alpha = 255;
+		pixels[i] = renderer::rgba(rand() % 256, rand() % 256, rand() % 256, alpha);
+	}
+	return pixels;
+}
+
+}
+
 BOOST_AUTO_TEST_CASE(image_testIO) {
 	renderer::RGBAImage src(400, 200);
 	renderer::RGBAImage dest;
@@ -50,3 +76,172 @@ BOOST_AUTO_TEST_CASE(image_testIO) {
 		}
 	}
 }
+
+BOOST_AUTO_TEST_CASE(image_testPNGEncoder) {
+	// random pixels and some areas of the same color, so the filters are not all equal
+	renderer::RGBAImage src(67, 45);
+	for (int x = 0; x < src.getWidth(); x++)
+		for (int y = 0; y < src.getHeight(); y++)
+			src.setPixel(x, y, x < 30 ? renderer::rgba(x, y, 100, 255)
+					: renderer::rgba(rand() % 256, rand() % 256, rand() % 256, rand() % 256));
+
+	renderer::PNGFilter filters[] = {renderer::PNGFilter::ADAPTIVE, renderer::PNGFilter::NONE,
+			renderer::PNGFilter::SUB, renderer::PNGFilter::UP, renderer::PNGFilter::AVERAGE,
+			renderer::PNGFilter::PAETH};
+	renderer::PNGStrategy strategies[] = {renderer::PNGStrategy::DEFAULT,
+			renderer::PNGStrategy::RLE};
+
+	// the same encoder is reused for all images
+	renderer::PNGEncoder encoder;
+	for (size_t f = 0; f < 6; f++) {
+		for (size_t s = 0; s < 2; s++) {
+			renderer::PNGOptions options;
+			options.filter = filters[f];
+			options.strategy = strategies[s];
+			options.compression_level = s == 0 ? 6 : 1;
+
+			std::string data;
+			renderer::RGBAImage dest;
+			BOOST_REQUIRE(encoder.encode(src, options, data));
+			std::istringstream in(data);
+			BOOST_REQUIRE_MESSAGE(dest.readPNG(in), "Filter " << filters[f]);
+			BOOST_CHECK_MESSAGE(dest.data == src.data, "Filter " << filters[f]
+					<< ", strategy " << strategies[s]);
+
+			// and the options with libpng
+			std::ostringstream out;
+			BOOST_REQUIRE(src.writePNG(out, options));
+			std::istringstream in2(out.str());
+			BOOST_REQUIRE(dest.readPNG(in2));
+			BOOST_CHECK(dest.data == src.data);
+		}
+	}
+
+	// no compression is bigger than the default compression
+	renderer::PNGOptions stored;
+	stored.compression_level = 0;
+	std::string data1, data2;
+	BOOST_REQUIRE(encoder.encode(src, stored, data1));
+	BOOST_REQUIRE(encoder.encode(src, renderer::PNGOptions(), data2));
+	BOOST_CHECK(data1.size() > data2.size());
+}
+
+BOOST_AUTO_TEST_CASE(image_testKernels) {
+	std::vector<const renderer::ImageKernels*> all_kernels = renderer::getSupportedImageKernels();
+	BOOST_TEST_MESSAGE("Selected image kernels: " << renderer::getImageKernels().name);
+
+	// the first test uses all combinations of source and destination alpha,
+	// the other ones some lengths which aren't a multiple of the vector width
+	size_t lengths[] = {256 * 256, 0, 1, 3, 7, 13, 37};
+
+	for (size_t k = 0; k < all_kernels.size(); k++) {
+		const renderer::ImageKernels& kernels = *all_kernels[k];
+		BOOST_TEST_CHECKPOINT("Testing image kernels " << kernels.name);
+
+		for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+			size_t n = lengths[l];
+			std::vector<renderer::RGBAPixel> source = createPixels(n);
+			std::vector<renderer::RGBAPixel> dest = createPixels(n);
+			if (l == 0)
+				for (size_t i = 0; i < n; i++) {
+					source[i] = (source[i] & 0xffffff) | ((i / 256) << 24);
+					dest[i] = (dest[i] & 0xffffff) | ((i % 256) << 24);
+				}
+			renderer::RGBAPixel color = renderer::rgba(rand() % 256, rand() % 256,
+					rand() % 256, rand() % 256);
+			uint8_t factor = rand() % 256;
+
+			std::vector<renderer::RGBAPixel> expected = dest, actual = dest;
+			for (size_t i = 0; i < n; i++)
+				renderer::blend(expected[i], source[i]);
+			kernels.blend(actual.data(), source.data(), n);
+			BOOST_CHECK(actual == expected);
+
+			expected = actual = dest;
+			for (size_t i = 0; i < n; i++)
+				if (renderer::rgba_alpha(source[i]) != 0)
+					expected[i] = source[i];
+			kernels.alphaCopy(actual.data(), source.data(), n);
+			BOOST_CHECK(actual == expected);
+
+			expected = actual = source;
+			for (size_t i = 0; i < n; i++)
+				expected[i] = renderer::rgba_multiply_scalar(source[i], factor);
+			kernels.multiplyScalar(actual.data(), n, factor);
+			BOOST_CHECK(actual == expected);
+
+			expected = actual = source;
+			for (size_t i = 0; i < n; i++)
+				if (renderer::rgba_alpha(source[i]) != 0)
+					expected[i] = renderer::rgba_multiply(source[i], color);
+			kernels.tint(actual.data(), n, color);
+			BOOST_CHECK(actual == expected);
+
+			expected = actual = dest;
+			for (size_t i = 0; i < n; i++)
+				expected[i] = renderer::rgba_multiply_with_alpha(source[i], color);
+			kernels.multiplyWithAlpha(actual.data(), source.data(), n, color);
+			BOOST_CHECK(actual == expected);
+
+			// the scalar implementation of this one is the reference
+			const uint8_t faces[3] = {42, 170, 85};
+			uint32_t factors[3][4];
+			for (int f = 0; f < 3; f++)
+				for (int c = 0; c < 4; c++)
+					factors[f][c] = rand() % 256;
+			std::vector<renderer::RGBAPixel> uv = createPixels(n);
+			for (size_t i = 0; i < n; i++)
+				if (rand() % 4 != 0)
+					uv[i] = (uv[i] & 0xff00ffff) | (faces[rand() % 3] << 16);
+			expected = actual = source;
+			all_kernels[0]->multiplyFaces(expected.data(), uv.data(), n, faces, factors);
+			kernels.multiplyFaces(actual.data(), uv.data(), n, faces, factors);
+			BOOST_CHECK(actual == expected);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(image_testResizeHalf) {
+	std::vector<const renderer::ImageKernels*> all_kernels = renderer::getSupportedImageKernels();
+
+	int sizes[] = {64, 37};
+	for (size_t s = 0; s < 2; s++) {
+		std::vector<renderer::RGBAPixel> row1 = createPixels(sizes[s]);
+		std::vector<renderer::RGBAPixel> row2 = createPixels(sizes[s]);
+		size_t n = sizes[s] / 2;
+
+		std::vector<renderer::RGBAPixel> expected(n);
+		for (size_t i = 0; i < n; i++) {
+			renderer::RGBAPixel p1 = row1[2 * i], p2 = row1[2 * i + 1];
+			renderer::RGBAPixel p3 = row2[2 * i], p4 = row2[2 * i + 1];
+			renderer::RGBAPixel high = ((p1 >> 2) & 0x3f3f3f3f) + ((p2 >> 2) & 0x3f3f3f3f)
+					+ ((p3 >> 2) & 0x3f3f3f3f) + ((p4 >> 2) & 0x3f3f3f3f);
+			renderer::RGBAPixel low = (((p1 & 0x03030303) + (p2 & 0x03030303)
+					+ (p3 & 0x03030303) + (p4 & 0x03030303)) >> 2) & 0x03030303;
+			expected[i] = high + low;
+		}
+
+		for (size_t k = 0; k < all_kernels.size(); k++) {
+			std::vector<renderer::RGBAPixel> actual(n);
+			all_kernels[k]->resizeHalf(actual.data(), row1.data(), row2.data(), n);
+			BOOST_CHECK_MESSAGE(actual == expected, "Kernels " << all_kernels[k]->name);
+		}
+	}
+
+	// and the whole image
+	renderer::RGBAImage image(37, 20), resized;
+	for (int x = 0; x < image.getWidth(); x++)
+		for (int y = 0; y < image.getHeight(); y++)
+			image.setPixel(x, y, renderer::rgba(rand() % 256, rand() % 256,
+					rand() % 256, rand() % 256));
+	image.resize(resized, 0, 0, renderer::InterpolationType::HALF);
+	BOOST_REQUIRE_EQUAL(resized.getWidth(), 18);
+	BOOST_REQUIRE_EQUAL(resized.getHeight(), 10);
+	renderer::RGBAPixel p1 = image.getPixel(6, 12), p2 = image.getPixel(7, 12);
+	renderer::RGBAPixel p3 = image.getPixel(6, 13), p4 = image.getPixel(7, 13);
+	renderer::RGBAPixel high = ((p1 >> 2) & 0x3f3f3f3f) + ((p2 >> 2) & 0x3f3f3f3f)
+			+ ((p3 >> 2) & 0x3f3f3f3f) + ((p4 >> 2) & 0x3f3f3f3f);
+	renderer::RGBAPixel low = (((p1 & 0x03030303) + (p2 & 0x03030303)
+			+ (p3 & 0x03030303) + (p4 & 0x03030303)) >> 2) & 0x03030303;
+	BOOST_CHECK_EQUAL(resized.getPixel(3, 6), high + low);
+}
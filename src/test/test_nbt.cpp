@@ -17,7 +17,9 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../mapcraftercore/mc/compression.h"
 #include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/nbtreader.h"
 
 #include <vector>
 #include <map>
@@ -98,3 +100,144 @@ BOOST_AUTO_TEST_CASE(nbt_testIO) {
 		BOOST_CHECK(intarray_data == in.findTag<nbt::TagIntArray>("intarray").payload);
 	}
 }
+
+BOOST_AUTO_TEST_CASE(nbt_testReader) {
+	std::vector<int64_t> longarray_data = {1, -1, 4294967296ll, -1234567890123ll};
+
+	nbt::NBTFile out("TestNBTFile");
+	nbt::TagCompound skipped;
+	skipped.addTag("string", nbt::TagString("skip me"));
+	nbt::TagList list(nbt::TagInt::TAG_TYPE);
+	for (int i = 0; i < 5; i++)
+		list.payload.push_back(nbt::TagPtr(new nbt::TagInt(i)));
+	skipped.addTag("list", list);
+	out.addTag("a_skipped", skipped);
+	out.addTag("byte", nbt::TagByte(42));
+	out.addTag("int", nbt::TagInt(-23));
+	out.addTag("long", nbt::TagLong(123456));
+	out.addTag("longarray", nbt::TagLongArray(longarray_data));
+	out.addTag("string", nbt::TagString("foobar"));
+
+	nbt::Compression compressions[] = {
+		nbt::Compression::NO_COMPRESSION,
+		nbt::Compression::GZIP,
+		nbt::Compression::ZLIB
+	};
+	for (size_t i = 0; i < 3; i++) {
+		std::stringstream stream;
+		out.writeNBT(stream, compressions[i]);
+		std::string raw = stream.str();
+
+		std::vector<uint8_t> data;
+		nbt::decompress(raw.data(), raw.size(), compressions[i], data);
+		nbt::NBTReader reader(data.data(), data.size());
+		reader.readRoot();
+
+		int8_t type;
+		nbt::StringRef name;
+		std::map<std::string, int8_t> found;
+		while (reader.nextTag(type, name)) {
+			found[name.str()] = type;
+			if (name == "byte")
+				BOOST_CHECK_EQUAL(reader.readByte(), 42);
+			else if (name == "int")
+				BOOST_CHECK_EQUAL(reader.readInt(), -23);
+			else if (name == "long")
+				BOOST_CHECK_EQUAL(reader.readLong(), 123456);
+			else if (name == "string")
+				BOOST_CHECK_EQUAL(reader.readString().str(), "foobar");
+			else if (name == "longarray") {
+				nbt::LongArrayRef array = reader.readLongArray();
+				BOOST_REQUIRE_EQUAL(array.size(), longarray_data.size());
+				for (size_t j = 0; j < array.size(); j++)
+					BOOST_CHECK_EQUAL(array[j], longarray_data[j]);
+			} else
+				reader.skipPayload(type);
+		}
+		// the whole buffer must be consumed
+		BOOST_CHECK_EQUAL(reader.tell(), data.size());
+		BOOST_CHECK_EQUAL(found.size(), 6);
+		BOOST_CHECK(found["a_skipped"] == nbt::TagCompound::TAG_TYPE);
+
+		// truncated data must not be read out of bounds
+		nbt::NBTReader truncated(data.data(), data.size() - 3);
+		truncated.readRoot();
+		BOOST_CHECK_THROW(truncated.skipPayload(nbt::TagCompound::TAG_TYPE), nbt::NBTError);
+	}
+}
+
+namespace {
+
+void appendLZ4Block(std::string& stream, int method, const std::string& data, size_t size) {
+	stream += "LZ4Block";
+	stream += (char) method;
+	uint32_t values[] = {(uint32_t) data.size(), (uint32_t) size, 0};
+	for (size_t i = 0; i < 3; i++)
+		for (int j = 0; j < 4; j++)
+			stream += (char) ((values[i] >> (8 * j)) & 0xff);
+	stream += data;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(nbt_testDecompress) {
+	nbt::NBTFile out("TestNBTFile");
+	out.addTag("string", nbt::TagString(std::string(1000, 'x') + "foobar"));
+	std::stringstream uncompressed_stream;
+	out.writeNBT(uncompressed_stream, nbt::Compression::NO_COMPRESSION);
+	std::string uncompressed = uncompressed_stream.str();
+
+	nbt::Compression compressions[] = {
+		nbt::Compression::GZIP,
+		nbt::Compression::ZLIB
+	};
+	// reuse the same buffer to make sure it is resized correctly
+	std::vector<uint8_t> decompressed(1);
+	for (size_t i = 0; i < 2; i++) {
+		std::stringstream stream;
+		out.writeNBT(stream, compressions[i]);
+		std::string compressed = stream.str();
+
+		nbt::decompress(compressed.data(), compressed.size(), compressions[i], decompressed);
+		BOOST_CHECK(std::string(decompressed.begin(), decompressed.end()) == uncompressed);
+
+		BOOST_CHECK_THROW(nbt::decompress(compressed.data(), compressed.size() / 2,
+				compressions[i], decompressed), nbt::NBTError);
+	}
+
+	// a LZ4 compressed block (abc + match of 12 bytes + x), a raw block and the end mark
+	std::string lz4;
+	appendLZ4Block(lz4, 0x20, std::string("\x38" "abc" "\x03\x00" "\x10" "x", 8), 16);
+	appendLZ4Block(lz4, 0x10, "raw", 3);
+	appendLZ4Block(lz4, 0x10, "", 0);
+	nbt::decompress(lz4.data(), lz4.size(), nbt::Compression::LZ4, decompressed);
+	BOOST_CHECK_EQUAL(std::string(decompressed.begin(), decompressed.end()), "abcabcabcabcabcxraw");
+
+	// invalid match offset
+	std::string invalid;
+	appendLZ4Block(invalid, 0x20, std::string("\x38" "abc" "\x09\x00" "\x10" "x", 8), 16);
+	BOOST_CHECK_THROW(nbt::decompress(invalid.data(), invalid.size(), nbt::Compression::LZ4,
+			decompressed), nbt::NBTError);
+
+	// decompressed sizes which are impossible are rejected before allocating memory for
+	// them: bigger than the maximum block size, and more than the compressed data can
+	// expand to
+	std::string oversized;
+	appendLZ4Block(oversized, 0x20, "x", 0xffffffff);
+	BOOST_CHECK_THROW(nbt::decompress(oversized.data(), oversized.size(), nbt::Compression::LZ4,
+			decompressed), nbt::NBTError);
+	oversized.clear();
+	appendLZ4Block(oversized, 0x20, std::string(8, 'x'), 8 * 255 + 17);
+	BOOST_CHECK_THROW(nbt::decompress(oversized.data(), oversized.size(), nbt::Compression::LZ4,
+			decompressed), nbt::NBTError);
+	BOOST_CHECK(decompressed.capacity() < 1 << 20);
+
+	// reading NBT data from a buffer uses the same decompression
+	std::stringstream stream;
+	out.writeNBT(stream, nbt::Compression::ZLIB);
+	std::string compressed = stream.str();
+	nbt::NBTFile in;
+	in.readNBT(compressed.data(), compressed.size(), nbt::Compression::ZLIB);
+	BOOST_CHECK_EQUAL(in.findTag<nbt::TagString>("string").payload,
+			out.findTag<nbt::TagString>("string").payload);
+}
@@ -25,6 +25,8 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 namespace mc = mapcrafter::mc;
@@ -54,3 +56,72 @@ BOOST_AUTO_TEST_CASE(region_testReadWrite) {
 	}
 
 }
+
+BOOST_AUTO_TEST_CASE(region_testMap) {
+	mc::BlockStateRegistry block_registry;
+
+	mc::RegionFile read("data/region/r.-1.0.mca");
+	mc::RegionFile mapped("data/region/r.-1.0.mca");
+	BOOST_CHECK(read.read());
+	BOOST_CHECK(mapped.map());
+	BOOST_CHECK_EQUAL(mapped.getContainingChunksCount(), read.getContainingChunksCount());
+
+	auto chunks = read.getContainingChunks();
+	for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+		BOOST_CHECK(mapped.hasChunk(*it));
+		BOOST_CHECK_EQUAL(mapped.getChunkTimestamp(*it), read.getChunkTimestamp(*it));
+		// the raw chunk data is only available if the region was read completely
+		BOOST_CHECK(mapped.getChunkData(*it).empty());
+
+		mc::Chunk chunk1, chunk2;
+		BOOST_CHECK_EQUAL(mapped.loadChunk(*it, block_registry, chunk1),
+				read.loadChunk(*it, block_registry, chunk2));
+	}
+
+	BOOST_CHECK(!mc::RegionFile("data/region/r.42.42.mca").map());
+}
+
+BOOST_AUTO_TEST_CASE(region_testCorruptChunkSize) {
+	namespace fs = boost::filesystem;
+
+	// a copy of the region with a huge size field for every chunk
+	std::ifstream in("data/region/r.-1.0.mca", std::ios::binary);
+	std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	BOOST_REQUIRE(data.size() > 8192);
+	for (size_t i = 0; i < 1024; i++) {
+		const uint8_t* location = reinterpret_cast<const uint8_t*>(&data[i * 4]);
+		size_t offset = ((location[0] << 16) | (location[1] << 8) | location[2]) * 4096;
+		if (offset == 0 || offset + 4 > data.size())
+			continue;
+		// 0xfffffff0 big-endian, the end of the chunk would wrap around with 32 bits
+		data[offset] = data[offset + 1] = data[offset + 2] = (char) 0xff;
+		data[offset + 3] = (char) 0xf0;
+	}
+	fs::path file = fs::temp_directory_path() / fs::unique_path("r.-1.0-%%%%%%%%.mca");
+	std::ofstream out(file.string().c_str(), std::ios::binary);
+	out.write(data.data(), data.size());
+	out.close();
+
+	mc::BlockStateRegistry block_registry;
+	mc::RegionFile original("data/region/r.-1.0.mca");
+	BOOST_REQUIRE(original.read());
+	mc::RegionFile mapped(file.string());
+	BOOST_REQUIRE(mapped.map());
+
+	auto chunks = original.getContainingChunks();
+	BOOST_REQUIRE(!chunks.empty());
+	for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+		const uint8_t* payload;
+		size_t size;
+		uint8_t compression;
+		BOOST_CHECK_EQUAL(mapped.getChunkPayload(*it, payload, size, compression),
+				(int) mc::RegionFile::CHUNK_DATA_INVALID);
+		mc::Chunk chunk;
+		BOOST_CHECK_EQUAL(mapped.loadChunk(*it, block_registry, chunk),
+				(int) mc::RegionFile::CHUNK_DATA_INVALID);
+	}
+
+	mc::RegionFile read(file.string());
+	BOOST_CHECK(!read.read());
+	fs::remove(file);
+}
@@ -17,11 +17,22 @@
  * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/renderer/renderviews/isometricnew/tileset.h"
+#include "../mapcraftercore/renderer/tilededuplicator.h"
+#include "../mapcraftercore/renderer/tileimagecache.h"
 #include "../mapcraftercore/renderer/tileset.h"
 
+#include <limits>
 #include <map>
+#include <set>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
+namespace fs = boost::filesystem;
+namespace mc = mapcrafter::mc;
 namespace renderer = mapcrafter::renderer;
 
 #define PATH(a, b, c, d) ((((renderer::TilePath() + a) + b) + c) + d)
@@ -51,3 +62,109 @@ BOOST_AUTO_TEST_CASE(test_tilepos) {
 	}
 	BOOST_CHECK_EQUAL(paths.size(), 256);
 }
+
+BOOST_AUTO_TEST_CASE(test_tileimagecache) {
+	// enough memory for two 16x16 images
+	renderer::TileImageCache cache(2 * 16 * 16 * 4);
+
+	renderer::RGBAImage image(16, 16);
+	image.setPixel(3, 4, renderer::rgba(1, 2, 3, 4));
+	BOOST_CHECK(cache.put(PATH(1, 2, 3, 4), image));
+	image.setSize(16, 16);
+	BOOST_CHECK(cache.put(PATH(1, 2, 3, 3), image));
+	// the cache is full now, images which are not cached are left untouched
+	image.setSize(16, 16);
+	BOOST_CHECK(!cache.put(PATH(1, 2, 3, 2), image));
+	BOOST_CHECK_EQUAL(image.getWidth(), 16);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+	BOOST_CHECK_EQUAL(cache.getMemoryUsage(), 2 * 16 * 16 * 4);
+
+	renderer::RGBAImage taken;
+	BOOST_CHECK(!cache.take(PATH(1, 2, 3, 2), taken));
+	BOOST_REQUIRE(cache.take(PATH(1, 2, 3, 4), taken));
+	BOOST_CHECK_EQUAL(taken.getWidth(), 16);
+	BOOST_CHECK_EQUAL(taken.getPixel(3, 4), renderer::rgba(1, 2, 3, 4));
+	// images are handed off only once
+	BOOST_CHECK(!cache.take(PATH(1, 2, 3, 4), taken));
+	BOOST_CHECK_EQUAL(cache.size(), 1);
+
+	// there is memory for another image again
+	BOOST_CHECK(cache.put(PATH(1, 2, 3, 2), image));
+	cache.clear();
+	BOOST_CHECK_EQUAL(cache.size(), 0);
+	BOOST_CHECK_EQUAL(cache.getMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_tilededuplicator) {
+	renderer::RGBAImage image1(16, 16), image2(16, 16), image3(16, 8);
+	image1.setPixel(3, 4, renderer::rgba(1, 2, 3, 4));
+	image2.setPixel(4, 3, renderer::rgba(1, 2, 3, 4));
+	renderer::TileHash hash1 = renderer::TileDeduplicator::hash(image1);
+	BOOST_CHECK(hash1 == renderer::TileDeduplicator::hash(image1));
+	BOOST_CHECK(!(hash1 == renderer::TileDeduplicator::hash(image2)));
+	// images with the same pixels, but different sizes
+	BOOST_CHECK(!(renderer::TileDeduplicator::hash(renderer::RGBAImage(16, 8))
+			== renderer::TileDeduplicator::hash(renderer::RGBAImage(8, 16))));
+
+	renderer::TileDeduplicator deduplicator(2);
+	std::string tile;
+	BOOST_CHECK(!deduplicator.find(hash1, tile));
+	deduplicator.add(hash1, "1.png");
+	BOOST_CHECK(deduplicator.find(hash1, tile));
+	BOOST_CHECK_EQUAL(tile, "1.png");
+	deduplicator.addLink(hash1);
+	BOOST_CHECK_EQUAL(deduplicator.getLinkedTiles(), 1);
+
+	// if the cache is full, images which were not found again are forgotten
+	renderer::TileHash hash2 = renderer::TileDeduplicator::hash(image2);
+	renderer::TileHash hash3 = renderer::TileDeduplicator::hash(image3);
+	deduplicator.add(hash2, "2.png");
+	deduplicator.add(hash3, "3.png");
+	BOOST_CHECK(deduplicator.find(hash1, tile));
+	BOOST_CHECK(!deduplicator.find(hash2, tile));
+	BOOST_CHECK(deduplicator.find(hash3, tile));
+}
+
+BOOST_AUTO_TEST_CASE(test_tileset_scan) {
+	// a world with copies of the test region at different positions
+	fs::path world_dir = fs::temp_directory_path() / fs::unique_path("mapcrafter-test-%%%%%%%%");
+	fs::create_directories(world_dir / "region");
+	const char* regions[] = {"r.-1.0.mca", "r.0.0.mca", "r.0.1.mca", "r.-2.-1.mca", "r.3.3.mca"};
+	for (int i = 0; i < 5; i++)
+		fs::copy_file("data/region/r.-1.0.mca", world_dir / "region" / regions[i]);
+	mc::World world(world_dir.string(), mc::Dimension::OVERWORLD, (world_dir / "cache").string());
+	BOOST_REQUIRE(world.load());
+
+	// the tiles of all chunks, scanned without the tile set
+	renderer::RenderRotation rotation(renderer::RenderRotation::TOP_LEFT);
+	renderer::NewIsometricTileSet reference(1, rotation);
+	std::set<renderer::TilePos> expected;
+	auto region_set = world.getAvailableRegions();
+	for (auto region_it = region_set.begin(); region_it != region_set.end(); ++region_it) {
+		mc::RegionFile region;
+		BOOST_REQUIRE(world.getRegion(*region_it, region) && region.readOnlyHeaders());
+		auto chunks = region.getContainingChunks();
+		for (auto chunk_it = chunks.begin(); chunk_it != chunks.end(); ++chunk_it)
+			reference.mapChunkToTiles(*chunk_it, expected);
+	}
+
+	// scanning with multiple threads must find the same tiles
+	for (int threads = 1; threads <= 4; threads++) {
+		renderer::NewIsometricTileSet tile_set(1, rotation);
+		tile_set.scan(world, threads);
+		tile_set.resetRequired();
+		BOOST_CHECK(tile_set.getRequiredRenderTiles() == expected);
+
+		int depth = tile_set.getDepth();
+		for (auto it = expected.begin(); it != expected.end(); ++it)
+			BOOST_CHECK(tile_set.hasTile(renderer::TilePath::byTilePos(*it, depth)));
+
+		// all chunks of the test region are older than now
+		tile_set.scanRequiredByTimestamp(std::numeric_limits<int>::max());
+		BOOST_CHECK_EQUAL(tile_set.getRequiredRenderTilesCount(), 0);
+		tile_set.scanRequiredByTimestamp(0);
+		BOOST_CHECK_EQUAL(tile_set.getRequiredRenderTilesCount(), expected.size());
+	}
+
+	fs::remove_all(world_dir);
+}
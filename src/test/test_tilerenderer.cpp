@@ -0,0 +1,253 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/config/mapcrafterconfig.h"
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/renderer/blockimages.h"
+#include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/renderer/renderview.h"
+#include "../mapcraftercore/renderer/tilerenderer.h"
+#include "../mapcraftercore/renderer/tilerenderworker.h"
+#include "../mapcraftercore/renderer/tileset.h"
+#include "../mapcraftercore/util.h"
+
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace fs = boost::filesystem;
+namespace config = mapcrafter::config;
+namespace mc = mapcrafter::mc;
+namespace nbt = mapcrafter::mc::nbt;
+namespace renderer = mapcrafter::renderer;
+
+namespace {
+
+const char* BLOCKS[] = {
+	"minecraft:air", "minecraft:stone", "minecraft:dirt", "minecraft:grass_block",
+	"minecraft:water", "minecraft:oak_leaves",
+};
+
+// block at a position of the test world, hills with water and some floating leaves
+int testBlock(int x, int z, int y) {
+	int height = 56 + 6 * std::sin(x / 5.0) * std::cos(z / 7.0);
+	if (y > height) {
+		if (y == height + 3 && (x * 7 + z * 13) % 5 == 0)
+			return 5;
+		return y <= 54 ? 4 : 0;
+	}
+	if (y == height)
+		return 3;
+	return y >= height - 2 ? 2 : 1;
+}
+
+/**
+ * Creates the NBT data of a chunk of the test world in the format of Minecraft 1.18+.
+ */
+std::string createChunk(int chunk_x, int chunk_z) {
+	nbt::NBTFile chunk("");
+	chunk.addTag("DataVersion", nbt::TagInt(3337));
+	chunk.addTag("Status", nbt::TagString("full"));
+	chunk.addTag("xPos", nbt::TagInt(chunk_x));
+	chunk.addTag("yPos", nbt::TagInt(-4));
+	chunk.addTag("zPos", nbt::TagInt(chunk_z));
+
+	nbt::TagList sections(nbt::TagCompound::TAG_TYPE);
+	for (int section_y = 2; section_y < 5; section_y++) {
+		// all blocks are in the palette, 4 bits per block, 16 blocks per long
+		nbt::TagList palette(nbt::TagCompound::TAG_TYPE);
+		for (int i = 0; i < 6; i++) {
+			nbt::TagCompound entry;
+			entry.addTag("Name", nbt::TagString(BLOCKS[i]));
+			palette.payload.push_back(nbt::TagPtr(entry.clone()));
+		}
+		std::vector<int64_t> data(256, 0);
+		for (int i = 0; i < 4096; i++) {
+			int block = testBlock(chunk_x * 16 + i % 16, chunk_z * 16 + (i / 16) % 16,
+					section_y * 16 + i / 256);
+			data[i / 16] |= (int64_t) block << (4 * (i % 16));
+		}
+		nbt::TagCompound block_states;
+		block_states.addTag("palette", palette);
+		block_states.addTag("data", nbt::TagLongArray(data));
+
+		nbt::TagCompound biomes;
+		nbt::TagList biome_palette(nbt::TagString::TAG_TYPE);
+		biome_palette.payload.push_back(nbt::TagPtr(new nbt::TagString("minecraft:plains")));
+		biomes.addTag("palette", biome_palette);
+
+		nbt::TagCompound section;
+		section.addTag("Y", nbt::TagByte(section_y));
+		section.addTag("block_states", block_states);
+		section.addTag("biomes", biomes);
+		section.addTag("SkyLight", nbt::TagByteArray(std::vector<int8_t>(2048, -1)));
+		sections.payload.push_back(nbt::TagPtr(section.clone()));
+	}
+	chunk.addTag("sections", sections);
+
+	std::stringstream stream;
+	chunk.writeNBT(stream, nbt::Compression::ZLIB);
+	return stream.str();
+}
+
+/**
+ * Writes a block image atlas (isometric view, rotation 0, texture size 16) with simple
+ * cubes of the blocks of the test world: opaque ones, translucent water and leaves with
+ * holes.
+ */
+void createBlockImages(const fs::path& block_dir) {
+	const int size = 32;
+	renderer::RGBAPixel colors[] = {
+		renderer::rgba(255, 0, 255),
+		renderer::rgba(120, 120, 120),
+		renderer::rgba(134, 96, 67),
+		renderer::rgba(90, 160, 60),
+		renderer::rgba(40, 60, 200, 160),
+		renderer::rgba(40, 120, 30),
+	};
+
+	// cells: uv mask, unknown block and the blocks
+	renderer::RGBAImage atlas(size * 7, size);
+	for (int x = 0; x < size; x++)
+		for (int y = 0; y < size; y++) {
+			double cx = x + 0.5, cy = y + 0.5;
+			uint8_t face = 0;
+			if (std::abs(cx - 16) / 2 + std::abs(cy - 8) <= 8)
+				face = renderer::FACE_UP_INDEX;
+			else if (cx < 16 && cy >= 8 + cx / 2 && cy <= 24 + cx / 2)
+				face = renderer::FACE_LEFT_INDEX;
+			else if (cx >= 16 && cy >= 16 - (cx - 16) / 2 && cy <= 32 - (cx - 16) / 2)
+				face = renderer::FACE_RIGHT_INDEX;
+			if (face == 0)
+				continue;
+			atlas.setPixel(x, y, renderer::rgba(0, 0, face, 255));
+			for (int i = 0; i < 6; i++) {
+				// leaves with holes
+				if (i == 5 && (x / 2 + y / 2) % 3 == 0)
+					continue;
+				atlas.setPixel(size * (i + 1) + x, y, colors[i]);
+			}
+		}
+
+	fs::create_directories(block_dir);
+	atlas.writePNG((block_dir / "isometric_0_16.png").string());
+	std::ofstream info((block_dir / "isometric_0_16.txt").string().c_str());
+	info << size << " " << size << " 7" << std::endl;
+	info << "minecraft:air - color=0,uv=0" << std::endl;
+	info << "minecraft:unknown_block - color=1,uv=0" << std::endl;
+	for (int i = 1; i < 6; i++)
+		info << BLOCKS[i] << " - color=" << i + 1 << ",uv=0" << std::endl;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(tilerenderer_testOcclusionCulling) {
+	fs::path dir = fs::temp_directory_path() / fs::unique_path("mapcrafter-test-%%%%%%%%");
+	fs::path world_dir = dir / "world", block_dir = dir / "blocks";
+	fs::create_directories(world_dir / "region");
+	mc::RegionFile region((world_dir / "region" / "r.0.0.mca").string());
+	for (int x = 0; x < 4; x++)
+		for (int z = 0; z < 4; z++) {
+			std::string data = createChunk(x, z);
+			region.setChunkData(mc::ChunkPos(x, z),
+					std::vector<uint8_t>(data.begin(), data.end()), 2);
+		}
+	BOOST_REQUIRE(region.write());
+	createBlockImages(block_dir);
+
+	config::MapcrafterConfig config;
+	config::ValidationMap validation = config.parseString(
+		"output_dir = " + (dir / "output").string() + "\n"
+		"template_dir = " + dir.string() + "\n"
+		"[world:test]\n"
+		"input_dir = " + world_dir.string() + "\n"
+		"[map:test]\n"
+		"world = test\n"
+		"render_view = isometric\n"
+		"texture_size = 16\n"
+		"block_dir = " + block_dir.string() + "\n");
+	BOOST_REQUIRE(!validation.isCritical());
+	config::MapSection map_config = config.getMap("test");
+	config::WorldSection world_config = config.getWorld("test");
+
+	std::shared_ptr<mc::World> world(new mc::World(world_dir.string(),
+			world_config.getDimension(), (dir / "cache").string()));
+	BOOST_REQUIRE(world->load());
+
+	mc::BlockStateRegistry block_registry;
+	std::shared_ptr<renderer::RenderView> render_view(renderer::createRenderView(
+			map_config.getRenderView(), renderer::RenderRotation::TOP_LEFT,
+			map_config.getWaterOpacity()));
+	std::shared_ptr<renderer::BlockImages> block_images(
+			render_view->createBlockImages(block_registry));
+	render_view->configureBlockImages(block_images.get(), world_config, map_config);
+	renderer::RenderedBlockImages* rendered_block_images =
+			dynamic_cast<renderer::RenderedBlockImages*>(block_images.get());
+	BOOST_REQUIRE(rendered_block_images != nullptr);
+	BOOST_REQUIRE(rendered_block_images->loadBlockImages(block_dir,
+			mapcrafter::util::str(map_config.getRenderView()), 0, 16));
+
+	std::shared_ptr<renderer::TileSet> tile_set(
+			render_view->createTileSet(map_config.getTileWidth()));
+	tile_set->scan(*world);
+	tile_set->resetRequired();
+
+	renderer::RenderContext context;
+	context.world_config = world_config;
+	context.map_config = map_config;
+	context.render_view = render_view.get();
+	context.block_images = block_images.get();
+	context.tile_set = tile_set.get();
+	context.block_registry = &block_registry;
+	context.world = world;
+	context.initializeTileRenderer();
+
+	// the tiles are the same with and without occlusion culling
+	const std::set<renderer::TilePos>& tiles = tile_set->getRequiredRenderTiles();
+	BOOST_REQUIRE(!tiles.empty());
+	int drawn = 0;
+	for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+		renderer::RGBAImage culled, unculled;
+		context.tile_renderer->setOcclusionCulling(true);
+		context.tile_renderer->renderTile(*it + tile_set->getTileOffset(), culled);
+		context.tile_renderer->setOcclusionCulling(false);
+		context.tile_renderer->renderTile(*it + tile_set->getTileOffset(), unculled);
+		BOOST_REQUIRE_EQUAL(culled.getWidth(), unculled.getWidth());
+		BOOST_REQUIRE_EQUAL(culled.getHeight(), unculled.getHeight());
+		BOOST_CHECK(culled.data == unculled.data);
+		for (size_t i = 0; i < culled.data.size(); i++)
+			if (culled.data[i] != 0) {
+				drawn++;
+				break;
+			}
+	}
+	// make sure something was rendered at all
+	BOOST_CHECK(drawn > 0);
+
+	fs::remove_all(dir);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/renderer/tilededuplicator.h"
+#include "../mapcraftercore/renderer/tileset.h"
+#include "../mapcraftercore/renderer/tilestorage.h"
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace fs = boost::filesystem;
+namespace renderer = mapcrafter::renderer;
+
+namespace {
+
+renderer::RGBAImage createImage(int seed) {
+	renderer::RGBAImage image(32, 32);
+	for (int x = 0; x < 32; x++)
+		for (int y = 0; y < 32; y++)
+			image.setPixel(x, y, renderer::rgba(x * 8, y * 8, seed, 255));
+	return image;
+}
+
+bool readsImage(const renderer::TileStorage& storage, const renderer::TilePath& tile,
+		const renderer::RGBAImage& expected) {
+	renderer::RGBAImage image;
+	return storage.readTile(tile, image) && image.data == expected.data;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_tilestorage_files) {
+	fs::path dir = fs::temp_directory_path() / fs::unique_path("mapcrafter-test-%%%%%%%%");
+	renderer::FileTileStorage storage(dir, renderer::TileFormat());
+	storage.setDeduplicator(std::make_shared<renderer::TileDeduplicator>());
+	renderer::TilePath tile1 = renderer::TilePath() + 1 + 2, tile2 = renderer::TilePath() + 4;
+	renderer::RGBAImage image1 = createImage(1), image2 = createImage(2);
+
+	BOOST_CHECK_EQUAL(storage.getTileFile(renderer::TilePath()), "base.png");
+	BOOST_CHECK_EQUAL(storage.getTileFile(tile1), "1/2.png");
+	std::time_t time;
+	BOOST_CHECK(!storage.getTileTime(tile1, time));
+
+	// the second tile with the same image is a link to the file of the first one
+	BOOST_REQUIRE(storage.writeTile(tile1, image1));
+	BOOST_REQUIRE(storage.writeTile(tile2, image1));
+	BOOST_CHECK(storage.getTileTime(tile1, time));
+	BOOST_CHECK_EQUAL(fs::hard_link_count(dir / "4.png"), 2);
+	BOOST_CHECK(readsImage(storage, tile2, image1));
+
+	// writing a linked tile doesn't change the other tile
+	storage.setDeduplicator(std::shared_ptr<renderer::TileDeduplicator>());
+	BOOST_REQUIRE(storage.writeTile(tile2, image2));
+	BOOST_CHECK(readsImage(storage, tile1, image1));
+	BOOST_CHECK(readsImage(storage, tile2, image2));
+
+	// the tiles of zoom level 1 are moved one level deeper
+	storage.moveTiles(renderer::TilePath() + 1, renderer::TilePath() + 1 + 4);
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 1 + 4 + 2, image1));
+	BOOST_CHECK(!fs::exists(dir / "1/2.png"));
+
+	fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_tilestorage_pack) {
+	fs::path dir = fs::temp_directory_path() / fs::unique_path("mapcrafter-test-%%%%%%%%");
+	fs::create_directories(dir);
+	fs::path file = dir / "tiles.pack";
+	renderer::TilePath tile1 = renderer::TilePath() + 1 + 2, tile2 = renderer::TilePath() + 4;
+	renderer::RGBAImage image1 = createImage(1), image2 = createImage(2);
+
+	{
+		renderer::PackTileStorage storage(file);
+		BOOST_REQUIRE(storage.open());
+		storage.setDeduplicator(std::make_shared<renderer::TileDeduplicator>());
+		BOOST_REQUIRE(storage.writeTile(tile1, image1));
+		BOOST_REQUIRE(storage.writeTile(tile2, image1));
+		BOOST_REQUIRE(storage.writeTile(renderer::TilePath(), image2));
+		// written tiles can be read before they are committed
+		BOOST_CHECK(readsImage(storage, tile1, image1));
+		BOOST_REQUIRE(storage.flush());
+
+		// deduplicated tiles share their image
+		std::map<std::string, renderer::TilePackEntry> entries = storage.getEntries();
+		BOOST_CHECK_EQUAL(entries.size(), 3);
+		BOOST_CHECK_EQUAL(entries["1/2.png"].offset, entries["4.png"].offset);
+		BOOST_CHECK_EQUAL(storage.getUnusedSize(), 0);
+
+		// tiles written after the last flush are lost if the pack is not closed properly
+		storage.setDeduplicator(std::shared_ptr<renderer::TileDeduplicator>());
+		BOOST_REQUIRE(storage.writeTile(tile2, image2));
+		BOOST_REQUIRE(storage.writeTile(renderer::TilePath() + 3, image2));
+		fs::copy_file(file, dir / "aborted.pack");
+	}
+
+	renderer::PackTileStorage aborted(dir / "aborted.pack");
+	BOOST_REQUIRE(aborted.open());
+	BOOST_CHECK_EQUAL(aborted.getEntries().size(), 3);
+	BOOST_CHECK(readsImage(aborted, tile2, image1));
+
+	// the pack was closed properly
+	renderer::PackTileStorage storage(file);
+	BOOST_REQUIRE(storage.open());
+	BOOST_CHECK_EQUAL(storage.getEntries().size(), 4);
+	BOOST_CHECK(readsImage(storage, tile1, image1));
+	BOOST_CHECK(readsImage(storage, tile2, image2));
+	BOOST_CHECK(readsImage(storage, renderer::TilePath(), image2));
+	std::time_t time;
+	BOOST_CHECK(storage.getTileTime(tile2, time));
+	BOOST_CHECK(!storage.getTileTime(renderer::TilePath() + 2, time));
+
+	// the tiles of zoom level 1 are moved one level deeper
+	storage.moveTiles(renderer::TilePath() + 1, renderer::TilePath() + 1 + 4);
+	storage.moveTiles(renderer::TilePath() + 4, renderer::TilePath() + 4 + 1);
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 1 + 4 + 2, image1));
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 4 + 1, image2));
+	BOOST_CHECK(!storage.getTileTime(tile1, time));
+	BOOST_CHECK(!storage.getTileTime(tile2, time));
+
+	// the replaced image of the third tile is removed when compacting
+	BOOST_REQUIRE(storage.writeTile(renderer::TilePath() + 3, image1));
+	BOOST_REQUIRE(storage.flush());
+	uint64_t size = fs::file_size(file);
+	uint64_t index_offset, end, compacted_index_offset, compacted_end;
+	BOOST_REQUIRE(renderer::PackTileStorage::readHeader(file, index_offset, end));
+	BOOST_CHECK(storage.getUnusedSize() > 0);
+
+	// the pack stays usable if the compacted pack can't be written
+	fs::path tmp = file.string() + ".tmp";
+	fs::create_directories(tmp / "blocked");
+	BOOST_CHECK(!storage.compact());
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 3, image1));
+	fs::remove_all(tmp);
+
+	BOOST_REQUIRE(storage.compact());
+	BOOST_CHECK(!fs::exists(tmp));
+	BOOST_CHECK_EQUAL(storage.getUnusedSize(), 0);
+	BOOST_CHECK(fs::file_size(file) < size);
+	BOOST_REQUIRE(renderer::PackTileStorage::readHeader(file,
+			compacted_index_offset, compacted_end));
+	BOOST_CHECK(compacted_index_offset != index_offset || compacted_end != end);
+	BOOST_CHECK_EQUAL(storage.getEntries().size(), 4);
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 1 + 4 + 2, image1));
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 4 + 1, image2));
+	BOOST_CHECK(readsImage(storage, renderer::TilePath() + 3, image1));
+
+	// read-only packs are not created
+	renderer::PackTileStorage missing(dir / "missing.pack");
+	BOOST_CHECK(!missing.open(true));
+
+	fs::remove_all(dir);
+}
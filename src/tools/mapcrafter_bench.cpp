@@ -0,0 +1,592 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/config/mapcrafterconfig.h"
+#include "../mapcraftercore/mc/blockstate.h"
+#include "../mapcraftercore/mc/chunk.h"
+#include "../mapcraftercore/mc/compression.h"
+#include "../mapcraftercore/mc/nbt.h"
+#include "../mapcraftercore/mc/region.h"
+#include "../mapcraftercore/mc/world.h"
+#include "../mapcraftercore/mc/worldcache.h"
+#include "../mapcraftercore/renderer/biomes.h"
+#include "../mapcraftercore/renderer/blockimages.h"
+#include "../mapcraftercore/renderer/image.h"
+#include "../mapcraftercore/renderer/image/kernels.h"
+#include "../mapcraftercore/renderer/image/quantization.h"
+#include "../mapcraftercore/renderer/renderview.h"
+#include "../mapcraftercore/renderer/tilerenderer.h"
+#include "../mapcraftercore/renderer/tilerenderworker.h"
+#include "../mapcraftercore/renderer/tileset.h"
+#include "../mapcraftercore/util.h"
+#include "../mapcraftercore/version.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// evil, I know
+using namespace mapcrafter;
+
+/**
+ * Micro-benchmarks of the hot paths of the renderer.
+ *
+ * All inputs are generated: A small world with synthetic chunks in the format of
+ * Minecraft 1.18+ and a block image atlas with a few simple blocks are written to a
+ * temporary directory, so the benchmarks run without any Minecraft data.
+ */
+
+namespace {
+
+struct BenchmarkResult {
+	std::string name;
+	// unit of the items processed per iteration (blocks, pixels, ...)
+	std::string unit;
+	double items_per_iteration;
+	long iterations;
+	double seconds;
+};
+
+class BenchmarkRunner {
+public:
+	BenchmarkRunner(double min_time, const std::string& filter)
+		: min_time(min_time), filter(filter) {}
+
+	bool isEnabled(const std::string& name) const {
+		return filter.empty() || name.find(filter) != std::string::npos;
+	}
+
+	/**
+	 * Runs a benchmark function, doubling the number of iterations until it runs at
+	 * least the minimum time.
+	 */
+	void run(const std::string& name, const std::string& unit, double items_per_iteration,
+			std::function<void ()> function) {
+		if (!isEnabled(name))
+			return;
+		typedef std::chrono::steady_clock clock;
+
+		// warm up caches and lazily initialized stuff
+		function();
+
+		long iterations = 1;
+		double seconds = 0;
+		while (true) {
+			auto begin = clock::now();
+			for (long i = 0; i < iterations; i++)
+				function();
+			seconds = std::chrono::duration<double>(clock::now() - begin).count();
+			if (seconds >= min_time || iterations >= (1L << 30))
+				break;
+			iterations *= 2;
+		}
+
+		BenchmarkResult result = {name, unit, items_per_iteration, iterations, seconds};
+		results.push_back(result);
+		std::cerr << std::left << std::setw(28) << name << std::right
+			<< std::setw(14) << std::fixed << std::setprecision(1)
+			<< seconds / iterations * 1e9 << " ns/op"
+			<< std::setw(16) << std::setprecision(0)
+			<< items_per_iteration * iterations / seconds << " " << unit << "/s" << std::endl;
+	}
+
+	const std::vector<BenchmarkResult>& getResults() const {
+		return results;
+	}
+
+private:
+	double min_time;
+	std::string filter;
+	std::vector<BenchmarkResult> results;
+};
+
+std::string escapeJSON(const std::string& str) {
+	std::string escaped;
+	for (size_t i = 0; i < str.size(); i++) {
+		if (str[i] == '"' || str[i] == '\\')
+			escaped += '\\';
+		escaped += str[i];
+	}
+	return escaped;
+}
+
+void writeJSON(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+	out << "{\n";
+	out << "  \"mapcrafter_version\": \"" << escapeJSON(MAPCRAFTER_VERSION) << "\",\n";
+	out << "  \"mapcrafter_gitversion\": \"" << escapeJSON(MAPCRAFTER_GITVERSION) << "\",\n";
+	out << "  \"image_kernels\": \"" << renderer::getImageKernels().name << "\",\n";
+	out << "  \"decompression\": \"" << mc::nbt::getDecompressionBackend() << "\",\n";
+	out << "  \"benchmarks\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+		out << (i == 0 ? "\n" : ",\n") << std::setprecision(6) << std::defaultfloat
+			<< "    {\"name\": \"" << escapeJSON(result.name) << "\""
+			<< ", \"iterations\": " << result.iterations
+			<< ", \"seconds\": " << result.seconds
+			<< ", \"ns_per_iteration\": " << result.seconds / result.iterations * 1e9
+			<< ", \"unit\": \"" << escapeJSON(result.unit) << "\""
+			<< ", \"items_per_second\": "
+			<< result.items_per_iteration * result.iterations / result.seconds << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+// the blocks of the generated world and block images
+const char* BLOCKS[] = {
+	"minecraft:air",
+	"minecraft:stone",
+	"minecraft:dirt",
+	"minecraft:grass_block",
+	"minecraft:water",
+	"minecraft:oak_leaves",
+};
+const int BLOCK_AIR = 0, BLOCK_STONE = 1, BLOCK_DIRT = 2, BLOCK_GRASS = 3, BLOCK_WATER = 4,
+		BLOCK_LEAVES = 5;
+
+const int WORLD_CHUNKS = 8;
+
+int terrainHeight(int x, int z) {
+	return 64 + 10 * std::sin(x / 20.0) * std::cos(z / 17.0) + 4 * std::sin((x + z) / 7.0);
+}
+
+int terrainBlock(int x, int z, int y) {
+	int height = terrainHeight(x, z);
+	if (y > height) {
+		// some leaves floating over the terrain, so there is some transparency
+		if (y == height + 4 && (x * 7 + z * 13) % 11 == 0)
+			return BLOCK_LEAVES;
+		return y <= 62 ? BLOCK_WATER : BLOCK_AIR;
+	}
+	if (y == height)
+		return height >= 62 ? BLOCK_GRASS : BLOCK_DIRT;
+	if (y >= height - 3)
+		return BLOCK_DIRT;
+	return BLOCK_STONE;
+}
+
+/**
+ * Packs values into longs like Minecraft 1.16+ (values don't span two longs).
+ */
+std::vector<int64_t> packValues(const std::vector<uint16_t>& values, int bits) {
+	int per_long = 64 / bits;
+	std::vector<int64_t> data((values.size() + per_long - 1) / per_long, 0);
+	for (size_t i = 0; i < values.size(); i++)
+		data[i / per_long] |= (int64_t) values[i] << (bits * (i % per_long));
+	return data;
+}
+
+/**
+ * Creates the NBT data of a chunk of the generated world in the format of Minecraft 1.18+.
+ */
+std::string createChunk(int chunk_x, int chunk_z, mc::nbt::Compression compression) {
+	namespace nbt = mc::nbt;
+	nbt::NBTFile chunk("");
+	chunk.addTag("DataVersion", nbt::TagInt(3337));
+	chunk.addTag("Status", nbt::TagString("full"));
+	chunk.addTag("xPos", nbt::TagInt(chunk_x));
+	chunk.addTag("yPos", nbt::TagInt(-4));
+	chunk.addTag("zPos", nbt::TagInt(chunk_z));
+
+	nbt::TagList sections(nbt::TagCompound::TAG_TYPE);
+	for (int section_y = -4; section_y < 20; section_y++) {
+		std::vector<uint16_t> blocks(4096);
+		std::vector<int8_t> sky_light(2048, 0);
+		for (int i = 0; i < 4096; i++) {
+			int x = chunk_x * 16 + i % 16, z = chunk_z * 16 + (i / 16) % 16;
+			int y = section_y * 16 + i / 256;
+			blocks[i] = terrainBlock(x, z, y);
+			if (y > terrainHeight(x, z))
+				sky_light[i / 2] |= (blocks[i] == BLOCK_AIR ? 15 : 12) << (4 * (i % 2));
+		}
+
+		// the palette with the blocks of the section, in order of their first occurrence
+		std::vector<int> palette_index(6, -1);
+		std::vector<uint16_t> indices(4096);
+		nbt::TagList palette(nbt::TagCompound::TAG_TYPE);
+		for (int i = 0; i < 4096; i++) {
+			int& index = palette_index[blocks[i]];
+			if (index == -1) {
+				index = palette.payload.size();
+				nbt::TagCompound entry;
+				entry.addTag("Name", nbt::TagString(BLOCKS[blocks[i]]));
+				palette.payload.push_back(nbt::TagPtr(entry.clone()));
+			}
+			indices[i] = index;
+		}
+
+		nbt::TagCompound block_states;
+		if (palette.payload.size() > 1)
+			block_states.addTag("data", nbt::TagLongArray(packValues(indices, 4)));
+		block_states.addTag("palette", palette);
+
+		nbt::TagCompound biomes;
+		nbt::TagList biome_palette(nbt::TagString::TAG_TYPE);
+		biome_palette.payload.push_back(nbt::TagPtr(new nbt::TagString("minecraft:plains")));
+		biomes.addTag("palette", biome_palette);
+
+		nbt::TagCompound section;
+		section.addTag("Y", nbt::TagByte(section_y));
+		section.addTag("block_states", block_states);
+		section.addTag("biomes", biomes);
+		section.addTag("SkyLight", nbt::TagByteArray(sky_light));
+		sections.payload.push_back(nbt::TagPtr(section.clone()));
+	}
+	chunk.addTag("sections", sections);
+
+	std::stringstream stream;
+	chunk.writeNBT(stream, compression);
+	return stream.str();
+}
+
+/**
+ * Copies a block image from the sprite sheet of the block images.
+ */
+renderer::RGBAImage copyImage(const renderer::RGBAImageView& view) {
+	renderer::RGBAImage image(view.getWidth(), view.getHeight());
+	std::copy(view.begin(), view.end(), image.data.begin());
+	return image;
+}
+
+/**
+ * Writes a region file with WORLD_CHUNKS x WORLD_CHUNKS generated chunks.
+ */
+void createWorld(const fs::path& world_dir) {
+	fs::create_directories(world_dir / "region");
+	mc::RegionFile region((world_dir / "region" / "r.0.0.mca").string());
+	for (int x = 0; x < WORLD_CHUNKS; x++)
+		for (int z = 0; z < WORLD_CHUNKS; z++) {
+			std::string data = createChunk(x, z, mc::nbt::Compression::ZLIB);
+			region.setChunkData(mc::ChunkPos(x, z),
+					std::vector<uint8_t>(data.begin(), data.end()), 2);
+		}
+	region.write();
+}
+
+/**
+ * Writes a block image atlas (isometric view, rotation 0, texture size 16) with simple
+ * colored cubes of the generated blocks.
+ */
+void createBlockImages(const fs::path& block_dir) {
+	const int size = 32;
+	// face index of a pixel of the isometric cube, 0 if the pixel is not part of the cube
+	auto face = [](int x, int y) {
+		double cx = x + 0.5, cy = y + 0.5;
+		if (std::abs(cx - 16) / 2 + std::abs(cy - 8) <= 8)
+			return renderer::FACE_UP_INDEX;
+		if (cx < 16 && cy >= 8 + cx / 2 && cy <= 24 + cx / 2)
+			return renderer::FACE_LEFT_INDEX;
+		if (cx >= 16 && cy >= 16 - (cx - 16) / 2 && cy <= 32 - (cx - 16) / 2)
+			return renderer::FACE_RIGHT_INDEX;
+		return (uint8_t) 0;
+	};
+
+	// cells: uv mask, unknown block and the blocks except air
+	renderer::RGBAImage atlas(size * 7, size);
+	renderer::RGBAPixel colors[] = {
+		renderer::rgba(255, 0, 255),
+		renderer::rgba(128, 128, 128),
+		renderer::rgba(134, 96, 67),
+		renderer::rgba(90, 160, 60),
+		renderer::rgba(40, 60, 200, 160),
+		renderer::rgba(40, 120, 30),
+	};
+	for (int x = 0; x < size; x++)
+		for (int y = 0; y < size; y++) {
+			uint8_t f = face(x, y);
+			if (f == 0)
+				continue;
+			atlas.setPixel(x, y, renderer::rgba(0, 0, f, 255));
+			for (int i = 0; i < 6; i++) {
+				// leaves with holes
+				if (i == 5 && (x / 2 + y / 2) % 3 == 0)
+					continue;
+				atlas.setPixel(size * (i + 1) + x, y, colors[i]);
+			}
+		}
+
+	fs::create_directories(block_dir);
+	atlas.writePNG((block_dir / "isometric_0_16.png").string());
+	std::ofstream info((block_dir / "isometric_0_16.txt").string().c_str());
+	info << size << " " << size << " 7" << std::endl;
+	info << "minecraft:air - color=0,uv=0" << std::endl;
+	info << "minecraft:unknown_block - color=1,uv=0" << std::endl;
+	for (int i = 1; i < 6; i++)
+		info << BLOCKS[i] << " - color=" << i + 1 << ",uv=0" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+	std::string output, filter;
+	double min_time;
+	fs::path temp_dir;
+
+	po::options_description options("Allowed options");
+	options.add_options()
+		("help,h", "shows this help message")
+		("output,o", po::value<std::string>(&output),
+			"writes the results as JSON to this file ('-' for stdout)")
+		("filter,f", po::value<std::string>(&filter),
+			"runs only the benchmarks whose name contains this string")
+		("min-time,t", po::value<double>(&min_time)->default_value(0.5),
+			"minimum time in seconds to run each benchmark")
+		("temp-dir", po::value<fs::path>(&temp_dir)->default_value(fs::temp_directory_path()),
+			"directory to create the generated benchmark data in");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, options), vm);
+	} catch (po::error& ex) {
+		std::cerr << "There is a problem parsing the command line arguments: "
+				<< ex.what() << std::endl;
+		std::cerr << "Use '" << argv[0] << " --help' for more information." << std::endl;
+		return 1;
+	}
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << options << std::endl;
+		return 0;
+	}
+
+	// block image loading is quite chatty
+	util::Logging::getInstance().setSinkVerbosity("__output__", util::LogLevel::WARNING);
+
+	fs::path bench_dir = temp_dir / fs::unique_path("mapcrafter-bench-%%%%%%%%");
+	fs::path world_dir = bench_dir / "world";
+	fs::path block_dir = bench_dir / "blocks";
+	createWorld(world_dir);
+	createBlockImages(block_dir);
+
+	BenchmarkRunner runner(min_time, filter);
+	std::cerr << "Image kernels: " << renderer::getImageKernels().name
+		<< ", decompression: " << mc::nbt::getDecompressionBackend() << std::endl;
+
+	// chunk decoding
+	renderer::Biome::initializeBiomes();
+	mc::BlockStateRegistry block_registry;
+	std::string chunk_zlib = createChunk(3, 5, mc::nbt::Compression::ZLIB);
+	std::string chunk_raw = createChunk(3, 5, mc::nbt::Compression::NO_COMPRESSION);
+	mc::Chunk chunk;
+	runner.run("chunk_decode_zlib", "chunks", 1, [&]() {
+		chunk.readNBT(block_registry, chunk_zlib.data(), chunk_zlib.size(),
+				mc::nbt::Compression::ZLIB);
+	});
+	runner.run("chunk_decode_nbt", "chunks", 1, [&]() {
+		chunk.readNBT(block_registry, chunk_raw.data(), chunk_raw.size(),
+				mc::nbt::Compression::NO_COMPRESSION);
+	});
+
+	// unpacking block state indices with a few typical bit widths, with and without
+	// remapping them with a palette
+	int widths[] = {4, 5, 8};
+	for (int i = 0; i < 3; i++) {
+		std::vector<uint16_t> values(4096);
+		for (size_t j = 0; j < values.size(); j++)
+			values[j] = (j * 7) % (1 << widths[i]);
+		std::vector<int64_t> packed = packValues(values, widths[i]);
+		std::vector<uint64_t> longs(packed.begin(), packed.end());
+		std::vector<uint16_t> palette(1 << widths[i]);
+		for (size_t j = 0; j < palette.size(); j++)
+			palette[j] = j * 3;
+		std::string width = util::str(widths[i]);
+		runner.run("unpack_values_" + width + "bit", "values", 4096, [&]() {
+			mc::unpackValues(longs.data(), widths[i], 0, values.size(), values.data());
+		});
+		runner.run("unpack_palette_" + width + "bit", "values", 4096, [&]() {
+			mc::unpackPalette(longs.data(), widths[i], 0, values.size(),
+					palette.data(), palette.size(), values.data());
+		});
+	}
+
+	// world cache and tile rendering
+	config::MapcrafterConfig config;
+	config::ValidationMap validation = config.parseString(
+		"output_dir = " + (bench_dir / "output").string() + "\n"
+		"template_dir = " + bench_dir.string() + "\n"
+		"[world:bench]\n"
+		"input_dir = " + world_dir.string() + "\n"
+		"[map:bench]\n"
+		"world = bench\n"
+		"render_view = isometric\n"
+		"texture_size = 16\n"
+		"block_dir = " + block_dir.string() + "\n"
+		"[map:bench_plain]\n"
+		"world = bench\n"
+		"render_view = isometric\n"
+		"render_mode = plain\n"
+		"texture_size = 16\n"
+		"block_dir = " + block_dir.string() + "\n");
+	if (validation.isCritical()) {
+		validation.log();
+		return 1;
+	}
+	config::MapSection map_config = config.getMap("bench");
+	config::WorldSection world_config = config.getWorld("bench");
+
+	std::shared_ptr<mc::World> world(new mc::World(world_dir.string(),
+			world_config.getDimension(), (bench_dir / "cache").string()));
+	if (!world->load()) {
+		std::cerr << "Unable to load the generated world!" << std::endl;
+		return 1;
+	}
+
+	if (runner.isEnabled("world_cache_get_block")) {
+		mc::WorldCache world_cache(block_registry, *world);
+		const int size = WORLD_CHUNKS * 16;
+		runner.run("world_cache_get_block", "blocks", size * size * 64, [&]() {
+			for (int x = 0; x < size; x++)
+				for (int z = 0; z < size; z++)
+					for (int y = 32; y < 96; y++)
+						world_cache.getBlock(mc::BlockPos(x, z, y), nullptr,
+								mc::GET_ID | mc::GET_SKY_LIGHT);
+		});
+	}
+
+	std::shared_ptr<renderer::RenderView> render_view(renderer::createRenderView(
+			map_config.getRenderView(), renderer::RenderRotation::TOP_LEFT,
+			map_config.getWaterOpacity()));
+	std::shared_ptr<renderer::BlockImages> block_images(
+			render_view->createBlockImages(block_registry));
+	render_view->configureBlockImages(block_images.get(), world_config, map_config);
+	renderer::RenderedBlockImages* rendered_block_images =
+			dynamic_cast<renderer::RenderedBlockImages*>(block_images.get());
+	if (rendered_block_images == nullptr || !rendered_block_images->loadBlockImages(
+			block_dir, util::str(map_config.getRenderView()), 0, 16)) {
+		std::cerr << "Unable to load the generated block images!" << std::endl;
+		return 1;
+	}
+	if (runner.isEnabled("block_image_multiply")) {
+		const renderer::BlockImage& grass = rendered_block_images->getBlockImage(
+				block_registry.getBlockID(mc::BlockState("minecraft:grass_block")));
+		renderer::RGBAImage block = copyImage(grass.image(0));
+		renderer::CornerValues left = {1.0, 0.8, 0.5, 1.0};
+		renderer::CornerValues right = {1.0, 0.6, 0.3, 0.8};
+		renderer::CornerValues up = {0.5, 1.0, 0.6, 0.8};
+		runner.run("block_image_multiply", "pixels", block.getWidth() * block.getHeight(), [&]() {
+			renderer::blockImageMultiply(block, grass.uv_image(0), left, right, up);
+		});
+	}
+
+	std::shared_ptr<renderer::TileSet> tile_set(
+			render_view->createTileSet(map_config.getTileWidth()));
+	tile_set->scan(*world);
+	tile_set->resetRequired();
+
+	renderer::RenderContext context;
+	context.world_config = world_config;
+	context.map_config = map_config;
+	context.render_view = render_view.get();
+	context.block_images = block_images.get();
+	context.tile_set = tile_set.get();
+	context.block_registry = &block_registry;
+	context.world = world;
+	context.initializeTileRenderer();
+
+	const std::set<renderer::TilePos>& tiles = tile_set->getRequiredRenderTiles();
+	renderer::RGBAImage tile;
+	runner.run("render_tiles", "tiles", tiles.size(), [&]() {
+		for (auto it = tiles.begin(); it != tiles.end(); ++it)
+			context.tile_renderer->renderTile(*it + tile_set->getTileOffset(), tile);
+	});
+
+	context.tile_renderer->setOcclusionCulling(false);
+	runner.run("render_tiles_no_culling", "tiles", tiles.size(), [&]() {
+		for (auto it = tiles.begin(); it != tiles.end(); ++it)
+			context.tile_renderer->renderTile(*it + tile_set->getTileOffset(), tile);
+	});
+	context.tile_renderer->setOcclusionCulling(true);
+
+	// the same tiles without lighting
+	if (runner.isEnabled("render_tiles_plain")) {
+		renderer::RenderContext plain_context = context;
+		plain_context.map_config = config.getMap("bench_plain");
+		plain_context.initializeTileRenderer();
+		runner.run("render_tiles_plain", "tiles", tiles.size(), [&]() {
+			for (auto it = tiles.begin(); it != tiles.end(); ++it)
+				plain_context.tile_renderer->renderTile(*it + tile_set->getTileOffset(), tile);
+		});
+	}
+
+	// image operations on a rendered tile, the tile in the middle has the most content
+	auto middle = tiles.begin();
+	std::advance(middle, tiles.size() / 2);
+	context.tile_renderer->renderTile(*middle + tile_set->getTileOffset(), tile);
+	renderer::RGBAImage block = copyImage(rendered_block_images->getBlockImage(
+			block_registry.getBlockID(mc::BlockState("minecraft:oak_leaves"))).image(0));
+
+	renderer::RGBAImage target(tile.getWidth(), tile.getHeight());
+	int blits_x = target.getWidth() / block.getWidth(), blits_y = target.getHeight() / block.getHeight();
+	runner.run("alpha_blit", "pixels", blits_x * blits_y * block.getWidth() * block.getHeight(), [&]() {
+		for (int x = 0; x < blits_x; x++)
+			for (int y = 0; y < blits_y; y++)
+				target.alphaBlit(block, x * block.getWidth(), y * block.getHeight());
+	});
+
+	renderer::RGBAImage resized;
+	runner.run("image_resize_half", "pixels", tile.getWidth() * tile.getHeight(), [&]() {
+		tile.resize(resized, 0, 0, renderer::InterpolationType::HALF);
+	});
+
+	runner.run("octree_quantize", "pixels", tile.getWidth() * tile.getHeight(), [&]() {
+		std::vector<renderer::RGBAPixel> colors;
+		renderer::Octree* octree;
+		renderer::octreeColorQuantize(tile, 256, colors, &octree);
+		delete octree;
+	});
+
+	std::string image_file = (bench_dir / "tile").string();
+	runner.run("png_encode", "pixels", tile.getWidth() * tile.getHeight(), [&]() {
+		tile.writePNG(image_file + ".png");
+	});
+	runner.run("png_encode_indexed", "pixels", tile.getWidth() * tile.getHeight(), [&]() {
+		tile.writeIndexedPNG(image_file + ".png");
+	});
+	runner.run("jpeg_encode", "pixels", tile.getWidth() * tile.getHeight(), [&]() {
+		tile.writeJPEG(image_file + ".jpg", 85);
+	});
+
+	fs::remove_all(bench_dir);
+
+	if (output == "-") {
+		writeJSON(std::cout, runner.getResults());
+	} else if (!output.empty()) {
+		std::ofstream out(output.c_str());
+		writeJSON(out, runner.getResults());
+		if (!out) {
+			std::cerr << "Unable to write results to '" << output << "'!" << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
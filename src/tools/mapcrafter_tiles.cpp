@@ -0,0 +1,361 @@
+/*
+ * Copyright 2012-2016 Moritz Hilscher
+ *
+ * This file is part of Mapcrafter.
+ *
+ * Mapcrafter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mapcrafter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mapcrafter.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mapcraftercore/renderer/tilestorage.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+namespace asio = boost::asio;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+using namespace mapcrafter;
+
+/**
+ * Tool to work with the tile packs written with 'tile_storage = pack':
+ * Lists, extracts and compacts tile packs, and serves a rendered map (tile files and
+ * tile packs) via HTTP, so the web viewer can be used with tile packs.
+ */
+
+namespace {
+
+const char PACK_FILENAME[] = "tiles.pack";
+
+// maximum size of the request headers and the time a client has to send them / to
+// receive the response
+const size_t MAX_REQUEST_SIZE = 16 * 1024;
+const std::chrono::seconds CONNECTION_TIMEOUT(10);
+
+/**
+ * Returns whether the name of a tile in a pack is a relative path that stays in the
+ * directory it is extracted to (not absolute and without '..').
+ */
+bool isSafeTileName(const std::string& name) {
+	fs::path path(name);
+	if (name.empty() || path.has_root_name() || path.has_root_directory())
+		return false;
+	for (auto it = path.begin(); it != path.end(); ++it)
+		if (*it == "..")
+			return false;
+	return true;
+}
+
+bool openPack(const fs::path& file, renderer::PackTileStorage& pack, bool read_only) {
+	if (!pack.open(read_only)) {
+		std::cerr << "Unable to open tile pack '" << file.string() << "'." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int listPack(const fs::path& file) {
+	renderer::PackTileStorage pack(file);
+	if (!openPack(file, pack, true))
+		return 1;
+
+	std::map<std::string, renderer::TilePackEntry> entries = pack.getEntries();
+	uint64_t size = 0;
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		char time[32];
+		std::time_t mtime = it->second.mtime;
+		std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", std::localtime(&mtime));
+		std::cout << it->first << " " << it->second.size << " " << time << std::endl;
+		size += it->second.size;
+	}
+	std::cerr << entries.size() << " tiles, " << size << " bytes of tile images, "
+		<< pack.getUnusedSize() << " unused bytes." << std::endl;
+	return 0;
+}
+
+int extractPack(const fs::path& file, const fs::path& dir) {
+	renderer::PackTileStorage pack(file);
+	if (!openPack(file, pack, true))
+		return 1;
+
+	std::map<std::string, renderer::TilePackEntry> entries = pack.getEntries();
+	std::string data;
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		if (!isSafeTileName(it->first)) {
+			std::cerr << "Invalid tile name '" << it->first << "'." << std::endl;
+			return 1;
+		}
+		fs::path path = dir / it->first;
+		if (!fs::exists(path.parent_path()))
+			fs::create_directories(path.parent_path());
+		std::ofstream out(path.string().c_str(), std::ios::binary);
+		if (!pack.readTileData(it->first, data) || !out.write(data.data(), data.size())) {
+			std::cerr << "Unable to extract tile '" << it->first << "'." << std::endl;
+			return 1;
+		}
+		out.close();
+		fs::last_write_time(path, it->second.mtime);
+	}
+	std::cerr << "Extracted " << entries.size() << " tiles." << std::endl;
+	return 0;
+}
+
+int compactPack(const fs::path& file) {
+	renderer::PackTileStorage pack(file);
+	if (!openPack(file, pack, false))
+		return 1;
+
+	uint64_t unused = pack.getUnusedSize();
+	if (!pack.compact()) {
+		std::cerr << "Unable to compact tile pack '" << file.string() << "'." << std::endl;
+		return 1;
+	}
+	std::cerr << "Removed " << unused << " unused bytes." << std::endl;
+	return 0;
+}
+
+/**
+ * Serves the files of an output directory, tiles which are not found as files are
+ * read from the tile packs of the map rotation directories.
+ *
+ * Connections are handled one after another, so the size of requests is limited and
+ * clients which are too slow are disconnected.
+ */
+class TileServer {
+public:
+	TileServer(asio::io_context& io_context, const fs::path& output_dir)
+		: io_context(io_context), output_dir(output_dir) {}
+
+	void serve(asio::ip::tcp::socket& socket) {
+		// reading fails if the headers don't fit into the buffer
+		asio::streambuf buffer(MAX_REQUEST_SIZE);
+		boost::system::error_code error;
+		asio::async_read_until(socket, buffer, "\r\n\r\n",
+			[&error](const boost::system::error_code& result, size_t) {
+				error = result;
+			});
+		if (!runWithTimeout(socket) || error)
+			return;
+
+		std::istream request(&buffer);
+		std::string method, url;
+		request >> method >> url;
+		url = url.substr(0, url.find('?'));
+		if (!url.empty() && url[url.size() - 1] == '/')
+			url += "index.html";
+
+		std::string data;
+		int status = 200;
+		if (method != "GET" && method != "HEAD")
+			status = 405;
+		else if (url.empty() || url[0] != '/' || url.find("..") != std::string::npos
+				|| !read(url.substr(1), data))
+			status = 404;
+
+		std::ostringstream response;
+		response << "HTTP/1.0 " << status << " " << (status == 200 ? "OK" : "Error") << "\r\n"
+			<< "Content-Type: " << (status == 200 ? getContentType(url) : "text/plain") << "\r\n"
+			<< "Content-Length: " << data.size() << "\r\n"
+			<< "Connection: close\r\n\r\n";
+		if (method == "GET")
+			response << data;
+		std::string response_data = response.str();
+		asio::async_write(socket, asio::buffer(response_data),
+			[](const boost::system::error_code&, size_t) {});
+		runWithTimeout(socket);
+	}
+
+private:
+	/**
+	 * Runs the pending operations of a connection until they are finished. If they are
+	 * not finished in time, the connection is closed and false is returned.
+	 */
+	bool runWithTimeout(asio::ip::tcp::socket& socket) {
+		io_context.restart();
+		io_context.run_for(CONNECTION_TIMEOUT);
+		if (io_context.stopped())
+			return true;
+		// closing the socket aborts the operations, their handlers still need to run
+		boost::system::error_code error;
+		socket.close(error);
+		io_context.restart();
+		io_context.run();
+		return false;
+	}
+
+	bool read(const std::string& file, std::string& data) {
+		fs::path path = output_dir / file;
+		if (fs::is_regular_file(path)) {
+			std::ifstream in(path.string().c_str(), std::ios::binary);
+			data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			return (bool) in;
+		}
+
+		// find the tile pack of the deepest directory containing one
+		for (size_t slash = file.rfind('/'); slash != std::string::npos && slash > 0;
+				slash = file.rfind('/', slash - 1)) {
+			std::shared_ptr<renderer::PackTileStorage> pack = getPack(file.substr(0, slash));
+			if (pack)
+				return pack->readTileData(file.substr(slash + 1), data);
+		}
+		return false;
+	}
+
+	/**
+	 * Returns the tile pack of a directory, it is opened again if it was committed since
+	 * it was opened.
+	 */
+	std::shared_ptr<renderer::PackTileStorage> getPack(const std::string& dir) {
+		fs::path file = output_dir / dir / PACK_FILENAME;
+		uint64_t index_offset, end;
+		if (!renderer::PackTileStorage::readHeader(file, index_offset, end))
+			return std::shared_ptr<renderer::PackTileStorage>();
+
+		OpenPack& pack = packs[dir];
+		if (!pack.pack || pack.index_offset != index_offset || pack.end != end) {
+			pack.pack = std::make_shared<renderer::PackTileStorage>(file);
+			pack.index_offset = index_offset;
+			pack.end = end;
+			if (!pack.pack->open(true))
+				pack.pack.reset();
+		}
+		return pack.pack;
+	}
+
+	static std::string getContentType(const std::string& url) {
+		std::string extension = fs::path(url).extension().string();
+		if (extension == ".html")
+			return "text/html";
+		if (extension == ".css")
+			return "text/css";
+		if (extension == ".js")
+			return "application/javascript";
+		if (extension == ".json")
+			return "application/json";
+		if (extension == ".png")
+			return "image/png";
+		if (extension == ".jpg")
+			return "image/jpeg";
+		if (extension == ".gif")
+			return "image/gif";
+		return "application/octet-stream";
+	}
+
+	struct OpenPack {
+		std::shared_ptr<renderer::PackTileStorage> pack;
+		// header of the pack when it was opened, it changes with every commit
+		uint64_t index_offset, end;
+	};
+
+	asio::io_context& io_context;
+	fs::path output_dir;
+	std::map<std::string, OpenPack> packs;
+};
+
+int serve(const fs::path& output_dir, const std::string& address, int port) {
+	asio::io_context io_context;
+	asio::ip::tcp::acceptor acceptor(io_context);
+	try {
+		asio::ip::tcp::endpoint endpoint(asio::ip::make_address(address), port);
+		acceptor.open(endpoint.protocol());
+		acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+		acceptor.bind(endpoint);
+		acceptor.listen();
+	} catch (boost::system::system_error& ex) {
+		std::cerr << "Unable to listen on " << address << ":" << port << ": "
+			<< ex.what() << std::endl;
+		return 1;
+	}
+
+	std::cerr << "Serving '" << output_dir.string() << "' on http://" << address << ":"
+		<< port << "/" << std::endl;
+	TileServer server(io_context, output_dir);
+	while (true) {
+		asio::ip::tcp::socket socket(io_context);
+		boost::system::error_code error;
+		acceptor.accept(socket, error);
+		if (!error)
+			server.serve(socket);
+	}
+	return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+	std::string command, address;
+	std::vector<std::string> arguments;
+	int port;
+
+	po::options_description options("Allowed options");
+	options.add_options()
+		("help,h", "shows this help message")
+		("address,a", po::value<std::string>(&address)->default_value("127.0.0.1"),
+			"address to serve on")
+		("port,p", po::value<int>(&port)->default_value(8080),
+			"port to serve on");
+	po::options_description hidden;
+	hidden.add_options()
+		("command", po::value<std::string>(&command))
+		("arguments", po::value<std::vector<std::string>>(&arguments));
+	po::options_description all;
+	all.add(options).add(hidden);
+	po::positional_options_description positional;
+	positional.add("command", 1).add("arguments", -1);
+
+	po::variables_map vm;
+	try {
+		po::store(po::command_line_parser(argc, argv).options(all)
+				.positional(positional).run(), vm);
+	} catch (po::error& ex) {
+		std::cerr << "There is a problem parsing the command line arguments: "
+				<< ex.what() << std::endl;
+		std::cerr << "Use '" << argv[0] << " --help' for more information." << std::endl;
+		return 1;
+	}
+	po::notify(vm);
+
+	if (vm.count("help") || command.empty()) {
+		std::cout << "Usage: " << argv[0] << " list <tile pack>" << std::endl
+			<< "       " << argv[0] << " extract <tile pack> <directory>" << std::endl
+			<< "       " << argv[0] << " compact <tile pack>" << std::endl
+			<< "       " << argv[0] << " serve <output directory> [options]" << std::endl
+			<< std::endl << options << std::endl;
+		return vm.count("help") ? 0 : 1;
+	}
+
+	if (command == "list" && arguments.size() == 1)
+		return listPack(arguments[0]);
+	if (command == "extract" && arguments.size() == 2)
+		return extractPack(arguments[0], arguments[1]);
+	if (command == "compact" && arguments.size() == 1)
+		return compactPack(arguments[0]);
+	if (command == "serve" && arguments.size() == 1)
+		return serve(arguments[0], address, port);
+
+	std::cerr << "Invalid command or arguments." << std::endl;
+	std::cerr << "Use '" << argv[0] << " --help' for more information." << std::endl;
+	return 1;
+}